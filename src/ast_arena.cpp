@@ -0,0 +1,133 @@
+#include <cz/heap.hpp>
+#include "parse.hpp"
+
+namespace red {
+namespace parse {
+
+void Ast_Arena::init() {
+    expressions.create();
+    statements.create();
+    lists.create();
+    stats = {};
+}
+
+void Ast_Arena::drop() {
+    expression_stack.drop(cz::heap_allocator());
+    statement_stack.drop(cz::heap_allocator());
+    spare_integers.drop(cz::heap_allocator());
+    lists.drop();
+    statements.drop();
+    expressions.drop();
+}
+
+void Ast_Arena::reset() {
+    spare_integers.set_len(0);
+    lists.drop();
+    statements.drop();
+    expressions.drop();
+    expressions.create();
+    statements.create();
+    lists.create();
+}
+
+static const char* const expression_names[] = {
+    "Integer",
+    "Variable",
+    "Binary",
+    "Ternary",
+    "Cast",
+    "Sizeof_Type",
+    "Sizeof_Expression",
+    "Function_Call",
+    "Index",
+    "Address_Of",
+    "Dereference",
+    "Bit_Not",
+    "Logical_Not",
+    "Member_Access",
+    "Dereference_Member_Access",
+    "Pre_Increment",
+    "Post_Increment",
+    "Pre_Decrement",
+    "Post_Decrement",
+};
+static_assert(sizeof(expression_names) / sizeof(*expression_names) == Ast_Stats::expression_tags,
+              "Every Expression::Tag must have a name");
+
+static const char* const statement_names[] = {
+    "Expression",
+    "Block",
+    "For",
+    "While",
+    "Return",
+    "Empty",
+    "If",
+    "Continue",
+    "Break",
+    "Initializer_Default",
+    "Initializer_Copy",
+};
+static_assert(sizeof(statement_names) / sizeof(*statement_names) == Ast_Stats::statement_tags,
+              "Every Statement::Tag must have a name");
+
+void Ast_Stats::add(const Ast_Stats& other) {
+    for (size_t i = 0; i < expression_tags; ++i) {
+        expression_counts[i] += other.expression_counts[i];
+        expression_bytes[i] += other.expression_bytes[i];
+    }
+    for (size_t i = 0; i < statement_tags; ++i) {
+        statement_counts[i] += other.statement_counts[i];
+        statement_bytes[i] += other.statement_bytes[i];
+    }
+    list_counts += other.list_counts;
+    list_bytes += other.list_bytes;
+    folded_expressions += other.folded_expressions;
+    if (other.peak_body_bytes > peak_body_bytes) {
+        peak_body_bytes = other.peak_body_bytes;
+    }
+}
+
+size_t Ast_Stats::bytes() const {
+    size_t total = list_bytes;
+    for (size_t i = 0; i < expression_tags; ++i) {
+        total += expression_bytes[i];
+    }
+    for (size_t i = 0; i < statement_tags; ++i) {
+        total += statement_bytes[i];
+    }
+    return total;
+}
+
+void Ast_Stats::print(FILE* file) const {
+    size_t total_count = 0;
+    size_t total_bytes = 0;
+
+    fprintf(file, "%-32s %12s %12s\n", "Node", "Count", "Bytes");
+    for (size_t i = 0; i < expression_tags; ++i) {
+        if (expression_counts[i] > 0) {
+            fprintf(file, "Expression_%-21s %12zu %12zu\n", expression_names[i],
+                    expression_counts[i], expression_bytes[i]);
+            total_count += expression_counts[i];
+            total_bytes += expression_bytes[i];
+        }
+    }
+    for (size_t i = 0; i < statement_tags; ++i) {
+        if (statement_counts[i] > 0) {
+            fprintf(file, "Statement_%-22s %12zu %12zu\n", statement_names[i],
+                    statement_counts[i], statement_bytes[i]);
+            total_count += statement_counts[i];
+            total_bytes += statement_bytes[i];
+        }
+    }
+    fprintf(file, "%-32s %12zu %12zu\n", "Lists", list_counts, list_bytes);
+    total_bytes += list_bytes;
+
+    fprintf(file, "%-32s %12zu %12zu\n", "Total", total_count, total_bytes);
+    fprintf(file, "%-32s %12zu\n", "Folded expressions", folded_expressions);
+    if (peak_body_bytes > 0) {
+        fprintf(file, "%-32s %25zu\n", "Peak function body bytes", peak_body_bytes);
+    }
+}
+
+}
+}
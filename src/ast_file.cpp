@@ -0,0 +1,773 @@
+#include "ast_file.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <Tracy.hpp>
+#include <cz/buffer_array.hpp>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/str_map.hpp>
+#include <cz/vector.hpp>
+#include "context.hpp"
+#include "file.hpp"
+#include "hashed_str.hpp"
+#include "parse.hpp"
+
+namespace red {
+namespace parse {
+
+static const char ast_file_magic[4] = {'R', 'A', 'S', 'T'};
+
+/// The size of one record in each section.
+static const size_t section_element_sizes[Ast_File_Section::Count] = {
+    1,                             // Strings
+    sizeof(Ast_File_String),       // String_Refs
+    sizeof(uint32_t),              // Files
+    sizeof(Ast_File_Type),         // Types
+    sizeof(uint32_t),              // Type_Lists
+    sizeof(Ast_File_Declaration),  // Members
+    sizeof(Ast_File_Enum_Value),   // Enum_Values
+    sizeof(Ast_File_Tag),          // Tags
+    sizeof(Ast_File_Declaration),  // Declarations
+    sizeof(uint32_t),              // Parameter_Names
+    sizeof(uint32_t),              // Initializers
+    sizeof(Compact_Expression),    // Expressions
+    sizeof(Compact_Statement),     // Statements
+    sizeof(uint32_t),              // Lists
+    sizeof(Compact_Span),          // Spans
+    sizeof(uint32_t),              // Names
+    sizeof(uint32_t),              // Ast_Types
+};
+
+static size_t align_section(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+namespace {
+struct Ast_File_Writer {
+    Compact_Ast ast;
+
+    cz::String strings;
+    cz::Vector<Ast_File_String> string_refs;
+    /// Maps each string to its index in `string_refs` so every string is only stored once.
+    cz::Str_Map<uint32_t> string_indices;
+
+    cz::Vector<uint32_t> files;
+    cz::Vector<Ast_File_Type> types;
+    cz::Vector<uint32_t> type_lists;
+    cz::Vector<Ast_File_Declaration> members;
+    cz::Vector<Ast_File_Enum_Value> enum_values;
+    cz::Vector<Ast_File_Tag> tags;
+    cz::Vector<Ast_File_Declaration> declarations;
+    cz::Vector<uint32_t> parameter_names;
+    cz::Vector<uint32_t> initializers;
+    cz::Vector<uint32_t> names;
+    cz::Vector<uint32_t> ast_types;
+
+    /// Map the address of each `Type` to its index in `types` and the address of each file scope
+    /// initializer to its index in `ast.statements`.  The keys are the bytes of the pointers and
+    /// are stored in `address_keys`.
+    cz::Str_Map<uint32_t> type_indices;
+    cz::Str_Map<uint32_t> initializer_indices;
+    cz::Buffer_Array address_keys;
+
+    void drop() {
+        ast.drop();
+        strings.drop(cz::heap_allocator());
+        string_refs.drop(cz::heap_allocator());
+        string_indices.drop(cz::heap_allocator());
+        files.drop(cz::heap_allocator());
+        types.drop(cz::heap_allocator());
+        type_lists.drop(cz::heap_allocator());
+        members.drop(cz::heap_allocator());
+        enum_values.drop(cz::heap_allocator());
+        tags.drop(cz::heap_allocator());
+        declarations.drop(cz::heap_allocator());
+        parameter_names.drop(cz::heap_allocator());
+        initializers.drop(cz::heap_allocator());
+        names.drop(cz::heap_allocator());
+        ast_types.drop(cz::heap_allocator());
+        type_indices.drop(cz::heap_allocator());
+        initializer_indices.drop(cz::heap_allocator());
+        address_keys.drop();
+    }
+};
+}
+
+static uint32_t add_string(Ast_File_Writer* writer, cz::Str str) {
+    cz::Hash hash = Hashed_Str::hash_str(str);
+    uint32_t* existing = writer->string_indices.get(str, hash);
+    if (existing) {
+        return *existing;
+    }
+
+    Ast_File_String string;
+    string.offset = (uint32_t)writer->strings.len();
+    string.len = (uint32_t)str.len;
+    writer->strings.reserve(cz::heap_allocator(), str.len);
+    writer->strings.append(str);
+
+    uint32_t index = (uint32_t)writer->string_refs.len();
+    writer->string_refs.reserve(cz::heap_allocator(), 1);
+    writer->string_refs.push(string);
+    writer->string_indices.reserve(cz::heap_allocator(), 1);
+    writer->string_indices.insert(str, hash, index);
+    return index;
+}
+
+static uint32_t* lookup_address(cz::Str_Map<uint32_t>* map, const void* pointer, cz::Hash* hash) {
+    uintptr_t address = (uintptr_t)pointer;
+    cz::Str key = {(const char*)&address, sizeof(address)};
+    *hash = Hashed_Str::hash_str(key);
+    return map->get(key, *hash);
+}
+
+static void insert_address(Ast_File_Writer* writer,
+                           cz::Str_Map<uint32_t>* map,
+                           const void* pointer,
+                           cz::Hash hash,
+                           uint32_t index) {
+    uintptr_t* stored = writer->address_keys.allocator().create<uintptr_t>();
+    *stored = (uintptr_t)pointer;
+    map->reserve(cz::heap_allocator(), 1);
+    map->insert({(const char*)stored, sizeof(uintptr_t)}, hash, index);
+}
+
+static uint32_t add_type(Ast_File_Writer* writer, TypeP type);
+
+static Ast_File_Declaration add_declaration(Ast_File_Writer* writer,
+                                            cz::Str name,
+                                            const Declaration& declaration);
+
+/// Add the members of `composite` to a contiguous range of `members`.
+static void add_members(Ast_File_Writer* writer, Type_Composite* composite, Ast_File_Type* record) {
+    size_t len;
+    if (composite->tag == Type::Struct) {
+        len = ((Type_Struct*)composite)->initializers.len;
+    } else {
+        len = composite->declarations.count;
+    }
+
+    // Reserve the range first because the members' types can add members of their own.
+    size_t start = writer->members.len();
+    writer->members.reserve(cz::heap_allocator(), len);
+    writer->members.set_len(start + len);
+    record->operands[0] = (uint32_t)start;
+    record->operands[1] = (uint32_t)len;
+
+    if (composite->tag == Type::Struct) {
+        // Store struct members in declaration order so consumers can lay them out.
+        Type_Struct* struct_type = (Type_Struct*)composite;
+        for (size_t i = 0; i < len; ++i) {
+            Statement_Initializer* initializer =
+                (Statement_Initializer*)struct_type->initializers[i];
+            Declaration* declaration = composite->declarations.get(initializer->identifier.str,
+                                                                   initializer->identifier.hash);
+            CZ_DEBUG_ASSERT(declaration);
+            Ast_File_Declaration member =
+                add_declaration(writer, initializer->identifier.str, *declaration);
+            writer->members[start + i] = member;
+        }
+    } else {
+        size_t index = start;
+        for (size_t i = 0; i < composite->declarations.slots(); ++i) {
+            if (!composite->declarations.is_present(i)) {
+                continue;
+            }
+            Ast_File_Declaration member = add_declaration(writer, composite->declarations.key(i),
+                                                          composite->declarations.value(i));
+            writer->members[index++] = member;
+        }
+    }
+}
+
+static uint32_t add_type(Ast_File_Writer* writer, TypeP type) {
+    Type* node = type.get_type();
+    uint32_t qualifiers = (uint32_t)(type.value & 3);
+
+    cz::Hash hash;
+    uint32_t* existing = lookup_address(&writer->type_indices, node, &hash);
+    if (existing) {
+        return (*existing << 2) | qualifiers;
+    }
+
+    // Register the type before visiting its components so recursive types terminate.
+    uint32_t index = (uint32_t)writer->types.len();
+    writer->types.reserve(cz::heap_allocator(), 1);
+    writer->types.push({});
+    insert_address(writer, &writer->type_indices, node, hash, index);
+
+    // `types` can be reallocated by the recursive calls so build the record locally.
+    Ast_File_Type record = {};
+    record.tag = node->tag;
+    for (size_t i = 0; i < 4; ++i) {
+        record.operands[i] = Compact_Ast::none;
+    }
+
+    switch (node->tag) {
+        case Type::Pointer: {
+            Type_Pointer* pointer = (Type_Pointer*)node;
+            record.operands[0] = add_type(writer, pointer->inner);
+        } break;
+
+        case Type::Array: {
+            Type_Array* array = (Type_Array*)node;
+            record.operands[0] = add_type(writer, array->inner);
+            record.flags = array->flags & Type_Array::Length_Known;
+            record.value = array->length;
+        } break;
+
+        case Type::Function: {
+            Type_Function* function = (Type_Function*)node;
+            record.flags = function->has_varargs;
+            record.operands[0] = add_type(writer, function->return_type);
+
+            uint32_t start = (uint32_t)writer->type_lists.len();
+            writer->type_lists.reserve(cz::heap_allocator(), function->parameter_types.len);
+            writer->type_lists.set_len(start + function->parameter_types.len);
+            for (size_t i = 0; i < function->parameter_types.len; ++i) {
+                uint32_t parameter = add_type(writer, function->parameter_types[i]);
+                writer->type_lists[start + i] = parameter;
+            }
+            record.operands[1] = start;
+            record.operands[2] = (uint32_t)function->parameter_types.len;
+        } break;
+
+        case Type::Struct:
+        case Type::Union: {
+            Type_Composite* composite = (Type_Composite*)node;
+            record.flags = composite->flags;
+            add_members(writer, composite, &record);
+            if (composite->flags & Type_Composite::Defined) {
+                record.operands[2] = (uint32_t)composite->size;
+                record.operands[3] = (uint32_t)composite->alignment;
+            }
+        } break;
+
+        case Type::Enum: {
+            Type_Enum* enum_type = (Type_Enum*)node;
+            record.flags = enum_type->flags;
+            record.operands[0] = (uint32_t)writer->enum_values.len();
+            writer->enum_values.reserve(cz::heap_allocator(), enum_type->values.count);
+            for (size_t i = 0; i < enum_type->values.slots(); ++i) {
+                if (!enum_type->values.is_present(i)) {
+                    continue;
+                }
+                Ast_File_Enum_Value value = {};
+                value.name = add_string(writer, enum_type->values.key(i));
+                value.value = enum_type->values.value(i);
+                writer->enum_values.push(value);
+            }
+            record.operands[1] = (uint32_t)writer->enum_values.len() - record.operands[0];
+        } break;
+
+        default:
+            break;
+    }
+
+    writer->types[index] = record;
+    return (index << 2) | qualifiers;
+}
+
+static Ast_File_Declaration add_declaration(Ast_File_Writer* writer,
+                                            cz::Str name,
+                                            const Declaration& declaration) {
+    Ast_File_Declaration record = {};
+    record.name = add_string(writer, name);
+    record.type = add_type(writer, declaration.type);
+    record.flags = declaration.flags;
+    record.span = writer->ast.add_span(declaration.span);
+    record.initializer = Compact_Ast::none;
+    record.body_span = Compact_Ast::none;
+
+    if (declaration.flags & Declaration::Typedef) {
+        return record;
+    }
+
+    if (declaration.type.get_type()->tag == Type::Function) {
+        Function_Definition* definition = declaration.v.function_definition;
+        if (definition) {
+            record.parameters_start = (uint32_t)writer->parameter_names.len();
+            record.parameters_len = (uint32_t)definition->parameter_names.len;
+            writer->parameter_names.reserve(cz::heap_allocator(),
+                                            definition->parameter_names.len);
+            for (size_t i = 0; i < definition->parameter_names.len; ++i) {
+                uint32_t parameter = add_string(writer, definition->parameter_names[i]);
+                writer->parameter_names.push(parameter);
+            }
+
+            Compact_Block body = writer->ast.add_block(definition->block);
+            record.body_start = body.start;
+            record.body_len = body.len;
+            record.body_span = writer->ast.add_span(definition->block_span);
+        }
+    } else if (declaration.v.initializer) {
+        cz::Hash hash;
+        uint32_t* existing =
+            lookup_address(&writer->initializer_indices, declaration.v.initializer, &hash);
+        if (existing) {
+            record.initializer = *existing;
+        } else {
+            record.initializer = writer->ast.add_statement(declaration.v.initializer);
+        }
+    }
+
+    return record;
+}
+
+static void add_section(cz::String* out,
+                        Ast_File_Header* header,
+                        Ast_File_Section section,
+                        const void* elems,
+                        size_t count) {
+    size_t bytes = count * section_element_sizes[section];
+    header->sections[section].offset = out->len();
+    header->sections[section].count = count;
+    out->append({(const char*)elems, bytes});
+    while (out->len() % 8 != 0) {
+        out->push('\0');
+    }
+}
+
+template <class T>
+static void add_section(cz::String* out,
+                        Ast_File_Header* header,
+                        Ast_File_Section section,
+                        const cz::Vector<T>& elems) {
+    add_section(out, header, section, elems.elems(), elems.len());
+}
+
+void serialize_ast(Context* context,
+                   Parser* parser,
+                   cz::Slice<Statement*> initializers,
+                   cz::String* out) {
+    ZoneScoped;
+
+    Ast_File_Writer writer = {};
+    writer.address_keys.create();
+    CZ_DEFER(writer.drop());
+
+    writer.files.reserve(cz::heap_allocator(), context->files.files.len());
+    for (size_t i = 0; i < context->files.files.len(); ++i) {
+        uint32_t path = add_string(&writer, context->files.files[i].path);
+        writer.files.push(path);
+    }
+
+    // Add the initializers first so the declarations can refer to them.
+    writer.initializers.reserve(cz::heap_allocator(), initializers.len);
+    for (size_t i = 0; i < initializers.len; ++i) {
+        uint32_t index = writer.ast.add_statement(initializers[i]);
+        writer.initializers.push(index);
+
+        cz::Hash hash;
+        if (!lookup_address(&writer.initializer_indices, initializers[i], &hash)) {
+            insert_address(&writer, &writer.initializer_indices, initializers[i], hash, index);
+        }
+    }
+
+    cz::Slice<Scope_Table<Type*>::Binding> tags = parser->types.scope(0);
+    writer.tags.reserve(cz::heap_allocator(), tags.len);
+    for (size_t i = 0; i < tags.len; ++i) {
+        Ast_File_Tag tag;
+        tag.name = add_string(&writer, tags[i].name.str);
+        TypeP type = {};
+        type.set_type(tags[i].value);
+        tag.type = add_type(&writer, type);
+        writer.tags.push(tag);
+    }
+
+    cz::Slice<Scope_Table<Declaration>::Binding> declarations = parser->declarations.scope(0);
+    writer.declarations.reserve(cz::heap_allocator(), declarations.len);
+    for (size_t i = 0; i < declarations.len; ++i) {
+        Ast_File_Declaration declaration =
+            add_declaration(&writer, declarations[i].name.str, declarations[i].value);
+        writer.declarations.push(declaration);
+    }
+
+    // Resolve the side tables of the tree last.  Adding a struct type adds the initializers of its
+    // members so `ast.types` can grow while it is being resolved.
+    for (size_t i = 0; i < writer.ast.types.len(); ++i) {
+        uint32_t type = add_type(&writer, writer.ast.types[i]);
+        writer.ast_types.reserve(cz::heap_allocator(), 1);
+        writer.ast_types.push(type);
+    }
+    writer.names.reserve(cz::heap_allocator(), writer.ast.names.len());
+    for (size_t i = 0; i < writer.ast.names.len(); ++i) {
+        uint32_t name = add_string(&writer, writer.ast.names[i].str);
+        writer.names.push(name);
+    }
+
+    Ast_File_Header header = {};
+    memcpy(header.magic, ast_file_magic, sizeof(header.magic));
+    header.version = Ast_File_Header::current_version;
+
+    size_t total = align_section(sizeof(header));
+    total += align_section(writer.strings.len());
+    total += align_section(writer.string_refs.len() * sizeof(Ast_File_String));
+    total += align_section(writer.files.len() * sizeof(uint32_t));
+    total += align_section(writer.types.len() * sizeof(Ast_File_Type));
+    total += align_section(writer.type_lists.len() * sizeof(uint32_t));
+    total += align_section(writer.members.len() * sizeof(Ast_File_Declaration));
+    total += align_section(writer.enum_values.len() * sizeof(Ast_File_Enum_Value));
+    total += align_section(writer.tags.len() * sizeof(Ast_File_Tag));
+    total += align_section(writer.declarations.len() * sizeof(Ast_File_Declaration));
+    total += align_section(writer.parameter_names.len() * sizeof(uint32_t));
+    total += align_section(writer.initializers.len() * sizeof(uint32_t));
+    total += align_section(writer.ast.bytes());
+    total += align_section(writer.names.len() * sizeof(uint32_t));
+    total += align_section(writer.ast_types.len() * sizeof(uint32_t));
+    // Each of the pools of the tree can need padding.
+    total += 8 * 4;
+
+    out->set_len(0);
+    out->reserve(cz::heap_allocator(), total);
+    while (out->len() < align_section(sizeof(header))) {
+        out->push('\0');
+    }
+
+    add_section(out, &header, Ast_File_Section::Strings, writer.strings.buffer(),
+                writer.strings.len());
+    add_section(out, &header, Ast_File_Section::String_Refs, writer.string_refs);
+    add_section(out, &header, Ast_File_Section::Files, writer.files);
+    add_section(out, &header, Ast_File_Section::Types, writer.types);
+    add_section(out, &header, Ast_File_Section::Type_Lists, writer.type_lists);
+    add_section(out, &header, Ast_File_Section::Members, writer.members);
+    add_section(out, &header, Ast_File_Section::Enum_Values, writer.enum_values);
+    add_section(out, &header, Ast_File_Section::Tags, writer.tags);
+    add_section(out, &header, Ast_File_Section::Declarations, writer.declarations);
+    add_section(out, &header, Ast_File_Section::Parameter_Names, writer.parameter_names);
+    add_section(out, &header, Ast_File_Section::Initializers, writer.initializers);
+    add_section(out, &header, Ast_File_Section::Expressions, writer.ast.expressions);
+    add_section(out, &header, Ast_File_Section::Statements, writer.ast.statements);
+    add_section(out, &header, Ast_File_Section::Lists, writer.ast.lists);
+    add_section(out, &header, Ast_File_Section::Spans, writer.ast.spans);
+    add_section(out, &header, Ast_File_Section::Names, writer.names);
+    add_section(out, &header, Ast_File_Section::Ast_Types, writer.ast_types);
+
+    memcpy(out->buffer(), &header, sizeof(header));
+}
+
+Result write_ast_file(Context* context,
+                      Parser* parser,
+                      cz::Slice<Statement*> initializers,
+                      const char* path) {
+    ZoneScoped;
+
+    cz::String encoded = {};
+    CZ_DEFER(encoded.drop(cz::heap_allocator()));
+    serialize_ast(context, parser, initializers, &encoded);
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return Result::last_system_error();
+    }
+    CZ_DEFER(fclose(file));
+
+    if (fwrite(encoded.buffer(), 1, encoded.len(), file) != encoded.len()) {
+        return {Result::ErrorFile};
+    }
+    return Result::ok();
+}
+
+Result Ast_File::open(const char* path) {
+    ZoneScoped;
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return Result::last_system_error();
+    }
+    CZ_DEFER(::close(fd));
+
+    struct stat stat;
+    if (fstat(fd, &stat) < 0) {
+        return Result::last_system_error();
+    }
+
+    size_t size = (size_t)stat.st_size;
+    if (size == 0) {
+        return {Result::ErrorInvalidInput};
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return Result::last_system_error();
+    }
+
+    if (!load(mapping, size)) {
+        munmap(mapping, size);
+        return {Result::ErrorInvalidInput};
+    }
+
+    mapped = true;
+    return Result::ok();
+}
+
+void Ast_File::close() {
+    if (mapped) {
+        munmap((void*)data, len);
+        mapped = false;
+    }
+    data = nullptr;
+    len = 0;
+}
+
+bool Ast_File::load(const void* data_, size_t len_) {
+    data = nullptr;
+    len = 0;
+    mapped = false;
+
+    if ((uintptr_t)data_ % 8 != 0 || len_ < sizeof(Ast_File_Header)) {
+        return false;
+    }
+
+    const Ast_File_Header* header = (const Ast_File_Header*)data_;
+    if (memcmp(header->magic, ast_file_magic, sizeof(header->magic)) != 0) {
+        return false;
+    }
+    if (header->version != Ast_File_Header::current_version) {
+        return false;
+    }
+
+    for (size_t i = 0; i < Ast_File_Section::Count; ++i) {
+        const Ast_File_Section_Header& section = header->sections[i];
+        if (section.offset % 8 != 0 || section.offset > len_) {
+            return false;
+        }
+        if (section.count > (len_ - section.offset) / section_element_sizes[i]) {
+            return false;
+        }
+    }
+
+    data = (const char*)data_;
+    len = len_;
+    return true;
+}
+
+Span Ast_File::span(uint32_t index) const {
+    const Compact_Span& compact = section<Compact_Span>(Ast_File_Section::Spans)[index];
+    Span span;
+    span.start.file = compact.start_file;
+    span.start.index = compact.start_index;
+    span.start.line = compact.start_line;
+    span.start.column = compact.start_column;
+    span.end.file = compact.end_file;
+    span.end.index = compact.end_index;
+    span.end.line = compact.end_line;
+    span.end.column = compact.end_column;
+    return span;
+}
+
+namespace {
+struct Ast_File_Walk {
+    const Ast_File* file;
+    size_t expression_count;
+    size_t statement_count;
+    size_t list_count;
+
+    /// The nodes left to visit.  The file is untrusted so walk it with explicit stacks instead of
+    /// recursing, which a deeply nested or cyclic tree would use to overflow the call stack.
+    cz::Vector<uint32_t> expression_stack;
+    cz::Vector<uint32_t> statement_stack;
+
+    size_t expressions;
+    size_t statements;
+
+    void drop() {
+        expression_stack.drop(cz::heap_allocator());
+        statement_stack.drop(cz::heap_allocator());
+    }
+};
+}
+
+static bool push_node(cz::Vector<uint32_t>* stack, size_t count, uint32_t index) {
+    if (index == Compact_Ast::none) {
+        return true;
+    }
+    if (index >= count) {
+        return false;
+    }
+    stack->reserve(cz::heap_allocator(), 1);
+    stack->push(index);
+    return true;
+}
+
+/// Push the `len` nodes listed at `start` in `Lists`.
+static bool push_list(Ast_File_Walk* walk,
+                      cz::Vector<uint32_t>* stack,
+                      size_t count,
+                      uint32_t start,
+                      uint32_t len) {
+    if (start > walk->list_count || len > walk->list_count - start) {
+        return false;
+    }
+    for (uint32_t i = 0; i < len; ++i) {
+        if (!push_node(stack, count, walk->file->list(start + i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool push_expression(Ast_File_Walk* walk, uint32_t index) {
+    return push_node(&walk->expression_stack, walk->expression_count, index);
+}
+
+static bool push_statement(Ast_File_Walk* walk, uint32_t index) {
+    return push_node(&walk->statement_stack, walk->statement_count, index);
+}
+
+static bool visit_expression(Ast_File_Walk* walk, uint32_t index) {
+    const Compact_Expression& expression = walk->file->expression(index);
+    switch (expression.tag) {
+        case Expression::Integer:
+        case Expression::Variable:
+        case Expression::Sizeof_Type:
+            return true;
+
+        case Expression::Cast:
+            return push_expression(walk, expression.operands[1]);
+
+        case Expression::Function_Call:
+            return push_expression(walk, expression.operands[0]) &&
+                   push_list(walk, &walk->expression_stack, walk->expression_count,
+                             expression.operands[1], expression.operands[2]);
+
+        case Expression::Member_Access:
+        case Expression::Dereference_Member_Access:
+            return push_expression(walk, expression.operands[0]);
+
+        default:
+            return push_expression(walk, expression.operands[0]) &&
+                   push_expression(walk, expression.operands[1]) &&
+                   push_expression(walk, expression.operands[2]);
+    }
+}
+
+static bool visit_statement(Ast_File_Walk* walk, uint32_t index) {
+    const Compact_Statement& statement = walk->file->statement(index);
+    switch (statement.tag) {
+        case Statement::Expression:
+        case Statement::Return:
+            return push_expression(walk, statement.operands[0]);
+
+        case Statement::Block:
+            return push_list(walk, &walk->statement_stack, walk->statement_count,
+                             statement.operands[0], statement.operands[1]);
+
+        case Statement::For:
+            return push_expression(walk, statement.operands[0]) &&
+                   push_expression(walk, statement.operands[1]) &&
+                   push_expression(walk, statement.operands[2]) &&
+                   push_statement(walk, statement.operands[3]);
+
+        case Statement::While:
+            return push_expression(walk, statement.operands[0]) &&
+                   push_statement(walk, statement.operands[1]);
+
+        case Statement::If:
+            return push_expression(walk, statement.operands[0]) &&
+                   push_statement(walk, statement.operands[1]) &&
+                   push_statement(walk, statement.operands[2]);
+
+        case Statement::Initializer_Copy:
+            return push_expression(walk, statement.operands[1]);
+
+        default:
+            return true;
+    }
+}
+
+/// Visit everything on the stacks.
+static bool walk_nodes(Ast_File_Walk* walk) {
+    while (1) {
+        if (walk->statement_stack.len() > 0) {
+            // Every node is written once so a node reached twice means the file is corrupt.
+            // Counting visits catches cycles and shared subtrees without marking each node.
+            if (++walk->statements > walk->statement_count) {
+                return false;
+            }
+            if (!visit_statement(walk, walk->statement_stack.pop())) {
+                return false;
+            }
+        } else if (walk->expression_stack.len() > 0) {
+            if (++walk->expressions > walk->expression_count) {
+                return false;
+            }
+            if (!visit_expression(walk, walk->expression_stack.pop())) {
+                return false;
+            }
+        } else {
+            return true;
+        }
+    }
+}
+
+bool walk_ast_file(const Ast_File& file, size_t* statements, size_t* expressions) {
+    ZoneScoped;
+
+    Ast_File_Walk walk = {};
+    walk.file = &file;
+    walk.expression_count = file.section<Compact_Expression>(Ast_File_Section::Expressions).len;
+    walk.statement_count = file.section<Compact_Statement>(Ast_File_Section::Statements).len;
+    walk.list_count = file.section<uint32_t>(Ast_File_Section::Lists).len;
+    CZ_DEFER(walk.drop());
+
+    cz::Slice<const uint32_t> initializers = file.section<uint32_t>(Ast_File_Section::Initializers);
+    for (size_t i = 0; i < initializers.len; ++i) {
+        if (!push_statement(&walk, initializers[i]) || !walk_nodes(&walk)) {
+            return false;
+        }
+    }
+
+    cz::Slice<const Ast_File_Declaration> declarations =
+        file.section<Ast_File_Declaration>(Ast_File_Section::Declarations);
+    for (size_t i = 0; i < declarations.len; ++i) {
+        if (!push_list(&walk, &walk.statement_stack, walk.statement_count,
+                       declarations[i].body_start, declarations[i].body_len) ||
+            !walk_nodes(&walk)) {
+            return false;
+        }
+    }
+
+    *statements = walk.statements;
+    *expressions = walk.expressions;
+    return true;
+}
+
+Result load_ast_file(Context* context, const char* file_name) {
+    ZoneScoped;
+
+    Ast_File file = {};
+    Result result = file.open(file_name);
+    if (result.type == Result::ErrorInvalidInput) {
+        context->report_error_unspanned("Invalid syntax tree file");
+    } else if (result.is_err()) {
+        context->report_error_unspanned("Could not open syntax tree file");
+    }
+    CZ_TRY(result);
+    CZ_DEFER(file.close());
+
+    size_t statements, expressions;
+    if (!walk_ast_file(file, &statements, &expressions)) {
+        context->report_error_unspanned("Invalid syntax tree file");
+        return {Result::ErrorInvalidInput};
+    }
+
+    if (context->options.print_stats) {
+        printf("Statistics for %s:\n", file_name);
+        printf("Declarations: %zu\n",
+               file.section<Ast_File_Declaration>(Ast_File_Section::Declarations).len);
+        printf("Types: %zu\n", file.section<Ast_File_Type>(Ast_File_Section::Types).len);
+        printf("Statements: %zu\n", statements);
+        printf("Expressions: %zu\n", expressions);
+    }
+
+    return Result::ok();
+}
+
+}
+}
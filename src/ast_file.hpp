@@ -0,0 +1,213 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cz/slice.hpp>
+#include <cz/str.hpp>
+#include <cz/string.hpp>
+#include "compact_ast.hpp"
+#include "result.hpp"
+#include "span.hpp"
+
+namespace red {
+struct Context;
+
+namespace parse {
+struct Parser;
+struct Statement;
+
+/// A binary encoding of the results of parsing a file that can be `mmap`ed and walked in place.
+///
+/// The file starts with an `Ast_File_Header` followed by the sections it lists.  Each section is
+/// an array of fixed size records aligned to 8 bytes.  Records refer to each other by 32 bit
+/// indices into other sections, never by pointers, so the file can be used wherever it is mapped.
+/// The syntax tree is stored as the pools of a `Compact_Ast` with names and types replaced by
+/// indices into the string and type tables.
+///
+/// All integers are stored in the byte order of the machine that wrote the file.
+namespace Ast_File_Section_ {
+enum Ast_File_Section : uint32_t {
+    /// The bytes of every string.  The count is in bytes.
+    Strings,
+    /// `Ast_File_String`.
+    String_Refs,
+    /// The path of each file as a string index.  `Compact_Span` files index this.
+    Files,
+    /// `Ast_File_Type`.
+    Types,
+    /// The parameter types of functions as type references.
+    Type_Lists,
+    /// `Ast_File_Declaration` for the members of structs and unions.
+    Members,
+    /// `Ast_File_Enum_Value`.
+    Enum_Values,
+    /// `Ast_File_Tag` for the tagged types at file scope.
+    Tags,
+    /// `Ast_File_Declaration` for the ordinary identifiers at file scope.
+    Declarations,
+    /// The names of function parameters as string indices.
+    Parameter_Names,
+    /// The statements initializing variables at file scope in the order they were declared.
+    Initializers,
+    /// `Compact_Ast::expressions`.
+    Expressions,
+    /// `Compact_Ast::statements`.
+    Statements,
+    /// `Compact_Ast::lists`.
+    Lists,
+    /// `Compact_Ast::spans`.
+    Spans,
+    /// `Compact_Ast::names` as string indices.
+    Names,
+    /// `Compact_Ast::types` as type references.
+    Ast_Types,
+    Count,
+};
+}
+using Ast_File_Section_::Ast_File_Section;
+
+struct Ast_File_Section_Header {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct Ast_File_Header {
+    static constexpr const uint32_t current_version = 1;
+
+    char magic[4];
+    uint32_t version;
+    Ast_File_Section_Header sections[Ast_File_Section::Count];
+};
+
+struct Ast_File_String {
+    uint32_t offset;
+    uint32_t len;
+};
+
+/// A type.  Types are referred to by their index shifted left by 2 with the `const` and
+/// `volatile` qualifiers in the low bits (see `TypeP`).  The meaning of `operands` depends on
+/// `tag`:
+///
+/// * `Pointer`: the pointed to type.
+/// * `Array`: the element type.  `value` is the length if `flags` has `Type_Array::Length_Known`.
+/// * `Function`: the return type and then the start and length of the parameters in
+///   `Type_Lists`.  `flags` is 1 if the function has varargs.
+/// * `Struct` and `Union`: the start and length of the members in `Members` then the size and
+///   alignment.  `flags` is the `Type_Composite` flags.
+/// * `Enum`: the start and length of the values in `Enum_Values`.  `flags` is the `Type_Enum`
+///   flags.
+struct Ast_File_Type {
+    uint32_t tag;
+    uint32_t flags;
+    uint32_t operands[4];
+    int64_t value;
+};
+
+/// A declaration.  Fields that don't apply are `Compact_Ast::none` or empty.
+struct Ast_File_Declaration {
+    /// A string index.
+    uint32_t name;
+    /// A type reference.
+    uint32_t type;
+    /// `Declaration` flags.
+    uint32_t flags;
+    /// An index in `Spans`.
+    uint32_t span;
+    /// The `Initializer_Default` or `Initializer_Copy` statement.
+    uint32_t initializer;
+    /// The start and length of the parameter names in `Parameter_Names` for function definitions.
+    uint32_t parameters_start;
+    uint32_t parameters_len;
+    /// The start and length of the body in `Lists` for function definitions.
+    uint32_t body_start;
+    uint32_t body_len;
+    /// An index in `Spans`.
+    uint32_t body_span;
+};
+
+struct Ast_File_Enum_Value {
+    uint32_t name;
+    uint32_t padding;
+    int64_t value;
+};
+
+struct Ast_File_Tag {
+    uint32_t name;
+    uint32_t type;
+};
+
+/// Encode the file scope of `parser` into `out`.  `out` is allocated with the heap.
+void serialize_ast(Context* context,
+                   Parser* parser,
+                   cz::Slice<Statement*> initializers,
+                   cz::String* out);
+
+/// Write the file scope of `parser` to the file at `path`.
+Result write_ast_file(Context* context,
+                      Parser* parser,
+                      cz::Slice<Statement*> initializers,
+                      const char* path);
+
+/// A view of an encoded syntax tree.  Accessors return pointers into the encoded data.
+struct Ast_File {
+    const char* data;
+    size_t len;
+    /// Set if `data` was mapped by `open` and must be unmapped by `close`.
+    bool mapped;
+
+    /// Map the file at `path` and `load` it.
+    Result open(const char* path);
+    void close();
+
+    /// Use `data` as the encoded file without copying it.  `data` must be aligned to 8 bytes.
+    /// The header and section bounds are checked but the records themselves are not.
+    bool load(const void* data, size_t len);
+
+    const Ast_File_Header* header() const { return (const Ast_File_Header*)data; }
+
+    template <class T>
+    cz::Slice<const T> section(Ast_File_Section section) const {
+        const Ast_File_Section_Header& entry = header()->sections[section];
+        return {(const T*)(data + entry.offset), (size_t)entry.count};
+    }
+
+    cz::Str string(uint32_t index) const {
+        Ast_File_String string = section<Ast_File_String>(Ast_File_Section::String_Refs)[index];
+        return {data + header()->sections[Ast_File_Section::Strings].offset + string.offset,
+                string.len};
+    }
+
+    const Ast_File_Type& type(uint32_t reference) const {
+        return section<Ast_File_Type>(Ast_File_Section::Types)[reference >> 2];
+    }
+
+    const Compact_Expression& expression(uint32_t index) const {
+        return section<Compact_Expression>(Ast_File_Section::Expressions)[index];
+    }
+    const Compact_Statement& statement(uint32_t index) const {
+        return section<Compact_Statement>(Ast_File_Section::Statements)[index];
+    }
+    uint32_t list(uint32_t index) const {
+        return section<uint32_t>(Ast_File_Section::Lists)[index];
+    }
+    /// The string index of the name at `index` in `Names`.
+    uint32_t name(uint32_t index) const {
+        return section<uint32_t>(Ast_File_Section::Names)[index];
+    }
+    /// The type reference at `index` in `Ast_Types`.
+    uint32_t ast_type(uint32_t index) const {
+        return section<uint32_t>(Ast_File_Section::Ast_Types)[index];
+    }
+    Span span(uint32_t index) const;
+};
+
+/// Walk the initializers and function bodies in `file`, counting their nodes.  Every index is
+/// checked so this returns `false` instead of crashing if the file is corrupt.
+bool walk_ast_file(const Ast_File& file, size_t* statements, size_t* expressions);
+
+/// Map the file at `file_name` and walk every tree in it.  This is used to compare the cost of
+/// loading a file against parsing it from source.
+Result load_ast_file(Context* context, const char* file_name);
+
+}
+}
@@ -0,0 +1,536 @@
+#include "compact_ast.hpp"
+
+#include <Tracy.hpp>
+#include <cz/heap.hpp>
+#include "parse.hpp"
+
+namespace red {
+namespace parse {
+
+static_assert(Token::Parser_Null_Token <= UINT8_MAX, "Token::Type must fit in a byte");
+
+void Compact_Ast::drop() {
+    expressions.drop(cz::heap_allocator());
+    statements.drop(cz::heap_allocator());
+    lists.drop(cz::heap_allocator());
+    spans.drop(cz::heap_allocator());
+    names.drop(cz::heap_allocator());
+    types.drop(cz::heap_allocator());
+    name_indices.drop(cz::heap_allocator());
+    list_stack.drop(cz::heap_allocator());
+}
+
+uint32_t Compact_Ast::add_span(const Span& span) {
+    Compact_Span compact;
+    compact.start_file = (uint32_t)span.start.file;
+    compact.start_index = (uint32_t)span.start.index;
+    compact.start_line = (uint32_t)span.start.line;
+    compact.start_column = (uint32_t)span.start.column;
+    compact.end_file = (uint32_t)span.end.file;
+    compact.end_index = (uint32_t)span.end.index;
+    compact.end_line = (uint32_t)span.end.line;
+    compact.end_column = (uint32_t)span.end.column;
+
+    uint32_t index = (uint32_t)spans.len();
+    spans.reserve(cz::heap_allocator(), 1);
+    spans.push(compact);
+    return index;
+}
+
+static uint32_t add_name(Compact_Ast* ast, Hashed_Str name) {
+    uint32_t* existing = ast->name_indices.get(name.str, name.hash);
+    if (existing) {
+        return *existing;
+    }
+
+    uint32_t index = (uint32_t)ast->names.len();
+    ast->names.reserve(cz::heap_allocator(), 1);
+    ast->names.push(name);
+    ast->name_indices.reserve(cz::heap_allocator(), 1);
+    ast->name_indices.insert(name.str, name.hash, index);
+    return index;
+}
+
+static uint32_t add_type(Compact_Ast* ast, TypeP type) {
+    uint32_t index = (uint32_t)ast->types.len();
+    ast->types.reserve(cz::heap_allocator(), 1);
+    ast->types.push(type);
+    return index;
+}
+
+/// Move the handles on `list_stack` starting at `start` into `lists`.
+static Compact_Block carve_list(Compact_Ast* ast, size_t start) {
+    Compact_Block block;
+    block.start = (uint32_t)ast->lists.len();
+    block.len = (uint32_t)(ast->list_stack.len() - start);
+    ast->lists.reserve(cz::heap_allocator(), block.len);
+    for (size_t i = start; i < ast->list_stack.len(); ++i) {
+        ast->lists.push(ast->list_stack[i]);
+    }
+    ast->list_stack.set_len(start);
+    return block;
+}
+
+static uint32_t add_optional_expression(Compact_Ast* ast, const Expression* expression) {
+    if (!expression) {
+        return Compact_Ast::none;
+    }
+    return ast->add_expression(expression);
+}
+
+static uint32_t add_optional_statement(Compact_Ast* ast, const Statement* statement) {
+    if (!statement) {
+        return Compact_Ast::none;
+    }
+    return ast->add_statement(statement);
+}
+
+uint32_t Compact_Ast::add_expression(const Expression* e) {
+    Compact_Expression compact = {};
+    compact.tag = (uint8_t)e->tag;
+    compact.operands[0] = none;
+    compact.operands[1] = none;
+    compact.operands[2] = none;
+
+    switch (e->tag) {
+        case Expression::Integer: {
+            const Expression_Integer* expression = (const Expression_Integer*)e;
+            compact.op = expression->is_int;
+            compact.operands[0] = (uint32_t)expression->value;
+            compact.operands[1] = (uint32_t)(expression->value >> 32);
+        } break;
+
+        case Expression::Variable: {
+            const Expression_Variable* expression = (const Expression_Variable*)e;
+            compact.operands[0] = add_name(this, expression->variable);
+        } break;
+
+        case Expression::Binary: {
+            const Expression_Binary* expression = (const Expression_Binary*)e;
+            compact.op = (uint8_t)expression->op;
+            compact.operands[0] = add_expression(expression->left);
+            compact.operands[1] = add_expression(expression->right);
+        } break;
+
+        case Expression::Ternary: {
+            const Expression_Ternary* expression = (const Expression_Ternary*)e;
+            compact.operands[0] = add_expression(expression->condition);
+            compact.operands[1] = add_expression(expression->then);
+            compact.operands[2] = add_expression(expression->otherwise);
+        } break;
+
+        case Expression::Cast: {
+            const Expression_Cast* expression = (const Expression_Cast*)e;
+            compact.operands[0] = add_type(this, expression->type);
+            compact.operands[1] = add_expression(expression->value);
+        } break;
+
+        case Expression::Sizeof_Type: {
+            const Expression_Sizeof_Type* expression = (const Expression_Sizeof_Type*)e;
+            compact.operands[0] = add_type(this, expression->type);
+        } break;
+
+        case Expression::Sizeof_Expression: {
+            const Expression_Sizeof_Expression* expression =
+                (const Expression_Sizeof_Expression*)e;
+            compact.operands[0] = add_expression(expression->expression);
+        } break;
+
+        case Expression::Function_Call: {
+            const Expression_Function_Call* expression = (const Expression_Function_Call*)e;
+            compact.operands[0] = add_expression(expression->function);
+
+            size_t start = list_stack.len();
+            for (size_t i = 0; i < expression->arguments.len; ++i) {
+                uint32_t argument = add_expression(expression->arguments[i]);
+                list_stack.reserve(cz::heap_allocator(), 1);
+                list_stack.push(argument);
+            }
+            Compact_Block arguments = carve_list(this, start);
+            compact.operands[1] = arguments.start;
+            compact.operands[2] = arguments.len;
+        } break;
+
+        case Expression::Index: {
+            const Expression_Index* expression = (const Expression_Index*)e;
+            compact.operands[0] = add_expression(expression->array);
+            compact.operands[1] = add_expression(expression->index);
+        } break;
+
+        case Expression::Member_Access: {
+            const Expression_Member_Access* expression = (const Expression_Member_Access*)e;
+            compact.operands[0] = add_expression(expression->object);
+            compact.operands[1] = add_name(this, expression->field);
+        } break;
+
+        case Expression::Dereference_Member_Access: {
+            const Expression_Dereference_Member_Access* expression =
+                (const Expression_Dereference_Member_Access*)e;
+            compact.operands[0] = add_expression(expression->pointer);
+            compact.operands[1] = add_name(this, expression->field);
+        } break;
+
+        // All unary operators have the same layout.
+        case Expression::Address_Of:
+        case Expression::Dereference:
+        case Expression::Bit_Not:
+        case Expression::Logical_Not:
+        case Expression::Pre_Increment:
+        case Expression::Post_Increment:
+        case Expression::Pre_Decrement:
+        case Expression::Post_Decrement: {
+            const Expression_Address_Of* expression = (const Expression_Address_Of*)e;
+            compact.operands[0] = add_expression(expression->value);
+        } break;
+    }
+
+    compact.span = add_span(e->span);
+
+    uint32_t index = (uint32_t)expressions.len();
+    expressions.reserve(cz::heap_allocator(), 1);
+    expressions.push(compact);
+    return index;
+}
+
+Compact_Block Compact_Ast::add_block(const Block& block) {
+    ZoneScoped;
+
+    size_t start = list_stack.len();
+    for (size_t i = 0; i < block.statements.len; ++i) {
+        uint32_t statement = add_statement(block.statements[i]);
+        list_stack.reserve(cz::heap_allocator(), 1);
+        list_stack.push(statement);
+    }
+    return carve_list(this, start);
+}
+
+uint32_t Compact_Ast::add_statement(const Statement* s) {
+    Compact_Statement compact = {};
+    compact.tag = (uint8_t)s->tag;
+    for (size_t i = 0; i < 4; ++i) {
+        compact.operands[i] = none;
+    }
+
+    switch (s->tag) {
+        case Statement::Expression: {
+            const Statement_Expression* statement = (const Statement_Expression*)s;
+            compact.operands[0] = add_expression(statement->expression);
+        } break;
+
+        case Statement::Block: {
+            const Statement_Block* statement = (const Statement_Block*)s;
+            Compact_Block block = add_block(statement->block);
+            compact.operands[0] = block.start;
+            compact.operands[1] = block.len;
+        } break;
+
+        case Statement::For: {
+            const Statement_For* statement = (const Statement_For*)s;
+            compact.operands[0] = add_optional_expression(this, statement->initializer);
+            compact.operands[1] = add_optional_expression(this, statement->condition);
+            compact.operands[2] = add_optional_expression(this, statement->increment);
+            compact.operands[3] = add_statement(statement->body);
+        } break;
+
+        case Statement::While: {
+            const Statement_While* statement = (const Statement_While*)s;
+            compact.operands[0] = add_expression(statement->condition);
+            compact.operands[1] = add_statement(statement->body);
+        } break;
+
+        case Statement::Return: {
+            const Statement_Return* statement = (const Statement_Return*)s;
+            compact.operands[0] = add_optional_expression(this, statement->o_value);
+        } break;
+
+        case Statement::If: {
+            const Statement_If* statement = (const Statement_If*)s;
+            compact.operands[0] = add_expression(statement->condition);
+            compact.operands[1] = add_statement(statement->then);
+            compact.operands[2] = add_optional_statement(this, statement->otherwise);
+        } break;
+
+        case Statement::Initializer_Default: {
+            const Statement_Initializer* statement = (const Statement_Initializer*)s;
+            compact.operands[0] = add_name(this, statement->identifier);
+        } break;
+
+        case Statement::Initializer_Copy: {
+            const Statement_Initializer_Copy* statement = (const Statement_Initializer_Copy*)s;
+            compact.operands[0] = add_name(this, statement->identifier);
+            compact.operands[1] = add_expression(statement->value);
+        } break;
+
+        case Statement::Empty:
+        case Statement::Continue:
+        case Statement::Break:
+            break;
+    }
+
+    compact.span = add_span(s->span);
+
+    uint32_t index = (uint32_t)statements.len();
+    statements.reserve(cz::heap_allocator(), 1);
+    statements.push(compact);
+    return index;
+}
+
+Span Compact_Ast::span(uint32_t index) const {
+    const Compact_Span& compact = spans[index];
+    Span span;
+    span.start.file = compact.start_file;
+    span.start.index = compact.start_index;
+    span.start.line = compact.start_line;
+    span.start.column = compact.start_column;
+    span.end.file = compact.end_file;
+    span.end.index = compact.end_index;
+    span.end.line = compact.end_line;
+    span.end.column = compact.end_column;
+    return span;
+}
+
+static Expression* expand_optional_expression(const Compact_Ast* ast,
+                                              Ast_Arena* arena,
+                                              uint32_t index) {
+    if (index == Compact_Ast::none) {
+        return nullptr;
+    }
+    return ast->expand_expression(arena, index);
+}
+
+static Statement* expand_optional_statement(const Compact_Ast* ast,
+                                            Ast_Arena* arena,
+                                            uint32_t index) {
+    if (index == Compact_Ast::none) {
+        return nullptr;
+    }
+    return ast->expand_statement(arena, index);
+}
+
+Expression* Compact_Ast::expand_expression(Ast_Arena* arena, uint32_t index) const {
+    const Compact_Expression& compact = expressions[index];
+    const uint32_t* operands = compact.operands;
+
+    Expression* e;
+    switch ((Expression::Tag)compact.tag) {
+        case Expression::Integer: {
+            Expression_Integer* expression = arena->create_integer();
+            expression->is_int = compact.op;
+            expression->value = (uint64_t)operands[0] | ((uint64_t)operands[1] << 32);
+            e = expression;
+        } break;
+
+        case Expression::Variable: {
+            Expression_Variable* expression = arena->create_expression<Expression_Variable>();
+            expression->variable = names[operands[0]];
+            e = expression;
+        } break;
+
+        case Expression::Binary: {
+            Expression_Binary* expression = arena->create_expression<Expression_Binary>();
+            expression->op = (Token::Type)compact.op;
+            expression->left = expand_expression(arena, operands[0]);
+            expression->right = expand_expression(arena, operands[1]);
+            e = expression;
+        } break;
+
+        case Expression::Ternary: {
+            Expression_Ternary* expression = arena->create_expression<Expression_Ternary>();
+            expression->condition = expand_expression(arena, operands[0]);
+            expression->then = expand_expression(arena, operands[1]);
+            expression->otherwise = expand_expression(arena, operands[2]);
+            e = expression;
+        } break;
+
+        case Expression::Cast: {
+            Expression_Cast* expression = arena->create_expression<Expression_Cast>();
+            expression->type = types[operands[0]];
+            expression->value = expand_expression(arena, operands[1]);
+            e = expression;
+        } break;
+
+        case Expression::Sizeof_Type: {
+            Expression_Sizeof_Type* expression = arena->create_expression<Expression_Sizeof_Type>();
+            expression->type = types[operands[0]];
+            e = expression;
+        } break;
+
+        case Expression::Sizeof_Expression: {
+            Expression_Sizeof_Expression* expression =
+                arena->create_expression<Expression_Sizeof_Expression>();
+            expression->expression = expand_expression(arena, operands[0]);
+            e = expression;
+        } break;
+
+        case Expression::Function_Call: {
+            Expression_Function_Call* expression =
+                arena->create_expression<Expression_Function_Call>();
+            expression->function = expand_expression(arena, operands[0]);
+
+            cz::Vector<Expression*>* arguments = &arena->expression_stack;
+            size_t arguments_start = arguments->len();
+            for (uint32_t i = 0; i < operands[2]; ++i) {
+                Expression* argument = expand_expression(arena, lists[operands[1] + i]);
+                arguments->reserve(cz::heap_allocator(), 1);
+                arguments->push(argument);
+            }
+            expression->arguments = arena->carve(arguments, arguments_start);
+            e = expression;
+        } break;
+
+        case Expression::Index: {
+            Expression_Index* expression = arena->create_expression<Expression_Index>();
+            expression->array = expand_expression(arena, operands[0]);
+            expression->index = expand_expression(arena, operands[1]);
+            e = expression;
+        } break;
+
+        case Expression::Member_Access: {
+            Expression_Member_Access* expression =
+                arena->create_expression<Expression_Member_Access>();
+            expression->object = expand_expression(arena, operands[0]);
+            expression->field = names[operands[1]];
+            e = expression;
+        } break;
+
+        case Expression::Dereference_Member_Access: {
+            Expression_Dereference_Member_Access* expression =
+                arena->create_expression<Expression_Dereference_Member_Access>();
+            expression->pointer = expand_expression(arena, operands[0]);
+            expression->field = names[operands[1]];
+            e = expression;
+        } break;
+
+#define EXPAND_UNARY(TAG)                                                             \
+    case Expression::TAG: {                                                           \
+        Expression_##TAG* expression = arena->create_expression<Expression_##TAG>(); \
+        expression->value = expand_expression(arena, operands[0]);                   \
+        e = expression;                                                               \
+    } break
+
+            EXPAND_UNARY(Address_Of);
+            EXPAND_UNARY(Dereference);
+            EXPAND_UNARY(Bit_Not);
+            EXPAND_UNARY(Logical_Not);
+            EXPAND_UNARY(Pre_Increment);
+            EXPAND_UNARY(Post_Increment);
+            EXPAND_UNARY(Pre_Decrement);
+            EXPAND_UNARY(Post_Decrement);
+#undef EXPAND_UNARY
+
+        default:
+            CZ_PANIC("Invalid compact expression");
+    }
+
+    e->span = span(compact.span);
+    return e;
+}
+
+Block Compact_Ast::expand_block(Ast_Arena* arena, Compact_Block block) const {
+    ZoneScoped;
+
+    cz::Vector<Statement*>* statements = &arena->statement_stack;
+    size_t statements_start = statements->len();
+    for (uint32_t i = 0; i < block.len; ++i) {
+        Statement* statement = expand_statement(arena, lists[block.start + i]);
+        statements->reserve(cz::heap_allocator(), 1);
+        statements->push(statement);
+    }
+
+    Block result;
+    result.statements = arena->carve(statements, statements_start);
+    return result;
+}
+
+Statement* Compact_Ast::expand_statement(Ast_Arena* arena, uint32_t index) const {
+    const Compact_Statement& compact = statements[index];
+    const uint32_t* operands = compact.operands;
+
+    Statement* s;
+    switch ((Statement::Tag)compact.tag) {
+        case Statement::Expression: {
+            Statement_Expression* statement = arena->create_statement<Statement_Expression>();
+            statement->expression = expand_expression(arena, operands[0]);
+            s = statement;
+        } break;
+
+        case Statement::Block: {
+            Statement_Block* statement = arena->create_statement<Statement_Block>();
+            statement->block = expand_block(arena, {operands[0], operands[1]});
+            s = statement;
+        } break;
+
+        case Statement::For: {
+            Statement_For* statement = arena->create_statement<Statement_For>();
+            statement->initializer = expand_optional_expression(this, arena, operands[0]);
+            statement->condition = expand_optional_expression(this, arena, operands[1]);
+            statement->increment = expand_optional_expression(this, arena, operands[2]);
+            statement->body = expand_statement(arena, operands[3]);
+            s = statement;
+        } break;
+
+        case Statement::While: {
+            Statement_While* statement = arena->create_statement<Statement_While>();
+            statement->condition = expand_expression(arena, operands[0]);
+            statement->body = expand_statement(arena, operands[1]);
+            s = statement;
+        } break;
+
+        case Statement::Return: {
+            Statement_Return* statement = arena->create_statement<Statement_Return>();
+            statement->o_value = expand_optional_expression(this, arena, operands[0]);
+            s = statement;
+        } break;
+
+        case Statement::Empty:
+            s = arena->create_statement<Statement_Empty>();
+            break;
+
+        case Statement::If: {
+            Statement_If* statement = arena->create_statement<Statement_If>();
+            statement->condition = expand_expression(arena, operands[0]);
+            statement->then = expand_statement(arena, operands[1]);
+            statement->otherwise = expand_optional_statement(this, arena, operands[2]);
+            s = statement;
+        } break;
+
+        case Statement::Continue:
+            s = arena->create_statement<Statement_Continue>();
+            break;
+
+        case Statement::Break:
+            s = arena->create_statement<Statement_Break>();
+            break;
+
+        case Statement::Initializer_Default: {
+            Statement_Initializer_Default* statement =
+                arena->create_statement<Statement_Initializer_Default>();
+            statement->identifier = names[operands[0]];
+            s = statement;
+        } break;
+
+        case Statement::Initializer_Copy: {
+            Statement_Initializer_Copy* statement =
+                arena->create_statement<Statement_Initializer_Copy>();
+            statement->identifier = names[operands[0]];
+            statement->value = expand_expression(arena, operands[1]);
+            s = statement;
+        } break;
+
+        default:
+            CZ_PANIC("Invalid compact statement");
+    }
+
+    s->span = span(compact.span);
+    return s;
+}
+
+size_t Compact_Ast::bytes() const {
+    return expressions.len() * sizeof(Compact_Expression) +
+           statements.len() * sizeof(Compact_Statement) + lists.len() * sizeof(uint32_t) +
+           spans.len() * sizeof(Compact_Span) + names.len() * sizeof(Hashed_Str) +
+           types.len() * sizeof(TypeP);
+}
+
+}
+}
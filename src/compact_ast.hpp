@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <cz/str_map.hpp>
+#include <cz/vector.hpp>
+#include "hashed_str.hpp"
+#include "span.hpp"
+
+namespace red {
+namespace parse {
+
+struct Ast_Arena;
+struct Block;
+struct Expression;
+struct Statement;
+struct TypeP;
+
+/// A `Span` with 32 bit fields.  Every field is kept so `expand_*` can restore the original span.
+struct Compact_Span {
+    uint32_t start_file;
+    uint32_t start_index;
+    uint32_t start_line;
+    uint32_t start_column;
+    uint32_t end_file;
+    uint32_t end_index;
+    uint32_t end_line;
+    uint32_t end_column;
+};
+
+/// An expression node.  The meaning of `operands` depends on `tag`:
+///
+/// * `Integer`: the low and high halves of the value.  `op` is set if it is an `int`.
+/// * `Variable`: the name.
+/// * `Binary`: the left and right sides.  `op` is the operator.
+/// * `Ternary`: the condition, then, and otherwise expressions.
+/// * `Cast`: the type and the value.
+/// * `Sizeof_Type`: the type.
+/// * `Function_Call`: the function and then the start and length of the arguments in `lists`.
+/// * `Index`: the array and the index.
+/// * `Member_Access` and `Dereference_Member_Access`: the object and the field name.
+/// * Unary operators: the value.
+struct Compact_Expression {
+    uint8_t tag;
+    uint8_t op;
+    uint32_t span;
+    uint32_t operands[3];
+};
+
+/// A statement node.  The meaning of `operands` depends on `tag`:
+///
+/// * `Expression`: the expression.
+/// * `Block`: the start and length of the statements in `lists`.
+/// * `For`: the initializer, condition, increment, and body.  Expressions may be `none`.
+/// * `While`: the condition and the body.
+/// * `Return`: the value or `none`.
+/// * `If`: the condition, then, and otherwise statements.  Otherwise may be `none`.
+/// * `Initializer_Default`: the name.
+/// * `Initializer_Copy`: the name and the value.
+struct Compact_Statement {
+    uint8_t tag;
+    uint32_t span;
+    uint32_t operands[4];
+};
+
+/// A list of statements stored in `Compact_Ast::lists`.
+struct Compact_Block {
+    uint32_t start;
+    uint32_t len;
+};
+
+/// An alternative encoding of the syntax tree.  Nodes are stored in typed, contiguous pools and
+/// refer to each other by 32 bit indices instead of pointers.  Spans, names, and types are
+/// likewise moved into side tables so each node is a small fixed size struct.  Children are added
+/// before their parents so a traversal mostly walks forwards through memory.
+///
+/// The parser does not emit this form.  Trees are converted to it after parsing with the `add_*`
+/// functions, which `--stats` uses to measure how big the tree would be, and back into the regular
+/// pointer based form with the `expand_*` functions.  Spans are stored in full (see
+/// `Compact_Span`) so a round trip is lossless.
+struct Compact_Ast {
+    static constexpr const uint32_t none = UINT32_MAX;
+
+    cz::Vector<Compact_Expression> expressions;
+    cz::Vector<Compact_Statement> statements;
+    /// The children of function calls and blocks.
+    cz::Vector<uint32_t> lists;
+
+    cz::Vector<Compact_Span> spans;
+    cz::Vector<Hashed_Str> names;
+    cz::Vector<TypeP> types;
+
+    /// Maps each name to its index in `names` so every name is only stored once.
+    cz::Str_Map<uint32_t> name_indices;
+
+    /// Scratch stack for the children of a list while they are being added.  See
+    /// `Ast_Arena::expression_stack`.
+    cz::Vector<uint32_t> list_stack;
+
+    void drop();
+
+    uint32_t add_expression(const Expression* expression);
+    uint32_t add_statement(const Statement* statement);
+    Compact_Block add_block(const Block& block);
+    uint32_t add_span(const Span& span);
+
+    Expression* expand_expression(Ast_Arena* arena, uint32_t index) const;
+    Statement* expand_statement(Ast_Arena* arena, uint32_t index) const;
+    Block expand_block(Ast_Arena* arena, Compact_Block block) const;
+
+    Span span(uint32_t index) const;
+
+    /// The number of bytes used by all the pools.
+    size_t bytes() const;
+};
+
+}
+}
@@ -1,22 +1,33 @@
 #include "compiler.hpp"
 
+#include <stdio.h>
 #include <Tracy.hpp>
+#include <new>
+#include <cz/assert.hpp>
 #include <cz/defer.hpp>
 #include <cz/heap.hpp>
 #include <cz/path.hpp>
 #include <cz/stringify.hpp>
 #include <cz/try.hpp>
+#include "ast_file.hpp"
+#include "compact_ast.hpp"
 #include "context.hpp"
 #include "definition.hpp"
 #include "file.hpp"
 #include "file_contents.hpp"
 #include "hashed_str.hpp"
+#include "header_bundle.hpp"
+#include "include_prefetcher.hpp"
 #include "lex.hpp"
 #include "load.hpp"
+#include "parallel_parse.hpp"
 #include "parse.hpp"
 #include "preprocess.hpp"
 #include "result.hpp"
 #include "token.hpp"
+#include "token_buffer.hpp"
+#include "token_pipeline.hpp"
+#include "virtual_files.hpp"
 
 namespace red {
 
@@ -24,7 +35,7 @@ static void add_parse_definition(Context* context,
                                  parse::Parser* parser,
                                  Hashed_Str name,
                                  cz::Str contents) {
-    cz::Vector<Token> tokens = {};
+    Token_Buffer tokens = {};
 
     Location point = {};
     point.file = context->files.files.len();
@@ -42,24 +53,20 @@ static void add_parse_definition(Context* context,
     context->files.file_path_hashes.reserve(cz::heap_allocator(), 1);
     parser->preprocessor.file_pragma_once.reserve(cz::heap_allocator(), 1);
 
-    File file;
+    File file = {};
     file.path = file_path;
     file.contents = file_contents;
     context->files.files.push(file);
     context->files.file_path_hashes.push(Hashed_Str::hash_str(file_path));
     parser->preprocessor.file_pragma_once.push(false);
 
-    while (1) {
-        Token token;
-        bool at_bol = false;
-        if (!lex::next_token(context, &parser->lexer, context->files.files[point.file].contents,
-                             &point, &token, &at_bol)) {
-            break;
-        }
+    lex::Tokenize_Options options = {};
+    options.allocator = cz::heap_allocator();
+    options.max_tokens = SIZE_MAX;
+    lex::tokenize_range(context, &parser->lexer, context->files.files[point.file].contents, &point,
+                        options, &tokens, nullptr);
 
-        tokens.reserve(cz::heap_allocator(), 1);
-        tokens.push(token);
-    }
+    tokens.realloc(cz::heap_allocator());
 
     pre::Definition definition = {};
     definition.tokens = tokens;
@@ -69,7 +76,7 @@ static void add_parse_definition(Context* context,
 #define ADD_BUILTIN_DEFINITION(x) \
     add_parse_definition(context, parser, Hashed_Str::from_str(#x), CZ_STRINGIFY(x));
 
-static void add_builtin_definitions(Context* context, parse::Parser* parser) {
+void add_builtin_definitions(Context* context, parse::Parser* parser) {
     ZoneScoped;
 
     parser->preprocessor.definitions.reserve(cz::heap_allocator(), 1024);
@@ -221,11 +228,59 @@ static void add_builtin_definitions(Context* context, parse::Parser* parser) {
     ADD_BUILTIN_DEFINITION(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16);
 }
 
+/// Print the size of the syntax tree when stored as a `Compact_Ast`.  This converts the tree
+/// after parsing purely to measure it; the compiler itself never works on the compact form.
+static void print_compact_ast_size(parse::Parser* parser,
+                                   cz::Slice<parse::Statement*> initializers) {
+    ZoneScoped;
+
+    parse::Compact_Ast compact = {};
+    CZ_DEFER(compact.drop());
+
+    for (size_t i = 0; i < initializers.len; ++i) {
+        compact.add_statement(initializers[i]);
+    }
+
+    cz::Slice<Scope_Table<parse::Declaration>::Binding> declarations =
+        parser->declarations.scope(0);
+    for (size_t i = 0; i < declarations.len; ++i) {
+        const parse::Declaration& declaration = declarations[i].value;
+        if (declaration.flags & parse::Declaration::Typedef) {
+            continue;
+        }
+        if (declaration.type.get_type()->tag != parse::Type::Function) {
+            continue;
+        }
+        if (declaration.v.function_definition) {
+            compact.add_block(declaration.v.function_definition->block);
+        }
+    }
+
+    printf("Compact syntax tree: %zu bytes\n", compact.bytes());
+}
+
+static Result ignore_declaration(void* data,
+                                 Context* context,
+                                 parse::Parser* parser,
+                                 const parse::Parsed_Declaration& declaration) {
+    return Result::ok();
+}
+
+parse::Declaration_Consumer stream_consumer(Context* context) {
+    parse::Declaration_Consumer consumer;
+    consumer.consume = ignore_declaration;
+    consumer.data = nullptr;
+    return consumer;
+}
+
 Result compile_file(Context* context, const char* file_name) {
     ZoneScoped;
 
     parse::Parser parser = {};
     parser.init();
+    parser.fold_constants = true;
+    parser.skip_bodies = context->options.skip_bodies || context->options.parse_threads > 0;
+    parser.record_body_tokens = !context->options.skip_bodies && context->options.parse_threads > 0;
     CZ_DEFER(parser.drop());
 
     add_builtin_definitions(context, &parser);
@@ -239,18 +294,87 @@ Result compile_file(Context* context, const char* file_name) {
     }
     file_path.realloc_null_terminate(context->files.file_path_buffer_array.allocator());
 
+    if (context->options.virtual_files && !context->files.virtual_files) {
+        Virtual_Files* virtual_files = context->files.get_virtual_files();
+        virtual_files->exclusive = context->options.virtual_files_only;
+        CZ_TRY(load_virtual_files(context, context->options.virtual_files, virtual_files));
+    }
+
+    if (context->options.header_bundle && !context->files.bundle) {
+        Header_Bundle* bundle = static_cast<Header_Bundle*>(
+            cz::heap_allocator().alloc({sizeof(Header_Bundle), alignof(Header_Bundle)}));
+        CZ_ASSERT(bundle);
+        *bundle = {};
+        if (bundle->open(context->options.header_bundle).is_err()) {
+            cz::heap_allocator().dealloc({bundle, sizeof(Header_Bundle)});
+            context->report_error_unspanned("Could not open header bundle");
+            return {Result::ErrorFile};
+        }
+        context->files.bundle = bundle;
+    }
+
+    if (context->options.prefetch_includes && !context->files.prefetcher) {
+        Include_Prefetcher* prefetcher = static_cast<Include_Prefetcher*>(
+            cz::heap_allocator().alloc({sizeof(Include_Prefetcher), alignof(Include_Prefetcher)}));
+        CZ_ASSERT(prefetcher);
+        new (prefetcher) Include_Prefetcher();
+        prefetcher->start(context->options.include_paths);
+        context->files.prefetcher = prefetcher;
+    }
+
     CZ_TRY(include_file(&context->files, &parser.preprocessor, file_path));
 
+    parse::Token_Pipeline pipeline;
+    if (context->options.pipeline) {
+        pipeline.start(context, &parser.preprocessor, &parser.lexer);
+        parser.pipeline = &pipeline;
+    }
+
     cz::Vector<parse::Statement*> initializers = {};
-    while (1) {
-        Result result = parse_declaration(context, &parser, &initializers);
-        if (result.is_err()) {
-            return result;
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+    Result result;
+    if (context->options.stream_declarations) {
+        parse::Declaration_Consumer consumer = stream_consumer(context);
+        result = parse::parse_declarations(context, &parser, &initializers, consumer);
+    } else {
+        do {
+            result = parse_declaration(context, &parser, &initializers);
+        } while (result.type == Result::Success);
+    }
+
+    if (parser.pipeline) {
+        pipeline.stop(context);
+        parser.pipeline = nullptr;
+    }
+
+    if (result.is_ok() && parser.record_body_tokens) {
+        result = parse::parse_skipped_bodies_in_parallel(context, &parser,
+                                                         context->options.parse_threads);
+    }
+
+    if (context->options.print_stats) {
+        printf("Statistics for %s:\n", file_path.buffer());
+        parser.ast_arena.stats.print(stdout);
+        printf("Derived types: %zu distinct, %zu duplicates\n", parser.type_interner.distinct,
+               parser.type_interner.duplicates);
+        // Streamed bodies are already freed so there is nothing left to measure.
+        if (!context->options.stream_declarations) {
+            print_compact_ast_size(&parser, initializers);
         }
-        if (result.type == Result::Done) {
-            return Result::ok();
+        if (context->options.skip_bodies) {
+            printf("Skipped function bodies: %zu\n", parser.skipped_bodies.len());
         }
     }
+
+    if (result.is_err()) {
+        return result;
+    }
+
+    if (context->options.emit_ast) {
+        CZ_TRY(parse::write_ast_file(context, &parser, initializers, context->options.emit_ast));
+    }
+
+    return Result::ok();
 }
 
 }
@@ -3,6 +3,17 @@
 namespace red {
 struct Context;
 struct Result;
+namespace parse {
+struct Declaration_Consumer;
+struct Parser;
+}
+
+/// Define the macros the compiler provides to every file.
+void add_builtin_definitions(Context* context, parse::Parser* parser);
+
+/// The consumer `compile_file` streams declarations to.  It keeps nothing so memory doesn't grow
+/// with the file, even with `--stats`.
+parse::Declaration_Consumer stream_consumer(Context* context);
 
 Result compile_file(Context*, const char* file_name);
 
@@ -11,6 +11,9 @@ void Context::init() {
 }
 
 void Context::destroy() {
+    // The include prefetcher's thread reads `options.include_paths` so stop it first.
+    files.destroy();
+
     options.destroy();
 
     temp_buffer_array.drop();
@@ -18,8 +21,6 @@ void Context::destroy() {
     error_message_buffer_array.drop();
     errors.drop(cz::heap_allocator());
     unspanned_errors.drop(cz::heap_allocator());
-
-    files.destroy();
 }
 
 void Context::report_error_str(Span error_span, Span source_span, cz::Str message) {
@@ -1,13 +1,12 @@
 #pragma once
 
-#include <cz/vector.hpp>
-#include "token.hpp"
+#include "token_buffer.hpp"
 
 namespace red {
 namespace pre {
 
 struct Definition {
-    cz::Vector<Token> tokens;
+    Token_Buffer tokens;
 
     size_t parameter_len;
     bool is_function;
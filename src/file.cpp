@@ -1 +1,55 @@
 #include "file.hpp"
+
+#include <string.h>
+#include <cz/heap.hpp>
+
+namespace red {
+
+static void build_line_starts(File* file) {
+    // The file is one block so it can be searched directly.
+    const char* start = file->contents.buffers[0];
+    const char* end = start + file->contents.len;
+    file->line_starts.reserve(cz::heap_allocator(), 1);
+    file->line_starts.push(0);
+    for (const char* it = start; (it = (const char*)memchr(it, '\n', end - it));) {
+        ++it;
+        file->line_starts.reserve(cz::heap_allocator(), 1);
+        file->line_starts.push((uint32_t)(it - start));
+    }
+    file->line_hint = 0;
+}
+
+void File::find_location(size_t index, Location* location) {
+    if (line_starts.len() == 0) {
+        build_line_starts(this);
+    }
+
+    size_t line = line_hint;
+    if (index < line_starts[line] ||
+        (line + 1 < line_starts.len() && index >= line_starts[line + 1])) {
+        // Find the last line starting at or before `index`.
+        size_t start = 0;
+        size_t end = line_starts.len();
+        while (end - start > 1) {
+            size_t mid = (start + end) / 2;
+            if (line_starts[mid] <= index) {
+                start = mid;
+            } else {
+                end = mid;
+            }
+        }
+        line = start;
+        line_hint = line;
+    }
+
+    location->index = index;
+    location->line = line;
+    location->column = index - line_starts[line];
+}
+
+void File::drop() {
+    contents.drop_buffers();
+    line_starts.drop(cz::heap_allocator());
+}
+
+}
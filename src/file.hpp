@@ -1,13 +1,27 @@
 #pragma once
 
+#include <stdint.h>
 #include <cz/str.hpp>
+#include <cz/vector.hpp>
 #include "file_contents.hpp"
+#include "location.hpp"
 
 namespace red {
 
 struct File {
     cz::Str path;
     File_Contents contents;
+
+    /// The index of the start of each line.  Built the first time `find_location` is called.
+    cz::Vector<uint32_t> line_starts;
+    /// The line `find_location` found last.  Consecutive lookups are almost always on it.
+    size_t line_hint;
+
+    /// Set the `index`, `line`, and `column` of `location` for the byte at `index`.  Lines only
+    /// end at newlines, so this matches the lexer even across line splices.
+    void find_location(size_t index, Location* location);
+
+    void drop();
 };
 
 }
@@ -1,111 +1,310 @@
 #include "file_contents.hpp"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <cz/assert.hpp>
 #include <cz/defer.hpp>
+#include "utf8.hpp"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace red {
 
+/// Allocate the block for `len` bytes and the `eof` after them.
+static char* allocate_block(File_Contents* file_contents,
+                            size_t len,
+                            cz::Allocator buffers_array_allocator) {
+    char* block;
+    if (len + 1 <= File_Contents::small_file_size) {
+        file_contents->storage = File_Contents_Storage::Pooled;
+        block = static_cast<char*>(buffers_array_allocator.alloc({len + 1, 1}));
+    } else {
+        file_contents->storage = File_Contents_Storage::Heap;
+        block = static_cast<char*>(malloc(len + 1));
+    }
+    CZ_ASSERT(block);
+    return block;
+}
+
+/// Point `buffers` into `block`, which holds `len` bytes followed by `eof`.
+static void set_buffers(File_Contents* file_contents,
+                        char* block,
+                        size_t len,
+                        cz::Allocator buffers_array_allocator) {
+    file_contents->len = len;
+
+    // We add an extra EOF byte so we don't need to subtract 1 here.
+    file_contents->buffers_len = (len + File_Contents::buffer_size) / File_Contents::buffer_size;
+    file_contents->buffers = static_cast<char**>(buffers_array_allocator.alloc(
+        {sizeof(char*) * file_contents->buffers_len, alignof(char*)}));
+    CZ_ASSERT(file_contents->buffers);
+    for (size_t i = 0; i < file_contents->buffers_len; ++i) {
+        file_contents->buffers[i] = block + i * File_Contents::buffer_size;
+    }
+}
+
+/// Terminate `block`, which holds `len` bytes, point `buffers` into it, and scan it.
+static void set_block(File_Contents* file_contents,
+                      char* block,
+                      size_t len,
+                      cz::Allocator buffers_array_allocator) {
+    block[len] = File_Contents::eof;
+    set_buffers(file_contents, block, len, buffers_array_allocator);
+    file_contents->find_first_splice();
+    file_contents->validate_utf8();
+}
+
 Result File_Contents::read(const char* cstr_file_name, cz::Allocator buffers_array_allocator) {
-    FILE* file = fopen(cstr_file_name, "r");
-    if (!file) {
+    int fd = ::open(cstr_file_name, O_RDONLY);
+    if (fd < 0) {
         return Result::last_system_error();
     }
-    CZ_DEFER(fclose(file));
+    CZ_DEFER(::close(fd));
 
-    size_t buffers_capacity = 8;
-    buffers = static_cast<char**>(
-        buffers_array_allocator.alloc({buffers_capacity * sizeof(char*), alignof(char*)}));
-    CZ_ASSERT(buffers);
-    buffers_len = 0;
+    struct stat stat;
+    if (fstat(fd, &stat) < 0) {
+        return Result::last_system_error();
+    }
 
-    while (1) {
-        // read a chunk into a new buffer
-        char* buffer = static_cast<char*>(malloc(buffer_size));
-        CZ_ASSERT(buffer);
-        size_t len = fread(buffer, 1, buffer_size, file);
+    if (!S_ISREG(stat.st_mode)) {
+        // Pipes and devices don't know their size so grow the block until we hit the end.
+        size_t capacity = buffer_size;
+        size_t len = 0;
+        char* block = static_cast<char*>(malloc(capacity + 1));
+        CZ_ASSERT(block);
+        while (1) {
+            if (len == capacity) {
+                capacity *= 2;
+                block = static_cast<char*>(realloc(block, capacity + 1));
+                CZ_ASSERT(block);
+            }
 
-        // we reached the end of the file (eof) but still have some final characters to consume
-        if (len < buffer_size) {
-            buffer[len] = eof;
+            ssize_t result = ::read(fd, block + len, capacity - len);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                Result error = Result::last_system_error();
+                free(block);
+                return error;
+            }
+            if (result == 0) {
+                break;
+            }
+            len += result;
         }
 
-        // reserve a spot
-        if (buffers_len + 1 == buffers_capacity) {
-            size_t new_cap = buffers_capacity * 2;
-            char** new_buffers = static_cast<char**>(
-                buffers_array_allocator.realloc({buffers, buffers_capacity * sizeof(char*)},
-                                                {new_cap * sizeof(char*), alignof(char*)}));
-            CZ_ASSERT(new_buffers);
+        block = static_cast<char*>(realloc(block, len + 1));
+        CZ_ASSERT(block);
+        storage = File_Contents_Storage::Heap;
+        set_block(this, block, len, buffers_array_allocator);
+        return Result::ok();
+    }
+
+    size_t capacity = stat.st_size;
+    char* block = allocate_block(this, capacity, buffers_array_allocator);
 
-            buffers = new_buffers;
-            buffers_capacity = new_cap;
+    size_t len = 0;
+    while (len < capacity) {
+        ssize_t result = ::read(fd, block + len, capacity - len);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Result error = Result::last_system_error();
+            if (storage == File_Contents_Storage::Pooled) {
+                buffers_array_allocator.dealloc({block, capacity + 1});
+            } else {
+                free(block);
+            }
+            return error;
         }
-
-        if (len == buffer_size) {
-            // put the buffer in the spot and continue reading
-            buffers[buffers_len] = buffer;
-            ++buffers_len;
-        } else {
-            // shrink the last string to size
-            this->len = buffers_len * buffer_size + len;
-            char* shrunk_buffer = static_cast<char*>(realloc(buffer, len + 1));
-            CZ_ASSERT(shrunk_buffer);
-            buffer = shrunk_buffer;
-
-            // put it in the spot and stop reading
-            buffers[buffers_len] = buffer;
-            ++buffers_len;
+        if (result == 0) {
+            // The file was truncated after we looked at its size.
             break;
         }
+        len += result;
     }
 
-    if (feof(file)) {
-        // we most likely overallocated so shrink to size
-        char** shrunk_buffers = static_cast<char**>(
-            buffers_array_allocator.realloc({buffers, buffers_capacity * sizeof(char*)},
-                                            {buffers_len * sizeof(char*), alignof(char*)}));
-        CZ_ASSERT(shrunk_buffers);
-        buffers = shrunk_buffers;
-
-        return Result::ok();
-    } else {
-        drop_array(buffers_array_allocator);
-        return {Result::ErrorFile};
+    // `drop_array` frees a `Pooled` block as `len + 1` bytes so shrink it to match.
+    if (len < capacity && storage == File_Contents_Storage::Pooled) {
+        block = static_cast<char*>(
+            buffers_array_allocator.realloc({block, capacity + 1}, {len + 1, 1}));
+        CZ_ASSERT(block);
     }
+
+    set_block(this, block, len, buffers_array_allocator);
+    return Result::ok();
 }
 
-void File_Contents::load_str(cz::Str contents, cz::Allocator allocator) {
-    // We add an extra EOF byte so we don't need to subtract 1 here.
-    buffers_len = (contents.len + File_Contents::buffer_size /*- 1*/) / File_Contents::buffer_size;
+void File_Contents::load_str(cz::Str contents, cz::Allocator buffers_array_allocator) {
+    char* block = allocate_block(this, contents.len, buffers_array_allocator);
+    memcpy(block, contents.buffer, contents.len);
+    set_block(this, block, contents.len, buffers_array_allocator);
+}
+
+void File_Contents::reload_str(cz::Str contents) {
+    char* block = nullptr;
+    char** old_buffers = nullptr;
+    if (storage == File_Contents_Storage::Resizable) {
+        block = buffers[0];
+        old_buffers = buffers;
+    } else if (storage == File_Contents_Storage::Heap) {
+        block = buffers[0];
+    }
+
+    block = static_cast<char*>(realloc(block, contents.len + 1));
+    CZ_ASSERT(block);
+    memcpy(block, contents.buffer, contents.len);
+    block[contents.len] = eof;
+
+    storage = File_Contents_Storage::Resizable;
     len = contents.len;
-    buffers = static_cast<char**>(allocator.alloc({sizeof(char*) * buffers_len, alignof(char*)}));
+    buffers_len = (len + buffer_size) / buffer_size;
+    buffers = static_cast<char**>(realloc(old_buffers, sizeof(char*) * buffers_len));
+    CZ_ASSERT(buffers);
+    for (size_t i = 0; i < buffers_len; ++i) {
+        buffers[i] = block + i * buffer_size;
+    }
+
+    find_first_splice();
+    validate_utf8();
+}
+
+void File_Contents::load_borrowed(const char* block,
+                                  size_t len,
+                                  cz::Allocator buffers_array_allocator) {
+    CZ_DEBUG_ASSERT(block[len] == eof);
+    storage = File_Contents_Storage::Borrowed;
+    // The lexer never writes to the buffers so they can point into read only memory.
+    set_buffers(this, const_cast<char*>(block), len, buffers_array_allocator);
+}
+
+/// Find the first backslash or question mark in `[start, end)`.
+static const char* find_splice_candidate(const char* start, const char* end) {
+#ifdef __SSE2__
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i question = _mm_set1_epi8('?');
+    for (; end - start >= 16; start += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)start);
+        __m128i matches =
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, backslash), _mm_cmpeq_epi8(chunk, question));
+        int mask = _mm_movemask_epi8(matches);
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; start < end; ++start) {
+        if (*start == '\\' || *start == '?') {
+            return start;
+        }
+    }
+    return end;
+}
+
+void File_Contents::find_first_splice() {
+    for (size_t base = 0; base < buffers_len; ++base) {
+        size_t offset = base * buffer_size;
+        size_t size = buffer_size;
+        if (size > len - offset) {
+            size = len - offset;
+        }
 
-    size_t offset = 0;
-    for (size_t i = 0; i + 1 < buffers_len; ++i, offset += File_Contents::buffer_size) {
-        size_t size = File_Contents::buffer_size;
-        char* buffer = static_cast<char*>(malloc(size));
-        buffers[i] = buffer;
-        memcpy(buffer, contents.buffer + offset, size);
+        const char* buffer = buffers[base];
+        const char* end = buffer + size;
+        for (const char* it = buffer; (it = find_splice_candidate(it, end)) != end; ++it) {
+            size_t index = offset + (it - buffer);
+            // A splice can straddle two buffers so look at the next character with `get`.
+            char next = get(index + 1);
+            if ((*it == '\\' && next == '\n') || (*it == '?' && next == '?')) {
+                first_splice = index;
+                return;
+            }
+        }
     }
 
-    if (buffers_len > 0) {
-        size_t size = len - offset;
-        char* buffer = static_cast<char*>(malloc(size + 1));
-        buffers[buffers_len - 1] = buffer;
-        memcpy(buffer, contents.buffer + offset, size);
-        buffer[size] = eof;
+    first_splice = len;
+}
+
+void File_Contents::validate_utf8() {
+    is_ascii = true;
+    // The number of bytes at the start of the buffer that belong to a sequence from the last one.
+    size_t carried = 0;
+    for (size_t base = 0; base < buffers_len; ++base) {
+        size_t offset = base * buffer_size;
+        size_t size = buffer_size;
+        if (size > len - offset) {
+            size = len - offset;
+        }
+
+        const char* buffer = buffers[base];
+        const char* end = buffer + size;
+        const char* it = buffer + carried;
+        carried = 0;
+        while ((it = utf8::find_non_ascii(it, end)) != end) {
+            is_ascii = false;
+
+            size_t index = offset + (it - buffer);
+            uint32_t code_point;
+            size_t length;
+            if (end - it >= (ptrdiff_t)utf8::max_sequence_length) {
+                length = utf8::decode(it, end, &code_point);
+            } else {
+                length = decode_utf8(index, &code_point);
+            }
+
+            if (length == 0) {
+                first_invalid_utf8 = index;
+                return;
+            }
+
+            if ((size_t)(end - it) < length) {
+                carried = length - (end - it);
+                break;
+            }
+            it += length;
+        }
     }
+
+    first_invalid_utf8 = len;
+}
+
+size_t File_Contents::decode_utf8(size_t index, uint32_t* code_point) const {
+    char sequence[utf8::max_sequence_length];
+    size_t available = 0;
+    for (; available < utf8::max_sequence_length && index + available < len; ++available) {
+        sequence[available] = get(index + available);
+    }
+    return utf8::decode(sequence, sequence + available, code_point);
 }
 
 void File_Contents::drop_buffers() {
-    for (size_t i = 0; i < buffers_len; ++i) {
-        free(buffers[i]);
+    // Pooled blocks are freed along with the buffers array allocator.
+    if (storage == File_Contents_Storage::Heap) {
+        free(buffers[0]);
+    } else if (storage == File_Contents_Storage::Resizable) {
+        free(buffers[0]);
+        free(buffers);
     }
 }
 
 void File_Contents::drop_array(cz::Allocator allocator) {
-    drop_buffers();
+    if (storage == File_Contents_Storage::Heap) {
+        free(buffers[0]);
+    } else if (storage == File_Contents_Storage::Pooled) {
+        allocator.dealloc({buffers[0], len + 1});
+    } else if (storage == File_Contents_Storage::Resizable) {
+        free(buffers[0]);
+        free(buffers);
+        return;
+    }
     allocator.dealloc({buffers, buffers_len * sizeof(char*)});
 }
 
@@ -1,12 +1,28 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 #include <cz/allocator.hpp>
 #include <cz/write.hpp>
 #include "result.hpp"
 
 namespace red {
 
+namespace File_Contents_Storage_ {
+enum File_Contents_Storage {
+    /// The block was allocated with `malloc`.
+    Heap,
+    /// The block was allocated with the buffers array allocator.
+    Pooled,
+    /// The block belongs to something that outlives the file, such as a `Header_Bundle`.
+    Borrowed,
+    /// The block and `buffers` were both allocated with `malloc` so they can be resized by
+    /// `reload_str`.
+    Resizable,
+};
+}
+using File_Contents_Storage_::File_Contents_Storage;
+
 struct File_Contents {
     static constexpr const size_t buffer_size_bits = 13;
     static constexpr const size_t buffer_size = 1 << buffer_size_bits;
@@ -17,13 +33,52 @@ struct File_Contents {
     /// 255 = 0b11111111 which is invalid utf8.
     static constexpr const char eof = 255;
 
+    /// Files up to this size are allocated with the buffers array allocator instead of `malloc`.
+    /// Most headers are this small so they share the same few big allocations.
+    static constexpr const size_t small_file_size = 1 << 15;
+
+    /// The contents are one block of `len` bytes followed by `eof`.  Each buffer points into it.
     char** buffers;
     size_t buffers_len;
     size_t len;
 
+    File_Contents_Storage storage;
+
+    /// The index of the first line splice (a backslash then a newline) or `??` that could start
+    /// a trigraph.  This is `len` if there are none, in which case the lexer doesn't look for them.
+    size_t first_splice;
+
     Result read(const char* cstr_file_name, cz::Allocator buffers_array_allocator);
     void load_str(cz::Str contents, cz::Allocator buffers_array_allocator);
 
+    /// Replace the contents with `contents`.  The first call moves the file to `Resizable`
+    /// storage and later calls reuse it so replacing the file repeatedly doesn't allocate more
+    /// memory.  A `Pooled` block isn't freed until the buffers array allocator is.
+    void reload_str(cz::Str contents);
+
+    /// Use the `len` bytes at `block`, which must be followed by `eof`, without copying them.
+    /// Unlike `read` and `load_str` this doesn't look for splices or validate UTF-8; the caller
+    /// sets `first_splice`, `is_ascii`, and `first_invalid_utf8`.
+    void load_borrowed(const char* block, size_t len, cz::Allocator buffers_array_allocator);
+
+    /// Set `first_splice`.  Called by `read` and `load_str`.
+    void find_first_splice();
+    bool is_splice_free() const { return first_splice == len; }
+
+    /// Whether every byte is ASCII.  The lexer can then skip decoding UTF-8 entirely.
+    bool is_ascii;
+
+    /// The index of the first byte that doesn't start a valid UTF-8 sequence or `len` if there
+    /// are none.  The lexer reports it if it is inside a comment or literal.
+    size_t first_invalid_utf8;
+
+    /// Set `is_ascii` and `first_invalid_utf8`.  Called by `read` and `load_str`.
+    void validate_utf8();
+
+    /// Decode the UTF-8 sequence starting at `index`, which may straddle buffers.  Returns its
+    /// length or 0 if it is invalid.
+    size_t decode_utf8(size_t index, uint32_t* code_point) const;
+
     void drop_buffers();
     void drop_array(cz::Allocator buffers_array_allocator);
 
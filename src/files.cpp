@@ -1,18 +1,51 @@
 #include "files.hpp"
 
+#include <cz/assert.hpp>
 #include <cz/heap.hpp>
 #include "file.hpp"
+#include "header_bundle.hpp"
+#include "include_prefetcher.hpp"
+#include "virtual_files.hpp"
 
 namespace red {
 
 void Files::destroy() {
     for (size_t i = 0; i < files.len(); ++i) {
-        files[i].contents.drop_buffers();
+        files[i].drop();
     }
     files.drop(cz::heap_allocator());
     file_path_hashes.drop(cz::heap_allocator());
     file_array_buffer_array.drop();
     file_path_buffer_array.drop();
+
+    if (prefetcher) {
+        prefetcher->stop();
+        prefetcher->~Include_Prefetcher();
+        cz::heap_allocator().dealloc({prefetcher, sizeof(Include_Prefetcher)});
+        prefetcher = nullptr;
+    }
+
+    if (bundle) {
+        bundle->close();
+        cz::heap_allocator().dealloc({bundle, sizeof(Header_Bundle)});
+        bundle = nullptr;
+    }
+
+    if (virtual_files) {
+        virtual_files->drop();
+        cz::heap_allocator().dealloc({virtual_files, sizeof(Virtual_Files)});
+        virtual_files = nullptr;
+    }
+}
+
+Virtual_Files* Files::get_virtual_files() {
+    if (!virtual_files) {
+        virtual_files = static_cast<Virtual_Files*>(
+            cz::heap_allocator().alloc({sizeof(Virtual_Files), alignof(Virtual_Files)}));
+        CZ_ASSERT(virtual_files);
+        virtual_files->init();
+    }
+    return virtual_files;
 }
 
 }
@@ -7,6 +7,9 @@
 
 namespace red {
 struct File;
+struct Header_Bundle;
+struct Include_Prefetcher;
+struct Virtual_Files;
 
 struct Files {
     /// Used for file paths and the buffer array in `File_Contents`.
@@ -15,11 +18,29 @@ struct Files {
     cz::Vector<File> files;
     cz::Vector<cz::Hash> file_path_hashes;
 
+    /// Loads includes ahead of the preprocessor if `Options::prefetch_includes` is set.  Files
+    /// may have been taken from it so it is stopped after they are dropped.
+    Include_Prefetcher* prefetcher;
+
+    /// Files under the bundled directories are loaded from here if `Options::header_bundle` is
+    /// set.  Files point into it so it is closed after they are dropped.
+    Header_Bundle* bundle;
+
+    /// Files that are loaded from memory before anything else is checked.  Null until
+    /// `get_virtual_files` is called.
+    Virtual_Files* virtual_files;
+
     void init() {
         file_path_buffer_array.create();
         file_array_buffer_array.create();
+        prefetcher = nullptr;
+        bundle = nullptr;
+        virtual_files = nullptr;
     }
     void destroy();
+
+    /// Get `virtual_files`, creating it if it doesn't exist yet.
+    Virtual_Files* get_virtual_files();
 };
 
 }
@@ -0,0 +1,364 @@
+#include "header_bundle.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <Tracy.hpp>
+#include <cz/buffer_array.hpp>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/str_map.hpp>
+#include <cz/vector.hpp>
+#include "context.hpp"
+#include "file_contents.hpp"
+#include "hashed_str.hpp"
+#include "load.hpp"
+
+namespace red {
+
+static const char header_bundle_magic[4] = {'R', 'H', 'D', 'R'};
+
+/// The size of one record in each section.
+static const size_t section_element_sizes[Header_Bundle_Section::Count] = {
+    1,                             // Strings
+    sizeof(Header_Bundle_String),  // Roots
+    sizeof(Header_Bundle_Slot),    // Slots
+};
+
+/// Directories nested deeper than this aren't bundled.  This stops symbolic link cycles.
+static const size_t max_directory_depth = 32;
+
+namespace {
+struct Header_Bundle_Writer {
+    cz::String strings;
+    cz::Vector<Header_Bundle_String> roots;
+    cz::Vector<Header_Bundle_Slot> files;
+    /// The paths that have been bundled.  An include directory can be listed twice.
+    cz::Str_Map<bool> paths;
+    /// Stores the keys of `paths`.
+    cz::Buffer_Array path_buffer_array;
+
+    void drop() {
+        path_buffer_array.drop();
+        strings.drop(cz::heap_allocator());
+        roots.drop(cz::heap_allocator());
+        files.drop(cz::heap_allocator());
+        paths.drop(cz::heap_allocator());
+    }
+};
+}
+
+static Header_Bundle_String add_string(Header_Bundle_Writer* writer, cz::Str str) {
+    Header_Bundle_String string;
+    string.offset = writer->strings.len();
+    string.len = str.len;
+    writer->strings.reserve(cz::heap_allocator(), str.len);
+    writer->strings.append(str);
+    return string;
+}
+
+static void add_file(Header_Bundle_Writer* writer, cz::Str path) {
+    cz::Hash hash = Hashed_Str::hash_str(path);
+    if (writer->paths.get(path, hash)) {
+        return;
+    }
+
+    File_Contents contents = {};
+    if (contents.read(path.buffer, cz::heap_allocator()).is_err()) {
+        return;
+    }
+    CZ_DEFER(contents.drop_array(cz::heap_allocator()));
+
+    Header_Bundle_Slot slot = {};
+    slot.hash = hash;
+    slot.path = add_string(writer, path);
+    // The contents are one block followed by `eof` so they can be copied all at once.
+    slot.contents = add_string(writer, {contents.buffers[0], contents.len + 1});
+    --slot.contents.len;
+    slot.first_splice = contents.first_splice;
+    slot.first_invalid_utf8 = contents.first_invalid_utf8;
+    slot.is_ascii = contents.is_ascii;
+
+    writer->files.reserve(cz::heap_allocator(), 1);
+    writer->files.push(slot);
+
+    // `path` is reused by the caller so copy it.
+    cz::Slice<char> key = writer->path_buffer_array.allocator().duplicate(
+        cz::Slice<const char>{path.buffer, path.len});
+    writer->paths.reserve(cz::heap_allocator(), 1);
+    writer->paths.insert({key.elems, key.len}, hash, true);
+}
+
+/// Bundle the files in `root/relative` and its subdirectories.  `relative` is empty or ends in
+/// a `/`.
+static void add_directory(Header_Bundle_Writer* writer,
+                          cz::Str root,
+                          cz::String* relative,
+                          size_t depth) {
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+    make_include_path(root, *relative, cz::heap_allocator(), &path);
+
+    DIR* dir = opendir(path.buffer());
+    if (!dir) {
+        return;
+    }
+    CZ_DEFER(closedir(dir));
+
+    size_t relative_len = relative->len();
+    while (struct dirent* entry = readdir(dir)) {
+        cz::Str name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        relative->set_len(relative_len);
+        relative->reserve(cz::heap_allocator(), name.len + 1);
+        relative->append(name);
+        make_include_path(root, *relative, cz::heap_allocator(), &path);
+
+        // Follow symbolic links like opening the file would.
+        struct stat stat;
+        if (::stat(path.buffer(), &stat) < 0) {
+            continue;
+        }
+
+        if (S_ISDIR(stat.st_mode)) {
+            if (depth + 1 < max_directory_depth) {
+                relative->push('/');
+                add_directory(writer, root, relative, depth + 1);
+            }
+        } else if (S_ISREG(stat.st_mode)) {
+            add_file(writer, path);
+        }
+    }
+    relative->set_len(relative_len);
+}
+
+static void add_section(cz::String* out,
+                        Header_Bundle_Header* header,
+                        Header_Bundle_Section section,
+                        const void* elems,
+                        size_t count) {
+    size_t bytes = count * section_element_sizes[section];
+    header->sections[section].offset = out->len();
+    header->sections[section].count = count;
+    out->reserve(cz::heap_allocator(), bytes + 8);
+    out->append({(const char*)elems, bytes});
+    while (out->len() % 8 != 0) {
+        out->push('\0');
+    }
+}
+
+Result serialize_header_bundle(cz::Slice<const cz::Str> include_paths, cz::String* out) {
+    ZoneScoped;
+
+    Header_Bundle_Writer writer = {};
+    writer.path_buffer_array.create();
+    CZ_DEFER(writer.drop());
+
+    cz::String relative = {};
+    CZ_DEFER(relative.drop(cz::heap_allocator()));
+    cz::String root = {};
+    CZ_DEFER(root.drop(cz::heap_allocator()));
+    for (size_t i = 0; i < include_paths.len; ++i) {
+        // Make the root the way `make_include_path` spells the directory so `covers` can
+        // compare prefixes.  Directories that don't exist are still roots since nothing can be
+        // included from them.
+        make_include_path(include_paths[i], "x", cz::heap_allocator(), &root);
+        writer.roots.reserve(cz::heap_allocator(), 1);
+        writer.roots.push(add_string(&writer, {root.buffer(), root.len() - 1}));
+
+        relative.set_len(0);
+        add_directory(&writer, include_paths[i], &relative, 0);
+    }
+
+    // Keep the table at most half full.
+    size_t slot_count = 1;
+    while (slot_count < writer.files.len() * 2) {
+        slot_count *= 2;
+    }
+    cz::Vector<Header_Bundle_Slot> slots = {};
+    CZ_DEFER(slots.drop(cz::heap_allocator()));
+    slots.reserve(cz::heap_allocator(), slot_count);
+    for (size_t i = 0; i < slot_count; ++i) {
+        slots.push({});
+    }
+    for (size_t i = 0; i < writer.files.len(); ++i) {
+        const Header_Bundle_Slot& file = writer.files[i];
+        size_t index = file.hash & (slot_count - 1);
+        while (slots[index].path.len != 0) {
+            index = (index + 1) & (slot_count - 1);
+        }
+        slots[index] = file;
+    }
+
+    Header_Bundle_Header header = {};
+    memcpy(header.magic, header_bundle_magic, sizeof(header.magic));
+    header.version = Header_Bundle_Header::current_version;
+
+    out->set_len(0);
+    out->reserve(cz::heap_allocator(), sizeof(header) + 8);
+    out->append({(const char*)&header, sizeof(header)});
+    while (out->len() % 8 != 0) {
+        out->push('\0');
+    }
+
+    add_section(out, &header, Header_Bundle_Section::Strings, writer.strings.buffer(),
+                writer.strings.len());
+    add_section(out, &header, Header_Bundle_Section::Roots, writer.roots.elems(),
+                writer.roots.len());
+    add_section(out, &header, Header_Bundle_Section::Slots, slots.elems(), slots.len());
+
+    memcpy(out->buffer(), &header, sizeof(header));
+    return Result::ok();
+}
+
+Result write_header_bundle(Context* context,
+                           cz::Slice<const cz::Str> include_paths,
+                           const char* path) {
+    ZoneScoped;
+
+    cz::String encoded = {};
+    CZ_DEFER(encoded.drop(cz::heap_allocator()));
+    CZ_TRY(serialize_header_bundle(include_paths, &encoded));
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        context->report_error_unspanned("Could not open header bundle for writing");
+        return Result::last_system_error();
+    }
+    CZ_DEFER(fclose(file));
+
+    if (fwrite(encoded.buffer(), 1, encoded.len(), file) != encoded.len()) {
+        context->report_error_unspanned("Could not write header bundle");
+        return {Result::ErrorFile};
+    }
+    return Result::ok();
+}
+
+Result Header_Bundle::open(const char* path) {
+    ZoneScoped;
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return Result::last_system_error();
+    }
+    CZ_DEFER(::close(fd));
+
+    struct stat stat;
+    if (fstat(fd, &stat) < 0) {
+        return Result::last_system_error();
+    }
+
+    size_t size = (size_t)stat.st_size;
+    if (size == 0) {
+        return {Result::ErrorInvalidInput};
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return Result::last_system_error();
+    }
+
+    if (!load(mapping, size)) {
+        munmap(mapping, size);
+        return {Result::ErrorInvalidInput};
+    }
+
+    mapped = true;
+    return Result::ok();
+}
+
+void Header_Bundle::close() {
+    if (mapped) {
+        munmap((void*)data, len);
+        mapped = false;
+    }
+    data = nullptr;
+    len = 0;
+}
+
+bool Header_Bundle::load(const void* data_, size_t len_) {
+    data = nullptr;
+    len = 0;
+    mapped = false;
+
+    if ((uintptr_t)data_ % 8 != 0 || len_ < sizeof(Header_Bundle_Header)) {
+        return false;
+    }
+
+    const Header_Bundle_Header* header = (const Header_Bundle_Header*)data_;
+    if (memcmp(header->magic, header_bundle_magic, sizeof(header->magic)) != 0) {
+        return false;
+    }
+    if (header->version != Header_Bundle_Header::current_version) {
+        return false;
+    }
+
+    for (size_t i = 0; i < Header_Bundle_Section::Count; ++i) {
+        const Header_Bundle_Section_Header& section = header->sections[i];
+        if (section.offset % 8 != 0 || section.offset > len_) {
+            return false;
+        }
+        if (section.count > (len_ - section.offset) / section_element_sizes[i]) {
+            return false;
+        }
+    }
+
+    uint64_t slot_count = header->sections[Header_Bundle_Section::Slots].count;
+    if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0) {
+        return false;
+    }
+
+    data = (const char*)data_;
+    len = len_;
+    return true;
+}
+
+const Header_Bundle_Slot* Header_Bundle::find(cz::Str path, cz::Hash hash) const {
+    cz::Slice<const Header_Bundle_Slot> slots =
+        section<Header_Bundle_Slot>(Header_Bundle_Section::Slots);
+    size_t mask = slots.len - 1;
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+        const Header_Bundle_Slot& slot = slots[index];
+        if (slot.path.len == 0) {
+            return nullptr;
+        }
+        if (slot.hash == hash && string(slot.path) == path) {
+            return &slot;
+        }
+    }
+}
+
+bool Header_Bundle::covers(cz::Str path) const {
+    cz::Slice<const Header_Bundle_String> roots =
+        section<Header_Bundle_String>(Header_Bundle_Section::Roots);
+    for (size_t i = 0; i < roots.len; ++i) {
+        cz::Str root = string(roots[i]);
+        if (root.ends_with("/")) {
+            --root.len;
+        }
+        // Match whole directories so `/root2/a.h` isn't inside `/root`.
+        if (path.starts_with(root) && (path.len == root.len || path[root.len] == '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Header_Bundle::load_file(const Header_Bundle_Slot& slot,
+                              File_Contents* file_contents,
+                              cz::Allocator buffers_array_allocator) const {
+    cz::Str contents = string(slot.contents);
+    file_contents->load_borrowed(contents.buffer, contents.len, buffers_array_allocator);
+    file_contents->first_splice = slot.first_splice;
+    file_contents->first_invalid_utf8 = slot.first_invalid_utf8;
+    file_contents->is_ascii = slot.is_ascii;
+}
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cz/allocator.hpp>
+#include <cz/hash.hpp>
+#include <cz/slice.hpp>
+#include <cz/str.hpp>
+#include <cz/string.hpp>
+#include "result.hpp"
+
+namespace red {
+struct Context;
+struct File_Contents;
+
+/// A single file holding every file under a set of include directories so they can be loaded
+/// from one mapping instead of being looked up and read one by one.
+///
+/// The file starts with a `Header_Bundle_Header` followed by the sections it lists, each aligned
+/// to 8 bytes.  Files are found by their absolute path in an open addressed hash table of
+/// `Header_Bundle_Slot`s.  The paths are the ones `make_include_path` produces so lookups match
+/// the paths `process_include` tries exactly.
+///
+/// All integers are stored in the byte order of the machine that wrote the file.
+namespace Header_Bundle_Section_ {
+enum Header_Bundle_Section : uint32_t {
+    /// The bytes of the paths and the contents of the files.  The count is in bytes.
+    Strings,
+    /// `Header_Bundle_String` for each bundled directory, ending in a `/`.
+    Roots,
+    /// `Header_Bundle_Slot`.  The count is a power of two.
+    Slots,
+    Count,
+};
+}
+using Header_Bundle_Section_::Header_Bundle_Section;
+
+struct Header_Bundle_Section_Header {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct Header_Bundle_Header {
+    static constexpr const uint32_t current_version = 1;
+
+    char magic[4];
+    uint32_t version;
+    Header_Bundle_Section_Header sections[Header_Bundle_Section::Count];
+};
+
+/// A range of `Strings`.
+struct Header_Bundle_String {
+    uint64_t offset;
+    uint64_t len;
+};
+
+struct Header_Bundle_Slot {
+    /// `Hashed_Str::hash_str` of the path.
+    uint64_t hash;
+    /// The absolute path of the file.  Empty if the slot is unused.
+    Header_Bundle_String path;
+    /// The contents of the file.  They are followed by `File_Contents::eof`.
+    Header_Bundle_String contents;
+    /// The results of scanning the contents when the bundle was made.  See `File_Contents`.
+    uint64_t first_splice;
+    uint64_t first_invalid_utf8;
+    uint64_t is_ascii;
+};
+
+/// Bundle every file under `include_paths`.  `out` is allocated with the heap.
+Result serialize_header_bundle(cz::Slice<const cz::Str> include_paths, cz::String* out);
+
+/// Bundle every file under `include_paths` into the file at `path`.
+Result write_header_bundle(Context* context,
+                           cz::Slice<const cz::Str> include_paths,
+                           const char* path);
+
+/// A view of a bundle.
+struct Header_Bundle {
+    const char* data;
+    size_t len;
+    /// Set if `data` was mapped by `open` and must be unmapped by `close`.
+    bool mapped;
+
+    /// Map the file at `path` and `load` it.
+    Result open(const char* path);
+    void close();
+
+    /// Use `data` as the bundle without copying it.  `data` must be aligned to 8 bytes.  The
+    /// header and section bounds are checked but the records themselves are not.
+    bool load(const void* data, size_t len);
+
+    const Header_Bundle_Header* header() const { return (const Header_Bundle_Header*)data; }
+
+    template <class T>
+    cz::Slice<const T> section(Header_Bundle_Section section) const {
+        const Header_Bundle_Section_Header& entry = header()->sections[section];
+        return {(const T*)(data + entry.offset), (size_t)entry.count};
+    }
+
+    cz::Str string(Header_Bundle_String string) const {
+        return {data + header()->sections[Header_Bundle_Section::Strings].offset + string.offset,
+                (size_t)string.len};
+    }
+
+    /// Find the file at `path`.
+    const Header_Bundle_Slot* find(cz::Str path, cz::Hash hash) const;
+
+    /// Is `path` inside one of the bundled directories?  If so and `find` fails then the file
+    /// didn't exist when the bundle was made.
+    bool covers(cz::Str path) const;
+
+    /// Point `file_contents` at the contents of `slot` in place.
+    void load_file(const Header_Bundle_Slot& slot,
+                   File_Contents* file_contents,
+                   cz::Allocator buffers_array_allocator) const;
+};
+
+}
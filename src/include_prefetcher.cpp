@@ -0,0 +1,255 @@
+#include "include_prefetcher.hpp"
+
+#include <string.h>
+#include <Tracy.hpp>
+#include <cz/assert.hpp>
+#include <cz/heap.hpp>
+#include <cz/path.hpp>
+#include <cz/string.hpp>
+#include "hashed_str.hpp"
+#include "load.hpp"
+
+namespace red {
+
+static bool is_blank(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+void scan_includes(const File_Contents& contents, cz::Vector<Include_Spelling>* spellings) {
+    ZoneScoped;
+
+    // The file is one block so it can be searched directly.
+    const char* start = contents.buffers[0];
+    const char* end = start + contents.len;
+    for (const char* it = start; (it = (const char*)memchr(it, '#', end - it)); ++it) {
+        // The `#` must be the first thing on its line.
+        const char* before = it;
+        while (before > start && is_blank(before[-1])) {
+            --before;
+        }
+        if (before > start && before[-1] != '\n') {
+            continue;
+        }
+
+        const char* point = it + 1;
+        while (point < end && is_blank(*point)) {
+            ++point;
+        }
+        if (end - point < 7 || memcmp(point, "include", 7) != 0) {
+            continue;
+        }
+        point += 7;
+        while (point < end && is_blank(*point)) {
+            ++point;
+        }
+        if (point == end || (*point != '<' && *point != '"')) {
+            continue;
+        }
+
+        char target = *point == '<' ? '>' : '"';
+        const char* path_start = point + 1;
+        const char* path_end = path_start;
+        while (path_end < end && *path_end != target && *path_end != '\n') {
+            ++path_end;
+        }
+        if (path_end == end || *path_end != target) {
+            continue;
+        }
+
+        spellings->reserve(cz::heap_allocator(), 1);
+        spellings->push({{path_start, (size_t)(path_end - path_start)}, target == '>'});
+        it = path_end;
+    }
+}
+
+static cz::Str duplicate(cz::Allocator allocator, cz::Str str) {
+    cz::Slice<char> copy = allocator.duplicate(cz::Slice<const char>{str.buffer, str.len});
+    return {copy.elems, copy.len};
+}
+
+/// Queue the includes of the file at `path`.  The mutex must be held.
+static void push_requests(Include_Prefetcher* prefetcher,
+                          cz::Str path,
+                          cz::Slice<const Include_Spelling> spellings) {
+    cz::Allocator allocator = prefetcher->path_buffer_array.allocator();
+    cz::Option<cz::Str> directory = cz::path::directory_component(path);
+    cz::Str stored_directory =
+        duplicate(allocator, directory.is_present ? directory.value : cz::Str());
+
+    // The requests are a stack so push them backwards to load them in the order they're
+    // included.  The includes of the first file are then pushed on top of the rest, so the
+    // include graph is walked in the same order as the preprocessor walks it.
+    prefetcher->requests.reserve(cz::heap_allocator(), spellings.len);
+    for (size_t i = spellings.len; i-- > 0;) {
+        Include_Prefetcher::Request request;
+        request.directory = stored_directory;
+        request.spelling.relative_path = duplicate(allocator, spellings[i].relative_path);
+        request.spelling.angled = spellings[i].angled;
+        prefetcher->requests.push(request);
+    }
+}
+
+/// Try each place `process_include` would look for the file and load the first that exists.
+static void resolve(Include_Prefetcher* prefetcher,
+                    const Include_Prefetcher::Request& request,
+                    cz::String* path,
+                    cz::Vector<Include_Spelling>* spellings) {
+    ZoneScoped;
+
+    size_t count = prefetcher->include_paths.len;
+    for (size_t i = count + 1; i-- > 0;) {
+        cz::Str include_path;
+        if (i == count) {
+            if (request.spelling.angled) {
+                continue;
+            }
+            include_path = request.directory;
+        } else {
+            include_path = prefetcher->include_paths[i];
+        }
+
+        make_include_path(include_path, request.spelling.relative_path, cz::heap_allocator(),
+                          path);
+        cz::Hash hash = Hashed_Str::hash_str(*path);
+
+        {
+            std::lock_guard<std::mutex> lock(prefetcher->mutex);
+            Include_Prefetcher::Entry* entry = prefetcher->entries.get(*path, hash);
+            if (entry) {
+                if (entry->result == Prefetch_Result::Missing) {
+                    continue;
+                }
+                // The file was loaded by either us or the preprocessor.
+                return;
+            }
+        }
+
+        File_Contents contents;
+        bool loaded =
+            contents.read(path->buffer(), prefetcher->contents_buffer_array.allocator()).is_ok();
+
+        cz::Str key;
+        {
+            std::lock_guard<std::mutex> lock(prefetcher->mutex);
+            if (prefetcher->entries.get(*path, hash)) {
+                // The preprocessor got to the file while it was being read.
+                if (loaded) {
+                    contents.drop_buffers();
+                }
+                return;
+            }
+
+            Include_Prefetcher::Entry entry;
+            entry.result = loaded ? Prefetch_Result::Loaded : Prefetch_Result::Missing;
+            entry.contents = contents;
+            key = duplicate(prefetcher->path_buffer_array.allocator(), *path);
+            prefetcher->entries.reserve(cz::heap_allocator(), 1);
+            prefetcher->entries.insert(key, hash, entry);
+        }
+
+        if (loaded) {
+            // The preprocessor may take the file now but it won't modify it.
+            spellings->set_len(0);
+            scan_includes(contents, spellings);
+            std::lock_guard<std::mutex> lock(prefetcher->mutex);
+            push_requests(prefetcher, key, *spellings);
+            return;
+        }
+    }
+}
+
+static void run_prefetcher(Include_Prefetcher* prefetcher) {
+    ZoneScoped;
+
+    cz::String path = {};
+    cz::Vector<Include_Spelling> spellings = {};
+    while (1) {
+        Include_Prefetcher::Request request;
+        {
+            std::unique_lock<std::mutex> lock(prefetcher->mutex);
+            prefetcher->condition.wait(lock, [&]() {
+                return prefetcher->stopping || prefetcher->requests.len() > 0;
+            });
+            if (prefetcher->stopping) {
+                break;
+            }
+            request = prefetcher->requests.pop();
+        }
+
+        resolve(prefetcher, request, &path, &spellings);
+    }
+
+    path.drop(cz::heap_allocator());
+    spellings.drop(cz::heap_allocator());
+}
+
+void Include_Prefetcher::start(cz::Slice<const cz::Str> include_paths) {
+    this->include_paths = include_paths;
+    requests = {};
+    entries = {};
+    path_buffer_array.create();
+    contents_buffer_array.create();
+    stopping = false;
+    thread = std::thread(run_prefetcher, this);
+}
+
+void Include_Prefetcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_one();
+    thread.join();
+
+    for (size_t i = 0; i < entries.cap; ++i) {
+        if (entries.is_present(i) && entries.values[i].result == Prefetch_Result::Loaded) {
+            entries.values[i].contents.drop_buffers();
+        }
+    }
+    entries.drop(cz::heap_allocator());
+    requests.drop(cz::heap_allocator());
+    path_buffer_array.drop();
+    contents_buffer_array.drop();
+}
+
+void Include_Prefetcher::scan(cz::Str path, const File_Contents& contents) {
+    ZoneScoped;
+
+    cz::Vector<Include_Spelling> spellings = {};
+    scan_includes(contents, &spellings);
+    if (spellings.len() > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        push_requests(this, path, spellings);
+    }
+    spellings.drop(cz::heap_allocator());
+    condition.notify_one();
+}
+
+Prefetch_Result Include_Prefetcher::take(cz::Str path, cz::Hash hash, File_Contents* contents) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry* entry = entries.get(path, hash);
+    if (!entry) {
+        // Claim the file so the thread doesn't load it too.
+        Entry claimed = {};
+        claimed.result = Prefetch_Result::Unknown;
+        entries.reserve(cz::heap_allocator(), 1);
+        entries.insert(duplicate(path_buffer_array.allocator(), path), hash, claimed);
+        return Prefetch_Result::Unknown;
+    }
+
+    Prefetch_Result result = entry->result;
+    if (result == Prefetch_Result::Loaded) {
+        *contents = entry->contents;
+        entry->result = Prefetch_Result::Unknown;
+    }
+    return result;
+}
+
+void Include_Prefetcher::set_missing(cz::Str path, cz::Hash hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry* entry = entries.get(path, hash);
+    CZ_DEBUG_ASSERT(entry && entry->result == Prefetch_Result::Unknown);
+    entry->result = Prefetch_Result::Missing;
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cz/buffer_array.hpp>
+#include <cz/hash.hpp>
+#include <cz/slice.hpp>
+#include <cz/str.hpp>
+#include <cz/str_map.hpp>
+#include <cz/vector.hpp>
+#include "file_contents.hpp"
+
+namespace red {
+
+namespace Prefetch_Result_ {
+enum Prefetch_Result {
+    /// The prefetcher loaded the file.
+    Loaded,
+    /// The prefetcher tried to load the file and it doesn't exist.
+    Missing,
+    /// The prefetcher hasn't gotten to the file.  The caller must load it itself.
+    Unknown,
+};
+}
+using Prefetch_Result_::Prefetch_Result;
+
+/// An `#include` found by `scan_includes`.
+struct Include_Spelling {
+    /// The text between the `<>` or `""`.
+    cz::Str relative_path;
+    bool angled;
+};
+
+/// Find the `#include <...>` and `#include "..."` lines in `contents` without preprocessing it.
+/// Includes inside comments or skipped conditionals are found too and includes spelled with
+/// macros or line splices are missed; this is only used to guess what will be loaded next.
+void scan_includes(const File_Contents& contents, cz::Vector<Include_Spelling>* spellings);
+
+/// Loads the files that are likely to be `#include`d on a background thread before the
+/// preprocessor reaches them.
+///
+/// Each file the preprocessor loads is scanned for includes.  The thread resolves them the
+/// same way `process_include` does, reads the files, and scans those in turn, so it walks the
+/// include graph ahead of the preprocessor.  `include_file` then calls `take` before touching
+/// the disk.  Paths found to not exist are remembered so the include path search doesn't probe
+/// them again.
+struct Include_Prefetcher {
+    struct Request {
+        /// The directory of the including file.
+        cz::Str directory;
+        Include_Spelling spelling;
+    };
+
+    /// `Unknown` once the preprocessor has taken the file or loaded it itself.
+    struct Entry {
+        Prefetch_Result result;
+        File_Contents contents;
+    };
+
+    /// The include paths in the order `Options::include_paths` lists them.  These are borrowed so
+    /// the prefetcher must be stopped before they are destroyed.
+    cz::Slice<const cz::Str> include_paths;
+
+    /// Guards everything below but `contents_buffer_array`.
+    std::mutex mutex;
+    std::condition_variable condition;
+    cz::Vector<Request> requests;
+    /// Files by their absolute path.
+    cz::Str_Map<Entry> entries;
+    /// Stores the paths of the requests and entries.
+    cz::Buffer_Array path_buffer_array;
+    bool stopping;
+
+    /// Used for the files the thread loads.  Only the thread touches it.  It must outlive the
+    /// files taken from the prefetcher.
+    cz::Buffer_Array contents_buffer_array;
+
+    std::thread thread;
+
+    void start(cz::Slice<const cz::Str> include_paths);
+
+    /// Stop the thread and free everything, including the files that were taken, so they must
+    /// no longer be used.
+    void stop();
+
+    /// Queue the includes in a file the preprocessor loaded itself.
+    void scan(cz::Str path, const File_Contents& contents);
+
+    /// Get the file at `path` if it has been prefetched.  Afterwards the prefetcher won't load
+    /// it.
+    Prefetch_Result take(cz::Str path, cz::Hash hash, File_Contents* contents);
+
+    /// Record that a file `take` returned `Unknown` for doesn't exist.
+    void set_missing(cz::Str path, cz::Hash hash);
+};
+
+}
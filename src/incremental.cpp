@@ -0,0 +1,425 @@
+#include "incremental.hpp"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <Tracy.hpp>
+#include <chrono>
+#include <utility>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/path.hpp>
+#include <cz/try.hpp>
+#include "compiler.hpp"
+#include "context.hpp"
+#include "file.hpp"
+#include "file_contents.hpp"
+#include "hashed_str.hpp"
+#include "load.hpp"
+#include "result.hpp"
+
+namespace red {
+
+static void init_parser(parse::Parser* parser) {
+    parser->init();
+    parser->fold_constants = true;
+    // Reparsed bodies are lexed from versions of the file that are reloaded later.
+    parser->declarations.copy_names = true;
+    parser->types.copy_names = true;
+}
+
+Result Incremental_Parse::init(Context* context, cz::Str file_path, cz::Str contents) {
+    this->file_path = {};
+    this->file_path.reserve(cz::heap_allocator(), file_path.len);
+    this->file_path.append(file_path);
+
+    this->contents = {};
+    this->contents.reserve(cz::heap_allocator(), contents.len);
+    this->contents.append(contents);
+
+    init_parser(&parser);
+    return parse_all(context);
+}
+
+static void drop_body_arenas(cz::Slice<Function_Body> bodies) {
+    for (size_t i = 0; i < bodies.len; ++i) {
+        if (bodies[i].arena) {
+            bodies[i].arena->drop();
+            cz::heap_allocator().dealloc({bodies[i].arena, sizeof(parse::Ast_Arena)});
+        }
+    }
+}
+
+void Incremental_Parse::drop() {
+    drop_body_arenas(bodies);
+    parser.drop();
+    file_path.drop(cz::heap_allocator());
+    initializers.drop(cz::heap_allocator());
+    contents.drop(cz::heap_allocator());
+    bodies.drop(cz::heap_allocator());
+}
+
+static void reset_context(Context* context) {
+    context->files.destroy();
+    context->files = {};
+    context->files.init();
+
+    context->errors.set_len(0);
+    context->unspanned_errors.set_len(0);
+    context->error_message_buffer_array.drop();
+    context->error_message_buffer_array.create();
+}
+
+/// Load the current contents as a new version of the main file.
+static size_t push_file_version(Context* context, Incremental_Parse* incremental, Hashed_Str path) {
+    File_Contents file_contents;
+    file_contents.load_str(incremental->contents,
+                           context->files.file_array_buffer_array.allocator());
+    include_file_reserve(&context->files, &incremental->parser.preprocessor);
+    force_include_file(&context->files, &incremental->parser.preprocessor, path, file_contents);
+    return context->files.files.len() - 1;
+}
+
+Result Incremental_Parse::parse_all(Context* context) {
+    ZoneScoped;
+
+    if (full_reparses > 0) {
+        parser.drop();
+        parser = {};
+        init_parser(&parser);
+        reset_context(context);
+    }
+    ++full_reparses;
+
+    initializers.set_len(0);
+    drop_body_arenas(bodies);
+    bodies.set_len(0);
+
+    add_builtin_definitions(context, &parser);
+
+    cz::String path = {};
+    path.reserve(context->files.file_path_buffer_array.allocator(), file_path.len() + 1);
+    path.append(file_path);
+    path.null_terminate();
+    file = push_file_version(context, this, Hashed_Str::from_str(path));
+
+    Result result;
+    while (1) {
+        Function_Body body = {};
+        body.declarations_end = parser.declarations.bindings.len();
+        body.definitions_version = parser.preprocessor.definitions_version;
+        parser.last_function_definition = nullptr;
+
+        result = parse_declaration(context, &parser, &initializers);
+        if (result.type != Result::Success) {
+            break;
+        }
+
+        parse::Function_Definition* function_definition = parser.last_function_definition;
+        if (!function_definition) {
+            continue;
+        }
+
+        // Only bodies written directly in the main file can be reparsed.
+        Span span = function_definition->block_span;
+        if (span.start.file != file || span.end.file != file ||
+            contents[span.start.index] != '{' || contents[span.end.index - 1] != '}') {
+            continue;
+        }
+
+        body.function_definition = function_definition;
+        body.function_type = parser.last_function_type;
+        body.start = span.start;
+        body.end = span.end.index;
+        body.file = file;
+        body.types_end = parser.types.bindings.len();
+        bodies.reserve(cz::heap_allocator(), 1);
+        bodies.push(body);
+    }
+
+    if (result.is_err()) {
+        return result;
+    }
+    return Result::ok();
+}
+
+/// Remove errors reported while parsing `span`.
+static void remove_errors_in(Context* context, Span span) {
+    size_t j = 0;
+    for (size_t i = 0; i < context->errors.len(); ++i) {
+        Span error = context->errors[i].source_span;
+        if (error.start.file == span.start.file && error.start.index >= span.start.index &&
+            error.start.index < span.end.index) {
+            continue;
+        }
+        context->errors[j++] = context->errors[i];
+    }
+    context->errors.set_len(j);
+}
+
+static void clear_lookahead(parse::Parser* parser) {
+    for (size_t i = 0; i < 4; ++i) {
+        parser->pairs[i].token.type = Token::Parser_Null_Token;
+    }
+}
+
+/// Try to reparse only `body` after an edit inside of it.  If this fails the parser's state is
+/// unspecified and the entire file must be reparsed.
+static bool reparse_body(Context* context, Incremental_Parse* incremental, Function_Body* body,
+                         size_t new_end) {
+    ZoneScoped;
+
+    parse::Parser* parser = &incremental->parser;
+    if (body->definitions_version != parser->preprocessor.definitions_version ||
+        parser->preprocessor.include_stack.len() != 0 ||
+        parser->preprocessor.definition_stack.len() != 0) {
+        return false;
+    }
+
+    // Directives inside the body would be run again.
+    cz::Str text = incremental->contents;
+    if (memchr(text.buffer + body->start.index, '#', new_end - body->start.index)) {
+        return false;
+    }
+
+    remove_errors_in(context, body->function_definition->block_span);
+
+    size_t version = body->file;
+    if (version == incremental->file) {
+        Hashed_Str path = {context->files.files[incremental->file].path,
+                           context->files.file_path_hashes[incremental->file]};
+        version = push_file_version(context, incremental, path);
+        body->file = version;
+    } else {
+        // Nothing outside of the body refers to its version so replace it in place.
+        File* file = &context->files.files[version];
+        file->contents.reload_str(incremental->contents);
+        file->line_starts.set_len(0);
+
+        pre::Include_Info entry = {};
+        entry.span.start.file = version;
+        entry.span.end.file = version;
+        parser->preprocessor.include_stack.reserve(cz::heap_allocator(), 1);
+        parser->preprocessor.include_stack.push(entry);
+    }
+    pre::Include_Info* info = &parser->preprocessor.include_stack.last();
+    info->span.start = body->start;
+    info->span.start.file = version;
+    info->span.end = info->span.start;
+
+    parser->declarations.hidden_start = body->declarations_end;
+    parser->declarations.hidden_end = parser->declarations.bindings.len();
+    parser->types.hidden_start = body->types_end;
+    parser->types.hidden_end = parser->types.bindings.len();
+    CZ_DEFER({
+        parser->declarations.hidden_start = parser->declarations.hidden_end = 0;
+        parser->types.hidden_start = parser->types.hidden_end = 0;
+    });
+
+    // The old nodes are unreachable once the body is reparsed.  Clear the statistics too so they
+    // only count the current body.
+    if (body->arena) {
+        body->arena->reset();
+        body->arena->stats = {};
+    } else {
+        body->arena = cz::heap_allocator().create<parse::Ast_Arena>();
+        body->arena->init();
+    }
+
+    clear_lookahead(parser);
+    parser->body_arena = body->arena;
+    std::swap(parser->ast_arena, *parser->body_arena);
+    parser->in_body_arena = true;
+    Result result =
+        parse_function_body(context, parser, body->function_type, body->function_definition);
+    parser->in_body_arena = false;
+    std::swap(parser->ast_arena, *parser->body_arena);
+    parser->body_arena = nullptr;
+    if (result.type != Result::Success) {
+        return false;
+    }
+
+    // The body must end exactly where the old one did.  Otherwise the edit unbalanced the braces.
+    if (parser->preprocessor.include_stack.len() != 1 ||
+        parser->preprocessor.definition_stack.len() != 0 ||
+        parser->preprocessor.definitions_version != body->definitions_version ||
+        body->function_definition->block_span.end.file != version ||
+        body->function_definition->block_span.end.index != new_end) {
+        return false;
+    }
+
+    pre::Include_Info entry = parser->preprocessor.include_stack.pop();
+    entry.if_stack.drop(cz::heap_allocator());
+    clear_lookahead(parser);
+    return true;
+}
+
+/// Count the newlines in `[start, end)`.
+static size_t count_lines(cz::Str str, size_t start, size_t end) {
+    size_t lines = 0;
+    for (size_t i = start; i < end; ++i) {
+        if (str[i] == '\n') {
+            ++lines;
+        }
+    }
+    return lines;
+}
+
+static size_t column_of(cz::Str str, size_t index) {
+    size_t column = 0;
+    while (column < index && str[index - column - 1] != '\n') {
+        ++column;
+    }
+    return column;
+}
+
+Result Incremental_Parse::edit(Context* context, size_t start, size_t end, cz::Str text) {
+    ZoneScoped;
+
+    CZ_DEBUG_ASSERT(start <= end);
+    CZ_DEBUG_ASSERT(end <= contents.len());
+
+    // Find the last body starting before the edit.
+    size_t low = 0, high = bodies.len();
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (bodies[mid].start.index < start) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    // Work out where the end of the edit was and will be so later bodies can be moved.
+    Function_Body* body = low > 0 ? &bodies[low - 1] : nullptr;
+    bool inside_body = body && end < body->end;
+    size_t old_end_line = 0, old_end_column = 0, removed_lines = 0, added_lines = 0;
+    size_t new_end_column = 0;
+    if (inside_body) {
+        cz::Str old_contents = contents;
+        removed_lines = count_lines(old_contents, start, end);
+        added_lines = count_lines(text, 0, text.len);
+        old_end_line = body->start.line + count_lines(old_contents, body->start.index, end);
+        old_end_column = column_of(old_contents, end);
+        if (added_lines == 0) {
+            new_end_column = column_of(old_contents, start) + text.len;
+        } else {
+            new_end_column = column_of(text, text.len);
+        }
+    }
+
+    cz::String new_contents = {};
+    new_contents.reserve(cz::heap_allocator(), contents.len() - (end - start) + text.len);
+    new_contents.append(contents.as_str().slice_end(start));
+    new_contents.append(text);
+    new_contents.append(contents.as_str().slice_start(end));
+    contents.drop(cz::heap_allocator());
+    contents = new_contents;
+
+    if (!inside_body) {
+        return parse_all(context);
+    }
+
+    size_t new_end = body->end - (end - start) + text.len;
+    if (!reparse_body(context, this, body, new_end)) {
+        return parse_all(context);
+    }
+
+    ++incremental_reparses;
+    body->end = new_end;
+
+    for (size_t i = low; i < bodies.len(); ++i) {
+        Location* location = &bodies[i].start;
+        if (location->line == old_end_line) {
+            location->column = location->column - old_end_column + new_end_column;
+        }
+        location->line = location->line - removed_lines + added_lines;
+        location->index = location->index - (end - start) + text.len;
+        bodies[i].end = bodies[i].end - (end - start) + text.len;
+    }
+
+    return Result::ok();
+}
+
+static Result read_file(const char* file_name, cz::String* contents) {
+    FILE* file = fopen(file_name, "r");
+    if (!file) {
+        return Result::last_system_error();
+    }
+    CZ_DEFER(fclose(file));
+
+    char buffer[4096];
+    while (1) {
+        size_t len = fread(buffer, 1, sizeof(buffer), file);
+        contents->reserve(cz::heap_allocator(), len);
+        contents->append({buffer, len});
+        if (len < sizeof(buffer)) {
+            break;
+        }
+    }
+    return Result::ok();
+}
+
+Result replay_edits(Context* context, const char* file_name) {
+    ZoneScoped;
+
+    cz::String file_path = {};
+    cz::Result abs_result =
+        cz::path::make_absolute(file_name, cz::heap_allocator(), &file_path);
+    CZ_DEFER(file_path.drop(cz::heap_allocator()));
+    if (abs_result.is_err()) {
+        return Result::from(abs_result);
+    }
+    file_path.realloc_null_terminate(cz::heap_allocator());
+
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    CZ_TRY(read_file(file_path.buffer(), &contents));
+
+    using std::chrono::high_resolution_clock;
+    using std::chrono::microseconds;
+
+    Incremental_Parse incremental = {};
+    CZ_DEFER(incremental.drop());
+    auto start_time = high_resolution_clock::now();
+    CZ_TRY(incremental.init(context, file_path, contents));
+    auto end_time = high_resolution_clock::now();
+    int64_t full_micros =
+        std::chrono::duration_cast<microseconds>(end_time - start_time).count();
+
+    int64_t total_micros = 0;
+    int64_t max_micros = 0;
+    size_t keystrokes = 0;
+    for (size_t i = 0; i < incremental.bodies.len(); ++i) {
+        size_t position = incremental.bodies[i].start.index + 1;
+        for (int step = 0; step < 2; ++step) {
+            start_time = high_resolution_clock::now();
+            if (step == 0) {
+                CZ_TRY(incremental.edit(context, position, position, " "));
+            } else {
+                CZ_TRY(incremental.edit(context, position, position + 1, ""));
+            }
+            end_time = high_resolution_clock::now();
+
+            int64_t micros =
+                std::chrono::duration_cast<microseconds>(end_time - start_time).count();
+            total_micros += micros;
+            if (micros > max_micros) {
+                max_micros = micros;
+            }
+            ++keystrokes;
+        }
+    }
+
+    printf("Edit replay for %s:\n", file_path.buffer());
+    printf("Full parse: %" PRId64 "us\n", full_micros);
+    printf("Keystrokes: %zu (%zu incremental, %zu full)\n", keystrokes,
+           incremental.incremental_reparses, incremental.full_reparses - 1);
+    if (keystrokes > 0) {
+        printf("Average: %" PRId64 "us\n", total_micros / (int64_t)keystrokes);
+        printf("Max: %" PRId64 "us\n", max_micros);
+    }
+    return Result::ok();
+}
+
+}
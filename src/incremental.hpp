@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cz/string.hpp>
+#include <cz/vector.hpp>
+#include "location.hpp"
+#include "parse.hpp"
+
+namespace red {
+struct Context;
+struct Result;
+
+/// The body of a function defined at file scope in the main file.
+struct Function_Body {
+    parse::Function_Definition* function_definition;
+    parse::Type_Function* function_type;
+
+    /// The location of the `{` in the current contents of the file.  `file` is unused.
+    Location start;
+    /// The offset after the `}` in the current contents of the file.
+    size_t end;
+
+    /// The number of ordinary identifiers and tagged types at file scope at the point the body was
+    /// parsed.  Bindings after these are hidden while reparsing the body.
+    size_t declarations_end;
+    size_t types_end;
+
+    /// `Preprocessor::definitions_version` when the function was parsed.
+    size_t definitions_version;
+
+    /// The version of the file the body was last parsed from.  This is `Incremental_Parse::file`
+    /// until the body is reparsed.  Afterwards the body owns the version and each reparse
+    /// replaces its contents.
+    size_t file;
+    /// The nodes of the body once it has been reparsed.  Each reparse frees the previous ones.
+    parse::Ast_Arena* arena;
+};
+
+/// Keeps a file parsed as it is edited.
+///
+/// Every top level declaration is recorded as it is parsed.  An edit that lies entirely inside the
+/// body of a function only relexes and reparses that body.  The body is reparsed against the final
+/// macro definitions and with the declarations after the function hidden.  Thus this fast path
+/// only applies if no macros were defined or undefined after the function and the body contains
+/// no directives.  Any other edit reparses the entire file.
+///
+/// The reparsed body is lexed from its own copy of the file so that spans in the rest of the
+/// syntax tree stay valid.  The copy and the body's nodes are reused by the next reparse of the
+/// same body.  The scope tables copy the names they keep so nothing else points into the copy.
+/// Types declared in a body are still allocated again on each reparse.
+struct Incremental_Parse {
+    parse::Parser parser;
+    cz::Vector<parse::Statement*> initializers;
+
+    cz::String file_path;
+    /// The index of the file parsed in the last full parse.
+    size_t file;
+    cz::String contents;
+
+    /// The function bodies sorted by their position in the file.
+    cz::Vector<Function_Body> bodies;
+
+    size_t incremental_reparses;
+    size_t full_reparses;
+
+    /// Parse `contents` as the file at `file_path`.  Note that the files and errors in the
+    /// `Context` are reset each time the entire file is reparsed.
+    Result init(Context* context, cz::Str file_path, cz::Str contents);
+    void drop();
+
+    /// Replace `[start, end)` with `text` and reparse.
+    Result edit(Context* context, size_t start, size_t end, cz::Str text);
+
+    Result parse_all(Context* context);
+};
+
+/// Simulate typing in every function body of the file by inserting and deleting a character at
+/// the start of each body.  Prints the time to reparse after each keystroke.
+Result replay_edits(Context* context, const char* file_name);
+
+}
@@ -1,11 +1,17 @@
 #include "lex.hpp"
 
 #include <ctype.h>
+#include <string.h>
 #include <Tracy.hpp>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "context.hpp"
 #include "file_contents.hpp"
 #include "location.hpp"
 #include "token.hpp"
+#include "token_buffer.hpp"
+#include "utf8.hpp"
 
 namespace red {
 namespace lex {
@@ -91,6 +97,37 @@ switch_:
     }
 }
 
+/// `next_character` for files that have no line splices or trigraphs.
+static bool next_character_splice_free(const File_Contents& file_contents,
+                                       Location* location,
+                                       char* out) {
+    *out = file_contents.get(location->index);
+    if (*out == File_Contents::eof) {
+        return false;
+    }
+
+    ++location->index;
+    if (*out == '\n') {
+        ++location->line;
+        location->column = 0;
+    } else {
+        ++location->column;
+    }
+    return true;
+}
+
+/// The lexer is instantiated twice: once for files that `File_Contents::is_splice_free` and once
+/// for every other file.  The first instantiation compiles out all handling of line splices and
+/// trigraphs.
+template <bool Splice_Free>
+static bool next_char(const File_Contents& file_contents, Location* location, char* out) {
+    if (Splice_Free) {
+        return next_character_splice_free(file_contents, location, out);
+    } else {
+        return next_character(file_contents, location, out);
+    }
+}
+
 #define IDENTIFIER_START_CASES \
     case 'a':                  \
     case 'b':                  \
@@ -178,6 +215,7 @@ switch_:
     case 'E':                  \
     case 'F'
 
+template <bool Splice_Free>
 static bool process_escaped_string(const File_Contents& file_contents,
                                    Location* location,
                                    char* c) {
@@ -205,7 +243,7 @@ static bool process_escaped_string(const File_Contents& file_contents,
             return true;
         case 'x': {
             char f;
-            if (!next_character(file_contents, location, &f)) {
+            if (!next_char<Splice_Free>(file_contents, location, &f)) {
                 return false;
             }
 
@@ -228,7 +266,7 @@ static bool process_escaped_string(const File_Contents& file_contents,
             }
 
             char s;
-            if (!next_character(file_contents, location, &s)) {
+            if (!next_char<Splice_Free>(file_contents, location, &s)) {
                 return false;
             }
 
@@ -298,6 +336,441 @@ static void append_buffer_contents_slice(cz::String* value,
     }
 }
 
+/// Get the characters from `index` to the end of its chunk of the file as `[*begin, *end)`.
+static void get_rest_of_chunk(const File_Contents& file_contents,
+                              size_t index,
+                              const char** begin,
+                              const char** end) {
+    size_t chunk_start = index - file_contents.get_offset(index);
+    size_t chunk_end = chunk_start + File_Contents::buffer_size;
+    if (chunk_end > file_contents.len) {
+        chunk_end = file_contents.len;
+    }
+
+    const char* buffer = file_contents.buffers[file_contents.get_base(index)];
+    *begin = buffer + (index - chunk_start);
+    *end = buffer + (chunk_end - chunk_start);
+}
+
+/// Find the first character in `[start, end)` that stops the plain run of a string literal.  That
+/// is the closing quote, the start of an escape or a line splice, a newline, or a `?` that could
+/// start a trigraph.  Returns `end` if there is none.
+static const char* find_string_special_character(const char* start, const char* end) {
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i question = _mm_set1_epi8('?');
+    for (; end - start >= 16; start += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)start);
+        __m128i quotes = _mm_cmpeq_epi8(chunk, quote);
+        __m128i backslashes = _mm_cmpeq_epi8(chunk, backslash);
+        __m128i newlines = _mm_cmpeq_epi8(chunk, newline);
+        __m128i questions = _mm_cmpeq_epi8(chunk, question);
+        __m128i matches =
+            _mm_or_si128(_mm_or_si128(quotes, backslashes), _mm_or_si128(newlines, questions));
+        int mask = _mm_movemask_epi8(matches);
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; start < end; ++start) {
+        switch (*start) {
+            case '"':
+            case '\\':
+            case '\n':
+            case '?':
+                return start;
+        }
+    }
+    return end;
+}
+
+/// Lex the part of a string literal that can be taken straight from the file.  `point` is just
+/// after the opening quote.  Scans the current chunk of the file and stops before the first
+/// character that has to be decoded.
+///
+/// Returns `true` if the closing quote was reached.  In that case `*plain` is the entire literal
+/// and `point` is moved past the closing quote.  Otherwise `*plain` is the prefix that needs no
+/// decoding and `point` is moved past it.
+static bool lex_plain_string(const File_Contents& file_contents, Location* point, cz::Str* plain) {
+    const char* begin;
+    const char* end;
+    get_rest_of_chunk(file_contents, point->index, &begin, &end);
+    const char* it = begin;
+    while (1) {
+        it = find_string_special_character(it, end);
+        // A lone `?` is not a trigraph so keep going.
+        if (it != end && *it == '?' && it + 1 != end && it[1] != '?') {
+            ++it;
+            continue;
+        }
+        break;
+    }
+
+    *plain = {begin, (size_t)(it - begin)};
+    point->index += plain->len;
+    point->column += plain->len;
+
+    if (it != end && *it == '"') {
+        ++point->index;
+        ++point->column;
+        return true;
+    }
+    return false;
+}
+
+namespace punctuator_dfa {
+
+struct Punctuator {
+    const char* spelling;
+    Token::Type type;
+};
+
+/// Every punctuator but `/` and `/=`, which are lexed alongside comments.  `..` isn't a token but
+/// is a prefix of `...` and `%:%` is a prefix of `%:%:`.
+constexpr const Punctuator punctuators[] = {
+    {"(", Token::OpenParen},
+    {")", Token::CloseParen},
+    {"{", Token::OpenCurly},
+    {"<%", Token::OpenCurly},
+    {"}", Token::CloseCurly},
+    {"%>", Token::CloseCurly},
+    {"[", Token::OpenSquare},
+    {"<:", Token::OpenSquare},
+    {"]", Token::CloseSquare},
+    {":>", Token::CloseSquare},
+    {"<", Token::LessThan},
+    {"<=", Token::LessEqual},
+    {">", Token::GreaterThan},
+    {">=", Token::GreaterEqual},
+    {"==", Token::Equals},
+    {"!=", Token::NotEquals},
+    {".", Token::Dot},
+    {"->", Token::Arrow},
+    {",", Token::Comma},
+    {"=", Token::Set},
+    {"+", Token::Plus},
+    {"-", Token::Minus},
+    {"*", Token::Star},
+    {"%", Token::Modulus},
+    {"&", Token::Ampersand},
+    {"&&", Token::And},
+    {"|", Token::Pipe},
+    {"||", Token::Or},
+    {"^", Token::Xor},
+    {"<<", Token::LeftShift},
+    {">>", Token::RightShift},
+    {"+=", Token::PlusSet},
+    {"-=", Token::MinusSet},
+    {"*=", Token::MultiplySet},
+    {"%=", Token::ModulusSet},
+    {"&=", Token::BitAndSet},
+    {"|=", Token::BitOrSet},
+    {"^=", Token::BitXorSet},
+    {"<<=", Token::LeftShiftSet},
+    {">>=", Token::RightShiftSet},
+    {";", Token::Semicolon},
+    {"!", Token::Not},
+    {"?", Token::QuestionMark},
+    {"~", Token::Tilde},
+    {"++", Token::Increment},
+    {"--", Token::Decrement},
+    {":", Token::Colon},
+    {"::", Token::ColonColon},
+    {"#", Token::Hash},
+    {"%:", Token::Hash},
+    {"##", Token::HashHash},
+    {"%:%:", Token::HashHash},
+    {"...", Token::Preprocessor_Varargs_Parameter_Indicator},
+};
+
+constexpr const size_t max_states = 64;
+constexpr const size_t max_classes = 32;
+/// Marks states that aren't the end of a punctuator.
+constexpr const uint8_t no_token = UINT8_MAX;
+
+/// A trie of the punctuators.  Bytes are first mapped to classes so the transition table only
+/// needs a column per character that appears in a punctuator.  State 0 is both the start state
+/// and the dead state, since no transition ever leads back to the start.
+struct Dfa {
+    /// The state after the first byte, so a byte that can't start a punctuator is rejected with
+    /// a single load.
+    uint8_t start_states[256];
+    uint8_t classes[256];
+    uint8_t transitions[max_states][max_classes];
+    uint8_t tokens[max_states];
+    /// Whether any transition leaves the state.  Lets `(`, `;`, and friends skip the walk.
+    bool continues[max_states];
+    size_t num_states;
+    size_t num_classes;
+};
+
+constexpr Dfa build() {
+    Dfa dfa = {};
+    dfa.num_states = 1;
+    dfa.num_classes = 1;
+    for (size_t state = 0; state < max_states; ++state) {
+        dfa.tokens[state] = no_token;
+    }
+
+    for (const Punctuator& punctuator : punctuators) {
+        size_t state = 0;
+        for (const char* it = punctuator.spelling; *it; ++it) {
+            uint8_t& byte_class = dfa.classes[(uint8_t)*it];
+            if (byte_class == 0) {
+                byte_class = dfa.num_classes++;
+            }
+
+            uint8_t& next = dfa.transitions[state][byte_class];
+            if (next == 0) {
+                next = dfa.num_states++;
+            }
+            dfa.continues[state] = true;
+            state = next;
+        }
+        dfa.tokens[state] = punctuator.type;
+    }
+
+    for (size_t byte = 0; byte < 256; ++byte) {
+        dfa.start_states[byte] = dfa.transitions[0][dfa.classes[byte]];
+    }
+    return dfa;
+}
+
+constexpr const Dfa dfa = build();
+static_assert(dfa.num_states <= max_states, "Too many punctuator states");
+static_assert(dfa.num_classes <= max_classes, "Too many punctuator characters");
+
+}
+
+/// Lex the rest of a punctuator that starts with `first` by running `punctuator_dfa` over the
+/// bytes of the file.  `point` is just after `first`.  Only valid in files without line splices
+/// or trigraphs.  Returns `false` without changing anything if `first` doesn't start a punctuator
+/// or the punctuator could continue into the next chunk of the file.
+static bool lex_punctuator(const File_Contents& file_contents,
+                           Location* point,
+                           char first,
+                           Token* token_out) {
+    using namespace punctuator_dfa;
+
+    size_t state = dfa.start_states[(uint8_t)first];
+    if (state == 0) {
+        return false;
+    }
+    if (!dfa.continues[state]) {
+        token_out->type = (Token::Type)dfa.tokens[state];
+        return true;
+    }
+
+    const char* begin;
+    const char* end;
+    get_rest_of_chunk(file_contents, point->index, &begin, &end);
+
+    // Take the longest punctuator.  This is only shorter than the walk for `..` and `%:%`.
+    uint8_t token = dfa.tokens[state];
+    size_t token_len = 0;
+    const char* it = begin;
+    for (; it != end; ++it) {
+        state = dfa.transitions[state][dfa.classes[(uint8_t)*it]];
+        if (state == 0) {
+            break;
+        }
+        if (dfa.tokens[state] != no_token) {
+            token = dfa.tokens[state];
+            token_len = it + 1 - begin;
+        }
+    }
+
+    if (token == no_token) {
+        return false;
+    }
+    if (it == end && point->index + (it - begin) != file_contents.len) {
+        return false;
+    }
+
+    point->index += token_len;
+    point->column += token_len;
+    token_out->type = (Token::Type)token;
+    return true;
+}
+
+/// Multiply `*value` by `base` and add `digit`.  Returns `false` if the result doesn't fit.
+static bool accumulate_digits(uint64_t* value, uint64_t base, uint64_t digit) {
+    return !__builtin_mul_overflow(*value, base, value) &&
+           !__builtin_add_overflow(*value, digit, value);
+}
+
+/// Convert 8 decimal digits at once by combining adjacent pairs of digits, then pairs of pairs,
+/// and so on inside a single 64 bit integer.
+static uint32_t parse_eight_decimal_digits(const char* digits) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t chunk;
+    memcpy(&chunk, digits, sizeof(chunk));
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FF;
+    chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFF;
+    chunk = (chunk * 10000 + (chunk >> 32)) & 0x00000000FFFFFFFF;
+    return (uint32_t)chunk;
+#else
+    uint32_t value = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        value = value * 10 + (digits[i] - '0');
+    }
+    return value;
+#endif
+}
+
+/// Convert 8 hexadecimal digits at once.  Same idea as `parse_eight_decimal_digits`.
+static uint32_t parse_eight_hex_digits(const char* digits) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t chunk;
+    memcpy(&chunk, digits, sizeof(chunk));
+    // Letters have bit 6 set and their low nibble is one less than `value - 9`.
+    uint64_t letters = (chunk >> 6) & 0x0101010101010101;
+    chunk = (chunk & 0x0F0F0F0F0F0F0F0F) + letters * 9;
+    chunk = ((chunk & 0x000F000F000F000F) << 4) | ((chunk >> 8) & 0x000F000F000F000F);
+    chunk = ((chunk & 0x000000FF000000FF) << 8) | ((chunk >> 16) & 0x000000FF000000FF);
+    chunk = ((chunk & 0x000000000000FFFF) << 16) | ((chunk >> 32) & 0x000000000000FFFF);
+    return (uint32_t)chunk;
+#else
+    uint32_t value = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        char c = digits[i];
+        value = (value << 4) | (isdigit(c) ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    return value;
+#endif
+}
+
+/// Convert the decimal digits in `[start, end)`.  Returns `false` if the value doesn't fit.
+static bool parse_decimal_digits(const char* start, const char* end, uint64_t* value) {
+    bool fits = true;
+    for (; end - start >= 8; start += 8) {
+        fits &= accumulate_digits(value, 100000000, parse_eight_decimal_digits(start));
+    }
+    for (; start < end; ++start) {
+        fits &= accumulate_digits(value, 10, *start - '0');
+    }
+    return fits;
+}
+
+/// Convert the hexadecimal digits in `[start, end)`.  Returns `false` if the value doesn't fit.
+static bool parse_hex_digits(const char* start, const char* end, uint64_t* value) {
+    bool fits = true;
+    for (; end - start >= 8; start += 8) {
+        fits &= accumulate_digits(value, (uint64_t)1 << 32, parse_eight_hex_digits(start));
+    }
+    for (; start < end; ++start) {
+        char c = *start;
+        uint64_t digit = isdigit(c) ? c - '0' : (c | 0x20) - 'a' + 10;
+        fits &= accumulate_digits(value, 16, digit);
+    }
+    return fits;
+}
+
+/// Lex a decimal or hexadecimal integer literal straight from the current chunk of the file.
+/// `point` is just after the first digit, `first`.
+///
+/// Returns `false` without changing anything if the literal is octal, could be continued by a
+/// line splice, or runs past the end of the chunk.  The character by character loop handles
+/// those cases.
+static bool lex_integer_fast(Context* context,
+                             const File_Contents& file_contents,
+                             Location* point,
+                             char first,
+                             Token* token_out) {
+    const char* begin;
+    const char* end;
+    get_rest_of_chunk(file_contents, point->index, &begin, &end);
+    const char* it = begin;
+
+    uint64_t value = 0;
+    bool fits;
+    if (first == '0' && it != end && (*it == 'x' || *it == 'X')) {
+        ++it;
+        const char* digits = it;
+        while (it != end && isxdigit(*it)) {
+            ++it;
+        }
+        if (it == digits) {
+            return false;
+        }
+        fits = parse_hex_digits(digits, it, &value);
+    } else if (first == '0') {
+        if (it != end && isdigit(*it)) {
+            return false;
+        }
+        fits = true;
+    } else {
+        // `first` may be the last character of the previous chunk so it isn't part of the run.
+        value = first - '0';
+        while (it != end && isdigit(*it)) {
+            ++it;
+        }
+        fits = parse_decimal_digits(begin, it, &value);
+    }
+
+    uint32_t suffix = 0;
+    while (it != end) {
+        if (*it == 'u' || *it == 'U') {
+            suffix |= Integer_Suffix::Unsigned;
+            ++it;
+        } else if (*it == 'l' || *it == 'L') {
+            if (it + 1 != end && it[1] == *it) {
+                suffix |= Integer_Suffix::LongLong;
+                it += 2;
+            } else {
+                suffix |= Integer_Suffix::Long;
+                ++it;
+            }
+        } else {
+            break;
+        }
+    }
+
+    size_t index = point->index + (it - begin);
+    if (it == end && index != file_contents.len) {
+        return false;
+    }
+    if (*it == '\\' && file_contents.get(index + 1) == '\n') {
+        return false;
+    }
+    if (*it == '?' && file_contents.get(index + 1) == '?' && file_contents.get(index + 2) == '/' &&
+        file_contents.get(index + 3) == '\n') {
+        return false;
+    }
+
+    point->index = index;
+    point->column += it - begin;
+
+    if (!fits) {
+        context->report_lex_error({token_out->span.start, *point}, "Integer literal is too large");
+    }
+
+    token_out->v.integer.value = value;
+    token_out->v.integer.suffix = suffix;
+    token_out->type = Token::Integer;
+    return true;
+}
+
+/// The length of the UTF-8 encoded identifier character at `index` or 0 if there isn't one.
+static size_t utf8_identifier_length(const File_Contents& file_contents, size_t index) {
+    if ((unsigned char)file_contents.get(index) < 0x80) {
+        return 0;
+    }
+
+    uint32_t code_point;
+    size_t length = file_contents.decode_utf8(index, &code_point);
+    if (length == 0 || !utf8::is_identifier_continue(code_point)) {
+        return 0;
+    }
+    return length;
+}
+
+template <bool Splice_Free>
 static void next_token_identifier(Lexer* lexer,
                                   const File_Contents& file_contents,
                                   Location* location,
@@ -315,13 +788,13 @@ static void next_token_identifier(Lexer* lexer,
             break;
 
             case '\\':
-                if (file_contents.get(point.index + 1) == '\n') {
+                if (!Splice_Free && file_contents.get(point.index + 1) == '\n') {
                     goto expensive_loop_backslash_newline;
                 }
                 goto commit_cheap_identifier;
 
             case '?':
-                if (file_contents.get(point.index + 1) == '?' &&
+                if (!Splice_Free && file_contents.get(point.index + 1) == '?' &&
                     file_contents.get(point.index + 2) == '/' &&
                     file_contents.get(point.index + 3) == '\n') {
                     goto expensive_loop_trigraph_backslash_newline;
@@ -329,6 +802,13 @@ static void next_token_identifier(Lexer* lexer,
                 goto commit_cheap_identifier;
 
             default:
+                if (!file_contents.is_ascii) {
+                    size_t length = utf8_identifier_length(file_contents, point.index);
+                    if (length > 0) {
+                        point.index += length;
+                        break;
+                    }
+                }
                 goto commit_cheap_identifier;
         }
     }
@@ -405,6 +885,13 @@ commit_cheap_identifier : {
                 goto commit_expensive_identifier;
 
             default:
+                if (!file_contents.is_ascii) {
+                    size_t length = utf8_identifier_length(file_contents, point.index);
+                    if (length > 0) {
+                        point.index += length;
+                        break;
+                    }
+                }
                 goto commit_expensive_identifier;
         }
     }
@@ -418,20 +905,39 @@ commit_expensive_identifier:
     token_out->v.identifier = Hashed_Str::from_str(value);
 }
 
-bool next_token(Context* context,
-                Lexer* lexer,
-                const File_Contents& file_contents,
-                Location* location,
-                Token* token_out,
-                bool* at_bol) {
+/// Invalid UTF-8 in identifiers and between tokens is reported as it is lexed but comments and
+/// literals are copied byte by byte.  Report the file's first invalid sequence if it is in one.
+static void check_utf8(Context* context,
+                       const File_Contents& file_contents,
+                       Location start,
+                       Location end) {
+    if (file_contents.first_invalid_utf8 >= start.index &&
+        file_contents.first_invalid_utf8 < end.index) {
+        context->report_lex_error({start, end}, "Invalid UTF-8");
+    }
+}
+
+template <bool Splice_Free>
+static bool next_token_specialized(Context* context,
+                                   Lexer* lexer,
+                                   const File_Contents& file_contents,
+                                   Location* location,
+                                   Token* token_out,
+                                   bool* at_bol) {
     ZoneScopedN("lex::next_token");
     Location point = *location;
 top:
     token_out->span.start = point;
     char c;
-    if (!next_character(file_contents, &point, &c)) {
+    if (!next_char<Splice_Free>(file_contents, &point, &c)) {
         return false;
     }
+
+    if (Splice_Free && lex_punctuator(file_contents, &point, c, token_out)) {
+        token_out->span.end = point;
+        *location = point;
+        return true;
+    }
     switch (c) {
         case '(':
             token_out->type = Token::OpenParen;
@@ -454,7 +960,7 @@ top:
         case '<': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '=') {
                     token_out->type = Token::LessEqual;
                 } else if (next == ':') {
@@ -463,7 +969,7 @@ top:
                     token_out->type = Token::OpenCurly;
                 } else if (next == '<') {
                     *location = point;
-                    if (next_character(file_contents, &point, &next) && next == '=') {
+                    if (next_char<Splice_Free>(file_contents, &point, &next) && next == '=') {
                         token_out->type = Token::LeftShiftSet;
                     } else {
                         token_out->type = Token::LeftShift;
@@ -482,12 +988,12 @@ top:
         case '>': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '=') {
                     token_out->type = Token::GreaterEqual;
                 } else if (next == '>') {
                     *location = point;
-                    if (next_character(file_contents, &point, &next) && next == '=') {
+                    if (next_char<Splice_Free>(file_contents, &point, &next) && next == '=') {
                         token_out->type = Token::RightShiftSet;
                     } else {
                         token_out->type = Token::RightShift;
@@ -506,7 +1012,7 @@ top:
         case ':': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '>') {
                     token_out->type = Token::CloseSquare;
                 } else if (next == ':') {
@@ -524,17 +1030,26 @@ top:
         case '%': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '>') {
                     token_out->type = Token::CloseCurly;
                 } else if (next == '=') {
                     token_out->type = Token::ModulusSet;
+                } else if (next == ':') {
+                    token_out->type = Token::Hash;
+                    *location = point;
+                    if (next_char<Splice_Free>(file_contents, &point, &next) && next == '%' &&
+                        next_char<Splice_Free>(file_contents, &point, &next) && next == ':') {
+                        token_out->type = Token::HashHash;
+                    } else {
+                        point = *location;
+                    }
                 } else {
-                    token_out->type = Token::Ampersand;
+                    token_out->type = Token::Modulus;
                     point = *location;
                 }
             } else {
-                token_out->type = Token::Ampersand;
+                token_out->type = Token::Modulus;
                 point = *location;
             }
             break;
@@ -542,7 +1057,7 @@ top:
         case '=': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next) && next == '=') {
+            if (next_char<Splice_Free>(file_contents, &point, &next) && next == '=') {
                 token_out->type = Token::Equals;
             } else {
                 token_out->type = Token::Set;
@@ -553,8 +1068,8 @@ top:
         case '.': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next) && next == '.') {
-                if (next_character(file_contents, &point, &next) && next == '.') {
+            if (next_char<Splice_Free>(file_contents, &point, &next) && next == '.') {
+                if (next_char<Splice_Free>(file_contents, &point, &next) && next == '.') {
                     token_out->type = Token::Preprocessor_Varargs_Parameter_Indicator;
                 } else {
                     token_out->type = Token::Dot;
@@ -572,7 +1087,7 @@ top:
         case '+': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '=') {
                     token_out->type = Token::PlusSet;
                 } else if (next == '+') {
@@ -590,7 +1105,7 @@ top:
         case '-': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '=') {
                     token_out->type = Token::MinusSet;
                 } else if (next == '>') {
@@ -610,7 +1125,7 @@ top:
         case '/': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '*') {
                     ZoneScopedN("lex::next_token block comment");
                     size_t start_index = point.index - point.column;
@@ -635,11 +1150,14 @@ top:
                                         case '/':
                                             ++point.index;
                                             point.column = point.index - start_index;
+                                            check_utf8(context, file_contents,
+                                                       token_out->span.start, point);
                                             *location = point;
                                             goto top;
 
                                         case '\\':
-                                            if (file_contents.get(point.index + 1) == '\n') {
+                                            if (!Splice_Free &&
+                                                file_contents.get(point.index + 1) == '\n') {
                                                 point.index += 2;
                                                 ++point.line;
                                                 start_index = point.index;
@@ -648,7 +1166,8 @@ top:
                                             goto block_comment_switch;
 
                                         case '?':
-                                            if (file_contents.get(point.index + 1) == '?' &&
+                                            if (!Splice_Free &&
+                                                file_contents.get(point.index + 1) == '?' &&
                                                 file_contents.get(point.index + 2) == '/' &&
                                                 file_contents.get(point.index + 3) == '\n') {
                                                 point.index += 4;
@@ -685,7 +1204,8 @@ top:
                     ZoneScopedN("lex::next_token line comment");
                     while (1) {
                         char next;
-                        if (!next_character(file_contents, &point, &next)) {
+                        if (!next_char<Splice_Free>(file_contents, &point, &next)) {
+                            check_utf8(context, file_contents, token_out->span.start, point);
                             *location = point;
                             return false;
                         }
@@ -695,6 +1215,7 @@ top:
                         }
                     }
 
+                    check_utf8(context, file_contents, token_out->span.start, point);
                     *location = point;
                     *at_bol = true;
                     goto top;
@@ -713,7 +1234,7 @@ top:
         case '*': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next) && next == '=') {
+            if (next_char<Splice_Free>(file_contents, &point, &next) && next == '=') {
                 token_out->type = Token::MultiplySet;
             } else {
                 token_out->type = Token::Star;
@@ -724,7 +1245,7 @@ top:
         case '&': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '&') {
                     token_out->type = Token::And;
                 } else if (next == '=') {
@@ -742,7 +1263,7 @@ top:
         case '|': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next)) {
+            if (next_char<Splice_Free>(file_contents, &point, &next)) {
                 if (next == '|') {
                     token_out->type = Token::Or;
                 } else if (next == '=') {
@@ -760,7 +1281,7 @@ top:
         case '^': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next) && next == '=') {
+            if (next_char<Splice_Free>(file_contents, &point, &next) && next == '=') {
                 token_out->type = Token::BitXorSet;
             } else {
                 token_out->type = Token::Xor;
@@ -780,7 +1301,7 @@ top:
         case '!': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next) && next == '=') {
+            if (next_char<Splice_Free>(file_contents, &point, &next) && next == '=') {
                 token_out->type = Token::NotEquals;
             } else {
                 token_out->type = Token::Not;
@@ -791,7 +1312,7 @@ top:
         case '#': {
             *location = point;
             char next;
-            if (next_character(file_contents, &point, &next) && next == '#') {
+            if (next_char<Splice_Free>(file_contents, &point, &next) && next == '#') {
                 token_out->type = Token::HashHash;
             } else {
                 token_out->type = Token::Hash;
@@ -807,18 +1328,18 @@ top:
 
             *location = point;
 
-            if (!next_character(file_contents, &point, &c)) {
+            if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                 context->report_lex_error({start, point}, "Unterminated character literal");
                 return false;
             }
 
             if (c == '\\') {
-                if (!next_character(file_contents, &point, &c)) {
+                if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                     context->report_lex_error({start, point}, "Unterminated character literal");
                     return false;
                 }
 
-                if (!process_escaped_string(file_contents, &point, &c)) {
+                if (!process_escaped_string<Splice_Free>(file_contents, &point, &c)) {
                     context->report_lex_error({start, point}, "Undefined escape sequence `\\", c,
                                               "`");
                     c = 0;
@@ -827,10 +1348,11 @@ top:
 
             char value = c;
 
-            if (!next_character(file_contents, &point, &c) || c != '\'') {
+            if (!next_char<Splice_Free>(file_contents, &point, &c) || c != '\'') {
                 context->report_lex_error({start, point}, "Unterminated character literal");
                 return false;
             }
+            check_utf8(context, file_contents, start, point);
 
             *location = point;
 
@@ -842,27 +1364,40 @@ top:
         case '"': {
             ZoneScopedN("lex::next_token string");
 
-            cz::String value = {};
             Location start = point;
 
+            // Most literals contain no escapes so they can point directly into the file.
+            cz::Str plain;
+            if (lex_plain_string(file_contents, &point, &plain)) {
+                check_utf8(context, file_contents, start, point);
+                token_out->v.string = plain;
+                token_out->type = Token::String;
+                break;
+            }
+
+            // Decode the rest of the literal character by character.
+            cz::String value = {};
+            value.reserve(lexer->string_buffer_array.allocator(), plain.len);
+            value.append(plain);
+
             *location = point;
             while (1) {
                 Location middle = point;
 
-                if (!next_character(file_contents, &point, &c)) {
+                if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                     context->report_lex_error({start, point}, "Unterminated string");
                     value.drop(lexer->string_buffer_array.allocator());
                     return false;
                 }
 
                 if (c == '\\') {
-                    if (!next_character(file_contents, &point, &c)) {
+                    if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                         context->report_lex_error({start, point}, "Unterminated string");
                         value.drop(lexer->string_buffer_array.allocator());
                         return false;
                     }
 
-                    if (!process_escaped_string(file_contents, &point, &c)) {
+                    if (!process_escaped_string<Splice_Free>(file_contents, &point, &c)) {
                         context->report_lex_error({middle, point}, "Undefined escape sequence `\\",
                                                   c, "`");
                         goto skip_char;
@@ -878,6 +1413,7 @@ top:
                 *location = point;
             }
 
+            check_utf8(context, file_contents, start, point);
             value.realloc(lexer->string_buffer_array.allocator());
             token_out->v.string = value;
             token_out->type = Token::String;
@@ -895,16 +1431,21 @@ top:
             goto top;
 
         IDENTIFIER_START_CASES:
-            next_token_identifier(lexer, file_contents, location, point, c, token_out);
+            next_token_identifier<Splice_Free>(lexer, file_contents, location, point, c, token_out);
             break;
 
         NUMBER_CASES : {
             ZoneScopedN("lex::next_token number");
 
+            if (lex_integer_fast(context, file_contents, &point, c, token_out)) {
+                break;
+            }
+
             uint64_t value = 0;
+            bool fits = true;
             if (c == '0') {
                 *location = point;
-                if (next_character(file_contents, &point, &c)) {
+                if (next_char<Splice_Free>(file_contents, &point, &c)) {
                     if (isdigit(c)) {
                         // octal
                         while (1) {
@@ -915,7 +1456,7 @@ top:
                                     "`");
                                 while (1) {
                                     *location = point;
-                                    if (!next_character(file_contents, &point, &c)) {
+                                    if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                                         c = 0;
                                         break;
                                     }
@@ -926,11 +1467,10 @@ top:
                                 break;
                             }
 
-                            value *= 8;
-                            value += c - '0';
+                            fits &= accumulate_digits(&value, 8, c - '0');
 
                             *location = point;
-                            if (!next_character(file_contents, &point, &c)) {
+                            if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                                 c = 0;
                                 break;
                             }
@@ -942,7 +1482,7 @@ top:
                         // hex
                         Location backup = point;
                         char ch = c;
-                        if (!next_character(file_contents, &point, &c)) {
+                        if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                             point = backup;
                             c = ch;
                             break;
@@ -959,18 +1499,15 @@ top:
                                 while (1) {
                                     switch (c) {
                                     NUMBER_CASES:
-                                        value <<= 4;
-                                        value += c - '0';
+                                        fits &= accumulate_digits(&value, 16, c - '0');
                                         break;
 
                                     HEX_LOWER_LETTER_CASES:
-                                        value <<= 4;
-                                        value += c - 'a' + 10;
+                                        fits &= accumulate_digits(&value, 16, c - 'a' + 10);
                                         break;
 
                                     HEX_UPPER_LETTER_CASES:
-                                        value <<= 4;
-                                        value += c - 'A' + 10;
+                                        fits &= accumulate_digits(&value, 16, c - 'A' + 10);
                                         break;
 
                                         default:
@@ -978,7 +1515,7 @@ top:
                                     }
 
                                     *location = point;
-                                    if (!next_character(file_contents, &point, &c)) {
+                                    if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                                         c = 0;
                                         break;
                                     }
@@ -991,11 +1528,10 @@ top:
                 }
             } else {
                 while (1) {
-                    value *= 10;
-                    value += c - '0';
+                    fits &= accumulate_digits(&value, 10, c - '0');
 
                     *location = point;
-                    if (!next_character(file_contents, &point, &c)) {
+                    if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                         c = 0;
                         break;
                     }
@@ -1010,19 +1546,19 @@ top:
                 if (c == 'u' || c == 'U') {
                     suffix |= Integer_Suffix::Unsigned;
                     *location = point;
-                    if (!next_character(file_contents, &point, &c)) {
+                    if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                         c = 0;
                     }
                 } else if (c == 'l' || c == 'L') {
                     char f = c;
                     *location = point;
-                    if (!next_character(file_contents, &point, &c)) {
+                    if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                         c = 0;
                     }
                     if (c == f) {
                         suffix |= Integer_Suffix::LongLong;
                         *location = point;
-                        if (!next_character(file_contents, &point, &c)) {
+                        if (!next_char<Splice_Free>(file_contents, &point, &c)) {
                             c = 0;
                         }
                     } else {
@@ -1034,14 +1570,48 @@ top:
             }
 
             point = *location;
+            if (!fits) {
+                context->report_lex_error({token_out->span.start, point},
+                                          "Integer literal is too large");
+            }
+
             token_out->v.integer.value = value;
             token_out->v.integer.suffix = suffix;
             token_out->type = Token::Integer;
         } break;
 
-        default:
-            context->report_lex_error({*location, point}, "Unable to process character `", c, "`");
+        default: {
+            if (file_contents.is_ascii || (unsigned char)c < 0x80) {
+                context->report_lex_error({*location, point}, "Unable to process character `", c,
+                                          "`");
+                return false;
+            }
+
+            // `c` starts a multibyte character.
+            size_t index = point.index - 1;
+            uint32_t code_point;
+            size_t length = file_contents.decode_utf8(index, &code_point);
+            if (length == 0) {
+                context->report_lex_error({*location, point}, "Invalid UTF-8");
+                return false;
+            }
+
+            point.index = index + length;
+            if (utf8::is_identifier_start(code_point)) {
+                next_token_identifier<Splice_Free>(lexer, file_contents, location, point, c,
+                                                   token_out);
+                break;
+            }
+
+            point.column += length - 1;
+            char sequence[utf8::max_sequence_length];
+            for (size_t i = 0; i < length; ++i) {
+                sequence[i] = file_contents.get(index + i);
+            }
+            context->report_lex_error({*location, point}, "Unable to process character `",
+                                      cz::Str{sequence, length}, "`");
             return false;
+        }
     }
 
     token_out->span.end = point;
@@ -1049,5 +1619,71 @@ top:
     return true;
 }
 
+bool next_token(Context* context,
+                Lexer* lexer,
+                const File_Contents& file_contents,
+                Location* location,
+                Token* token_out,
+                bool* at_bol) {
+    if (file_contents.is_splice_free()) {
+        return next_token_specialized<true>(context, lexer, file_contents, location, token_out,
+                                            at_bol);
+    } else {
+        return next_token_specialized<false>(context, lexer, file_contents, location, token_out,
+                                             at_bol);
+    }
+}
+
+template <bool Splice_Free>
+static Tokenize_Stop tokenize_range_specialized(Context* context,
+                                                Lexer* lexer,
+                                                const File_Contents& file_contents,
+                                                Location* location,
+                                                const Tokenize_Options& options,
+                                                Token_Buffer* tokens,
+                                                Token* next_line) {
+    ZoneScoped;
+
+    bool at_bol = options.at_bol;
+    for (size_t i = 0; i < options.max_tokens; ++i) {
+        Token token;
+        if (!next_token_specialized<Splice_Free>(context, lexer, file_contents, location, &token,
+                                                 &at_bol)) {
+            return Tokenize_Stop::End_Of_File;
+        }
+
+        if (at_bol) {
+            if (options.stop_at_eol) {
+                *next_line = token;
+                return Tokenize_Stop::End_Of_Line;
+            }
+            if (options.line_starts) {
+                options.line_starts->reserve(options.allocator, 1);
+                options.line_starts->push((uint32_t)tokens->len());
+            }
+            at_bol = false;
+        }
+
+        tokens->push(options.allocator, token);
+    }
+    return Tokenize_Stop::Full;
+}
+
+Tokenize_Stop tokenize_range(Context* context,
+                             Lexer* lexer,
+                             const File_Contents& file_contents,
+                             Location* location,
+                             const Tokenize_Options& options,
+                             Token_Buffer* tokens,
+                             Token* next_line) {
+    if (file_contents.is_splice_free()) {
+        return tokenize_range_specialized<true>(context, lexer, file_contents, location, options,
+                                                tokens, next_line);
+    } else {
+        return tokenize_range_specialized<false>(context, lexer, file_contents, location, options,
+                                                 tokens, next_line);
+    }
+}
+
 }
 }
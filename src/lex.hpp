@@ -1,12 +1,16 @@
 #pragma once
 
+#include <stdint.h>
+#include <cz/allocator.hpp>
 #include <cz/buffer_array.hpp>
+#include <cz/vector.hpp>
 #include "token.hpp"
 
 namespace red {
 struct Context;
 struct File_Contents;
 struct Location;
+struct Token_Buffer;
 
 namespace lex {
 
@@ -39,5 +43,39 @@ bool next_token(Context* context,
                 Token* token_out,
                 bool* at_bol);
 
+namespace Tokenize_Stop_ {
+enum Tokenize_Stop {
+    /// There are no more tokens in the file.
+    End_Of_File,
+    /// The next token starts a new line.  It is stored in `next_line`.
+    End_Of_Line,
+    /// `max_tokens` tokens were lexed.
+    Full,
+};
+}
+using Tokenize_Stop_::Tokenize_Stop;
+
+struct Tokenize_Options {
+    /// Used to push to `tokens` and `line_starts`.
+    cz::Allocator allocator;
+    size_t max_tokens;
+    /// Stop before the first token of the next line instead of adding it to `tokens`.
+    bool stop_at_eol;
+    /// Whether the first token is at the beginning of a line.  See `next_token`.
+    bool at_bol;
+    /// If not null, the index in `tokens` of each token at the beginning of a line is pushed here.
+    cz::Vector<uint32_t>* line_starts;
+};
+
+/// Get many tokens without running the preprocessor, appending them to `tokens`.  This is
+/// equivalent to calling `next_token` in a loop but the lexer only has to be set up once.
+Tokenize_Stop tokenize_range(Context* context,
+                             Lexer* lexer,
+                             const File_Contents& file_contents,
+                             Location* location,
+                             const Tokenize_Options& options,
+                             Token_Buffer* tokens,
+                             Token* next_line);
+
 }
 }
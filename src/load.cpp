@@ -7,12 +7,16 @@
 
 #include <Tracy.hpp>
 #include <cz/heap.hpp>
+#include <cz/path.hpp>
 #include <cz/try.hpp>
 #include "file.hpp"
 #include "file_contents.hpp"
 #include "files.hpp"
 #include "hashed_str.hpp"
+#include "header_bundle.hpp"
+#include "include_prefetcher.hpp"
 #include "preprocess.hpp"
+#include "virtual_files.hpp"
 
 namespace red {
 
@@ -36,7 +40,7 @@ void force_include_file(Files* files,
                         File_Contents file_contents) {
     push_file(preprocessor, files->files.len());
 
-    File file;
+    File file = {};
     file.path = file_path.str;
     file.contents = file_contents;
     files->files.push(file);
@@ -44,6 +48,80 @@ void force_include_file(Files* files,
     preprocessor->file_pragma_once.push(false);
 }
 
+void make_include_path(cz::Str include_path,
+                       cz::Str relative_path,
+                       cz::Allocator allocator,
+                       cz::String* file_name) {
+    bool trailing_slash = include_path.ends_with("/");  // @Speed: ends_with(char)
+    file_name->set_len(0);
+    file_name->reserve(allocator, include_path.len + !trailing_slash + relative_path.len + 1);
+    file_name->append(include_path);
+    if (!trailing_slash) {
+        file_name->push('/');
+    }
+    file_name->append(relative_path);
+    cz::path::flatten(file_name);
+    file_name->null_terminate();
+}
+
+/// Load the file at `file_path` from the virtual files, the header bundle, the prefetcher, or
+/// the disk.
+static Result load_file_contents(Files* files,
+                                 cz::Str file_path,
+                                 cz::Hash hash,
+                                 File_Contents* file_contents) {
+    if (files->virtual_files) {
+        const cz::Str* contents = files->virtual_files->find(file_path, hash);
+        if (contents) {
+            file_contents->load_str(*contents, files->file_array_buffer_array.allocator());
+            if (files->prefetcher) {
+                files->prefetcher->scan(file_path, *file_contents);
+            }
+            return Result::ok();
+        }
+        if (files->virtual_files->exclusive) {
+            return {Result::ErrorFile};
+        }
+    }
+
+    if (files->bundle) {
+        const Header_Bundle_Slot* slot = files->bundle->find(file_path, hash);
+        if (slot) {
+            files->bundle->load_file(*slot, file_contents,
+                                     files->file_array_buffer_array.allocator());
+            return Result::ok();
+        }
+        // The file didn't exist when the bundle was made so don't look for it.
+        if (files->bundle->covers(file_path)) {
+            return {Result::ErrorFile};
+        }
+    }
+
+    Prefetch_Result prefetched = Prefetch_Result::Unknown;
+    if (files->prefetcher) {
+        prefetched = files->prefetcher->take(file_path, hash, file_contents);
+    }
+    if (prefetched == Prefetch_Result::Loaded) {
+        return Result::ok();
+    }
+    if (prefetched == Prefetch_Result::Missing) {
+        return {Result::ErrorFile};
+    }
+
+    Result result =
+        file_contents->read(file_path.buffer, files->file_array_buffer_array.allocator());
+    if (result.is_err()) {
+        if (files->prefetcher) {
+            files->prefetcher->set_missing(file_path, hash);
+        }
+        return result;
+    }
+    if (files->prefetcher) {
+        files->prefetcher->scan(file_path, *file_contents);
+    }
+    return Result::ok();
+}
+
 Result include_file(Files* files, pre::Preprocessor* preprocessor, cz::String file_path) {
     ZoneScoped;
 
@@ -78,11 +156,10 @@ Result include_file(Files* files, pre::Preprocessor* preprocessor, cz::String fi
         ZoneName(buffer, len);
 #endif
 
-        // Load the file from disk.
         include_file_reserve(files, preprocessor);
 
         File_Contents file_contents;
-        CZ_TRY(file_contents.read(file_path.buffer(), files->file_array_buffer_array.allocator()));
+        CZ_TRY(load_file_contents(files, file_path, hash, &file_contents));
 
 #if PRINT_INCLUDE_STACK
         for (size_t i = 0; i < preprocessor->include_stack.len(); ++i) {
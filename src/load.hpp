@@ -22,6 +22,13 @@ void force_include_file(Files* files,
                         Hashed_Str file_path,
                         File_Contents file_contents);
 
+/// Set `file_name` to the null terminated path `#include` looks for `relative_path` at in the
+/// directory `include_path`.
+void make_include_path(cz::Str include_path,
+                       cz::Str relative_path,
+                       cz::Allocator allocator,
+                       cz::String* file_name);
+
 /// Process the file at `file_path` being included into the compilation unit.
 ///
 /// The `file_path` must be allocated from `files.file_buffer_array` as it will be deallocated if
@@ -7,17 +7,31 @@
 #include <cz/heap.hpp>
 #include <cz/slice.hpp>
 #include <cz/try.hpp>
+#include "ast_file.hpp"
 #include "compiler.hpp"
 #include "context.hpp"
 #include "file.hpp"
+#include "header_bundle.hpp"
+#include "incremental.hpp"
 #include "result.hpp"
 
 namespace red {
 
 static Result run_main(Context* context) {
     ZoneScoped;
+    if (context->options.make_header_bundle) {
+        return write_header_bundle(context, context->options.include_paths,
+                                   context->options.make_header_bundle);
+    }
+
     for (size_t i = 0; i < context->options.input_files.len(); ++i) {
-        CZ_TRY(compile_file(context, context->options.input_files[i]));
+        if (context->options.edit_replay) {
+            CZ_TRY(replay_edits(context, context->options.input_files[i]));
+        } else if (context->options.load_ast) {
+            CZ_TRY(parse::load_ast_file(context, context->options.input_files[i]));
+        } else {
+            CZ_TRY(compile_file(context, context->options.input_files[i]));
+        }
     }
     return Result::ok();
 }
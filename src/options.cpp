@@ -1,5 +1,7 @@
 #include "options.hpp"
 
+#include <stdlib.h>
+#include <string.h>
 #include <cz/heap.hpp>
 #include <cz/path.hpp>
 #include "context.hpp"
@@ -33,12 +35,58 @@ int Options::parse(Context* context, int argc, char** argv) {
             }
             path.realloc_null_terminate(buffer_array.allocator());
             include_paths.push(path);
+        } else if (cz::Str(arg) == "--stats") {
+            print_stats = true;
+        } else if (cz::Str(arg) == "--edit-replay") {
+            edit_replay = true;
+        } else if (cz::Str(arg).starts_with("--parse-threads=")) {
+            parse_threads = strtoul(arg + strlen("--parse-threads="), nullptr, 10);
+            if (parse_threads == 0) {
+                context->report_error_unspanned("--parse-threads must be at least 1");
+                return 1;
+            }
+        } else if (cz::Str(arg) == "--pipeline") {
+            pipeline = true;
+        } else if (cz::Str(arg) == "--prefetch-includes") {
+            prefetch_includes = true;
+        } else if (cz::Str(arg) == "-isysroot-bundle") {
+            if (i + 1 == (size_t)argc) {
+                context->report_error_unspanned("-isysroot-bundle must be followed by a path");
+                return 1;
+            }
+            header_bundle = argv[++i];
+        } else if (cz::Str(arg).starts_with("--make-header-bundle=")) {
+            make_header_bundle = arg + strlen("--make-header-bundle=");
+        } else if (cz::Str(arg).starts_with("--virtual-files=")) {
+            virtual_files = arg + strlen("--virtual-files=");
+        } else if (cz::Str(arg) == "--virtual-files-only") {
+            virtual_files_only = true;
+        } else if (cz::Str(arg) == "--stream-declarations") {
+            stream_declarations = true;
+        } else if (cz::Str(arg) == "--skip-bodies") {
+            skip_bodies = true;
+        } else if (cz::Str(arg).starts_with("--emit-ast=")) {
+            emit_ast = arg + strlen("--emit-ast=");
+        } else if (cz::Str(arg) == "--load-ast") {
+            load_ast = true;
         } else {
             input_files.reserve(cz::heap_allocator(), 1);
             input_files.push(arg);
         }
     }
 
+    if (stream_declarations && (skip_bodies || parse_threads > 0 || emit_ast)) {
+        context->report_error_unspanned(
+            "--stream-declarations frees function bodies so it can't be used with --skip-bodies, "
+            "--parse-threads, or --emit-ast");
+        return 1;
+    }
+
+    if (virtual_files_only && !virtual_files) {
+        context->report_error_unspanned("--virtual-files-only requires --virtual-files");
+        return 1;
+    }
+
     return 0;
 }
 
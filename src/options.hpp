@@ -12,6 +12,50 @@ struct Options {
     cz::Vector<cz::Str> include_paths;
     cz::Buffer_Array buffer_array;
 
+    /// Print statistics about the syntax tree after each file is parsed.
+    bool print_stats;
+
+    /// Instead of compiling, time reparsing each file after simulated edits.
+    bool edit_replay;
+
+    /// If nonzero, parse in two phases: first the declarations, recording the tokens of each
+    /// function body, then the bodies on this many threads.
+    size_t parse_threads;
+
+    /// Run the lexer and preprocessor on their own thread, overlapping them with parsing.
+    bool pipeline;
+
+    /// Load the files that are likely to be included on a background thread.  See
+    /// `Include_Prefetcher`.
+    bool prefetch_includes;
+
+    /// Load the files under the include paths from the bundle at this path instead of the disk.
+    /// See `Header_Bundle`.
+    const char* header_bundle;
+
+    /// Load the files in this mapping before looking on the disk.  See `parse_virtual_files`.
+    const char* virtual_files;
+
+    /// Don't load files that aren't in `virtual_files` from the disk.
+    bool virtual_files_only;
+
+    /// Instead of compiling, bundle every file under the include paths into this path.
+    const char* make_header_bundle;
+
+    /// Hand each declaration to a consumer as soon as it is parsed and free function bodies once
+    /// they have been consumed.  See `parse::parse_declarations`.
+    bool stream_declarations;
+
+    /// Only parse declarations.  Function bodies are matched by braces and skipped.
+    bool skip_bodies;
+
+    /// Write the syntax tree of each file to this path.  See `Ast_File`.
+    const char* emit_ast;
+
+    /// Instead of compiling, treat each input file as a syntax tree written with `emit_ast` and
+    /// walk it.
+    bool load_ast;
+
     int parse(Context*, int argc, char** argv);
     void destroy();
 };
@@ -0,0 +1,199 @@
+#include "parallel_parse.hpp"
+
+#include <Tracy.hpp>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <cz/assert.hpp>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/vector.hpp>
+#include "context.hpp"
+#include "parse.hpp"
+#include "result.hpp"
+
+namespace red {
+namespace parse {
+
+namespace {
+struct Body_Worker {
+    Parser* parser;
+    /// Errors are reported here and then moved to the main context once every thread is done.
+    Context context;
+};
+
+struct Body_Result {
+    Result result;
+    size_t worker;
+    size_t errors_start;
+    size_t errors_end;
+};
+
+struct Body_Queue {
+    const Parser* parent;
+    std::atomic<size_t> next;
+    Body_Result* results;
+};
+}
+
+static void run_body_worker(Body_Queue* queue, Body_Worker* worker, size_t worker_index) {
+    ZoneScoped;
+
+    const Parser* parent = queue->parent;
+    while (1) {
+        size_t i = queue->next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= parent->skipped_bodies.len()) {
+            break;
+        }
+
+        Body_Result* result = &queue->results[i];
+        result->worker = worker_index;
+        result->errors_start = worker->context.errors.len();
+        result->result = parse_skipped_body(&worker->context, worker->parser,
+                                            parent->body_tokens, parent->skipped_bodies[i]);
+        result->errors_end = worker->context.errors.len();
+    }
+}
+
+/// Cache the layout of the arrays `node` is built out of.  Composite types aren't followed since
+/// their members were laid out when they were defined.
+static void cache_array_layouts(Type* node) {
+    switch (node->tag) {
+        case Type::Pointer:
+            cache_array_layouts(((Type_Pointer*)node)->inner.get_type());
+            break;
+
+        case Type::Array: {
+            size_t size, alignment;
+            get_type_size_alignment(node, &size, &alignment);
+            cache_array_layouts(((Type_Array*)node)->inner.get_type());
+        } break;
+
+        case Type::Function: {
+            Type_Function* function = (Type_Function*)node;
+            cache_array_layouts(function->return_type.get_type());
+            for (size_t i = 0; i < function->parameter_types.len; ++i) {
+                cache_array_layouts(function->parameter_types[i].get_type());
+            }
+        } break;
+
+        default:
+            break;
+    }
+}
+
+/// `get_type_size_alignment` caches the layout of arrays the first time it is asked for.  The
+/// workers share every type interned so far with the parent (see `Type_Interner::init_worker`)
+/// and reach them through declarations, struct members, `sizeof`, and pointers.  Fill in the
+/// caches before starting the workers so they only ever read the shared types.
+static void cache_array_layouts(Parser* parser) {
+    ZoneScoped;
+
+    const cz::Str_Map<Type*>& types = parser->type_interner.types;
+    for (size_t i = 0; i < types.cap; ++i) {
+        if (types.is_present(i)) {
+            cache_array_layouts(types.values[i]);
+        }
+    }
+
+    // Arrays whose length couldn't be folded when they were declared aren't interned.
+    cz::Slice<Scope_Table<Declaration>::Binding> declarations = parser->declarations.scope(0);
+    for (size_t i = 0; i < declarations.len; ++i) {
+        cache_array_layouts(declarations[i].value.type.get_type());
+    }
+}
+
+Result parse_skipped_bodies_in_parallel(Context* context, Parser* parser, size_t threads) {
+    ZoneScoped;
+
+    size_t bodies = parser->skipped_bodies.len();
+    if (threads > bodies) {
+        threads = bodies;
+    }
+    if (threads == 0) {
+        return Result::ok();
+    }
+
+    cache_array_layouts(parser);
+
+    cz::Vector<Body_Result> results = {};
+    CZ_DEFER(results.drop(cz::heap_allocator()));
+    results.reserve(cz::heap_allocator(), bodies);
+    results.set_len(bodies);
+
+    cz::Vector<Body_Worker> workers = {};
+    CZ_DEFER(workers.drop(cz::heap_allocator()));
+    workers.reserve(cz::heap_allocator(), threads);
+    parser->workers.reserve(cz::heap_allocator(), threads);
+    for (size_t i = 0; i < threads; ++i) {
+        Body_Worker worker = {};
+        worker.parser = cz::heap_allocator().create<Parser>();
+        *worker.parser = {};
+        worker.parser->init_worker(*parser);
+        worker.context.error_message_buffer_array.create();
+        worker.context.temp_buffer_array.create();
+        workers.push(worker);
+
+        // The parent owns the workers so the bodies they parse live as long as it does.
+        parser->workers.push(worker.parser);
+    }
+
+    Body_Queue queue;
+    queue.parent = parser;
+    queue.next = 0;
+    queue.results = results.elems();
+
+    {
+        ZoneScopedN("Parse bodies");
+
+        // The calling thread is the first worker.
+        size_t spawned = threads - 1;
+        std::thread* handles = (std::thread*)cz::heap_allocator().alloc(
+            {sizeof(std::thread) * spawned, alignof(std::thread)});
+        CZ_ASSERT(handles || spawned == 0);
+        for (size_t i = 0; i < spawned; ++i) {
+            new (&handles[i]) std::thread(run_body_worker, &queue, &workers[i + 1], i + 1);
+        }
+
+        run_body_worker(&queue, &workers[0], 0);
+
+        for (size_t i = 0; i < spawned; ++i) {
+            handles[i].join();
+            handles[i].~thread();
+        }
+        cz::heap_allocator().dealloc({handles, sizeof(std::thread) * spawned});
+    }
+
+    // Report the errors as if the bodies were parsed in order.
+    Result result = Result::ok();
+    for (size_t i = 0; i < bodies; ++i) {
+        const Body_Result& body = results[i];
+        Context* worker_context = &workers[body.worker].context;
+        for (size_t j = body.errors_start; j < body.errors_end; ++j) {
+            const Compiler_Error& error = worker_context->errors[j];
+            cz::Slice<char> message = context->error_message_buffer_array.allocator().duplicate(
+                cz::Slice<const char>{error.message.buffer, error.message.len});
+            context->report_error_str(error.error_span, error.source_span,
+                                      {message.elems, message.len});
+        }
+
+        if (body.result.is_err() && result.is_ok()) {
+            result = body.result;
+        }
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        parser->ast_arena.stats.add(workers[i].parser->ast_arena.stats);
+
+        Context* worker_context = &workers[i].context;
+        worker_context->errors.drop(cz::heap_allocator());
+        worker_context->unspanned_errors.drop(cz::heap_allocator());
+        worker_context->error_message_buffer_array.drop();
+        worker_context->temp_buffer_array.drop();
+    }
+
+    return result;
+}
+
+}
+}
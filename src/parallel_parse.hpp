@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace red {
+struct Context;
+struct Result;
+
+namespace parse {
+struct Parser;
+
+/// Parse the function bodies that `parser` skipped and recorded (see `Parser::skip_bodies` and
+/// `Parser::record_body_tokens`) on `threads` threads.
+///
+/// Each thread parses bodies with its own worker parser (see `Parser::init_worker`) that reads a
+/// copy of the file scope.  Thus `parser` is only read while the workers run.  Errors are
+/// reported in the order of the bodies regardless of which thread parsed them.
+Result parse_skipped_bodies_in_parallel(Context* context, Parser* parser, size_t threads);
+
+}
+}
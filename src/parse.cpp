@@ -1,12 +1,15 @@
 #include "parse.hpp"
 
+#include <string.h>
 #include <Tracy.hpp>
 #include <cz/defer.hpp>
 #include <cz/heap.hpp>
 #include <cz/try.hpp>
 #include <new>
+#include <utility>
 #include "context.hpp"
 #include "result.hpp"
+#include "token_pipeline.hpp"
 
 namespace red {
 namespace parse {
@@ -70,16 +73,55 @@ static bool evaluate_expression(Expression* e, int64_t* value) {
                         break;
                 }
 
-                EVAL_OP(Plus, +);
-                EVAL_OP(Minus, -);
-                EVAL_OP(Divide, /);
-                EVAL_OP(Star, *);
+                {
+                    case Token::Divide:
+                        if (right == 0 || (left == INT64_MIN && right == -1)) {
+                            return false;
+                        }
+                        *value = left / right;
+                        break;
+                }
+
+                {
+                    case Token::Modulus:
+                        if (right == 0 || (left == INT64_MIN && right == -1)) {
+                            return false;
+                        }
+                        *value = left % right;
+                        break;
+                }
+
+#define EVAL_WRAPPING_OP(TK, OP)                               \
+    case Token::TK:                                            \
+        *value = (int64_t)((uint64_t)left OP(uint64_t) right); \
+        break
+                EVAL_WRAPPING_OP(Plus, +);
+                EVAL_WRAPPING_OP(Minus, -);
+                EVAL_WRAPPING_OP(Star, *);
+#undef EVAL_WRAPPING_OP
                 EVAL_OP(Ampersand, &);
                 EVAL_OP(And, &&);
                 EVAL_OP(Pipe, |);
                 EVAL_OP(Or, ||);
-                EVAL_OP(LeftShift, <<);
-                EVAL_OP(RightShift, >>);
+                EVAL_OP(Xor, ^);
+
+                {
+                    case Token::LeftShift:
+                        if (right < 0 || right >= 64) {
+                            return false;
+                        }
+                        *value = (int64_t)((uint64_t)left << right);
+                        break;
+                }
+
+                {
+                    case Token::RightShift:
+                        if (right < 0 || right >= 64) {
+                            return false;
+                        }
+                        *value = left >> right;
+                        break;
+                }
 
                 default:
                     return false;
@@ -118,26 +160,6 @@ static bool evaluate_expression(Expression* e, int64_t* value) {
             return true;
         }
 
-        case Expression::Sizeof_Expression: {
-            CZ_PANIC("evaluate_expression unhandled case sizeof(expression)");
-        }
-
-        case Expression::Function_Call: {
-            CZ_PANIC("evaluate_expression unhandled case function call");
-        }
-
-        case Expression::Index: {
-            CZ_PANIC("evaluate_expression unhandled case index");
-        }
-
-        case Expression::Address_Of: {
-            CZ_PANIC("evaluate_expression unhandled case address of");
-        }
-
-        case Expression::Dereference: {
-            CZ_PANIC("evaluate_expression unhandled case dereference");
-        }
-
         case Expression::Bit_Not: {
             Expression_Bit_Not* expression = (Expression_Bit_Not*)e;
             if (!evaluate_expression(expression->value, value)) {
@@ -156,32 +178,33 @@ static bool evaluate_expression(Expression* e, int64_t* value) {
             return true;
         }
 
-        case Expression::Member_Access: {
-            CZ_PANIC("evaluate_expression unhandled case member access");
-        }
-
-        case Expression::Dereference_Member_Access: {
-            CZ_PANIC("evaluate_expression unhandled case dereference member access");
-        }
-
-        case Expression::Pre_Increment: {
-            CZ_PANIC("evaluate_expression unhandled case pre-increment");
-        }
-
-        case Expression::Post_Increment: {
-            CZ_PANIC("evaluate_expression unhandled case post-increment");
-        }
+        // Todo: evaluate `sizeof` of an expression once expressions are typed.
+        case Expression::Sizeof_Expression:
+        case Expression::Function_Call:
+        case Expression::Index:
+        case Expression::Address_Of:
+        case Expression::Dereference:
+        case Expression::Member_Access:
+        case Expression::Dereference_Member_Access:
+        case Expression::Pre_Increment:
+        case Expression::Post_Increment:
+        case Expression::Pre_Decrement:
+        case Expression::Post_Decrement:
+            return false;
+    }
 
-        case Expression::Pre_Decrement: {
-            CZ_PANIC("evaluate_expression unhandled case pre-decrement");
-        }
+    CZ_PANIC("evaluate_expression unhandled case");
+}
 
-        case Expression::Post_Decrement: {
-            CZ_PANIC("evaluate_expression unhandled case post-decrement");
-        }
+static bool fold_array_length(Type_Array* array) {
+    int64_t length;
+    if (!evaluate_expression(array->o_length, &length)) {
+        return false;
     }
 
-    CZ_PANIC("evaluate_expression unhandled case");
+    array->length = length;
+    array->flags |= Type_Array::Length_Known;
+    return true;
 }
 
 bool get_type_size_alignment(const Type* type, size_t* size, size_t* alignment) {
@@ -277,20 +300,30 @@ bool get_type_size_alignment(const Type* type, size_t* size, size_t* alignment)
 
         case Type::Array: {
             Type_Array* array = (Type_Array*)type;
-            if (array->o_length) {
-                if (!get_type_size_alignment(array->inner.get_type(), size, alignment)) {
-                    return false;
-                }
+            if (!array->o_length) {
+                goto ptr;
+            }
 
-                int64_t length;
-                if (!evaluate_expression(array->o_length, &length)) {
-                    return false;
-                }
+            if (array->flags & Type_Array::Layout_Known) {
+                *size = array->size;
+                *alignment = array->alignment;
+                return true;
+            }
 
-                *size *= length;
-            } else {
-                goto ptr;
+            // The length is normally folded when the array is parsed but it may refer to types
+            // that weren't complete yet.
+            if (!(array->flags & Type_Array::Length_Known) && !fold_array_length(array)) {
+                return false;
             }
+
+            if (!get_type_size_alignment(array->inner.get_type(), size, alignment)) {
+                return false;
+            }
+
+            *size *= array->length;
+            array->size = *size;
+            array->alignment = *alignment;
+            array->flags |= Type_Array::Layout_Known;
             return true;
         }
     }
@@ -307,6 +340,8 @@ static Type* make_primitive(cz::Allocator allocator, Type::Tag tag) {
 void Parser::init() {
     lexer.init();
     buffer_array.create();
+    ast_arena.init();
+    type_interner.init();
 
     type_char = make_primitive(buffer_array.allocator(), Type::Builtin_Char);
     type_signed_char = make_primitive(buffer_array.allocator(), Type::Builtin_Signed_Char);
@@ -335,70 +370,97 @@ void Parser::init() {
     pairs[2].token.type = Token::Parser_Null_Token;
     pairs[3].token.type = Token::Parser_Null_Token;
 
-    type_stack.reserve(cz::heap_allocator(), 4);
-    typedef_stack.reserve(cz::heap_allocator(), 4);
-    declaration_stack.reserve(cz::heap_allocator(), 4);
-    type_stack.push({});
-    typedef_stack.push({});
-    declaration_stack.push({});
+    types.push_scope();
+    declarations.push_scope();
 }
 
-void Parser::drop() {
-    for (size_t i = 0; i < type_stack.len(); ++i) {
-        drop_types(&type_stack[i]);
-    }
-    type_stack.drop(cz::heap_allocator());
+void Parser::init_worker(const Parser& parent) {
+    buffer_array.create();
+    ast_arena.init();
+    type_interner.init_worker(parent.type_interner);
 
-    for (size_t i = 0; i < typedef_stack.len(); ++i) {
-        typedef_stack[i].drop(cz::heap_allocator());
-    }
-    typedef_stack.drop(cz::heap_allocator());
+    type_char = parent.type_char;
+    type_signed_char = parent.type_signed_char;
+    type_unsigned_char = parent.type_unsigned_char;
 
-    for (size_t i = 0; i < declaration_stack.len(); ++i) {
-        declaration_stack[i].drop(cz::heap_allocator());
-    }
-    declaration_stack.drop(cz::heap_allocator());
+    type_float = parent.type_float;
+    type_double = parent.type_double;
+    type_long_double = parent.type_long_double;
 
-    buffer_array.drop();
-    preprocessor.destroy();
-    lexer.drop();
-}
+    type_signed_short = parent.type_signed_short;
+    type_signed_int = parent.type_signed_int;
+    type_signed_long = parent.type_signed_long;
+    type_signed_long_long = parent.type_signed_long_long;
+    type_unsigned_short = parent.type_unsigned_short;
+    type_unsigned_int = parent.type_unsigned_int;
+    type_unsigned_long = parent.type_unsigned_long;
+    type_unsigned_long_long = parent.type_unsigned_long_long;
 
-void drop_type(Type* type) {
-    switch (type->tag) {
-        case Type::Enum: {
-            Type_Enum* t = (Type_Enum*)type;
-            t->values.drop(cz::heap_allocator());
-            break;
-        }
+    type_void = parent.type_void;
+    type_error = parent.type_error;
 
-        case Type::Struct:
-        case Type::Union: {
-            Type_Composite* t = (Type_Composite*)type;
-            drop_types(&t->types);
-            t->typedefs.drop(cz::heap_allocator());
-            t->declarations.drop(cz::heap_allocator());
-            break;
-        }
+    pairs[0].token.type = Token::Parser_Null_Token;
+    pairs[1].token.type = Token::Parser_Null_Token;
+    pairs[2].token.type = Token::Parser_Null_Token;
+    pairs[3].token.type = Token::Parser_Null_Token;
 
-        default:
-            break;
-    }
+    fold_constants = parent.fold_constants;
+
+    types.copy_outer_scope(parent.types);
+    declarations.copy_outer_scope(parent.declarations);
 }
 
-void drop_types(cz::Str_Map<Type*>* types) {
-    for (size_t i = 0; i < types->count; ++i) {
-        if (types->is_present(i)) {
-            drop_type(types->values[i]);
-        }
+void Parser::drop_worker() {
+    // The file scope types belong to the parent.
+    types.drop();
+    declarations.drop();
+
+    type_interner.drop();
+    ast_arena.drop();
+    buffer_array.drop();
+}
+
+void Parser::drop() {
+    for (size_t i = 0; i < workers.len(); ++i) {
+        workers[i]->drop_worker();
+        cz::heap_allocator().dealloc({workers[i], sizeof(Parser)});
     }
+    workers.drop(cz::heap_allocator());
 
-    types->drop(cz::heap_allocator());
+    types.drop();
+    declarations.drop();
+
+    type_interner.drop();
+    body_tokens.drop(cz::heap_allocator());
+    skipped_bodies.drop(cz::heap_allocator());
+    ast_arena.drop();
+    buffer_array.drop();
+    preprocessor.destroy();
+    lexer.drop();
 }
 
 static Result peek_token(Context* context, Parser* parser, Token_Source_Span_Pair* pair_out) {
     Token_Source_Span_Pair* pair = &parser->pairs[parser->pair_index];
     if (pair->token.type == Token::Parser_Null_Token) {
+        if (parser->replaying) {
+            if (parser->replay_index == parser->replay_tokens.len) {
+                return Result::done();
+            }
+            *pair = parser->replay_tokens[parser->replay_index++];
+            *pair_out = *pair;
+            return Result::ok();
+        }
+
+        if (parser->pipeline) {
+            Result result = parser->pipeline->next(context, pair);
+            if (result.type == Result::Success) {
+                *pair_out = *pair;
+            } else {
+                pair->token.type = Token::Parser_Null_Token;
+            }
+            return result;
+        }
+
         Result result =
             cpp::next_token(context, &parser->preprocessor, &parser->lexer, &pair->token);
         if (result.type == Result::Success) {
@@ -436,40 +498,47 @@ static void previous_token(Parser* parser, Token_Source_Span_Pair* pair) {
     *pair = parser->pairs[(parser->pair_index - 1) & 3];
 }
 
-static Declaration* lookup_declaration(Parser* parser, Hashed_Str id) {
+/// Look up an identifier in the ordinary namespace.  This resolves whether the identifier is a
+/// typedef (see `Declaration::Typedef`), a declaration, or undefined in one probe.
+static Declaration* lookup_ordinary(Parser* parser, Hashed_Str id) {
     ZoneScoped;
+    return parser->declarations.lookup(id);
+}
 
-    for (size_t i = parser->declaration_stack.len(); i-- > 0;) {
-        Declaration* declaration = parser->declaration_stack[i].get(id.str, id.hash);
-        if (declaration) {
-            return declaration;
-        }
+static Declaration* lookup_declaration(Parser* parser, Hashed_Str id) {
+    Declaration* declaration = lookup_ordinary(parser, id);
+    if (declaration && (declaration->flags & Declaration::Typedef)) {
+        return nullptr;
     }
-    return nullptr;
+    return declaration;
 }
 
-static Type_Definition* lookup_typedef(Parser* parser, Hashed_Str id) {
+/// Note that the returned type should be copied out before any other types are declared.
+static Type* lookup_type(Parser* parser, Hashed_Str id) {
     ZoneScoped;
+    Type** type = parser->types.lookup(id);
+    return type ? *type : nullptr;
+}
 
-    for (size_t i = parser->typedef_stack.len(); i-- > 0;) {
-        Type_Definition* type_def = parser->typedef_stack[i].get(id.str, id.hash);
-        if (type_def) {
-            return type_def;
-        }
-    }
-    return nullptr;
+static void push_scope(Parser* parser) {
+    parser->types.push_scope();
+    parser->declarations.push_scope();
 }
 
-static Type** lookup_type(Parser* parser, Hashed_Str id) {
-    ZoneScoped;
+/// Pop the innermost scope.  The types declared in it live on in `Parser::buffer_array` since the
+/// syntax tree may still refer to them.
+static void pop_scope(Parser* parser) {
+    parser->types.pop_scope();
+    parser->declarations.pop_scope();
+}
 
-    for (size_t i = parser->type_stack.len(); i-- > 0;) {
-        Type** type = parser->type_stack[i].get(id.str, id.hash);
-        if (type) {
-            return type;
-        }
-    }
-    return nullptr;
+/// Pop the innermost scope, moving its contents into the members of `composite`.
+static void pop_scope_into_composite(Parser* parser, Type_Composite* composite) {
+    composite->types = {};
+    composite->declarations = {};
+    cz::Allocator allocator = parser->buffer_array.allocator();
+    parser->types.pop_scope_into(&composite->types, allocator);
+    parser->declarations.pop_scope_into(&composite->declarations, allocator);
 }
 
 static void parse_const(Context* context, TypeP* type, Token_Source_Span_Pair pair) {
@@ -497,7 +566,6 @@ static Result parse_declaration_identifier_and_type(Context* context,
                                                     Parser* parser,
                                                     Hashed_Str* identifier,
                                                     TypeP* type,
-                                                    TypeP** inner_type_out,
                                                     cz::Slice<cz::Str>* parameter_names);
 
 static Result parse_parameters(Context* context,
@@ -547,7 +615,7 @@ static Result parse_parameters(Context* context,
         if (pair.token.type != Token::CloseParen && pair.token.type != Token::Comma) {
             cz::Slice<cz::Str> inner_parameter_names;
             CZ_TRY(parse_declaration_identifier_and_type(context, parser, &identifier, &type,
-                                                         nullptr, &inner_parameter_names));
+                                                         &inner_parameter_names));
         }
 
         parameter_types->reserve(cz::heap_allocator(), 1);
@@ -667,6 +735,127 @@ static bool typeps_equal(TypeP left, TypeP right, bool default_) {
     return types_equal(left.get_type(), right.get_type(), default_);
 }
 
+Result parse_function_body(Context* context,
+                           Parser* parser,
+                           const Type_Function* type,
+                           Function_Definition* function_definition) {
+    ZoneScoped;
+
+    Token_Source_Span_Pair start_pair;
+    Result result = peek_token(context, parser, &start_pair);
+    CZ_TRY_VAR(result);
+    CZ_DEBUG_ASSERT(result.type == Result::Success);
+    CZ_DEBUG_ASSERT(start_pair.token.type == Token::OpenCurly);
+
+    push_scope(parser);
+    CZ_DEFER(pop_scope(parser));
+
+    cz::Slice<cz::Str> parameter_names = function_definition->parameter_names;
+    for (size_t i = 0; i < parameter_names.len; ++i) {
+        Declaration declaration = {};
+        declaration.type = type->parameter_types[i];
+        parser->declarations.insert(Hashed_Str::from_str(parameter_names[i]), declaration);
+    }
+
+    Block block;
+    CZ_TRY(parse_block(context, parser, &block));
+
+    Token_Source_Span_Pair end_pair;
+    previous_token(parser, &end_pair);
+
+    function_definition->block = block;
+    function_definition->block_span.start = start_pair.source_span.start;
+    function_definition->block_span.end = end_pair.source_span.end;
+    return Result::ok();
+}
+
+/// Skip over a function body starting at its `{` without parsing it.
+static Result skip_function_body(Context* context,
+                                 Parser* parser,
+                                 Type_Function* type,
+                                 Function_Definition* function_definition) {
+    ZoneScoped;
+
+    Skipped_Body body;
+    body.function_definition = function_definition;
+    body.function_type = type;
+    body.tokens_start = parser->body_tokens.len();
+    body.declarations_end = parser->declarations.bindings.len();
+    body.types_end = parser->types.bindings.len();
+
+    Token_Source_Span_Pair start_pair;
+    peek_token(context, parser, &start_pair);
+    CZ_DEBUG_ASSERT(start_pair.token.type == Token::OpenCurly);
+
+    size_t depth = 0;
+    Token_Source_Span_Pair pair;
+    do {
+        Result result = next_token(context, parser, &pair);
+        CZ_TRY_VAR(result);
+        if (result.type == Result::Done) {
+            context->report_error(start_pair.token.span, start_pair.source_span,
+                                  "Unterminated function body");
+            return {Result::ErrorInvalidInput};
+        }
+
+        if (parser->record_body_tokens) {
+            parser->body_tokens.reserve(cz::heap_allocator(), 1);
+            parser->body_tokens.push(pair);
+        }
+
+        if (pair.token.type == Token::OpenCurly) {
+            ++depth;
+        } else if (pair.token.type == Token::CloseCurly) {
+            --depth;
+        }
+    } while (depth > 0);
+
+    body.tokens_end = parser->body_tokens.len();
+    parser->skipped_bodies.reserve(cz::heap_allocator(), 1);
+    parser->skipped_bodies.push(body);
+
+    function_definition->block = {};
+    function_definition->block_span.start = start_pair.source_span.start;
+    function_definition->block_span.end = pair.source_span.end;
+    return Result::ok();
+}
+
+Result parse_skipped_body(Context* context,
+                          Parser* parser,
+                          cz::Slice<Token_Source_Span_Pair> tokens,
+                          const Skipped_Body& body) {
+    ZoneScoped;
+
+    CZ_DEBUG_ASSERT(body.tokens_end > body.tokens_start);
+
+    // Save the lookahead of the main token stream.
+    Token_Source_Span_Pair pairs[4];
+    memcpy(pairs, parser->pairs, sizeof(pairs));
+    int pair_index = parser->pair_index;
+    for (size_t i = 0; i < 4; ++i) {
+        parser->pairs[i].token.type = Token::Parser_Null_Token;
+    }
+
+    parser->replaying = true;
+    parser->replay_tokens = {tokens.elems + body.tokens_start, body.tokens_end - body.tokens_start};
+    parser->replay_index = 0;
+
+    parser->declarations.hidden_start = body.declarations_end;
+    parser->declarations.hidden_end = parser->declarations.bindings.len();
+    parser->types.hidden_start = body.types_end;
+    parser->types.hidden_end = parser->types.bindings.len();
+
+    CZ_DEFER({
+        parser->declarations.hidden_start = parser->declarations.hidden_end = 0;
+        parser->types.hidden_start = parser->types.hidden_end = 0;
+        parser->replaying = false;
+        memcpy(parser->pairs, pairs, sizeof(pairs));
+        parser->pair_index = pair_index;
+    });
+
+    return parse_function_body(context, parser, body.function_type, body.function_definition);
+}
+
 static Result parse_declaration_initializer(Context* context,
                                             Parser* parser,
                                             Declaration declaration,
@@ -692,43 +881,26 @@ static Result parse_declaration_initializer(Context* context,
             }
 
             case Token::OpenCurly: {
-                cz::Str_Map<Declaration> parameters = {};
-                parameters.reserve(cz::heap_allocator(), parameter_names.len);
                 Type_Function* fun = (Type_Function*)declaration.type.get_type();
-                for (size_t i = 0; i < parameter_names.len; ++i) {
-                    Declaration declaration = {};
-                    declaration.type = fun->parameter_types[i];
-                    parameters.insert_hash(parameter_names[i], declaration);
-                }
-
-                parser->type_stack.reserve(cz::heap_allocator(), 1);
-                parser->typedef_stack.reserve(cz::heap_allocator(), 1);
-                parser->declaration_stack.reserve(cz::heap_allocator(), 1);
-                parser->type_stack.push({});
-                parser->typedef_stack.push({});
-                parser->declaration_stack.push(parameters);
-                CZ_DEFER({
-                    drop_types(&parser->type_stack.last());
-                    parser->typedef_stack.last().drop(cz::heap_allocator());
-                    parser->declaration_stack.last().drop(cz::heap_allocator());
-                    parser->type_stack.pop();
-                    parser->typedef_stack.pop();
-                    parser->declaration_stack.pop();
-                });
-
-                Block block;
-                CZ_TRY(parse_block(context, parser, &block));
-
-                Token_Source_Span_Pair end_pair;
-                previous_token(parser, &end_pair);
-
                 Function_Definition* function_definition =
                     parser->buffer_array.allocator().create<Function_Definition>();
                 function_definition->parameter_names = parameter_names;
-                function_definition->block = block;
-                function_definition->block_span.start = pair.source_span.start;
-                function_definition->block_span.end = end_pair.source_span.end;
+                if (parser->skip_bodies) {
+                    CZ_TRY(skip_function_body(context, parser, fun, function_definition));
+                } else if (parser->body_arena) {
+                    std::swap(parser->ast_arena, *parser->body_arena);
+                    parser->in_body_arena = true;
+                    Result body_result =
+                        parse_function_body(context, parser, fun, function_definition);
+                    parser->in_body_arena = false;
+                    std::swap(parser->ast_arena, *parser->body_arena);
+                    CZ_TRY(body_result);
+                } else {
+                    CZ_TRY(parse_function_body(context, parser, fun, function_definition));
+                }
                 declaration.v.function_definition = function_definition;
+                parser->last_function_definition = function_definition;
+                parser->last_function_type = fun;
 
                 *force_terminate = true;
             } break;
@@ -753,7 +925,7 @@ static Result parse_declaration_initializer(Context* context,
                 }
 
                 Statement_Initializer_Copy* initializer =
-                    parser->buffer_array.allocator().create<Statement_Initializer_Copy>();
+                    parser->ast_arena.create_statement<Statement_Initializer_Copy>();
                 initializer->span.start = declaration.span.start;
                 initializer->span.end = value->span.end;
                 initializer->identifier = identifier;
@@ -765,7 +937,7 @@ static Result parse_declaration_initializer(Context* context,
 
             default: {
                 Statement_Initializer_Default* initializer =
-                    parser->buffer_array.allocator().create<Statement_Initializer_Default>();
+                    parser->ast_arena.create_statement<Statement_Initializer_Default>();
                 initializer->span = declaration.span;
                 initializer->identifier = identifier;
                 initializers->reserve(cz::heap_allocator(), 1);
@@ -775,13 +947,19 @@ static Result parse_declaration_initializer(Context* context,
         }
     }
 
-    cz::Str_Map<Declaration>* declarations = &parser->declaration_stack.last();
-    Declaration* existing_declaration = declarations->get(identifier.str, identifier.hash);
+    Declaration* existing_declaration = parser->declarations.lookup_in_scope(identifier);
     if (!existing_declaration) {
-        declarations->reserve(cz::heap_allocator(), 1);
-        declarations->insert(identifier.str, identifier.hash, declaration);
-    } else if (existing_declaration &&
-               typeps_equal(declaration.type, existing_declaration->type, true)) {
+        parser->declarations.insert(identifier, declaration);
+    } else if ((declaration.flags & Declaration::Typedef) &&
+               (existing_declaration->flags & Declaration::Typedef)) {
+        context->report_error(previous_span, previous_source_span, "Typedef `", identifier.str,
+                              "` has already been created");
+        context->report_error(existing_declaration->span, existing_declaration->span,
+                              "Note: it was created here");
+    } else if ((declaration.flags & Declaration::Typedef) !=
+               (existing_declaration->flags & Declaration::Typedef)) {
+        goto error_declaration_already_created;
+    } else if (typeps_equal(declaration.type, existing_declaration->type, true)) {
         if (declaration.type.get_type()->tag == Type::Function) {
             if (existing_declaration->v.function_definition && declaration.v.function_definition) {
                 goto error_declaration_already_created;
@@ -799,12 +977,12 @@ static Result parse_declaration_initializer(Context* context,
     return Result::ok();
 }
 
-static Result parse_declaration_identifier_and_type(Context* context,
-                                                    Parser* parser,
-                                                    Hashed_Str* identifier,
-                                                    TypeP* overall_type,
-                                                    TypeP** inner_type_out,
-                                                    cz::Slice<cz::Str>* parameter_names_out) {
+static Result parse_declaration_identifier_and_type_(Context* context,
+                                                     Parser* parser,
+                                                     Hashed_Str* identifier,
+                                                     TypeP* overall_type,
+                                                     TypeP** inner_type_out,
+                                                     cz::Slice<cz::Str>* parameter_names_out) {
     ZoneScoped;
 
     /// We need to parse `(*function)(params)` to `Pointer(Function([params], base type))`.
@@ -900,8 +1078,8 @@ static Result parse_declaration_identifier_and_type(Context* context,
 
                     next_token_after_peek(parser);
 
-                    CZ_TRY(parse_declaration_identifier_and_type(context, parser, identifier, type,
-                                                                 &type, parameter_names_out));
+                    CZ_TRY(parse_declaration_identifier_and_type_(context, parser, identifier, type,
+                                                                  &type, parameter_names_out));
                     already_hit_identifier = true;
 
                     result = next_token(context, parser, &pair);
@@ -955,6 +1133,10 @@ static Result parse_declaration_identifier_and_type(Context* context,
                 Type_Array* array = parser->buffer_array.allocator().create<Type_Array>();
                 array->inner = *type;
                 array->o_length = length;
+                array->flags = 0;
+                if (length) {
+                    fold_array_length(array);
+                }
                 if (inner_type_out) {
                     *inner_type_out = &array->inner;
                     inner_type_out = nullptr;
@@ -1009,6 +1191,37 @@ static Result parse_declaration_identifier_and_type(Context* context,
     }
 }
 
+static Result parse_declaration_identifier_and_type(Context* context,
+                                                    Parser* parser,
+                                                    Hashed_Str* identifier,
+                                                    TypeP* type,
+                                                    cz::Slice<cz::Str>* parameter_names) {
+    CZ_TRY(parse_declaration_identifier_and_type_(context, parser, identifier, type, nullptr,
+                                                  parameter_names));
+
+    // The declarator patches the nodes it creates until it is finished so intern them afterwards.
+    *type = parser->type_interner.intern(parser->buffer_array.allocator(), *type);
+    return Result::ok();
+}
+
+/// Types outlive the function body they are declared in so while a body is being parsed into
+/// `Parser::body_arena` switch back to the file's arena for a struct or union body.
+static bool enter_file_arena(Parser* parser) {
+    if (!parser->in_body_arena) {
+        return false;
+    }
+    std::swap(parser->ast_arena, *parser->body_arena);
+    parser->in_body_arena = false;
+    return true;
+}
+
+static void exit_file_arena(Parser* parser, bool entered) {
+    if (entered) {
+        std::swap(parser->ast_arena, *parser->body_arena);
+        parser->in_body_arena = true;
+    }
+}
+
 static Result parse_composite_body(Context* context,
                                    Parser* parser,
                                    cz::Vector<Statement*>* initializers,
@@ -1037,7 +1250,7 @@ static Result parse_composite_body(Context* context,
 
 static Result parse_enum_body(Context* context,
                               Parser* parser,
-                              cz::Str_Map<int64_t>* values,
+                              Small_Map<int64_t, 8>* values,
                               uint32_t* flags,
                               Span enum_span,
                               Span enum_source_span) {
@@ -1096,7 +1309,7 @@ static Result parse_enum_body(Context* context,
             }
         }
 
-        values->reserve(cz::heap_allocator(), 1);
+        values->reserve(parser->buffer_array.allocator(), 1);
         if (!values->get(name.str, name.hash)) {
             values->insert(name.str, name.hash, value);
         } else {
@@ -1142,6 +1355,77 @@ struct Numeric_Base {
     };
 };
 
+static void get_member_size_alignment(Context* context,
+                                      const Declaration* declaration,
+                                      size_t* size,
+                                      size_t* alignment) {
+    if (!get_type_size_alignment(declaration->type.get_type(), size, alignment)) {
+        context->report_error(declaration->span, declaration->span,
+                              "Declaration must have constant size");
+        *size = 0;
+        *alignment = 1;
+    }
+}
+
+/// Lay out the members of a struct in declaration order.  This is done once when the body is
+/// closed; afterwards `get_type_size_alignment` just reads the result.
+static void layout_struct(Context* context, Type_Struct* struct_type) {
+    ZoneScoped;
+
+    struct_type->size = 0;
+    struct_type->alignment = 1;
+    for (size_t i = 0; i < struct_type->initializers.len; ++i) {
+        Statement_Initializer* initializer = (Statement_Initializer*)struct_type->initializers[i];
+
+        Declaration* declaration = struct_type->declarations.get(initializer->identifier.str,
+                                                                 initializer->identifier.hash);
+        CZ_DEBUG_ASSERT(declaration);
+        if (declaration->flags & Declaration::Typedef) {
+            continue;
+        }
+
+        size_t size, alignment;
+        get_member_size_alignment(context, declaration, &size, &alignment);
+
+        if (alignment > struct_type->alignment) {
+            struct_type->alignment = alignment;
+        }
+
+        struct_type->size += alignment - 1;
+        struct_type->size &= ~(alignment - 1);
+
+        struct_type->size += size;
+    }
+}
+
+/// Lay out the members of a union.  See `layout_struct`.
+static void layout_union(Context* context, Type_Union* union_type) {
+    ZoneScoped;
+
+    union_type->size = 0;
+    union_type->alignment = 1;
+    for (size_t i = 0; i < union_type->declarations.slots(); ++i) {
+        if (!union_type->declarations.is_present(i)) {
+            continue;
+        }
+
+        Declaration* declaration = &union_type->declarations.value(i);
+        if (declaration->flags & Declaration::Typedef) {
+            continue;
+        }
+
+        size_t size, alignment;
+        get_member_size_alignment(context, declaration, &size, &alignment);
+
+        if (size > union_type->size) {
+            union_type->size = size;
+        }
+        if (alignment > union_type->alignment) {
+            union_type->alignment = alignment;
+        }
+    }
+}
+
 static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type) {
     // Todo: dealloc anonymous structures.  This will probably work by copying the type information
     // into the buffer array.
@@ -1199,9 +1483,9 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                 if (pair.token.type == Token::Semicolon) {
                     if (identifier.str.len > 0) {
-                        Type** type = lookup_type(parser, identifier);
+                        Type* type = lookup_type(parser, identifier);
                         if (type) {
-                            if ((*type)->tag != Type::Struct) {
+                            if (type->tag != Type::Struct) {
                                 context->report_error(identifier_span, identifier_source_span,
                                                       "Type `", identifier.str,
                                                       "` is not a struct");
@@ -1216,13 +1500,10 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                                                  identifier_source_span.end};
 
                             struct_type->types = {};
-                            struct_type->typedefs = {};
                             struct_type->declarations = {};
                             struct_type->initializers = {};
                             struct_type->flags = 0;
-                            cz::Str_Map<Type*>* types = &parser->type_stack.last();
-                            types->reserve(cz::heap_allocator(), 1);
-                            types->insert(identifier.str, identifier.hash, struct_type);
+                            parser->types.insert(identifier, struct_type);
                         }
                     }
                     return Result::ok();
@@ -1231,11 +1512,11 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                 if (pair.token.type == Token::OpenCurly) {
                     next_token_after_peek(parser);
 
-                    Type** type = lookup_type(parser, identifier);
+                    Type* type = lookup_type(parser, identifier);
                     Type_Struct* struct_type = nullptr;
                     if (type) {
-                        if ((*type)->tag == Type::Struct) {
-                            struct_type = (Type_Struct*)*type;
+                        if (type->tag == Type::Struct) {
+                            struct_type = (Type_Struct*)type;
                             if (struct_type->flags & Type_Struct::Defined) {
                                 context->report_error(identifier_span, identifier_source_span,
                                                       "Type `", identifier.str,
@@ -1251,43 +1532,38 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                     uint32_t flags = Type_Struct::Defined;
 
-                    parser->type_stack.reserve(cz::heap_allocator(), 1);
-                    parser->typedef_stack.reserve(cz::heap_allocator(), 1);
-                    parser->declaration_stack.reserve(cz::heap_allocator(), 1);
-                    parser->type_stack.push({});
-                    parser->typedef_stack.push({});
-                    parser->declaration_stack.push({});
-                    bool cleanup_last_stack = true;
+                    bool entered_file_arena = enter_file_arena(parser);
+                    CZ_DEFER(exit_file_arena(parser, entered_file_arena));
+
+                    push_scope(parser);
+                    bool scope_popped = false;
                     CZ_DEFER({
-                        if (cleanup_last_stack) {
-                            drop_types(&parser->type_stack.last());
-                            parser->typedef_stack.last().drop(cz::heap_allocator());
-                            parser->declaration_stack.last().drop(cz::heap_allocator());
+                        if (!scope_popped) {
+                            pop_scope(parser);
                         }
-                        parser->type_stack.pop();
-                        parser->typedef_stack.pop();
-                        parser->declaration_stack.pop();
                     });
 
-                    cz::Vector<Statement*> initializers = {};
-                    CZ_DEFER(initializers.drop(cz::heap_allocator()));
-                    CZ_TRY(parse_composite_body(context, parser, &initializers, &flags, struct_span,
+                    cz::Vector<Statement*>* initializers = &parser->ast_arena.statement_stack;
+                    size_t initializers_start = initializers->len();
+                    CZ_DEFER(initializers->set_len(initializers_start));
+                    CZ_TRY(parse_composite_body(context, parser, initializers, &flags, struct_span,
                                                 struct_source_span));
 
                     // If type is already defined, just don't define it again.  This allows us to
                     // continue parsing which is good.
                     if (!type) {
+                        bool declare = !struct_type;
                         if (!struct_type) {
                             struct_type = parser->buffer_array.allocator().create<Type_Struct>();
-                            if (identifier.str.len > 0) {
-                                cz::Str_Map<Type*>* types =
-                                    &parser->type_stack[parser->type_stack.len() - 2];
-                                types->reserve(cz::heap_allocator(), 1);
-                                types->insert(identifier.str, identifier.hash, struct_type);
-                            }
                         }
 
-                        cleanup_last_stack = false;
+                        // The members now belong to the struct.  Then declare the struct in the
+                        // enclosing scope.
+                        pop_scope_into_composite(parser, struct_type);
+                        scope_popped = true;
+                        if (declare && identifier.str.len > 0) {
+                            parser->types.insert(identifier, struct_type);
+                        }
 
                         // Todo: :MacroSpan rather than always using the source span, use the
                         // spans from the outermost macro that contains all the tokens.
@@ -1295,57 +1571,26 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                         previous_token(parser, &end_pair);
                         struct_type->span = {struct_source_span.start, end_pair.source_span.end};
 
-                        struct_type->types = parser->type_stack.last();
-                        struct_type->typedefs = parser->typedef_stack.last();
-                        struct_type->declarations = parser->declaration_stack.last();
                         struct_type->initializers =
-                            parser->buffer_array.allocator().duplicate(initializers.as_slice());
+                            parser->ast_arena.carve(initializers, initializers_start);
                         struct_type->flags = flags;
-
-                        struct_type->size = 0;
-                        struct_type->alignment = 1;
-                        for (size_t i = 0; i < struct_type->initializers.len; ++i) {
-                            Statement_Initializer* initializer =
-                                (Statement_Initializer*)struct_type->initializers[i];
-
-                            Declaration* declaration = struct_type->declarations.get(
-                                initializer->identifier.str, initializer->identifier.hash);
-                            CZ_DEBUG_ASSERT(declaration);
-
-                            size_t size, alignment;
-                            if (!get_type_size_alignment(declaration->type.get_type(), &size,
-                                                         &alignment)) {
-                                context->report_error(declaration->span, declaration->span,
-                                                      "Declaration must have constant size");
-                                size = 0;
-                                alignment = 1;
-                            }
-
-                            if (alignment > struct_type->alignment) {
-                                struct_type->alignment = alignment;
-                            }
-
-                            struct_type->size += alignment - 1;
-                            struct_type->size &= ~(alignment - 1);
-
-                            struct_type->size += size;
-                        }
+                        layout_struct(context, struct_type);
 
                         base_type->set_type(struct_type);
                     } else {
-                        base_type->set_type(*type);
+                        base_type->set_type(type);
                     }
                     break;
                 } else {
                     if (identifier.str.len > 0) {
-                        Type** type = lookup_type(parser, identifier);
+                        Type* type = lookup_type(parser, identifier);
                         if (type) {
-                            if ((*type)->tag != Type::Struct) {
+                            if (type->tag != Type::Struct) {
                                 context->report_error(identifier_span, identifier_source_span,
                                                       "Type `", identifier.str,
                                                       "` is not a struct");
                             }
-                            base_type->set_type(*type);
+                            base_type->set_type(type);
                         } else {
                             Type_Struct* struct_type =
                                 parser->buffer_array.allocator().create<Type_Struct>();
@@ -1356,13 +1601,10 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                                                  identifier_source_span.end};
 
                             struct_type->types = {};
-                            struct_type->typedefs = {};
                             struct_type->declarations = {};
                             struct_type->initializers = {};
                             struct_type->flags = 0;
-                            cz::Str_Map<Type*>* types = &parser->type_stack.last();
-                            types->reserve(cz::heap_allocator(), 1);
-                            types->insert(identifier.str, identifier.hash, struct_type);
+                            parser->types.insert(identifier, struct_type);
                             base_type->set_type(struct_type);
                         }
                     } else {
@@ -1407,9 +1649,9 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                 if (pair.token.type == Token::Semicolon) {
                     if (identifier.str.len > 0) {
-                        Type** type = lookup_type(parser, identifier);
+                        Type* type = lookup_type(parser, identifier);
                         if (type) {
-                            if ((*type)->tag != Type::Union) {
+                            if (type->tag != Type::Union) {
                                 context->report_error(identifier_span, identifier_source_span,
                                                       "Type `", identifier.str, "` is not a union");
                                 return {Result::ErrorInvalidInput};
@@ -1424,12 +1666,9 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                                                 identifier_source_span.end};
 
                             union_type->types = {};
-                            union_type->typedefs = {};
                             union_type->declarations = {};
                             union_type->flags = 0;
-                            cz::Str_Map<Type*>* types = &parser->type_stack.last();
-                            types->reserve(cz::heap_allocator(), 1);
-                            types->insert(identifier.str, identifier.hash, union_type);
+                            parser->types.insert(identifier, union_type);
                         }
                     }
                     return Result::ok();
@@ -1438,11 +1677,11 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                 if (pair.token.type == Token::OpenCurly) {
                     next_token_after_peek(parser);
 
-                    Type** type = lookup_type(parser, identifier);
+                    Type* type = lookup_type(parser, identifier);
                     Type_Union* union_type = nullptr;
                     if (type) {
-                        if ((*type)->tag == Type::Union) {
-                            union_type = (Type_Union*)*type;
+                        if (type->tag == Type::Union) {
+                            union_type = (Type_Union*)type;
                             if (union_type->flags & Type_Union::Defined) {
                                 context->report_error(identifier_span, identifier_source_span,
                                                       "Type `", identifier.str,
@@ -1458,48 +1697,43 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                     uint32_t flags = Type_Union::Defined;
 
-                    parser->type_stack.reserve(cz::heap_allocator(), 1);
-                    parser->typedef_stack.reserve(cz::heap_allocator(), 1);
-                    parser->declaration_stack.reserve(cz::heap_allocator(), 1);
-                    parser->type_stack.push({});
-                    parser->typedef_stack.push({});
-                    parser->declaration_stack.push({});
-                    bool cleanup_last_stack = true;
+                    bool entered_file_arena = enter_file_arena(parser);
+                    CZ_DEFER(exit_file_arena(parser, entered_file_arena));
+
+                    push_scope(parser);
+                    bool scope_popped = false;
                     CZ_DEFER({
-                        if (cleanup_last_stack) {
-                            drop_types(&parser->type_stack.last());
-                            parser->typedef_stack.last().drop(cz::heap_allocator());
-                            parser->declaration_stack.last().drop(cz::heap_allocator());
+                        if (!scope_popped) {
+                            pop_scope(parser);
                         }
-                        parser->type_stack.pop();
-                        parser->typedef_stack.pop();
-                        parser->declaration_stack.pop();
                     });
 
-                    cz::Vector<Statement*> initializers = {};
-                    CZ_DEFER(initializers.drop(cz::heap_allocator()));
-                    CZ_TRY(parse_composite_body(context, parser, &initializers, &flags, union_span,
+                    cz::Vector<Statement*>* initializers = &parser->ast_arena.statement_stack;
+                    size_t initializers_start = initializers->len();
+                    CZ_DEFER(initializers->set_len(initializers_start));
+                    CZ_TRY(parse_composite_body(context, parser, initializers, &flags, union_span,
                                                 union_source_span));
 
-                    for (size_t i = 0; i < initializers.len(); ++i) {
-                        if (initializers[i]->tag != Statement::Initializer_Default) {
+                    for (size_t i = initializers_start; i < initializers->len(); ++i) {
+                        if ((*initializers)[i]->tag != Statement::Initializer_Default) {
                             context->report_error(union_span, union_source_span,
                                                   "Union variants cannot have initializers");
                         }
                     }
 
                     if (!type) {
+                        bool declare = !union_type;
                         if (!union_type) {
                             union_type = parser->buffer_array.allocator().create<Type_Union>();
-                            if (identifier.str.len > 0) {
-                                cz::Str_Map<Type*>* types =
-                                    &parser->type_stack[parser->type_stack.len() - 2];
-                                types->reserve(cz::heap_allocator(), 1);
-                                types->insert(identifier.str, identifier.hash, union_type);
-                            }
                         }
 
-                        cleanup_last_stack = false;
+                        // The members now belong to the union.  Then declare the union in the
+                        // enclosing scope.
+                        pop_scope_into_composite(parser, union_type);
+                        scope_popped = true;
+                        if (declare && identifier.str.len > 0) {
+                            parser->types.insert(identifier, union_type);
+                        }
 
                         // Todo: :MacroSpan rather than always using the source span, use the
                         // spans from the outermost macro that contains all the tokens.
@@ -1507,48 +1741,23 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                         previous_token(parser, &end_pair);
                         union_type->span = {union_source_span.start, end_pair.source_span.end};
 
-                        union_type->types = parser->type_stack.last();
-                        union_type->typedefs = parser->typedef_stack.last();
-                        union_type->declarations = parser->declaration_stack.last();
                         union_type->flags = flags;
-
-                        union_type->size = 0;
-                        union_type->alignment = 1;
-                        for (size_t i = 0; i < union_type->declarations.cap; ++i) {
-                            if (union_type->declarations.is_present(i)) {
-                                Declaration* declaration = &union_type->declarations.values[i];
-                                size_t size, alignment;
-                                if (!get_type_size_alignment(declaration->type.get_type(), &size,
-                                                             &alignment)) {
-                                    context->report_error(declaration->span, declaration->span,
-                                                          "Declaration must have constant size");
-                                    size = 0;
-                                    alignment = 1;
-                                }
-
-                                if (size > union_type->size) {
-                                    union_type->size = size;
-                                }
-                                if (alignment > union_type->alignment) {
-                                    union_type->alignment = alignment;
-                                }
-                            }
-                        }
+                        layout_union(context, union_type);
 
                         base_type->set_type(union_type);
                     } else {
-                        base_type->set_type(*type);
+                        base_type->set_type(type);
                     }
                     break;
                 } else {
                     if (identifier.str.len > 0) {
-                        Type** type = lookup_type(parser, identifier);
+                        Type* type = lookup_type(parser, identifier);
                         if (type) {
-                            if ((*type)->tag != Type::Union) {
+                            if (type->tag != Type::Union) {
                                 context->report_error(identifier_span, identifier_source_span,
                                                       "Type `", identifier.str, "` is not a union");
                             }
-                            base_type->set_type(*type);
+                            base_type->set_type(type);
                         } else {
                             Type_Union* union_type =
                                 parser->buffer_array.allocator().create<Type_Union>();
@@ -1559,12 +1768,9 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                                                 identifier_source_span.end};
 
                             union_type->types = {};
-                            union_type->typedefs = {};
                             union_type->declarations = {};
                             union_type->flags = 0;
-                            cz::Str_Map<Type*>* types = &parser->type_stack.last();
-                            types->reserve(cz::heap_allocator(), 1);
-                            types->insert(identifier.str, identifier.hash, union_type);
+                            parser->types.insert(identifier, union_type);
                             base_type->set_type(union_type);
                         }
                     } else {
@@ -1608,9 +1814,9 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                 if (pair.token.type == Token::Semicolon) {
                     if (identifier.str.len > 0) {
-                        Type** type = lookup_type(parser, identifier);
+                        Type* type = lookup_type(parser, identifier);
                         if (type) {
-                            if ((*type)->tag != Type::Enum) {
+                            if (type->tag != Type::Enum) {
                                 context->report_error(identifier_span, identifier_source_span,
                                                       "Type `", identifier.str, "` is not an enum");
                             }
@@ -1624,9 +1830,7 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                             enum_type->values = {};
                             enum_type->flags = 0;
-                            cz::Str_Map<Type*>* types = &parser->type_stack.last();
-                            types->reserve(cz::heap_allocator(), 1);
-                            types->insert(identifier.str, identifier.hash, enum_type);
+                            parser->types.insert(identifier, enum_type);
                         }
                     }
                     return Result::ok();
@@ -1635,11 +1839,11 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                 if (pair.token.type == Token::OpenCurly) {
                     next_token_after_peek(parser);
 
-                    Type** type = lookup_type(parser, identifier);
+                    Type* type = lookup_type(parser, identifier);
                     Type_Enum* enum_type = nullptr;
                     if (type) {
-                        if ((*type)->tag == Type::Enum) {
-                            enum_type = (Type_Enum*)*type;
+                        if (type->tag == Type::Enum) {
+                            enum_type = (Type_Enum*)type;
                             if (enum_type->flags & Type_Enum::Defined) {
                                 context->report_error(identifier_span, identifier_source_span,
                                                       "Type `", identifier.str,
@@ -1655,19 +1859,15 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                     uint32_t flags = Type_Enum::Defined;
 
-                    cz::Str_Map<int64_t> values = {};
-                    bool destroy_values = true;
-                    CZ_DEFER(if (destroy_values) { values.drop(cz::heap_allocator()); });
+                    Small_Map<int64_t, 8> values = {};
 
                     CZ_TRY(parse_enum_body(context, parser, &values, &flags, enum_span,
                                            enum_source_span));
 
-                    cz::Str_Map<Declaration>* declarations = &parser->declaration_stack.last();
-                    declarations->reserve(cz::heap_allocator(), values.cap);
-                    for (size_t i = 0; i < values.cap; ++i) {
+                    for (size_t i = 0; i < values.slots(); ++i) {
                         if (values.is_present(i)) {
-                            Hashed_Str key = Hashed_Str::from_str(values.keys[i]);
-                            if (!declarations->get(key.str, key.hash)) {
+                            Hashed_Str key = Hashed_Str::from_str(values.key(i));
+                            if (!parser->declarations.lookup_in_scope(key)) {
                                 Declaration declaration = {};
                                 // Todo: add spans
                                 declaration.span = {};
@@ -1677,18 +1877,21 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                                 declaration.type.set_const();
 
                                 Statement_Initializer_Copy* initializer =
-                                    parser->buffer_array.allocator()
-                                        .create<Statement_Initializer_Copy>();
+                                    parser->ast_arena
+                                        .create_statement<Statement_Initializer_Copy>();
+                                initializer->span = {};
                                 initializer->identifier = key;
-                                Expression_Integer* value =
-                                    parser->buffer_array.allocator().create<Expression_Integer>();
-                                value->value = values.values[i];
+                                Expression_Integer* value = parser->ast_arena.create_integer();
+                                value->span = {};
+                                value->value = values.value(i);
+                                value->is_int = values.value(i) >= INT32_MIN &&
+                                                values.value(i) <= INT32_MAX;
                                 initializer->value = value;
                                 declaration.v.initializer = initializer;
 
                                 declaration.flags = Declaration::Enum_Variant;
 
-                                declarations->insert(key.str, key.hash, declaration);
+                                parser->declarations.insert(key, declaration);
                             }
                         }
                     }
@@ -1697,15 +1900,10 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                         if (!enum_type) {
                             enum_type = parser->buffer_array.allocator().create<Type_Enum>();
                             if (identifier.str.len > 0) {
-                                cz::Str_Map<Type*>* types =
-                                    &parser->type_stack[parser->type_stack.len() - 2];
-                                types->reserve(cz::heap_allocator(), 1);
-                                types->insert(identifier.str, identifier.hash, enum_type);
+                                parser->types.insert(identifier, enum_type);
                             }
                         }
 
-                        destroy_values = false;
-
                         // Todo: :MacroSpan rather than always using the source span, use the
                         // spans from the outermost macro that contains all the tokens.
                         Token_Source_Span_Pair end_pair;
@@ -1717,17 +1915,17 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                         base_type->set_type(enum_type);
                     } else {
-                        base_type->set_type(*type);
+                        base_type->set_type(type);
                     }
                     break;
                 } else {
-                    Type** type = lookup_type(parser, identifier);
+                    Type* type = lookup_type(parser, identifier);
                     if (type) {
-                        if ((*type)->tag != Type::Enum) {
+                        if (type->tag != Type::Enum) {
                             context->report_error(identifier_span, identifier_source_span, "Type `",
                                                   identifier.str, "` is not an enum");
                         }
-                        base_type->set_type(*type);
+                        base_type->set_type(type);
                     } else {
                         Type_Enum* enum_type = parser->buffer_array.allocator().create<Type_Enum>();
 
@@ -1737,9 +1935,7 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                         enum_type->values = {};
                         enum_type->flags = 0;
-                        cz::Str_Map<Type*>* types = &parser->type_stack.last();
-                        types->reserve(cz::heap_allocator(), 1);
-                        types->insert(identifier.str, identifier.hash, enum_type);
+                        parser->types.insert(identifier, enum_type);
                         base_type->set_type(enum_type);
                     }
                     break;
@@ -1751,11 +1947,12 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                     goto stop_processing_tokens;
                 }
 
-                Declaration* declaration = lookup_declaration(parser, pair.token.v.identifier);
-                Type_Definition* type_def = lookup_typedef(parser, pair.token.v.identifier);
-                if (declaration) {
-                    if (type_def) {
-                        Type* t = type_def->type.get_type();
+                Declaration* ordinary = lookup_ordinary(parser, pair.token.v.identifier);
+                if (ordinary && !(ordinary->flags & Declaration::Typedef)) {
+                    // A variable can't share a name with a typedef in the same scope, but it can
+                    // with a tag so hint at using that instead.
+                    Type* t = lookup_type(parser, pair.token.v.identifier);
+                    if (t) {
                         if (t->tag == Type::Enum) {
                             context->report_error(
                                 pair.token.span, pair.source_span,
@@ -1764,14 +1961,11 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
                             context->report_error(
                                 pair.token.span, pair.source_span,
                                 "Variable cannot be used as a type.  Hint: add the tag `struct`");
-                        } else if (t->tag == Type::Union) {
+                        } else {
+                            CZ_DEBUG_ASSERT(t->tag == Type::Union);
                             context->report_error(
                                 pair.token.span, pair.source_span,
                                 "Variable cannot be used as a type.  Hint: add the tag `union`");
-                        } else {
-                            // Todo: add hint about spelling out the type
-                            context->report_error(pair.token.span, pair.source_span,
-                                                  "Variable cannot be used as a type.");
                         }
                     } else {
                         context->report_error(pair.token.span, pair.source_span,
@@ -1782,19 +1976,19 @@ static Result parse_base_type(Context* context, Parser* parser, TypeP* base_type
 
                 next_token_after_peek(parser);
 
-                if (!type_def) {
+                if (!ordinary) {
                     context->report_error(pair.token.span, pair.source_span, "Undefined type `",
                                           pair.token.v.identifier.str, "`");
-                    Type** tagged_type = lookup_type(parser, pair.token.v.identifier);
+                    Type* tagged_type = lookup_type(parser, pair.token.v.identifier);
                     if (tagged_type) {
-                        base_type->set_type(*tagged_type);
+                        base_type->set_type(tagged_type);
                         break;
                     } else {
                         return {Result::ErrorInvalidInput};
                     }
                 }
 
-                base_type->merge_typedef(type_def->type);
+                base_type->merge_typedef(ordinary->type);
                 break;
             }
 
@@ -2157,7 +2351,7 @@ Result parse_declaration_(Context* context,
         TypeP type = base_type;
         Hashed_Str identifier = {};
         cz::Slice<cz::Str> parameter_names;
-        CZ_TRY(parse_declaration_identifier_and_type(context, parser, &identifier, &type, nullptr,
+        CZ_TRY(parse_declaration_identifier_and_type(context, parser, &identifier, &type,
                                                      &parameter_names));
 
         if (identifier.str.len > 0) {
@@ -2214,41 +2408,14 @@ Result parse_declaration(Context* context, Parser* parser, cz::Vector<Statement*
         next_token_after_peek(parser);
 
         size_t len = initializers->len();
-        parser->declaration_stack.reserve(cz::heap_allocator(), 1);
-        parser->declaration_stack.push({});
-        CZ_DEFER({
-            parser->declaration_stack.last().drop(cz::heap_allocator());
-            parser->declaration_stack.pop();
-        });
+        result = parse_declaration_(context, parser, initializers, Declaration::Typedef);
 
-        result = parse_declaration_(context, parser, initializers, 0);
-
-        cz::Str_Map<Type_Definition>* typedefs = &parser->typedef_stack.last();
-        typedefs->reserve(cz::heap_allocator(), initializers->len() - len);
         for (size_t i = len; i < initializers->len(); ++i) {
             Statement* init = (*initializers)[i];
             if (init->tag != Statement::Initializer_Default) {
                 context->report_error(pair.token.span, pair.source_span,
                                       "Typedef cannot have initializer");
             }
-
-            Statement_Initializer* in = (Statement_Initializer*)init;
-            Declaration* declaration =
-                parser->declaration_stack.last().get(in->identifier.str, in->identifier.hash);
-            CZ_DEBUG_ASSERT(declaration);
-            Type_Definition* existing_type_def =
-                typedefs->get(in->identifier.str, in->identifier.hash);
-            if (!existing_type_def) {
-                Type_Definition type_definition;
-                type_definition.type = declaration->type;
-                type_definition.span = declaration->span;
-                typedefs->insert(in->identifier.str, in->identifier.hash, type_definition);
-            } else {
-                context->report_error(pair.token.span, pair.source_span, "Typedef `",
-                                      in->identifier.str, "` has already been created");
-                context->report_error(existing_type_def->span, existing_type_def->span,
-                                      "Note: it was created here");
-            }
         }
 
         return Result::ok();
@@ -2289,6 +2456,61 @@ Result parse_declaration(Context* context, Parser* parser, cz::Vector<Statement*
     }
 }
 
+Result parse_declarations(Context* context,
+                          Parser* parser,
+                          cz::Vector<Statement*>* initializers,
+                          Declaration_Consumer consumer) {
+    ZoneScoped;
+
+    Ast_Arena body_arena = {};
+    body_arena.init();
+    parser->body_arena = &body_arena;
+    CZ_DEFER({
+        parser->body_arena = nullptr;
+        parser->ast_arena.stats.add(body_arena.stats);
+        body_arena.drop();
+    });
+
+    while (1) {
+        size_t declarations_start = parser->declarations.bindings.len();
+        size_t initializers_start = initializers->len();
+        size_t body_bytes_start = body_arena.stats.bytes();
+        parser->last_function_definition = nullptr;
+
+        Result result = parse_declaration(context, parser, initializers);
+        if (result.type != Result::Success) {
+            return result;
+        }
+
+        Parsed_Declaration declaration = {};
+        declaration.declarations = parser->declarations.bindings.as_slice();
+        declaration.declarations.elems += declarations_start;
+        declaration.declarations.len -= declarations_start;
+        declaration.initializers = initializers->as_slice();
+        declaration.initializers.elems += initializers_start;
+        declaration.initializers.len -= initializers_start;
+        declaration.function_definition = parser->last_function_definition;
+        declaration.function_type = parser->last_function_type;
+        if (!declaration.function_definition) {
+            declaration.function_type = nullptr;
+        }
+
+        result = consumer.consume(consumer.data, context, parser, declaration);
+
+        if (declaration.function_definition) {
+            size_t body_bytes = body_arena.stats.bytes() - body_bytes_start;
+            if (body_bytes > body_arena.stats.peak_body_bytes) {
+                body_arena.stats.peak_body_bytes = body_bytes;
+            }
+
+            declaration.function_definition->block = {};
+            body_arena.reset();
+        }
+
+        CZ_TRY(result);
+    }
+}
+
 Result parse_declaration_or_statement(Context* context,
                                       Parser* parser,
                                       cz::Vector<Statement*>* statements,
@@ -2308,9 +2530,8 @@ Result parse_declaration_or_statement(Context* context,
     }
 
     case Token::Identifier: {
-        Declaration* declaration = lookup_declaration(parser, pair.token.v.identifier);
-        Type_Definition* type = lookup_typedef(parser, pair.token.v.identifier);
-        if (declaration) {
+        Declaration* ordinary = lookup_ordinary(parser, pair.token.v.identifier);
+        if (ordinary && !(ordinary->flags & Declaration::Typedef)) {
             *which = Declaration_Or_Statement::Statement;
 
             Statement* statement;
@@ -2320,7 +2541,7 @@ Result parse_declaration_or_statement(Context* context,
                 statements->push(statement);
             }
             return result;
-        } else if (type) {
+        } else if (ordinary) {
             *which = Declaration_Or_Statement::Declaration;
             return parse_declaration(context, parser, statements);
         } else {
@@ -2344,6 +2565,103 @@ Result parse_declaration_or_statement(Context* context,
     }
 }
 
+/// Whether `expression` is an integer of type `int`.
+static bool is_int_constant(const Expression* expression) {
+    return expression->tag == Expression::Integer &&
+           ((const Expression_Integer*)expression)->is_int;
+}
+
+/// If every operand of `expression` is an `int` constant then evaluate it and store the result in
+/// the first operand, which takes the span of `expression`.  The other operands are kept for
+/// `Ast_Arena::create_integer` to reuse.  `expression` is usually a temporary so folding
+/// allocates nothing.  Only `int` operands are folded because then the result is an `int` too and
+/// 64 bit arithmetic gives the same value C does.  Returns `nullptr` if `expression` can't be
+/// folded or its result overflows an `int`.
+static Expression* fold_constant(Parser* parser, Expression* expression) {
+    if (!parser->fold_constants) {
+        return nullptr;
+    }
+
+    Expression* operands[3];
+    size_t operands_len;
+    switch (expression->tag) {
+        case Expression::Binary: {
+            Expression_Binary* binary = (Expression_Binary*)expression;
+            operands[0] = binary->left;
+            operands[1] = binary->right;
+            operands_len = 2;
+        } break;
+
+        case Expression::Ternary: {
+            Expression_Ternary* ternary = (Expression_Ternary*)expression;
+            operands[0] = ternary->condition;
+            operands[1] = ternary->then;
+            operands[2] = ternary->otherwise;
+            operands_len = 3;
+        } break;
+
+        case Expression::Bit_Not:
+        case Expression::Logical_Not: {
+            // Bit_Not and Logical_Not have the same layout.
+            Expression_Bit_Not* unary = (Expression_Bit_Not*)expression;
+            operands[0] = unary->value;
+            operands_len = 1;
+        } break;
+
+        default:
+            return nullptr;
+    }
+
+    for (size_t i = 0; i < operands_len; ++i) {
+        if (!is_int_constant(operands[i])) {
+            return nullptr;
+        }
+    }
+
+    if (expression->tag == Expression::Binary) {
+        // These are undefined for `int` but have a value in 64 bits.
+        int64_t left = (int64_t)((Expression_Integer*)operands[0])->value;
+        int64_t right = (int64_t)((Expression_Integer*)operands[1])->value;
+        switch (((Expression_Binary*)expression)->op) {
+            case Token::LeftShift:
+                if (left < 0 || right >= 32) {
+                    return nullptr;
+                }
+                break;
+            case Token::RightShift:
+                if (right >= 32) {
+                    return nullptr;
+                }
+                break;
+            case Token::Modulus:
+                if (left == INT32_MIN && right == -1) {
+                    return nullptr;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    int64_t value;
+    if (!evaluate_expression(expression, &value)) {
+        return nullptr;
+    }
+    if (value < INT32_MIN || value > INT32_MAX) {
+        return nullptr;
+    }
+
+    Expression_Integer* integer = (Expression_Integer*)operands[0];
+    integer->span = expression->span;
+    integer->value = (uint64_t)value;
+    parser->ast_arena.spare_integers.reserve(cz::heap_allocator(), operands_len - 1);
+    for (size_t i = 1; i < operands_len; ++i) {
+        parser->ast_arena.spare_integers.push((Expression_Integer*)operands[i]);
+    }
+    ++parser->ast_arena.stats.folded_expressions;
+    return integer;
+}
+
 static Result parse_expression_atomic(Context* context, Parser* parser, Expression** eout) {
     ZoneScoped;
 
@@ -2356,10 +2674,11 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
     // Parse one atom
     switch (pair.token.type) {
         case Token::Integer: {
-            Expression_Integer* expression =
-                parser->buffer_array.allocator().create<Expression_Integer>();
+            Expression_Integer* expression = parser->ast_arena.create_integer();
             expression->span = pair.source_span;
             expression->value = pair.token.v.integer.value;
+            expression->is_int =
+                pair.token.v.integer.suffix == 0 && expression->value <= INT32_MAX;
             *eout = expression;
             break;
         }
@@ -2367,7 +2686,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
         case Token::Identifier: {
             if (lookup_declaration(parser, pair.token.v.identifier)) {
                 Expression_Variable* expression =
-                    parser->buffer_array.allocator().create<Expression_Variable>();
+                    parser->ast_arena.create_expression<Expression_Variable>();
                 expression->span = pair.source_span;
                 expression->variable = pair.token.v.identifier;
                 *eout = expression;
@@ -2392,7 +2711,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
             }
 
             Expression_Address_Of* address_of =
-                parser->buffer_array.allocator().create<Expression_Address_Of>();
+                parser->ast_arena.create_expression<Expression_Address_Of>();
             address_of->value = *eout;
             address_of->span.start = pair.source_span.start;
             address_of->span.end = (*eout)->span.end;
@@ -2412,7 +2731,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
             }
 
             Expression_Dereference* dereference =
-                parser->buffer_array.allocator().create<Expression_Dereference>();
+                parser->ast_arena.create_expression<Expression_Dereference>();
             dereference->value = *eout;
             dereference->span.start = pair.source_span.start;
             dereference->span.end = (*eout)->span.end;
@@ -2431,12 +2750,18 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
                 return {Result::ErrorInvalidInput};
             }
 
-            Expression_Bit_Not* bit_not =
-                parser->buffer_array.allocator().create<Expression_Bit_Not>();
-            bit_not->value = *eout;
-            bit_not->span.start = pair.source_span.start;
-            bit_not->span.end = (*eout)->span.end;
-            *eout = bit_not;
+            Expression_Bit_Not bit_not;
+            bit_not.value = *eout;
+            bit_not.span.start = pair.source_span.start;
+            bit_not.span.end = (*eout)->span.end;
+
+            *eout = fold_constant(parser, &bit_not);
+            if (!*eout) {
+                Expression_Bit_Not* expression =
+                    parser->ast_arena.create_expression<Expression_Bit_Not>();
+                *expression = bit_not;
+                *eout = expression;
+            }
         } break;
 
         case Token::Not: {
@@ -2451,12 +2776,18 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
                 return {Result::ErrorInvalidInput};
             }
 
-            Expression_Logical_Not* logical_not =
-                parser->buffer_array.allocator().create<Expression_Logical_Not>();
-            logical_not->value = *eout;
-            logical_not->span.start = pair.source_span.start;
-            logical_not->span.end = (*eout)->span.end;
-            *eout = logical_not;
+            Expression_Logical_Not logical_not;
+            logical_not.value = *eout;
+            logical_not.span.start = pair.source_span.start;
+            logical_not.span.end = (*eout)->span.end;
+
+            *eout = fold_constant(parser, &logical_not);
+            if (!*eout) {
+                Expression_Logical_Not* expression =
+                    parser->ast_arena.create_expression<Expression_Logical_Not>();
+                *expression = logical_not;
+                *eout = expression;
+            }
         } break;
 
         case Token::Increment: {
@@ -2472,7 +2803,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
             }
 
             Expression_Pre_Increment* increment =
-                parser->buffer_array.allocator().create<Expression_Pre_Increment>();
+                parser->ast_arena.create_expression<Expression_Pre_Increment>();
             increment->value = *eout;
             increment->span.start = pair.source_span.start;
             increment->span.end = (*eout)->span.end;
@@ -2492,7 +2823,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
             }
 
             Expression_Pre_Decrement* decrement =
-                parser->buffer_array.allocator().create<Expression_Pre_Decrement>();
+                parser->ast_arena.create_expression<Expression_Pre_Decrement>();
             decrement->value = *eout;
             decrement->span.start = pair.source_span.start;
             decrement->span.end = (*eout)->span.end;
@@ -2524,11 +2855,9 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
 
                 switch (peek_pair.token.type) {
                     case Token::Identifier: {
-                        Declaration* declaration =
-                            lookup_declaration(parser, peek_pair.token.v.identifier);
-                        Type_Definition* type =
-                            lookup_typedef(parser, peek_pair.token.v.identifier);
-                        if (declaration || !type) {
+                        Declaration* ordinary =
+                            lookup_ordinary(parser, peek_pair.token.v.identifier);
+                        if (!ordinary || !(ordinary->flags & Declaration::Typedef)) {
                             goto sizeof_open_paren_expression;
                         }
                     }  // fallthrough
@@ -2544,7 +2873,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
                         Hashed_Str identifier = {};
                         cz::Slice<cz::Str> inner_parameter_names;
                         CZ_TRY(parse_declaration_identifier_and_type(
-                            context, parser, &identifier, &type, nullptr, &inner_parameter_names));
+                            context, parser, &identifier, &type, &inner_parameter_names));
 
                         if (identifier.str.len > 0) {
                             context->report_error(
@@ -2553,7 +2882,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
                         }
 
                         Expression_Sizeof_Type* expression =
-                            parser->buffer_array.allocator().create<Expression_Sizeof_Type>();
+                            parser->ast_arena.create_expression<Expression_Sizeof_Type>();
                         expression->type = type;
                         *eout = expression;
                     } break;
@@ -2590,7 +2919,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
                 CZ_TRY_VAR(result);
 
                 Expression_Sizeof_Expression* expression =
-                    parser->buffer_array.allocator().create<Expression_Sizeof_Expression>();
+                    parser->ast_arena.create_expression<Expression_Sizeof_Expression>();
                 expression->span.start = pair.source_span.start;
                 expression->span.end = (*eout)->span.end;
                 expression->expression = *eout;
@@ -2608,10 +2937,8 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
 
             switch (peek_pair.token.type) {
                 case Token::Identifier: {
-                    Declaration* declaration =
-                        lookup_declaration(parser, peek_pair.token.v.identifier);
-                    Type_Definition* type = lookup_typedef(parser, peek_pair.token.v.identifier);
-                    if (declaration || !type) {
+                    Declaration* ordinary = lookup_ordinary(parser, peek_pair.token.v.identifier);
+                    if (!ordinary || !(ordinary->flags & Declaration::Typedef)) {
                         goto open_paren_expression;
                     }
                 }  // fallthrough
@@ -2627,7 +2954,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
                     Hashed_Str identifier = {};
                     cz::Slice<cz::Str> inner_parameter_names;
                     CZ_TRY(parse_declaration_identifier_and_type(
-                        context, parser, &identifier, &type, nullptr, &inner_parameter_names));
+                        context, parser, &identifier, &type, &inner_parameter_names));
 
                     Token_Source_Span_Pair open_paren_pair = pair;
                     if (identifier.str.len > 0) {
@@ -2664,7 +2991,7 @@ static Result parse_expression_atomic(Context* context, Parser* parser, Expressi
                     }
 
                     Expression_Cast* expression =
-                        parser->buffer_array.allocator().create<Expression_Cast>();
+                        parser->ast_arena.create_expression<Expression_Cast>();
                     expression->span.start = open_paren_pair.source_span.start;
                     expression->span.end = value->span.end;
                     expression->type = type;
@@ -2745,8 +3072,9 @@ static Result parse_expression_continuation(Context* context,
 
                 next_token_after_peek(parser);
 
-                cz::Vector<Expression*> arguments = {};
-                CZ_DEFER(arguments.drop(cz::heap_allocator()));
+                cz::Vector<Expression*>* arguments = &parser->ast_arena.expression_stack;
+                size_t arguments_start = arguments->len();
+                CZ_DEFER(arguments->set_len(arguments_start));
 
                 Token_Source_Span_Pair peek_pair;
                 result = peek_token(context, parser, &peek_pair);
@@ -2766,8 +3094,8 @@ static Result parse_expression_continuation(Context* context,
                         return {Result::ErrorInvalidInput};
                     }
 
-                    arguments.reserve(cz::heap_allocator(), 1);
-                    arguments.push(argument);
+                    arguments->reserve(cz::heap_allocator(), 1);
+                    arguments->push(argument);
 
                     result = peek_token(context, parser, &peek_pair);
                     CZ_TRY_VAR(result);
@@ -2794,10 +3122,9 @@ static Result parse_expression_continuation(Context* context,
 
             end_of_function_call:
                 Expression_Function_Call* function_call =
-                    parser->buffer_array.allocator().create<Expression_Function_Call>();
+                    parser->ast_arena.create_expression<Expression_Function_Call>();
                 function_call->function = *eout;
-                function_call->arguments =
-                    parser->buffer_array.allocator().duplicate(arguments.as_slice());
+                function_call->arguments = parser->ast_arena.carve(arguments, arguments_start);
                 function_call->span.start = (*eout)->span.start;
                 function_call->span.end = peek_pair.source_span.end;
                 *eout = function_call;
@@ -2845,7 +3172,7 @@ static Result parse_expression_continuation(Context* context,
                 next_token_after_peek(parser);
 
                 Expression_Index* expression =
-                    parser->buffer_array.allocator().create<Expression_Index>();
+                    parser->ast_arena.create_expression<Expression_Index>();
                 expression->array = *eout;
                 expression->index = index;
                 expression->span.start = (*eout)->span.start;
@@ -2895,14 +3222,20 @@ static Result parse_expression_continuation(Context* context,
                     return Result::ok();
                 }
 
-                Expression_Ternary* ternary =
-                    parser->buffer_array.allocator().create<Expression_Ternary>();
-                ternary->span.start = (*eout)->span.start;
-                ternary->span.end = otherwise->span.end;
-                ternary->condition = *eout;
-                ternary->then = then;
-                ternary->otherwise = otherwise;
-                *eout = ternary;
+                Expression_Ternary ternary;
+                ternary.span.start = (*eout)->span.start;
+                ternary.span.end = otherwise->span.end;
+                ternary.condition = *eout;
+                ternary.then = then;
+                ternary.otherwise = otherwise;
+
+                *eout = fold_constant(parser, &ternary);
+                if (!*eout) {
+                    Expression_Ternary* expression =
+                        parser->ast_arena.create_expression<Expression_Ternary>();
+                    *expression = ternary;
+                    *eout = expression;
+                }
                 continue;
             }
 
@@ -2928,7 +3261,7 @@ static Result parse_expression_continuation(Context* context,
                 next_token_after_peek(parser);
 
                 Expression_Member_Access* member_access =
-                    parser->buffer_array.allocator().create<Expression_Member_Access>();
+                    parser->ast_arena.create_expression<Expression_Member_Access>();
                 member_access->span.start = pair.source_span.start;
                 member_access->span.end = peek_pair.source_span.end;
                 member_access->object = *eout;
@@ -2959,7 +3292,7 @@ static Result parse_expression_continuation(Context* context,
                 next_token_after_peek(parser);
 
                 Expression_Dereference_Member_Access* member_access =
-                    parser->buffer_array.allocator().create<Expression_Dereference_Member_Access>();
+                    parser->ast_arena.create_expression<Expression_Dereference_Member_Access>();
                 member_access->span.start = pair.source_span.start;
                 member_access->span.end = peek_pair.source_span.end;
                 member_access->pointer = *eout;
@@ -2977,7 +3310,7 @@ static Result parse_expression_continuation(Context* context,
 
                 next_token_after_peek(parser);
                 Expression_Post_Increment* expression =
-                    parser->buffer_array.allocator().create<Expression_Post_Increment>();
+                    parser->ast_arena.create_expression<Expression_Post_Increment>();
                 expression->value = *eout;
                 expression->span.start = (*eout)->span.start;
                 expression->span.end = pair.source_span.end;
@@ -2995,7 +3328,7 @@ static Result parse_expression_continuation(Context* context,
 
                 next_token_after_peek(parser);
                 Expression_Post_Decrement* expression =
-                    parser->buffer_array.allocator().create<Expression_Post_Decrement>();
+                    parser->ast_arena.create_expression<Expression_Post_Decrement>();
                 expression->value = *eout;
                 expression->span.start = (*eout)->span.start;
                 expression->span.end = pair.source_span.end;
@@ -3015,6 +3348,7 @@ static Result parse_expression_continuation(Context* context,
             case Token::MinusSet:
             case Token::DivideSet:
             case Token::MultiplySet:
+            case Token::ModulusSet:
             case Token::BitAndSet:
             case Token::BitOrSet:
             case Token::BitXorSet:
@@ -3036,6 +3370,7 @@ static Result parse_expression_continuation(Context* context,
                 break;
             case Token::Divide:
             case Token::Star:
+            case Token::Modulus:
                 precedence = 5;
                 break;
             case Token::Ampersand:
@@ -3050,6 +3385,9 @@ static Result parse_expression_continuation(Context* context,
             case Token::Or:
                 precedence = 15;
                 break;
+            case Token::Xor:
+                precedence = 12;
+                break;
             case Token::LeftShift:
             case Token::RightShift:
                 precedence = 7;
@@ -3075,13 +3413,20 @@ static Result parse_expression_continuation(Context* context,
             break;
         }
 
-        Expression_Binary* binary = parser->buffer_array.allocator().create<Expression_Binary>();
-        binary->span.start = (*eout)->span.start;
-        binary->span.end = right->span.end;
-        binary->op = pair.token.type;
-        binary->left = *eout;
-        binary->right = right;
-        *eout = binary;
+        Expression_Binary binary;
+        binary.span.start = (*eout)->span.start;
+        binary.span.end = right->span.end;
+        binary.op = pair.token.type;
+        binary.left = *eout;
+        binary.right = right;
+
+        *eout = fold_constant(parser, &binary);
+        if (!*eout) {
+            Expression_Binary* expression =
+                parser->ast_arena.create_expression<Expression_Binary>();
+            *expression = binary;
+            *eout = expression;
+        }
     }
 
     return Result::ok();
@@ -3112,23 +3457,12 @@ static Result parse_block(Context* context, Parser* parser, Block* block) {
     Token_Source_Span_Pair open_curly_pair;
     next_token(context, parser, &open_curly_pair);
 
-    parser->type_stack.reserve(cz::heap_allocator(), 1);
-    parser->typedef_stack.reserve(cz::heap_allocator(), 1);
-    parser->declaration_stack.reserve(cz::heap_allocator(), 1);
-    parser->type_stack.push({});
-    parser->typedef_stack.push({});
-    parser->declaration_stack.push({});
-    CZ_DEFER({
-        drop_types(&parser->type_stack.last());
-        parser->typedef_stack.last().drop(cz::heap_allocator());
-        parser->declaration_stack.last().drop(cz::heap_allocator());
-        parser->type_stack.pop();
-        parser->typedef_stack.pop();
-        parser->declaration_stack.pop();
-    });
+    push_scope(parser);
+    CZ_DEFER(pop_scope(parser));
 
-    cz::Vector<Statement*> statements = {};
-    CZ_DEFER(statements.drop(cz::heap_allocator()));
+    cz::Vector<Statement*>* statements = &parser->ast_arena.statement_stack;
+    size_t statements_start = statements->len();
+    CZ_DEFER(statements->set_len(statements_start));
     Token_Source_Span_Pair pair;
     while (1) {
         result = peek_token(context, parser, &pair);
@@ -3144,7 +3478,7 @@ static Result parse_block(Context* context, Parser* parser, Block* block) {
         }
 
         Declaration_Or_Statement which;
-        CZ_TRY(parse_declaration_or_statement(context, parser, &statements, &which));
+        CZ_TRY(parse_declaration_or_statement(context, parser, statements, &which));
 
         if (which == Declaration_Or_Statement::Statement) {
             break;
@@ -3167,12 +3501,12 @@ static Result parse_block(Context* context, Parser* parser, Block* block) {
         Statement* statement;
         CZ_TRY(parse_statement(context, parser, &statement));
 
-        statements.reserve(cz::heap_allocator(), 1);
-        statements.push(statement);
+        statements->reserve(cz::heap_allocator(), 1);
+        statements->push(statement);
     }
 
 finish_block:
-    block->statements = parser->buffer_array.allocator().duplicate(statements.as_slice());
+    block->statements = parser->ast_arena.carve(statements, statements_start);
     return Result::ok();
 }
 
@@ -3187,7 +3521,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
 
     switch (pair.token.type) {
         case Token::Semicolon: {
-            Statement_Empty* statement = parser->buffer_array.allocator().create<Statement_Empty>();
+            Statement_Empty* statement = parser->ast_arena.create_statement<Statement_Empty>();
             statement->span = pair.source_span;
             *sout = statement;
         } break;
@@ -3199,7 +3533,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
             Token_Source_Span_Pair end_pair;
             previous_token(parser, &end_pair);
 
-            Statement_Block* statement = parser->buffer_array.allocator().create<Statement_Block>();
+            Statement_Block* statement = parser->ast_arena.create_statement<Statement_Block>();
             statement->span.start = pair.source_span.start;
             statement->span.end = end_pair.source_span.end;
             statement->block = block;
@@ -3271,7 +3605,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
                 end_location = otherwise->span.end;
             }
 
-            Statement_If* statement = parser->buffer_array.allocator().create<Statement_If>();
+            Statement_If* statement = parser->ast_arena.create_statement<Statement_If>();
             statement->span.start = if_pair.source_span.start;
             statement->span.end = end_location;
             statement->condition = condition;
@@ -3327,7 +3661,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
                 return {Result::ErrorInvalidInput};
             }
 
-            Statement_While* statement = parser->buffer_array.allocator().create<Statement_While>();
+            Statement_While* statement = parser->ast_arena.create_statement<Statement_While>();
             statement->span.start = while_pair.source_span.start;
             statement->span.end = body->span.end;
             statement->condition = condition;
@@ -3442,7 +3776,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
                 return {Result::ErrorInvalidInput};
             }
 
-            Statement_For* statement = parser->buffer_array.allocator().create<Statement_For>();
+            Statement_For* statement = parser->ast_arena.create_statement<Statement_For>();
             statement->span.start = for_pair.source_span.start;
             statement->span.end = body->span.end;
             statement->initializer = initializer;
@@ -3488,7 +3822,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
             next_token_after_peek(parser);
 
             Statement_Return* statement =
-                parser->buffer_array.allocator().create<Statement_Return>();
+                parser->ast_arena.create_statement<Statement_Return>();
             statement->span.start = return_source_span_start;
             statement->span.end = pair.source_span.end;
             statement->o_value = value;
@@ -3513,7 +3847,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
             }
 
             Statement_Continue* statement =
-                parser->buffer_array.allocator().create<Statement_Continue>();
+                parser->ast_arena.create_statement<Statement_Continue>();
             statement->span.start = continue_pair.source_span.start;
             statement->span.end = pair.source_span.end;
             *sout = statement;
@@ -3536,7 +3870,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
                 return {Result::ErrorInvalidInput};
             }
 
-            Statement_Break* statement = parser->buffer_array.allocator().create<Statement_Break>();
+            Statement_Break* statement = parser->ast_arena.create_statement<Statement_Break>();
             statement->span.start = break_pair.source_span.start;
             statement->span.end = pair.source_span.end;
             *sout = statement;
@@ -3562,7 +3896,7 @@ Result parse_statement(Context* context, Parser* parser, Statement** sout) {
             }
 
             Statement_Expression* statement =
-                parser->buffer_array.allocator().create<Statement_Expression>();
+                parser->ast_arena.create_statement<Statement_Expression>();
             statement->span.start = expression->span.start;
             statement->span.end = pair.source_span.end;
             statement->expression = expression;
@@ -1,17 +1,22 @@
 #pragma once
 
+#include <stdio.h>
 #include <cz/buffer_array.hpp>
 #include <cz/str_map.hpp>
 #include <cz/vector.hpp>
 #include "lex.hpp"
 #include "preprocess.hpp"
+#include "scope_table.hpp"
+#include "small_map.hpp"
 #include "token_source_span_pair.hpp"
 
 namespace red {
 namespace parse {
 
-struct Declaration;
+struct Function_Definition;
+struct Statement_Initializer;
 struct Type_Pointer;
+struct Token_Pipeline;
 
 struct alignas(4) Type {
     enum Tag {
@@ -63,16 +68,31 @@ struct TypeP {
     void set_volatile() { value |= 2; }
 };
 
-struct Type_Definition {
-    TypeP type;
+struct Declaration {
     Span span;
+    TypeP type;
+    Type_Pointer* o_type_pointer;
+    union {
+        Function_Definition* function_definition;
+        Statement_Initializer* initializer;
+    } v;
+
+    uint32_t flags;
+    enum {
+        Extern = 1,
+        Static = 2,
+        Enum_Variant = 4,
+        /// Typedefs share the ordinary identifier namespace with variables and functions so
+        /// they are stored as declarations of the type they name.
+        Typedef = 8,
+    };
 };
 
 struct Type_Enum : Type {
     Type_Enum() : Type(Enum) {}
 
     Span span;
-    cz::Str_Map<int64_t> values;
+    Small_Map<int64_t, 8> values;
 
     enum Flags : uint32_t {
         Defined = 1,
@@ -84,9 +104,9 @@ struct Type_Composite : Type {
     Type_Composite(Tag tag) : Type(tag) {}
 
     Span span;
-    cz::Str_Map<Type*> types;
-    cz::Str_Map<Type_Definition> typedefs;
-    cz::Str_Map<Declaration> declarations;
+    /// Tagged types declared inside the body, which are rare.
+    Small_Map<Type*, 1> types;
+    Small_Map<Declaration, 8> declarations;
 
     size_t size;
     size_t alignment;
@@ -118,6 +138,18 @@ struct Type_Array : Type {
 
     TypeP inner;
     struct Expression* o_length;
+
+    /// The value of `o_length` if `Length_Known` is set.
+    int64_t length;
+    /// Cached by `get_type_size_alignment` if `Layout_Known` is set.
+    size_t size;
+    size_t alignment;
+
+    enum Flags : uint32_t {
+        Length_Known = 1,
+        Layout_Known = 2,
+    };
+    uint32_t flags;
 };
 
 struct Type_Function : Type {
@@ -160,6 +192,9 @@ struct Expression {
 struct Expression_Integer : Expression {
     Expression_Integer() : Expression(Integer) {}
 
+    /// Set if the integer has type `int`.  Then `value` holds it sign extended.  Only these are
+    /// constant folded.
+    bool is_int;
     uint64_t value;
 };
 
@@ -381,23 +416,6 @@ struct Function_Definition {
     Span block_span;
 };
 
-struct Declaration {
-    Span span;
-    TypeP type;
-    Type_Pointer* o_type_pointer;
-    union {
-        Function_Definition* function_definition;
-        Statement_Initializer* initializer;
-    } v;
-
-    uint32_t flags;
-    enum {
-        Extern = 1,
-        Static = 2,
-        Enum_Variant = 4,
-    };
-};
-
 namespace Declaration_Or_Statement_ {
 enum Declaration_Or_Statement {
     Declaration,
@@ -406,15 +424,149 @@ enum Declaration_Or_Statement {
 }
 using Declaration_Or_Statement_::Declaration_Or_Statement;
 
+struct Ast_Stats {
+    static constexpr const size_t expression_tags = Expression::Post_Decrement + 1;
+    static constexpr const size_t statement_tags = Statement::Initializer_Copy + 1;
+
+    size_t expression_counts[expression_tags];
+    size_t expression_bytes[expression_tags];
+    size_t statement_counts[statement_tags];
+    size_t statement_bytes[statement_tags];
+    size_t list_counts;
+    size_t list_bytes;
+
+    /// The number of operators that were constant folded and thus never allocated.
+    size_t folded_expressions;
+
+    /// The most bytes held at once by a single function body while streaming declarations (see
+    /// `parse_declarations`).
+    size_t peak_body_bytes;
+
+    /// The bytes of every node and list.
+    size_t bytes() const;
+
+    void print(FILE* file) const;
+    /// Add the statistics of another arena.
+    void add(const Ast_Stats& other);
+};
+
+/// Bump allocated pools for the syntax tree.  Expressions, statements, and the lists pointing to
+/// them are each kept in their own pool so nodes of the same kind are adjacent in memory.
+struct Ast_Arena {
+    cz::Buffer_Array expressions;
+    cz::Buffer_Array statements;
+    cz::Buffer_Array lists;
+
+    /// Scratch stacks for lists whose length isn't known until they are closed.  A nested list
+    /// pushes above its parent's entries and is carved off (see `carve`) before the parent
+    /// continues, so the stacks are reused for the entire parse instead of allocating a vector
+    /// per list.
+    cz::Vector<Expression*> expression_stack;
+    cz::Vector<Statement*> statement_stack;
+
+    /// Integers whose values were folded into another integer.  `create_integer` reuses them
+    /// before allocating so folding doesn't leave its operands behind.
+    cz::Vector<Expression_Integer*> spare_integers;
+
+    Ast_Stats stats;
+
+    void init();
+    void drop();
+    /// Free every node and list but keep the scratch stacks and statistics.
+    void reset();
+
+    template <class T>
+    T* create_expression() {
+        T* expression = expressions.allocator().create<T>();
+        ++stats.expression_counts[expression->tag];
+        stats.expression_bytes[expression->tag] += sizeof(T);
+        return expression;
+    }
+
+    Expression_Integer* create_integer() {
+        if (spare_integers.len() > 0) {
+            return spare_integers.pop();
+        }
+        return create_expression<Expression_Integer>();
+    }
+
+    template <class T>
+    T* create_statement() {
+        T* statement = statements.allocator().create<T>();
+        ++stats.statement_counts[statement->tag];
+        stats.statement_bytes[statement->tag] += sizeof(T);
+        return statement;
+    }
+
+    /// Move the elements of `stack` starting at `start` into the list pool and pop them.
+    template <class T>
+    cz::Slice<T> carve(cz::Vector<T>* stack, size_t start) {
+        cz::Slice<T> slice = stack->as_slice();
+        slice.elems += start;
+        slice.len -= start;
+        cz::Slice<T> list = lists.allocator().duplicate(slice);
+        ++stats.list_counts;
+        stats.list_bytes += list.len * sizeof(T);
+        stack->set_len(start);
+        return list;
+    }
+};
+
+/// Hash conses derived types so that structurally identical pointer, function, and array types
+/// share one node.  Thus comparing interned types is usually a pointer comparison.  Arrays whose
+/// length isn't a constant are not interned.
+struct Type_Interner {
+    /// Maps the bytes of a key (see `intern`) to the canonical node.
+    cz::Str_Map<Type*> types;
+    /// Scratch space for building keys.
+    cz::Vector<uintptr_t> key;
+
+    size_t distinct;
+    size_t duplicates;
+
+    void init();
+    void drop();
+
+    /// Start with the types interned by `parent` as canonical.  This is used by workers that parse
+    /// function bodies in parallel (see `Parser::init_worker`).  Because every component of a
+    /// canonical type is canonical, interning never writes to the types shared with `parent`.
+    void init_worker(const Type_Interner& parent);
+
+    /// Intern `type` and every type it is built out of.  The first node seen with a given
+    /// structure becomes canonical.  The components of `type` are replaced in place so it must not
+    /// be mutated afterwards.  Keys are allocated in `allocator`.
+    TypeP intern(cz::Allocator allocator, TypeP type);
+};
+
+/// A function body that was skipped because `Parser::skip_bodies` was set.  See
+/// `parse_skipped_body`.
+struct Skipped_Body {
+    Function_Definition* function_definition;
+    Type_Function* function_type;
+
+    /// The tokens of the body, including the braces, are `[tokens_start, tokens_end)` in
+    /// `Parser::body_tokens`.  This is empty unless `Parser::record_body_tokens` was set.
+    size_t tokens_start;
+    size_t tokens_end;
+
+    /// The number of ordinary identifiers and tagged types at file scope when the body was
+    /// skipped.  Bindings after these are hidden while parsing the body.
+    size_t declarations_end;
+    size_t types_end;
+};
+
 struct Parser {
     pre::Preprocessor preprocessor;
     lex::Lexer lexer;
 
-    cz::Vector<cz::Str_Map<Type*> > type_stack;
-    cz::Vector<cz::Str_Map<Type_Definition> > typedef_stack;
-    cz::Vector<cz::Str_Map<Declaration> > declaration_stack;
+    /// Tagged types (`struct`, `union`, and `enum`).
+    Scope_Table<Type*> types;
+    /// Ordinary identifiers: variables, functions, enum values, and typedefs.
+    Scope_Table<Declaration> declarations;
 
     cz::Buffer_Array buffer_array;
+    Ast_Arena ast_arena;
+    Type_Interner type_interner;
 
     Type* type_char;
     Type* type_signed_char;
@@ -439,11 +591,98 @@ struct Parser {
     Token_Source_Span_Pair pairs[4];
     int pair_index;
 
+    /// Replace operators whose operands are all integers with their value as they are parsed.
+    bool fold_constants;
+
+    /// The function most recently defined and its type.  This allows incremental reparsing to find
+    /// the body of each top level declaration.
+    Function_Definition* last_function_definition;
+    Type_Function* last_function_type;
+
+    /// Parsers that parsed function bodies on other threads.  They own the nodes of those bodies.
+    /// See `parse_skipped_bodies_in_parallel`.
+    cz::Vector<Parser*> workers;
+
+    /// Instead of parsing function bodies, match their braces and move on.  The definitions are
+    /// left with empty blocks and are added to `skipped_bodies`.
+    bool skip_bodies;
+    /// Copy the tokens of skipped bodies into `body_tokens` so they can be parsed later.  This is
+    /// optional because copying the tokens costs more than matching the braces.
+    bool record_body_tokens;
+    cz::Vector<Token_Source_Span_Pair> body_tokens;
+    cz::Vector<Skipped_Body> skipped_bodies;
+
+    /// If `replaying` is set tokens are read from `replay_tokens` instead of the preprocessor.
+    bool replaying;
+    cz::Slice<Token_Source_Span_Pair> replay_tokens;
+    size_t replay_index;
+
+    /// If set tokens are read from a producer thread running the preprocessor instead.
+    Token_Pipeline* pipeline;
+
+    /// If set function bodies are allocated here instead of in `ast_arena` so they can be freed
+    /// once they have been consumed.  See `parse_declarations`.
+    Ast_Arena* body_arena;
+    /// Set while a body is being parsed into `body_arena`.  It is swapped with `ast_arena` during
+    /// the body so `body_arena` then holds the file's arena.
+    bool in_body_arena;
+
     void init();
     void drop();
+
+    /// Initialize a parser that only parses function bodies recorded by `parent`.  It shares the
+    /// builtin types and the file scope of `parent` but has its own scopes, arenas, and interner.
+    /// `parent` must not be modified while the worker is parsing.
+    void init_worker(const Parser& parent);
+    void drop_worker();
 };
 
 Result parse_declaration(Context* context, Parser* parser, cz::Vector<Statement*>* initializers);
+
+/// A declaration at file scope handed to a `Declaration_Consumer`.
+struct Parsed_Declaration {
+    /// The ordinary identifiers added to the file scope.  A definition of a function that was
+    /// already declared updates the existing binding instead of adding one.
+    cz::Slice<Scope_Table<Declaration>::Binding> declarations;
+    /// The initializers of the variables declared.
+    cz::Slice<Statement*> initializers;
+    /// The function defined, if any.  Its body is freed once the consumer returns.
+    Function_Definition* function_definition;
+    Type_Function* function_type;
+};
+
+struct Declaration_Consumer {
+    /// Called with each declaration as soon as it is parsed.  Return an error to stop parsing.
+    Result (*consume)(void* data,
+                      Context* context,
+                      Parser* parser,
+                      const Parsed_Declaration& declaration);
+    void* data;
+};
+
+/// Parse every declaration in the file, handing each one to `consumer` as soon as it is parsed.
+///
+/// Function bodies are allocated in their own arena that is reset after each one is consumed, so
+/// the memory held by the syntax tree is bounded by the largest function rather than the size of
+/// the file.  Afterwards each `Function_Definition` is left with an empty block.  Everything else
+/// at file scope, including types and initializers, is kept as in `parse_declaration`.
+Result parse_declarations(Context* context,
+                          Parser* parser,
+                          cz::Vector<Statement*>* initializers,
+                          Declaration_Consumer consumer);
+/// Parse the body of a function starting at its `{`.  The `parameter_names` of the
+/// `function_definition` must already be set.
+Result parse_function_body(Context* context,
+                           Parser* parser,
+                           const Type_Function* type,
+                           Function_Definition* function_definition);
+/// Parse a body recorded while `Parser::skip_bodies` and `Parser::record_body_tokens` were set.
+/// This can be done at any point after the declaration it belongs to has been parsed.  `tokens`
+/// are the `body_tokens` of the parser that recorded the body.
+Result parse_skipped_body(Context* context,
+                          Parser* parser,
+                          cz::Slice<Token_Source_Span_Pair> tokens,
+                          const Skipped_Body& body);
 Result parse_expression(Context* context, Parser* parser, Expression** expression);
 Result parse_statement(Context* context, Parser* parser, Statement** statement);
 Result parse_declaration_or_statement(Context* context,
@@ -451,8 +690,5 @@ Result parse_declaration_or_statement(Context* context,
                                       cz::Vector<Statement*>* statements,
                                       Declaration_Or_Statement* which);
 
-void drop_type(Type* type);
-void drop_types(cz::Str_Map<Type*>* types);
-
 }
 }
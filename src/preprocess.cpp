@@ -126,17 +126,8 @@ static Result process_include(Context* context, Preprocessor* preprocessor, lex:
             include_path = context->options.include_paths[i];
         }
 
-        bool trailing_slash = include_path.ends_with("/");  // @Speed: ends_with(char)
-        file_name.set_len(0);
-        file_name.reserve(context->files.file_path_buffer_array.allocator(),
-                          include_path.len + !trailing_slash + relative_path.len() + 1);
-        file_name.append(include_path);
-        if (!trailing_slash) {
-            file_name.push('/');
-        }
-        file_name.append(relative_path);
-        cz::path::flatten(&file_name);
-        file_name.null_terminate();
+        make_include_path(include_path, relative_path,
+                          context->files.file_path_buffer_array.allocator(), &file_name);
 
         if (include_file(&context->files, preprocessor, file_name).is_ok()) {
             relative_path.drop(context->temp_buffer_array.allocator());
@@ -168,6 +159,30 @@ static bool skip_until_eol(Context* context,
     }
 }
 
+/// Remove the `##`s at the start of a macro body.
+///
+/// :ConcatErrors ## errors are assumed to be eliminated in next_token_in_definition
+static void remove_leading_concatenations(Context* context, Token_Buffer* tokens) {
+    size_t leading = 0;
+    for (; leading < tokens->len() && tokens->type(leading) == Token::HashHash; ++leading) {
+        context->report_lex_error(tokens->span(&context->files, leading),
+                                  "Token concatenation (`##`) must have a token before it");
+    }
+
+    if (leading == 0) {
+        return;
+    }
+
+    Token_Buffer body = {};
+    for (size_t i = leading; i < tokens->len(); ++i) {
+        Token token;
+        tokens->get(&context->files, i, &token);
+        body.push(cz::heap_allocator(), token);
+    }
+    tokens->drop(cz::heap_allocator());
+    *tokens = body;
+}
+
 static Result process_ifdef(Context* context,
                             Preprocessor* preprocessor,
                             lex::Lexer* lexer,
@@ -331,6 +346,7 @@ static Result parse_and_eval_expression(Context* context,
                 break;
             case Token::Divide:
             case Token::Star:
+            case Token::Modulus:
                 precedence = 5;
                 break;
             case Token::Ampersand:
@@ -385,6 +401,7 @@ static Result parse_and_eval_expression(Context* context,
             CASE(Token::Plus, +);
             CASE(Token::Minus, -);
             CASE(Token::Divide, /);
+            CASE(Token::Modulus, %);
             CASE(Token::Star, *);
             CASE(Token::Ampersand, &);
             CASE(Token::And, &&);
@@ -609,7 +626,7 @@ static Result process_defined_identifier(Context* context,
         at_bol = false;
 
         // Process arguments
-        cz::Vector<Token> argument_tokens = {};
+        Token_Buffer argument_tokens = {};
         size_t paren_depth = 0;
         while (1) {
             ntid_result =
@@ -680,8 +697,7 @@ static Result process_defined_identifier(Context* context,
             }
 
         append_argument_token:
-            argument_tokens.reserve(cz::heap_allocator(), 1);
-            argument_tokens.push(*token);
+            argument_tokens.push(cz::heap_allocator(), *token);
         }
     }
 
@@ -1041,56 +1057,52 @@ process_token:
                             definition.parameter_len = parameters.count;
                             definition.is_function = true;
                         } else {
-                            definition.tokens.reserve(cz::heap_allocator(), 1);
-                            definition.tokens.push(*token);
+                            definition.tokens.push(cz::heap_allocator(), *token);
                         }
 
                         // Process the definition body.
-                        while (1) {
-                            if (!lex::next_token(context, lexer,
-                                                 context->files.files[point->file].contents, point,
-                                                 token, &at_bol)) {
-                                at_bol = false;
-                                break;
-                            }
-                            if (at_bol) {
-                                break;
-                            }
+                        size_t body_start = definition.tokens.len();
+                        size_t body_identifiers_start = definition.tokens.identifiers.len();
+                        lex::Tokenize_Options options = {};
+                        options.allocator = cz::heap_allocator();
+                        options.max_tokens = SIZE_MAX;
+                        options.stop_at_eol = true;
+                        at_bol = lex::tokenize_range(context, lexer,
+                                                     context->files.files[point->file].contents,
+                                                     point, options, &definition.tokens,
+                                                     token) == lex::Tokenize_Stop::End_Of_Line;
 
-                            // If the token matches a parameter, mark it as a parameter and replace
-                            // its string value with its index.
-                            if (token->type == Token::Identifier) {
-                                uint64_t* parameter = parameters.get(token->v.identifier.str,
-                                                                     token->v.identifier.hash);
-                                if (parameter) {
-                                    token->type = Token::Preprocessor_Parameter;
-                                    token->v.integer.value = *parameter;
-                                } else if (token->v.identifier.str == "__VAR_ARGS__") {
-                                    token->type = Token::Preprocessor_Parameter;
-                                    token->v.integer.value = parameters.count;
-                                }
-                            } else if (token->type == Token::HashHash) {
-                                if (definition.tokens.len() == 0) {
-                                    // :ConcatErrors ## errors are assumed to be eliminated in
-                                    // next_token_in_definition
-                                    context->report_lex_error(
-                                        token->span,
-                                        "Token concatenation (`##`) must have a token before it");
-                                    continue;
-                                }
+                        if (body_start == 0) {
+                            remove_leading_concatenations(context, &definition.tokens);
+                        }
+
+                        // If a token matches a parameter, mark it as a parameter and replace its
+                        // string value with its index.
+                        for (size_t i = body_start; i < definition.tokens.len(); ++i) {
+                            if (definition.tokens.type(i) != Token::Identifier) {
+                                continue;
                             }
 
-                            definition.tokens.reserve(cz::heap_allocator(), 1);
-                            definition.tokens.push(*token);
+                            Token body_token;
+                            definition.tokens.get(&context->files, i, &body_token);
+                            uint64_t* parameter = parameters.get(body_token.v.identifier.str,
+                                                                 body_token.v.identifier.hash);
+                            if (parameter) {
+                                definition.tokens.set_parameter(i, *parameter);
+                            } else if (body_token.v.identifier.str == "__VAR_ARGS__") {
+                                definition.tokens.set_parameter(i, parameters.count);
+                            }
                         }
+                        definition.tokens.remove_unused_identifiers(body_start,
+                                                                    body_identifiers_start);
 
                         if (definition.tokens.len() > 0) {
-                            Token* last_token = &definition.tokens.last();
-                            if (last_token->type == Token::HashHash) {
+                            size_t last = definition.tokens.len() - 1;
+                            if (definition.tokens.type(last) == Token::HashHash) {
                                 // :ConcatErrors ## errors are assumed to be eliminated in
                                 // next_token_in_definition
                                 context->report_lex_error(
-                                    last_token->span,
+                                    definition.tokens.span(&context->files, last),
                                     "Token concatenation (`##`) must have a token after it");
                                 definition.tokens.pop();
                             }
@@ -1100,6 +1112,8 @@ process_token:
                     }
 
                 end_definition:
+                    definition.tokens.realloc(cz::heap_allocator());
+
                     preprocessor->definitions.reserve(cz::heap_allocator(), 1);
 
                     Definition* dd = preprocessor->definitions.get(identifier.str, identifier.hash);
@@ -1110,6 +1124,7 @@ process_token:
                         preprocessor->definitions.insert(identifier.str, identifier.hash,
                                                          definition);
                     }
+                    ++preprocessor->definitions_version;
 
                     if (at_bol) {
                         goto process_token;
@@ -1144,6 +1159,7 @@ process_token:
                                                            token->v.identifier.hash, &index)) {
                         preprocessor->definitions.values[index].drop(cz::heap_allocator());
                         preprocessor->definitions.set_tombstone(index);
+                        ++preprocessor->definitions_version;
                     }
 
                     goto skip_until_eol_and_continue;
@@ -1271,7 +1287,7 @@ static Result peek_token_in_definition_no_expansion(Context* context,
             continue;
         }
 
-        *token = info->definition->tokens[info->index];
+        info->definition->tokens.get(&context->files, info->index, token);
         return Result::ok();
     }
     return {Result::Done};
@@ -1322,19 +1338,19 @@ static Result next_token_in_definition(Context* context,
             continue;
         }
 
-        Token* tk = &info->definition->tokens[info->index];
-        if (tk->type == Token::Preprocessor_Parameter) {
+        const Token_Buffer* tokens = &info->definition->tokens;
+        if (tokens->type(info->index) == Token::Preprocessor_Parameter) {
             // Run through the tokens in the argument.
-            cz::Slice<Token> argument_tokens = info->arguments[tk->v.integer.value];
-            if (info->argument_index == argument_tokens.len) {
+            const Token_Buffer* argument_tokens = &info->arguments[tokens->parameter(info->index)];
+            if (info->argument_index == argument_tokens->len()) {
                 // We're at the end of this argument.
                 ++info->index;
                 info->argument_index = 0;
                 continue;
             }
-            *token = argument_tokens[info->argument_index++];
+            argument_tokens->get(&context->files, info->argument_index++, token);
 
-            if (expand_macros != -1 && info->argument_index == argument_tokens.len) {
+            if (expand_macros != -1 && info->argument_index == argument_tokens->len()) {
                 // We're at the end of this argument.
                 ++info->index;
                 info->argument_index = 0;
@@ -1349,10 +1365,10 @@ static Result next_token_in_definition(Context* context,
             // is a parameter token.  Since we don't use the value for any other reason and a branch
             // is expensive, we just always set it to 0.
             info->argument_index = 0;
-            *token = *tk;
+            tokens->get(&context->files, info->index - 1, token);
 
-            if (token->type == Token::Hash && info->index < info->definition->tokens.len()) {
-                if (info->definition->tokens[info->index].type == Token::Preprocessor_Parameter) {
+            if (token->type == Token::Hash && info->index < tokens->len()) {
+                if (tokens->type(info->index) == Token::Preprocessor_Parameter) {
                     // Todo: use lex buffer array directly since we don't lex more tokens while in
                     // the definition stack.  At some point this might change in order to implement
                     // # correctly by replacing arguments with some sort of "token soup" that are
@@ -1361,7 +1377,7 @@ static Result next_token_in_definition(Context* context,
                     string.allocator = cz::heap_allocator();
                     CZ_DEFER(string.drop());
 
-                    tk = &info->definition->tokens[info->index];
+                    size_t parameter = tokens->parameter(info->index);
                     size_t pdsl = preprocessor->definition_stack.len();
                     while (1) {
                         Definition_Info* info = &preprocessor->definition_stack.last();
@@ -1373,8 +1389,7 @@ static Result next_token_in_definition(Context* context,
                         }
 
                         if (preprocessor->definition_stack.len() == pdsl) {
-                            if (info->argument_index ==
-                                info->arguments[tk->v.integer.value].len()) {
+                            if (info->argument_index == info->arguments[parameter].len()) {
                                 ++info->index;
                                 info->argument_index = 0;
                                 break;
@@ -1397,7 +1412,9 @@ static Result next_token_in_definition(Context* context,
                 } else {
                     cz::AllocatedString string = {};
                     string.allocator = lexer->string_buffer_array.allocator();
-                    write(string_writer(&string), info->definition->tokens[info->index]);
+                    Token stringified;
+                    tokens->get(&context->files, info->index, &stringified);
+                    write(string_writer(&string), stringified);
 
                     token->type = Token::String;
                     token->v.string = string;
@@ -1408,14 +1425,13 @@ static Result next_token_in_definition(Context* context,
         }
 
         if (token->type == Token::HashHash ||
-            (info->index < info->definition->tokens.len() &&
-             info->definition->tokens[info->index].type == Token::HashHash)) {
+            (info->index < tokens->len() && tokens->type(info->index) == Token::HashHash)) {
             if (token->type != Token::HashHash) {
                 ++info->index;
             }
 
             // :ConcatErrors ## errors are eliminated in process_define
-            CZ_DEBUG_ASSERT(info->index < info->definition->tokens.len());
+            CZ_DEBUG_ASSERT(info->index < tokens->len());
 
             cz::AllocatedString combined_identifier = {};
             combined_identifier.allocator = lexer->identifier_buffer_array.allocator();
@@ -1425,39 +1441,40 @@ static Result next_token_in_definition(Context* context,
             }
 
             while (1) {
-                Token* tk = &info->definition->tokens[info->index];
-                if (tk->type == Token::Preprocessor_Parameter) {
+                Token tk;
+                if (tokens->type(info->index) == Token::Preprocessor_Parameter) {
                     // Get the first token in the argument and then stop chaining.
-                    cz::Slice<Token> argument_tokens = info->arguments[tk->v.integer.value];
-                    if (info->argument_index == argument_tokens.len) {
+                    const Token_Buffer* argument_tokens =
+                        &info->arguments[tokens->parameter(info->index)];
+                    if (info->argument_index == argument_tokens->len()) {
                         // We're at the end of this argument.
                         ++info->index;
                         info->argument_index = 0;
                         break;
                     }
 
-                    write(string_writer(&combined_identifier),
-                          argument_tokens[info->argument_index]);
+                    argument_tokens->get(&context->files, info->argument_index, &tk);
+                    write(string_writer(&combined_identifier), tk);
                     ++info->argument_index;
 
-                    if (info->argument_index == argument_tokens.len) {
+                    if (info->argument_index == argument_tokens->len()) {
                         ++info->index;
                         info->argument_index = 0;
                     } else {
                         break;
                     }
                 } else {
-                    write(string_writer(&combined_identifier), *tk);
+                    tokens->get(&context->files, info->index, &tk);
+                    write(string_writer(&combined_identifier), tk);
                     ++info->index;
                     info->argument_index = 0;
                 }
 
                 // Deal with chain x ## y ## z
-                if (info->index + 1 >= info->definition->tokens.len()) {
+                if (info->index + 1 >= tokens->len()) {
                     break;
                 } else {
-                    tk = &info->definition->tokens[info->index];
-                    if (tk->type != Token::HashHash) {
+                    if (tokens->type(info->index) != Token::HashHash) {
                         break;
                     }
                     ++info->index;
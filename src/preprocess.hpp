@@ -3,6 +3,7 @@
 #include <cz/str_map_removable.hpp>
 #include <cz/vector.hpp>
 #include "span.hpp"
+#include "token_buffer.hpp"
 
 namespace red {
 namespace lex {
@@ -11,7 +12,6 @@ struct Lexer;
 
 struct Context;
 struct Result;
-struct Token;
 
 namespace pre {
 struct Definition;
@@ -27,12 +27,14 @@ struct Definition_Info {
     Definition* definition;
     size_t index;
     size_t argument_index;
-    cz::Vector<cz::Vector<Token> > arguments;
+    cz::Vector<Token_Buffer> arguments;
 };
 
 struct Preprocessor {
     cz::Vector<bool> file_pragma_once;
     cz::Str_Map_Removable<Definition> definitions;
+    /// Incremented whenever a macro is defined or undefined.
+    size_t definitions_version;
 
     cz::Vector<Include_Info> include_stack;
     cz::Vector<Definition_Info> definition_stack;
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stdint.h>
+#include <cz/assert.hpp>
+#include <cz/heap.hpp>
+#include <cz/slice.hpp>
+#include <cz/str_map.hpp>
+#include <cz/vector.hpp>
+#include "hashed_str.hpp"
+
+namespace red {
+
+/// A symbol table for a stack of lexical scopes stored as one flat list of bindings.
+///
+/// Every binding remembers the binding it shadows, and `heads` maps each name to its innermost
+/// binding.  Thus looking up a name is a single hash probe no matter how deeply nested the scope
+/// is, and popping a scope only touches the bindings that were introduced in it.  Entries in
+/// `heads` are never removed; once a name goes out of scope its head is set to `none`.
+///
+/// Pushing a scope only records where it starts, so once the vectors have grown to fit the
+/// deepest nesting, opening and closing empty blocks allocates nothing.
+template <class T>
+struct Scope_Table {
+    static constexpr size_t none = SIZE_MAX;
+
+    struct Binding {
+        Hashed_Str name;
+        T value;
+        /// The index of the binding that this binding shadows or `none`.
+        size_t shadowed;
+    };
+
+    cz::Str_Map<size_t> heads;
+    cz::Vector<Binding> bindings;
+    cz::Vector<size_t> scope_starts;
+
+    /// Bindings in the range `[hidden_start, hidden_end)` are skipped by lookups.  This is used to
+    /// reparse part of a file as if the bindings after it hadn't been made yet.
+    size_t hidden_start;
+    size_t hidden_end;
+
+    /// If set the names in `heads` are copied to the heap instead of slicing the inserted names.
+    /// Entries in `heads` are never removed so this is needed if the text the names point into
+    /// can be freed or rewritten while the table is alive, such as a file version that
+    /// `Incremental_Parse` reloads.
+    bool copy_names;
+
+    size_t depth() const { return scope_starts.len(); }
+
+    void push_scope() {
+        scope_starts.reserve(cz::heap_allocator(), 1);
+        scope_starts.push(bindings.len());
+    }
+
+    /// Pop the innermost scope.  The values bound in it are not dropped.
+    void pop_scope() {
+        size_t start = scope_starts.pop();
+        for (size_t i = bindings.len(); i-- > start;) {
+            Binding* binding = &bindings[i];
+            size_t* head = heads.get(binding->name.str, binding->name.hash);
+            CZ_DEBUG_ASSERT(head && *head == i);
+            *head = binding->shadowed;
+        }
+        bindings.set_len(start);
+    }
+
+    /// Get the bindings in the scope at `index` where `0` is the outermost scope.
+    cz::Slice<Binding> scope(size_t index) {
+        size_t start = scope_starts[index];
+        size_t end = index + 1 < scope_starts.len() ? scope_starts[index + 1] : bindings.len();
+        return {bindings.as_slice().elems + start, end - start};
+    }
+
+    size_t scope_count(size_t index) { return scope(index).len; }
+
+    /// Find the innermost binding of `name`.
+    T* lookup(Hashed_Str name) {
+        size_t* head = heads.get(name.str, name.hash);
+        if (!head || *head == none || is_hidden(*head)) {
+            return nullptr;
+        }
+        return &bindings[*head].value;
+    }
+
+    /// Find the binding of `name` in the innermost scope.
+    T* lookup_in_scope(Hashed_Str name) {
+        size_t* head = heads.get(name.str, name.hash);
+        if (!head || *head == none || *head < scope_starts.last() || is_hidden(*head)) {
+            return nullptr;
+        }
+        return &bindings[*head].value;
+    }
+
+    bool is_hidden(size_t index) const { return index >= hidden_start && index < hidden_end; }
+
+    T* get_hash(cz::Str str) { return lookup(Hashed_Str::from_str(str)); }
+
+    /// Bind `name` to `value` in the innermost scope, replacing the binding if it already exists.
+    ///
+    /// Note that this invalidates pointers to other values in the table.
+    void insert(Hashed_Str name, T value) {
+        heads.reserve(cz::heap_allocator(), 1);
+        size_t* head = heads.get(name.str, name.hash);
+        size_t shadowed = none;
+        if (head) {
+            if (*head != none && *head >= scope_starts.last() && !is_hidden(*head)) {
+                bindings[*head].value = value;
+                return;
+            }
+            shadowed = *head;
+        }
+
+        size_t index = bindings.len();
+        bindings.reserve(cz::heap_allocator(), 1);
+        bindings.push({name, value, shadowed});
+
+        if (head) {
+            *head = index;
+        } else {
+            cz::Str key = name.str;
+            if (copy_names) {
+                cz::Slice<char> copy =
+                    cz::heap_allocator().duplicate(cz::Slice<const char>{key.buffer, key.len});
+                key = {copy.elems, copy.len};
+            }
+            heads.insert(key, name.hash, index);
+        }
+    }
+
+    /// Copy the bindings in the innermost scope into `map`, allocating with `allocator`, and then
+    /// pop it.
+    template <class Map>
+    void pop_scope_into(Map* map, cz::Allocator allocator) {
+        cz::Slice<Binding> innermost = scope(depth() - 1);
+        map->reserve(allocator, innermost.len);
+        for (size_t i = 0; i < innermost.len; ++i) {
+            map->insert(innermost[i].name.str, innermost[i].name.hash, innermost[i].value);
+        }
+        pop_scope();
+    }
+
+    /// Make this table a copy of the outermost scope of `other`, which must have no other scopes
+    /// open.  Binding indices are preserved.
+    void copy_outer_scope(const Scope_Table& other) {
+        CZ_DEBUG_ASSERT(other.scope_starts.len() == 1);
+
+        bindings = other.bindings.clone(cz::heap_allocator());
+        push_scope();
+
+        heads.reserve(cz::heap_allocator(), other.heads.count);
+        for (size_t i = 0; i < other.heads.cap; ++i) {
+            if (other.heads.is_present(i)) {
+                cz::Str name = other.heads.keys[i];
+                heads.insert(name, Hashed_Str::hash_str(name), other.heads.values[i]);
+            }
+        }
+    }
+
+    void drop() {
+        if (copy_names) {
+            for (size_t i = 0; i < heads.cap; ++i) {
+                if (heads.is_present(i)) {
+                    cz::Str key = heads.keys[i];
+                    cz::heap_allocator().dealloc({(void*)key.buffer, key.len});
+                }
+            }
+        }
+        heads.drop(cz::heap_allocator());
+        bindings.drop(cz::heap_allocator());
+        scope_starts.drop(cz::heap_allocator());
+    }
+};
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stddef.h>
+#include <cz/allocator.hpp>
+#include <cz/assert.hpp>
+#include <cz/str_map.hpp>
+#include "hashed_str.hpp"
+
+namespace red {
+
+/// A map from strings to `T` that stores up to `N` entries in arrays sized to fit them and finds
+/// them with a linear search that compares hashes before strings.  Once more than `N` entries are
+/// reserved they are all moved into a `cz::Str_Map`.
+///
+/// Most structs, unions, and enums have a handful of members, so this avoids allocating a hash
+/// table for each of them and keeps lookups within a cache line or two.  The entries are kept out
+/// of line so a type with few or no members only pays for the members it has.
+///
+/// Entries are visited by looping over `slots` and checking `is_present`.  While the map is small
+/// they are in the order they were inserted.
+template <class T, size_t N>
+struct Small_Map {
+    size_t count;
+    /// The length of the small arrays.  This is at most `N`.
+    size_t small_cap;
+    /// The hashes are kept apart from the keys so a search scans as little memory as possible.
+    cz::Hash* small_hashes;
+    cz::Str* small_keys;
+    T* small_values;
+    /// Holds every entry once the map has grown past `N`.
+    cz::Str_Map<T> map;
+
+    bool is_small() const { return map.cap == 0; }
+
+    T* get(cz::Str str, cz::Hash hash) {
+        if (!is_small()) {
+            return map.get(str, hash);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (small_hashes[i] == hash && small_keys[i] == str) {
+                return &small_values[i];
+            }
+        }
+        return nullptr;
+    }
+
+    T* get_hash(cz::Str str) { return get(str, Hashed_Str::hash_str(str)); }
+
+    /// Make room for `extra` more entries.  This must be called before `insert`.
+    void reserve(cz::Allocator allocator, size_t extra) {
+        if (!is_small()) {
+            map.reserve(allocator, extra);
+            return;
+        }
+
+        if (count + extra <= small_cap) {
+            return;
+        }
+
+        if (count + extra <= N) {
+            // Grow geometrically for callers that reserve one entry at a time.
+            size_t new_cap = small_cap * 2;
+            if (new_cap < count + extra) {
+                new_cap = count + extra;
+            }
+            if (new_cap > N) {
+                new_cap = N;
+            }
+            small_hashes = resize(allocator, small_hashes, small_cap, new_cap);
+            small_keys = resize(allocator, small_keys, small_cap, new_cap);
+            small_values = resize(allocator, small_values, small_cap, new_cap);
+            small_cap = new_cap;
+            return;
+        }
+
+        map.reserve(allocator, count + extra);
+        for (size_t i = 0; i < count; ++i) {
+            map.insert(small_keys[i], small_hashes[i], small_values[i]);
+        }
+        drop_small(allocator);
+    }
+
+    /// Insert an entry or replace the value of an existing one.
+    void insert(cz::Str str, cz::Hash hash, T value) {
+        if (!is_small()) {
+            map.insert(str, hash, value);
+            count = map.count;
+            return;
+        }
+
+        T* existing = get(str, hash);
+        if (existing) {
+            *existing = value;
+            return;
+        }
+
+        CZ_DEBUG_ASSERT(count < small_cap);
+        small_hashes[count] = hash;
+        small_keys[count] = str;
+        small_values[count] = value;
+        ++count;
+    }
+
+    size_t slots() const { return is_small() ? count : map.cap; }
+    bool is_present(size_t index) const { return is_small() || map.is_present(index); }
+    cz::Str key(size_t index) const { return is_small() ? small_keys[index] : map.keys[index]; }
+    T& value(size_t index) { return is_small() ? small_values[index] : map.values[index]; }
+
+    void drop(cz::Allocator allocator) {
+        if (is_small()) {
+            drop_small(allocator);
+        } else {
+            map.drop(allocator);
+        }
+    }
+
+    template <class U>
+    static U* resize(cz::Allocator allocator, U* array, size_t old_len, size_t new_len) {
+        U* result = static_cast<U*>(allocator.realloc({array, sizeof(U) * old_len},
+                                                      {sizeof(U) * new_len, alignof(U)}));
+        CZ_ASSERT(result);
+        return result;
+    }
+
+    void drop_small(cz::Allocator allocator) {
+        if (small_cap > 0) {
+            allocator.dealloc({small_hashes, sizeof(cz::Hash) * small_cap});
+            allocator.dealloc({small_keys, sizeof(cz::Str) * small_cap});
+            allocator.dealloc({small_values, sizeof(T) * small_cap});
+        }
+        small_hashes = nullptr;
+        small_keys = nullptr;
+        small_values = nullptr;
+        small_cap = 0;
+    }
+};
+
+}
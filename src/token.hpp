@@ -122,9 +122,9 @@ struct Token {
 
 namespace Integer_Suffix_ {
 enum Integer_Suffix : uint32_t {
-    Unsigned,
-    Long,
-    LongLong,
+    Unsigned = 1 << 0,
+    Long = 1 << 1,
+    LongLong = 1 << 2,
 };
 }
 using Integer_Suffix_::Integer_Suffix;
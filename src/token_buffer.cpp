@@ -0,0 +1,174 @@
+#include "token_buffer.hpp"
+
+#include "file.hpp"
+#include "files.hpp"
+
+namespace red {
+
+static_assert(Token::Parser_Null_Token <= UINT8_MAX, "Token::Type must fit in a byte");
+
+Span Token_Buffer::span(Files* files, size_t index) const {
+    // There is almost always one run.
+    size_t run = file_runs.len() - 1;
+    if (file_runs[run].first_token > index) {
+        size_t start = 0;
+        size_t end = run;
+        while (end - start > 1) {
+            size_t mid = (start + end) / 2;
+            if (file_runs[mid].first_token <= index) {
+                start = mid;
+            } else {
+                end = mid;
+            }
+        }
+        run = start;
+    }
+
+    Span span;
+    span.start.file = file_runs[run].file;
+    span.end.file = span.start.file;
+    File* file = &files->files[span.start.file];
+    file->find_location(starts[index], &span.start);
+    file->find_location(starts[index] + lengths[index], &span.end);
+    return span;
+}
+
+void Token_Buffer::get(Files* files, size_t index, Token* token) const {
+    token->type = type(index);
+    token->span = span(files, index);
+
+    uint32_t payload = payloads[index];
+    switch (token->type) {
+        case Token::Identifier:
+            token->v.identifier = identifiers[payload];
+            break;
+        case Token::String:
+            token->v.string = strings[payload];
+            break;
+        case Token::Integer:
+            token->v.integer.value = integers[payload].value;
+            token->v.integer.suffix = integers[payload].suffix;
+            break;
+        case Token::Character:
+            token->v.ch = (char)payload;
+            break;
+        case Token::Preprocessor_Parameter:
+            token->v.integer.value = payload;
+            token->v.integer.suffix = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+void Token_Buffer::push(cz::Allocator allocator, const Token& token) {
+    uint32_t payload = 0;
+    switch (token.type) {
+        case Token::Identifier:
+            payload = (uint32_t)identifiers.len();
+            identifiers.reserve(allocator, 1);
+            identifiers.push(token.v.identifier);
+            break;
+        case Token::String:
+            payload = (uint32_t)strings.len();
+            strings.reserve(allocator, 1);
+            strings.push(token.v.string);
+            break;
+        case Token::Integer:
+            payload = (uint32_t)integers.len();
+            integers.reserve(allocator, 1);
+            integers.push({token.v.integer.value, token.v.integer.suffix});
+            break;
+        case Token::Character:
+            payload = (unsigned char)token.v.ch;
+            break;
+        case Token::Preprocessor_Parameter:
+            payload = (uint32_t)token.v.integer.value;
+            break;
+        default:
+            break;
+    }
+
+    CZ_DEBUG_ASSERT(token.span.end.file == token.span.start.file);
+    CZ_DEBUG_ASSERT(token.span.end.index >= token.span.start.index);
+    if (file_runs.len() == 0 || file_runs.last().file != token.span.start.file) {
+        file_runs.reserve(allocator, 1);
+        file_runs.push({(uint32_t)len(), (uint32_t)token.span.start.file});
+    }
+
+    types.reserve(allocator, 1);
+    payloads.reserve(allocator, 1);
+    starts.reserve(allocator, 1);
+    lengths.reserve(allocator, 1);
+    types.push((uint8_t)token.type);
+    payloads.push(payload);
+    starts.push((uint32_t)token.span.start.index);
+    lengths.push((uint32_t)(token.span.end.index - token.span.start.index));
+}
+
+void Token_Buffer::pop() {
+    // Side table entries are always appended so the last token owns the last entry.
+    switch (type(len() - 1)) {
+        case Token::Identifier:
+            identifiers.pop();
+            break;
+        case Token::String:
+            strings.pop();
+            break;
+        case Token::Integer:
+            integers.pop();
+            break;
+        default:
+            break;
+    }
+
+    types.pop();
+    payloads.pop();
+    starts.pop();
+    lengths.pop();
+    if (file_runs.last().first_token == len()) {
+        file_runs.pop();
+    }
+}
+
+void Token_Buffer::set_parameter(size_t index, uint32_t parameter) {
+    CZ_DEBUG_ASSERT(type(index) == Token::Identifier);
+    types[index] = Token::Preprocessor_Parameter;
+    payloads[index] = parameter;
+}
+
+void Token_Buffer::remove_unused_identifiers(size_t first_token, size_t first_identifier) {
+    size_t next = first_identifier;
+    for (size_t i = first_token; i < len(); ++i) {
+        if (type(i) == Token::Identifier) {
+            identifiers[next] = identifiers[payloads[i]];
+            payloads[i] = (uint32_t)next;
+            ++next;
+        }
+    }
+    identifiers.set_len(next);
+}
+
+void Token_Buffer::realloc(cz::Allocator allocator) {
+    types.realloc(allocator);
+    payloads.realloc(allocator);
+    starts.realloc(allocator);
+    lengths.realloc(allocator);
+    file_runs.realloc(allocator);
+    identifiers.realloc(allocator);
+    strings.realloc(allocator);
+    integers.realloc(allocator);
+}
+
+void Token_Buffer::drop(cz::Allocator allocator) {
+    types.drop(allocator);
+    payloads.drop(allocator);
+    starts.drop(allocator);
+    lengths.drop(allocator);
+    file_runs.drop(allocator);
+    identifiers.drop(allocator);
+    strings.drop(allocator);
+    integers.drop(allocator);
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <cz/assert.hpp>
+#include <cz/vector.hpp>
+#include "token.hpp"
+
+namespace red {
+struct Files;
+
+/// A compact list of tokens stored as a struct of arrays.
+///
+/// The hot data for each token is a one byte type and a four byte payload.  The payload is either
+/// the value itself (for characters and macro parameter indices) or an index into the side table
+/// for that type of token (`identifiers`, `strings`, or `integers`).
+///
+/// Spans aren't stored.  Each token keeps the offset of its start in its file and its length, and
+/// the line and column are looked up in the file's line table (see `File::find_location`) when a
+/// token is materialized via `get`.  The file only changes between runs of tokens so it is stored
+/// once per run.
+///
+/// This is used for macro bodies and arguments, which are iterated over far more often than
+/// they are created.
+struct Token_Buffer {
+    struct Integer {
+        uint64_t value;
+        uint32_t suffix;
+    };
+
+    /// The tokens starting at `first_token` are in `file` until the next run starts.
+    struct File_Run {
+        uint32_t first_token;
+        uint32_t file;
+    };
+
+    cz::Vector<uint8_t> types;
+    cz::Vector<uint32_t> payloads;
+    cz::Vector<uint32_t> starts;
+    cz::Vector<uint32_t> lengths;
+    cz::Vector<File_Run> file_runs;
+
+    cz::Vector<Hashed_Str> identifiers;
+    cz::Vector<cz::Str> strings;
+    cz::Vector<Integer> integers;
+
+    size_t len() const { return types.len(); }
+
+    Token::Type type(size_t index) const { return (Token::Type)types[index]; }
+
+    /// Get the index of the parameter a `Token::Preprocessor_Parameter` refers to.
+    size_t parameter(size_t index) const {
+        CZ_DEBUG_ASSERT(type(index) == Token::Preprocessor_Parameter);
+        return payloads[index];
+    }
+
+    Span span(Files* files, size_t index) const;
+
+    void get(Files* files, size_t index, Token* token) const;
+    void push(cz::Allocator allocator, const Token& token);
+    void pop();
+
+    /// Turn the identifier at `index` into a reference to the macro parameter `parameter`.  Its
+    /// entry in `identifiers` is left unused until `remove_unused_identifiers` is called.
+    void set_parameter(size_t index, uint32_t parameter);
+
+    /// Remove the entries in `identifiers` left unused by `set_parameter`.  `first_token` and
+    /// `first_identifier` are the lengths of the buffer and `identifiers` before the tokens that
+    /// were changed were pushed.
+    void remove_unused_identifiers(size_t first_token, size_t first_identifier);
+
+    /// Shrink all the arrays to fit their contents.
+    void realloc(cz::Allocator allocator);
+    void drop(cz::Allocator allocator);
+};
+
+}
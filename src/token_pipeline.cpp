@@ -0,0 +1,178 @@
+#include "token_pipeline.hpp"
+
+#include <Tracy.hpp>
+#include <cz/assert.hpp>
+#include <cz/heap.hpp>
+#include "lex.hpp"
+#include "preprocess.hpp"
+
+namespace red {
+namespace parse {
+
+/// Move the errors the producer has reported since the last call into `batch`.
+static void take_producer_errors(Context* producer_context, Token_Batch* batch) {
+    for (size_t i = 0; i < producer_context->errors.len(); ++i) {
+        Token_Batch_Error error;
+        error.index = batch->len;
+        error.error = producer_context->errors[i];
+        batch->errors.reserve(cz::heap_allocator(), 1);
+        batch->errors.push(error);
+    }
+    producer_context->errors.set_len(0);
+}
+
+static void run_producer(Token_Pipeline* pipeline) {
+    ZoneScoped;
+
+    Context* context = &pipeline->producer_context;
+    size_t head = pipeline->head.load(std::memory_order_relaxed);
+    while (!pipeline->stopping.load(std::memory_order_relaxed)) {
+        // Wait for the parser to free up a batch.
+        while (head - pipeline->tail.load(std::memory_order_acquire) ==
+               Token_Pipeline::batch_count) {
+            if (pipeline->stopping.load(std::memory_order_relaxed)) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        Token_Batch* batch = &pipeline->batches[head % Token_Pipeline::batch_count];
+        batch->len = 0;
+        batch->errors.set_len(0);
+        batch->last = false;
+
+        while (batch->len < Token_Batch::capacity) {
+            Token_Source_Span_Pair* pair = &batch->pairs[batch->len];
+            Result result =
+                cpp::next_token(context, pipeline->preprocessor, pipeline->lexer, &pair->token);
+            take_producer_errors(context, batch);
+            if (result.type != Result::Success) {
+                batch->last = true;
+                batch->result = result;
+                break;
+            }
+
+            pair->source_span = pipeline->preprocessor->include_stack.last().span;
+            ++batch->len;
+        }
+
+        ++head;
+        pipeline->head.store(head, std::memory_order_release);
+
+        if (batch->last) {
+            return;
+        }
+    }
+}
+
+void Token_Pipeline::start(Context* context, pre::Preprocessor* preprocessor, lex::Lexer* lexer) {
+    ZoneScoped;
+
+    batches = (Token_Batch*)cz::heap_allocator().alloc({sizeof(Token_Batch) * batch_count,
+                                                        alignof(Token_Batch)});
+    CZ_ASSERT(batches);
+    for (size_t i = 0; i < batch_count; ++i) {
+        batches[i].len = 0;
+        batches[i].errors = {};
+        batches[i].last = false;
+    }
+
+    head = 0;
+    tail = 0;
+    stopping = false;
+
+    producer_context = {};
+    producer_context.options = context->options;
+    producer_context.files = context->files;
+    producer_context.temp_buffer_array = context->temp_buffer_array;
+    producer_context.error_message_buffer_array.create();
+    context->files = {};
+    context->temp_buffer_array = {};
+
+    this->preprocessor = preprocessor;
+    this->lexer = lexer;
+
+    batch = nullptr;
+    index = 0;
+    error_index = 0;
+    finished = false;
+
+    producer = std::thread(run_producer, this);
+}
+
+void Token_Pipeline::stop(Context* context) {
+    ZoneScoped;
+
+    stopping.store(true, std::memory_order_relaxed);
+    producer.join();
+
+    context->files = producer_context.files;
+    context->temp_buffer_array = producer_context.temp_buffer_array;
+
+    // Error messages were copied into `context` as they were read.
+    producer_context.errors.drop(cz::heap_allocator());
+    producer_context.unspanned_errors.drop(cz::heap_allocator());
+    producer_context.error_message_buffer_array.drop();
+
+    for (size_t i = 0; i < batch_count; ++i) {
+        batches[i].errors.drop(cz::heap_allocator());
+    }
+    cz::heap_allocator().dealloc({batches, sizeof(Token_Batch) * batch_count});
+    batches = nullptr;
+}
+
+/// Report the errors in the current batch that were reported before the token at `end`.
+static void report_batch_errors(Context* context, Token_Pipeline* pipeline, size_t end) {
+    Token_Batch* batch = pipeline->batch;
+    for (; pipeline->error_index < batch->errors.len(); ++pipeline->error_index) {
+        const Token_Batch_Error& error = batch->errors[pipeline->error_index];
+        if (error.index > end) {
+            break;
+        }
+
+        cz::Slice<char> message = context->error_message_buffer_array.allocator().duplicate(
+            cz::Slice<const char>{error.error.message.buffer, error.error.message.len});
+        context->report_error_str(error.error.error_span, error.error.source_span,
+                                  {message.elems, message.len});
+    }
+}
+
+Result Token_Pipeline::next(Context* context, Token_Source_Span_Pair* pair) {
+    while (1) {
+        if (finished) {
+            return final_result;
+        }
+
+        if (!batch) {
+            size_t tail = this->tail.load(std::memory_order_relaxed);
+            if (head.load(std::memory_order_acquire) == tail) {
+                ZoneScopedN("Wait for tokens");
+                while (head.load(std::memory_order_acquire) == tail) {
+                    std::this_thread::yield();
+                }
+            }
+
+            batch = &batches[tail % batch_count];
+            index = 0;
+            error_index = 0;
+        }
+
+        report_batch_errors(context, this, index);
+
+        if (index < batch->len) {
+            *pair = batch->pairs[index++];
+            return Result::ok();
+        }
+
+        if (batch->last) {
+            finished = true;
+            final_result = batch->result;
+        }
+
+        batch = nullptr;
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+}
+
+}
+}
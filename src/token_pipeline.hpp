@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <cz/vector.hpp>
+#include "compiler_error.hpp"
+#include "context.hpp"
+#include "result.hpp"
+#include "token_source_span_pair.hpp"
+
+namespace red {
+namespace lex {
+struct Lexer;
+}
+namespace pre {
+struct Preprocessor;
+}
+
+namespace parse {
+
+/// An error reported by the preprocessor while producing the token at `index` in its batch.
+struct Token_Batch_Error {
+    size_t index;
+    Compiler_Error error;
+};
+
+struct Token_Batch {
+    static constexpr const size_t capacity = 256;
+
+    Token_Source_Span_Pair pairs[capacity];
+    size_t len;
+
+    /// Errors in the order they were reported.  They are reported to the parser's `Context` just
+    /// before the token they were reported while producing is read.
+    cz::Vector<Token_Batch_Error> errors;
+
+    /// Set on the last batch.  `result` is what the preprocessor returned instead of a token.
+    bool last;
+    Result result;
+};
+
+/// Runs the lexer and preprocessor on a producer thread so they overlap with parsing.
+///
+/// Tokens are passed to the parser in batches through a fixed size single producer single
+/// consumer ring.  The producer waits when the ring is full so it stays at most
+/// `batch_count * Token_Batch::capacity` tokens ahead of the parser.
+///
+/// While the pipeline is running the producer owns the `Files` of the `Context` and the
+/// preprocessor and lexer of the `Parser`; the parser thread may only report errors.
+struct Token_Pipeline {
+    static constexpr const size_t batch_count = 8;
+
+    Token_Batch* batches;
+
+    /// The number of batches the producer has finished.  Written by the producer.
+    alignas(64) std::atomic<size_t> head;
+    /// The number of batches the parser has finished.  Written by the parser.
+    alignas(64) std::atomic<size_t> tail;
+    /// Set by the parser to make the producer give up early.
+    std::atomic<bool> stopping;
+
+    /// The producer reports errors here.  Its `files` are moved from the parser's `Context`.
+    Context producer_context;
+    pre::Preprocessor* preprocessor;
+    lex::Lexer* lexer;
+    std::thread producer;
+
+    /// State of the parser thread.
+    Token_Batch* batch;
+    size_t index;
+    size_t error_index;
+    bool finished;
+    Result final_result;
+
+    /// Start producing tokens from `preprocessor` and `lexer`.  `context->files` is unusable
+    /// until `stop` is called.
+    void start(Context* context, pre::Preprocessor* preprocessor, lex::Lexer* lexer);
+
+    /// Stop the producer and give `context` its files back.
+    void stop(Context* context);
+
+    /// Read the next token.  The result is the same as `cpp::next_token` would give, including
+    /// the errors it reports.
+    Result next(Context* context, Token_Source_Span_Pair* pair);
+};
+
+}
+}
@@ -0,0 +1,108 @@
+#include <Tracy.hpp>
+#include <cz/heap.hpp>
+#include "hashed_str.hpp"
+#include "parse.hpp"
+
+namespace red {
+namespace parse {
+
+void Type_Interner::init() {
+    distinct = 0;
+    duplicates = 0;
+}
+
+void Type_Interner::init_worker(const Type_Interner& parent) {
+    init();
+    types.reserve(cz::heap_allocator(), parent.types.count);
+    for (size_t i = 0; i < parent.types.cap; ++i) {
+        if (parent.types.is_present(i)) {
+            cz::Str key = parent.types.keys[i];
+            types.insert(key, Hashed_Str::hash_str(key), parent.types.values[i]);
+        }
+    }
+}
+
+void Type_Interner::drop() {
+    types.drop(cz::heap_allocator());
+    key.drop(cz::heap_allocator());
+}
+
+/// Only write to types that change so types that are already canonical are never written to.
+static void set_component(TypeP* component, TypeP canonical) {
+    if (component->value != canonical.value) {
+        *component = canonical;
+    }
+}
+
+TypeP Type_Interner::intern(cz::Allocator allocator, TypeP type) {
+    Type* node = type.get_type();
+
+    // Intern the components first so the key can refer to them by identity.  The key is
+    // built afterwards because the recursive calls reuse the scratch space.
+    switch (node->tag) {
+        case Type::Pointer: {
+            Type_Pointer* pointer = (Type_Pointer*)node;
+            set_component(&pointer->inner, intern(allocator, pointer->inner));
+            key.set_len(0);
+            key.reserve(cz::heap_allocator(), 2);
+            key.push(Type::Pointer);
+            key.push(pointer->inner.value);
+        } break;
+
+        case Type::Array: {
+            Type_Array* array = (Type_Array*)node;
+            set_component(&array->inner, intern(allocator, array->inner));
+            if (array->o_length && !(array->flags & Type_Array::Length_Known)) {
+                return type;
+            }
+            key.set_len(0);
+            key.reserve(cz::heap_allocator(), 3);
+            key.push(Type::Array);
+            key.push(array->inner.value);
+            if (array->o_length) {
+                key.push(array->length);
+            }
+        } break;
+
+        case Type::Function: {
+            Type_Function* function = (Type_Function*)node;
+            set_component(&function->return_type, intern(allocator, function->return_type));
+            for (size_t i = 0; i < function->parameter_types.len; ++i) {
+                set_component(&function->parameter_types[i],
+                              intern(allocator, function->parameter_types[i]));
+            }
+            key.set_len(0);
+            key.reserve(cz::heap_allocator(), 3 + function->parameter_types.len);
+            key.push(Type::Function);
+            key.push(function->has_varargs);
+            key.push(function->return_type.value);
+            for (size_t i = 0; i < function->parameter_types.len; ++i) {
+                key.push(function->parameter_types[i].value);
+            }
+        } break;
+
+        default:
+            // Builtin types are singletons and tagged types are identified by their node.
+            return type;
+    }
+
+    cz::Slice<uintptr_t> slice = key.as_slice();
+    cz::Str str = {(const char*)slice.elems, slice.len * sizeof(uintptr_t)};
+    cz::Hash hash = Hashed_Str::hash_str(str);
+
+    Type** canonical = types.get(str, hash);
+    if (canonical) {
+        ++duplicates;
+        type.set_type(*canonical);
+        return type;
+    }
+
+    ++distinct;
+    cz::Slice<uintptr_t> stored = allocator.duplicate(slice);
+    types.reserve(cz::heap_allocator(), 1);
+    types.insert({(const char*)stored.elems, str.len}, hash, node);
+    return type;
+}
+
+}
+}
@@ -0,0 +1,148 @@
+#include "utf8.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace red {
+namespace utf8 {
+
+size_t decode(const char* start, const char* end, uint32_t* code_point) {
+    const unsigned char* it = (const unsigned char*)start;
+    size_t available = end - start;
+    if (available == 0) {
+        return 0;
+    }
+
+    uint32_t lead = it[0];
+    size_t length;
+    uint32_t minimum;
+    if (lead < 0x80) {
+        *code_point = lead;
+        return 1;
+    } else if (lead < 0xC0) {
+        // A continuation byte can't start a sequence.
+        return 0;
+    } else if (lead < 0xE0) {
+        length = 2;
+        minimum = 0x80;
+        lead &= 0x1F;
+    } else if (lead < 0xF0) {
+        length = 3;
+        minimum = 0x800;
+        lead &= 0x0F;
+    } else if (lead < 0xF8) {
+        length = 4;
+        minimum = 0x10000;
+        lead &= 0x07;
+    } else {
+        return 0;
+    }
+
+    if (available < length) {
+        return 0;
+    }
+
+    uint32_t value = lead;
+    for (size_t i = 1; i < length; ++i) {
+        if ((it[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        value = (value << 6) | (it[i] & 0x3F);
+    }
+
+    if (value < minimum || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+        return 0;
+    }
+
+    *code_point = value;
+    return length;
+}
+
+const char* find_non_ascii(const char* start, const char* end) {
+#ifdef __SSE2__
+    // Almost every file is entirely ASCII so test 64 bytes at a time.
+    for (; end - start >= 64; start += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)start);
+        __m128i b = _mm_loadu_si128((const __m128i*)(start + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(start + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(start + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) {
+            break;
+        }
+    }
+
+    for (; end - start >= 16; start += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)start));
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; start < end; ++start) {
+        if ((unsigned char)*start >= 0x80) {
+            return start;
+        }
+    }
+    return end;
+}
+
+struct Code_Point_Range {
+    uint32_t first;
+    uint32_t last;
+};
+
+/// The ranges of C11 Annex D.1 in the Basic Multilingual Plane, sorted.
+static const Code_Point_Range identifier_ranges[] = {
+    {0x00A8, 0x00A8}, {0x00AA, 0x00AA}, {0x00AD, 0x00AD}, {0x00AF, 0x00AF}, {0x00B2, 0x00B5},
+    {0x00B7, 0x00BA}, {0x00BC, 0x00BE}, {0x00C0, 0x00D6}, {0x00D8, 0x00F6}, {0x00F8, 0x00FF},
+    {0x0100, 0x167F}, {0x1681, 0x180D}, {0x180F, 0x1FFF}, {0x200B, 0x200D}, {0x202A, 0x202E},
+    {0x203F, 0x2040}, {0x2054, 0x2054}, {0x2060, 0x206F}, {0x2070, 0x218F}, {0x2460, 0x24FF},
+    {0x2776, 0x2793}, {0x2C00, 0x2DFF}, {0x2E80, 0x2FFF}, {0x3004, 0x3007}, {0x3021, 0x302F},
+    {0x3031, 0x303F}, {0x3040, 0xD7FF}, {0xF900, 0xFD3D}, {0xFD40, 0xFDCF}, {0xFDF0, 0xFE44},
+    {0xFE47, 0xFFFD},
+};
+
+bool is_identifier_continue(uint32_t code_point) {
+    // Latin, Greek, Cyrillic, and so on, and then CJK, cover nearly every identifier.
+    if (code_point >= 0x0100 && code_point <= 0x167F) {
+        return true;
+    }
+    if (code_point >= 0x3040 && code_point <= 0xD7FF) {
+        return true;
+    }
+
+    // Planes 1 through 14 are allowed except for the last two code points of each.
+    if (code_point >= 0x10000) {
+        return code_point < 0xF0000 && (code_point & 0xFFFF) <= 0xFFFD;
+    }
+
+    size_t start = 0;
+    size_t end = sizeof(identifier_ranges) / sizeof(identifier_ranges[0]);
+    while (start < end) {
+        size_t mid = (start + end) / 2;
+        if (code_point < identifier_ranges[mid].first) {
+            end = mid;
+        } else if (code_point > identifier_ranges[mid].last) {
+            start = mid + 1;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool is_identifier_start(uint32_t code_point) {
+    // Combining characters (C11 Annex D.2).
+    if ((code_point >= 0x0300 && code_point <= 0x036F) ||
+        (code_point >= 0x1DC0 && code_point <= 0x1DFF) ||
+        (code_point >= 0x20D0 && code_point <= 0x20FF) ||
+        (code_point >= 0xFE20 && code_point <= 0xFE2F)) {
+        return false;
+    }
+    return is_identifier_continue(code_point);
+}
+
+}
+}
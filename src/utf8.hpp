@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace red {
+namespace utf8 {
+
+/// The longest encoded code point.
+constexpr const size_t max_sequence_length = 4;
+
+/// Decode the code point at the start of `[start, end)`.  Returns the length of its encoding or
+/// 0 if it is truncated, overlong, a surrogate, or above U+10FFFF.
+size_t decode(const char* start, const char* end, uint32_t* code_point);
+
+/// Find the first byte in `[start, end)` that isn't ASCII.
+const char* find_non_ascii(const char* start, const char* end);
+
+/// Is the code point allowed in an identifier (C11 Annex D.1)?
+bool is_identifier_continue(uint32_t code_point);
+
+/// Is the code point allowed at the start of an identifier (C11 Annex D.1 minus D.2)?
+bool is_identifier_start(uint32_t code_point);
+
+}
+}
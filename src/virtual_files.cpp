@@ -0,0 +1,265 @@
+#include "virtual_files.hpp"
+
+#include <Tracy.hpp>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/path.hpp>
+#include <cz/string.hpp>
+#include "context.hpp"
+#include "file_contents.hpp"
+#include "hashed_str.hpp"
+
+namespace red {
+
+void Virtual_Files::init() {
+    files = {};
+    buffer_array.create();
+    exclusive = false;
+}
+
+void Virtual_Files::drop() {
+    files.drop(cz::heap_allocator());
+    buffer_array.drop();
+}
+
+static cz::Str duplicate(cz::Allocator allocator, cz::Str str) {
+    cz::Slice<char> copy = allocator.duplicate(cz::Slice<const char>{str.buffer, str.len});
+    return {copy.elems, copy.len};
+}
+
+Result Virtual_Files::add(cz::Str path, cz::Str contents) {
+    // Spell the path the way `make_include_path` does so `include_file` finds it.
+    cz::String absolute = {};
+    CZ_DEFER(absolute.drop(cz::heap_allocator()));
+    cz::Result result = cz::path::make_absolute(path, cz::heap_allocator(), &absolute);
+    if (result.is_err()) {
+        return Result::from(result);
+    }
+    cz::path::flatten(&absolute);
+
+    cz::Hash hash = Hashed_Str::hash_str(absolute);
+    cz::Str stored_contents = duplicate(buffer_array.allocator(), contents);
+    cz::Str* existing = files.get(absolute, hash);
+    if (existing) {
+        *existing = stored_contents;
+    } else {
+        files.reserve(cz::heap_allocator(), 1);
+        files.insert(duplicate(buffer_array.allocator(), absolute), hash, stored_contents);
+    }
+    return Result::ok();
+}
+
+const cz::Str* Virtual_Files::find(cz::Str path, cz::Hash hash) {
+    if (files.count == 0) {
+        return nullptr;
+    }
+    return files.get(path, hash);
+}
+
+namespace {
+struct Mapping_Parser {
+    const char* point;
+    const char* end;
+
+    void skip_whitespace() {
+        while (point < end &&
+               (*point == ' ' || *point == '\t' || *point == '\n' || *point == '\r')) {
+            ++point;
+        }
+    }
+
+    bool eat(char ch) {
+        skip_whitespace();
+        if (point < end && *point == ch) {
+            ++point;
+            return true;
+        }
+        return false;
+    }
+};
+}
+
+static bool parse_hex4(Mapping_Parser* parser, uint32_t* value) {
+    if (parser->end - parser->point < 4) {
+        return false;
+    }
+    *value = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        char ch = *parser->point++;
+        uint32_t digit;
+        if (ch >= '0' && ch <= '9') {
+            digit = ch - '0';
+        } else if (ch >= 'a' && ch <= 'f') {
+            digit = ch - 'a' + 10;
+        } else if (ch >= 'A' && ch <= 'F') {
+            digit = ch - 'A' + 10;
+        } else {
+            return false;
+        }
+        *value = (*value << 4) | digit;
+    }
+    return true;
+}
+
+static void push_utf8(cz::String* out, uint32_t code_point) {
+    out->reserve(cz::heap_allocator(), 4);
+    if (code_point < 0x80) {
+        out->push((char)code_point);
+    } else if (code_point < 0x800) {
+        out->push((char)(0xC0 | (code_point >> 6)));
+        out->push((char)(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out->push((char)(0xE0 | (code_point >> 12)));
+        out->push((char)(0x80 | ((code_point >> 6) & 0x3F)));
+        out->push((char)(0x80 | (code_point & 0x3F)));
+    } else {
+        out->push((char)(0xF0 | (code_point >> 18)));
+        out->push((char)(0x80 | ((code_point >> 12) & 0x3F)));
+        out->push((char)(0x80 | ((code_point >> 6) & 0x3F)));
+        out->push((char)(0x80 | (code_point & 0x3F)));
+    }
+}
+
+/// Parse a string, decoding its escape sequences into `out`.
+static bool parse_string(Mapping_Parser* parser, cz::String* out) {
+    out->set_len(0);
+    if (!parser->eat('"')) {
+        return false;
+    }
+
+    while (1) {
+        // Copy everything up to the next quote or escape at once.
+        const char* start = parser->point;
+        while (parser->point < parser->end && *parser->point != '"' && *parser->point != '\\') {
+            ++parser->point;
+        }
+        out->reserve(cz::heap_allocator(), parser->point - start);
+        out->append({start, (size_t)(parser->point - start)});
+
+        if (parser->point == parser->end) {
+            return false;
+        }
+        if (*parser->point++ == '"') {
+            return true;
+        }
+        if (parser->point == parser->end) {
+            return false;
+        }
+
+        char escape = *parser->point++;
+        char ch;
+        switch (escape) {
+            case '"':
+            case '\\':
+            case '/':
+                ch = escape;
+                break;
+            case 'b':
+                ch = '\b';
+                break;
+            case 'f':
+                ch = '\f';
+                break;
+            case 'n':
+                ch = '\n';
+                break;
+            case 'r':
+                ch = '\r';
+                break;
+            case 't':
+                ch = '\t';
+                break;
+            case 'u': {
+                uint32_t code_point;
+                if (!parse_hex4(parser, &code_point)) {
+                    return false;
+                }
+                if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+                    return false;
+                }
+                if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                    // Characters outside the Basic Multilingual Plane are written as surrogate
+                    // pairs.
+                    uint32_t low;
+                    if (parser->end - parser->point < 2 || parser->point[0] != '\\' ||
+                        parser->point[1] != 'u') {
+                        return false;
+                    }
+                    parser->point += 2;
+                    if (!parse_hex4(parser, &low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                }
+                push_utf8(out, code_point);
+                continue;
+            }
+            default:
+                return false;
+        }
+
+        out->reserve(cz::heap_allocator(), 1);
+        out->push(ch);
+    }
+}
+
+bool parse_virtual_files(cz::Str mapping, Virtual_Files* virtual_files) {
+    ZoneScoped;
+
+    Mapping_Parser parser;
+    parser.point = mapping.buffer;
+    parser.end = mapping.buffer + mapping.len;
+
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+
+    if (!parser.eat('{')) {
+        return false;
+    }
+
+    if (!parser.eat('}')) {
+        do {
+            if (!parse_string(&parser, &path)) {
+                return false;
+            }
+            if (!parser.eat(':')) {
+                return false;
+            }
+            if (!parse_string(&parser, &contents)) {
+                return false;
+            }
+            if (virtual_files->add(path, contents).is_err()) {
+                return false;
+            }
+        } while (parser.eat(','));
+
+        if (!parser.eat('}')) {
+            return false;
+        }
+    }
+
+    parser.skip_whitespace();
+    return parser.point == parser.end;
+}
+
+Result load_virtual_files(Context* context, const char* path, Virtual_Files* virtual_files) {
+    ZoneScoped;
+
+    File_Contents mapping;
+    if (mapping.read(path, cz::heap_allocator()).is_err()) {
+        context->report_error_unspanned("Could not read virtual file mapping");
+        return {Result::ErrorFile};
+    }
+    CZ_DEFER(mapping.drop_array(cz::heap_allocator()));
+
+    // The file is one block so it can be parsed directly.
+    if (!parse_virtual_files({mapping.buffers[0], mapping.len}, virtual_files)) {
+        context->report_error_unspanned("Invalid virtual file mapping");
+        return {Result::ErrorInvalidInput};
+    }
+    return Result::ok();
+}
+
+}
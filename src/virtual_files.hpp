@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cz/buffer_array.hpp>
+#include <cz/hash.hpp>
+#include <cz/str.hpp>
+#include <cz/str_map.hpp>
+#include "result.hpp"
+
+namespace red {
+struct Context;
+
+/// Files kept in memory that `include_file` loads instead of the files on disk at the same
+/// paths.  This lets build systems pass unsaved buffers or generated headers without writing
+/// them out and lets benchmarks run without touching the disk.
+struct Virtual_Files {
+    /// The contents of each file by its absolute path.
+    cz::Str_Map<cz::Str> files;
+    /// Stores the paths and contents.
+    cz::Buffer_Array buffer_array;
+
+    /// Treat files that aren't in `files` as missing instead of looking for them on the disk.
+    bool exclusive;
+
+    void init();
+    void drop();
+
+    /// Add the file at `path`, replacing it if it was already added.  A relative `path` is
+    /// relative to the working directory.  Both `path` and `contents` are copied.
+    Result add(cz::Str path, cz::Str contents);
+
+    /// Find the contents of the file at the absolute, flattened `path`.
+    const cz::Str* find(cz::Str path, cz::Hash hash);
+};
+
+/// Add the files in `mapping`, a JSON object whose keys are paths and whose values are the
+/// contents of the files.  Returns `false` if `mapping` is malformed.
+bool parse_virtual_files(cz::Str mapping, Virtual_Files* virtual_files);
+
+/// Add the files in the mapping file at `path`.  See `parse_virtual_files`.
+Result load_virtual_files(Context* context, const char* path, Virtual_Files* virtual_files);
+
+}
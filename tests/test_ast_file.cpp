@@ -0,0 +1,413 @@
+#include "test_base.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "ast_file.hpp"
+#include "context.hpp"
+#include "file.hpp"
+#include "file_contents.hpp"
+#include "load.hpp"
+#include "parse.hpp"
+
+using namespace red;
+using namespace red::parse;
+
+static void setup(Context* context, Parser* parser, cz::Str contents) {
+    context->init();
+
+    parser->init();
+    include_file_reserve(&context->files, &parser->preprocessor);
+    File_Contents file_contents;
+    file_contents.load_str(contents, context->files.file_array_buffer_array.allocator());
+    Hashed_Str file_path = Hashed_Str::from_str("*test_file*");
+    force_include_file(&context->files, &parser->preprocessor, file_path, file_contents);
+}
+
+#define SETUP(CONTENTS)                 \
+    Context context = {};               \
+    Parser parser = {};                 \
+    setup(&context, &parser, CONTENTS); \
+                                        \
+    CZ_DEFER({                          \
+        parser.drop();                  \
+        context.destroy();              \
+    })
+
+static void parse_all(Context* context, Parser* parser, cz::Vector<Statement*>* initializers) {
+    Result result;
+    do {
+        result = parse_declaration(context, parser, initializers);
+    } while (result.type == Result::Success);
+    REQUIRE(result.type == Result::Done);
+    REQUIRE(context->errors.len() == 0);
+}
+
+static void check_span(const Span& left, const Span& right) {
+    CHECK(left.start.file == right.start.file);
+    CHECK(left.start.index == right.start.index);
+    CHECK(left.end.file == right.end.file);
+    CHECK(left.end.index == right.end.index);
+}
+
+static void check_type(const Ast_File& file, uint32_t reference, TypeP type) {
+    CHECK((reference & 3) == (type.value & 3));
+
+    const Ast_File_Type& record = file.type(reference);
+    Type* node = type.get_type();
+    REQUIRE(record.tag == node->tag);
+
+    switch (node->tag) {
+        case Type::Pointer:
+            check_type(file, record.operands[0], ((Type_Pointer*)node)->inner);
+            break;
+
+        case Type::Array: {
+            Type_Array* array = (Type_Array*)node;
+            check_type(file, record.operands[0], array->inner);
+            REQUIRE(record.flags & Type_Array::Length_Known);
+            CHECK(record.value == array->length);
+        } break;
+
+        case Type::Function: {
+            Type_Function* function = (Type_Function*)node;
+            CHECK(record.flags == function->has_varargs);
+            check_type(file, record.operands[0], function->return_type);
+            REQUIRE(record.operands[2] == function->parameter_types.len);
+            cz::Slice<const uint32_t> parameters =
+                file.section<uint32_t>(Ast_File_Section::Type_Lists);
+            for (size_t i = 0; i < function->parameter_types.len; ++i) {
+                check_type(file, parameters[record.operands[1] + i],
+                           function->parameter_types[i]);
+            }
+        } break;
+
+        default:
+            break;
+    }
+}
+
+static void check_expression(const Ast_File& file, uint32_t index, const Expression* expression) {
+    const Compact_Expression& compact = file.expression(index);
+    REQUIRE(compact.tag == expression->tag);
+    check_span(file.span(compact.span), expression->span);
+
+    switch (expression->tag) {
+        case Expression::Integer:
+            CHECK(compact.operands[0] == ((Expression_Integer*)expression)->value);
+            break;
+
+        case Expression::Variable:
+            CHECK(file.string(file.name(compact.operands[0])) ==
+                  ((Expression_Variable*)expression)->variable.str);
+            break;
+
+        case Expression::Binary: {
+            Expression_Binary* binary = (Expression_Binary*)expression;
+            CHECK(compact.op == binary->op);
+            check_expression(file, compact.operands[0], binary->left);
+            check_expression(file, compact.operands[1], binary->right);
+        } break;
+
+        case Expression::Cast: {
+            Expression_Cast* cast = (Expression_Cast*)expression;
+            check_type(file, file.ast_type(compact.operands[0]), cast->type);
+            check_expression(file, compact.operands[1], cast->value);
+        } break;
+
+        case Expression::Function_Call: {
+            Expression_Function_Call* call = (Expression_Function_Call*)expression;
+            check_expression(file, compact.operands[0], call->function);
+            REQUIRE(compact.operands[2] == call->arguments.len);
+            for (size_t i = 0; i < call->arguments.len; ++i) {
+                check_expression(file, file.list(compact.operands[1] + i), call->arguments[i]);
+            }
+        } break;
+
+        case Expression::Dereference_Member_Access: {
+            Expression_Dereference_Member_Access* access =
+                (Expression_Dereference_Member_Access*)expression;
+            CHECK(file.string(file.name(compact.operands[1])) == access->field.str);
+            check_expression(file, compact.operands[0], access->pointer);
+        } break;
+
+        default:
+            CZ_PANIC("Unexpected expression in test");
+    }
+}
+
+static void check_statement(const Ast_File& file, uint32_t index, const Statement* statement) {
+    const Compact_Statement& compact = file.statement(index);
+    REQUIRE(compact.tag == statement->tag);
+    check_span(file.span(compact.span), statement->span);
+
+    switch (statement->tag) {
+        case Statement::Expression:
+            check_expression(file, compact.operands[0],
+                             ((Statement_Expression*)statement)->expression);
+            break;
+
+        case Statement::Return:
+            check_expression(file, compact.operands[0], ((Statement_Return*)statement)->o_value);
+            break;
+
+        case Statement::While: {
+            Statement_While* loop = (Statement_While*)statement;
+            check_expression(file, compact.operands[0], loop->condition);
+            check_statement(file, compact.operands[1], loop->body);
+        } break;
+
+        case Statement::Block: {
+            const Block& block = ((Statement_Block*)statement)->block;
+            REQUIRE(compact.operands[1] == block.statements.len);
+            for (size_t i = 0; i < block.statements.len; ++i) {
+                check_statement(file, file.list(compact.operands[0] + i), block.statements[i]);
+            }
+        } break;
+
+        case Statement::Initializer_Default:
+            CHECK(file.string(file.name(compact.operands[0])) ==
+                  ((Statement_Initializer*)statement)->identifier.str);
+            break;
+
+        case Statement::Initializer_Copy: {
+            Statement_Initializer_Copy* initializer = (Statement_Initializer_Copy*)statement;
+            CHECK(file.string(file.name(compact.operands[0])) == initializer->identifier.str);
+            check_expression(file, compact.operands[1], initializer->value);
+        } break;
+
+        default:
+            CZ_PANIC("Unexpected statement in test");
+    }
+}
+
+static void check_declarations(const Ast_File& file, Parser* parser) {
+    cz::Slice<Scope_Table<Declaration>::Binding> bindings = parser->declarations.scope(0);
+    cz::Slice<const Ast_File_Declaration> declarations =
+        file.section<Ast_File_Declaration>(Ast_File_Section::Declarations);
+    REQUIRE(declarations.len == bindings.len);
+
+    for (size_t i = 0; i < bindings.len; ++i) {
+        const Declaration& declaration = bindings[i].value;
+        const Ast_File_Declaration& record = declarations[i];
+        CHECK(file.string(record.name) == bindings[i].name.str);
+        CHECK(record.flags == declaration.flags);
+        check_span(file.span(record.span), declaration.span);
+        check_type(file, record.type, declaration.type);
+
+        if (declaration.flags & Declaration::Typedef) {
+            continue;
+        }
+
+        if (declaration.type.get_type()->tag == Type::Function) {
+            Function_Definition* definition = declaration.v.function_definition;
+            if (!definition) {
+                CHECK(record.body_len == 0);
+                continue;
+            }
+
+            REQUIRE(record.parameters_len == definition->parameter_names.len);
+            cz::Slice<const uint32_t> names =
+                file.section<uint32_t>(Ast_File_Section::Parameter_Names);
+            for (size_t j = 0; j < definition->parameter_names.len; ++j) {
+                CHECK(file.string(names[record.parameters_start + j]) ==
+                      definition->parameter_names[j]);
+            }
+
+            REQUIRE(record.body_len == definition->block.statements.len);
+            for (size_t j = 0; j < record.body_len; ++j) {
+                check_statement(file, file.list(record.body_start + j),
+                                definition->block.statements[j]);
+            }
+            check_span(file.span(record.body_span), definition->block_span);
+        } else {
+            REQUIRE(record.initializer != Compact_Ast::none);
+            check_statement(file, record.initializer, declaration.v.initializer);
+        }
+    }
+}
+
+static const char* round_trip_source =
+    "struct Node { int value; struct Node* next; };\n"
+    "enum Color { RED, GREEN = 5 };\n"
+    "typedef const char* string;\n"
+    "int table[4];\n"
+    "int count = 3 + 4;\n"
+    "int sum(struct Node* node);\n"
+    "int sum(struct Node* node) {\n"
+    "    int total = 0;\n"
+    "    while (node) {\n"
+    "        total = total + node->value;\n"
+    "        node = node->next;\n"
+    "    }\n"
+    "    return total + (int)sum(node) + GREEN;\n"
+    "}\n";
+
+TEST_CASE("Ast_File round trips declarations, types, and bodies") {
+    SETUP(round_trip_source);
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+    parse_all(&context, &parser, &initializers);
+
+    cz::String encoded = {};
+    CZ_DEFER(encoded.drop(cz::heap_allocator()));
+    serialize_ast(&context, &parser, initializers, &encoded);
+
+    Ast_File file = {};
+    REQUIRE(file.load(encoded.buffer(), encoded.len()));
+    CHECK(file.header()->version == Ast_File_Header::current_version);
+
+    cz::Slice<const uint32_t> files = file.section<uint32_t>(Ast_File_Section::Files);
+    REQUIRE(files.len == context.files.files.len());
+    CHECK(file.string(files[0]) == context.files.files[0].path);
+
+    check_declarations(file, &parser);
+
+    cz::Slice<const uint32_t> file_initializers =
+        file.section<uint32_t>(Ast_File_Section::Initializers);
+    REQUIRE(file_initializers.len == initializers.len());
+    for (size_t i = 0; i < initializers.len(); ++i) {
+        check_statement(file, file_initializers[i], initializers[i]);
+    }
+
+    // Tagged types and their members.
+    cz::Slice<const Ast_File_Tag> tags = file.section<Ast_File_Tag>(Ast_File_Section::Tags);
+    REQUIRE(tags.len == 2);
+    CHECK(file.string(tags[0].name) == "Node");
+    const Ast_File_Type& node = file.type(tags[0].type);
+    REQUIRE(node.tag == Type::Struct);
+    CHECK(node.flags & Type_Composite::Defined);
+    CHECK(node.operands[2] == 16);
+    CHECK(node.operands[3] == 8);
+    REQUIRE(node.operands[1] == 2);
+    cz::Slice<const Ast_File_Declaration> members =
+        file.section<Ast_File_Declaration>(Ast_File_Section::Members);
+    CHECK(file.string(members[node.operands[0]].name) == "value");
+    CHECK(file.string(members[node.operands[0] + 1].name) == "next");
+    const Ast_File_Type& next = file.type(members[node.operands[0] + 1].type);
+    REQUIRE(next.tag == Type::Pointer);
+    CHECK(file.type(next.operands[0]).tag == Type::Struct);
+
+    CHECK(file.string(tags[1].name) == "Color");
+    const Ast_File_Type& color = file.type(tags[1].type);
+    REQUIRE(color.tag == Type::Enum);
+    REQUIRE(color.operands[1] == 2);
+    cz::Slice<const Ast_File_Enum_Value> values =
+        file.section<Ast_File_Enum_Value>(Ast_File_Section::Enum_Values);
+    int64_t total = 0;
+    for (size_t i = 0; i < 2; ++i) {
+        total += values[color.operands[0] + i].value;
+    }
+    CHECK(total == 5);
+}
+
+TEST_CASE("Ast_File rejects files from other versions") {
+    SETUP("int x;");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+    parse_all(&context, &parser, &initializers);
+
+    cz::String encoded = {};
+    CZ_DEFER(encoded.drop(cz::heap_allocator()));
+    serialize_ast(&context, &parser, initializers, &encoded);
+
+    Ast_File file = {};
+    CHECK(file.load(encoded.buffer(), encoded.len()));
+    CHECK_FALSE(file.load(encoded.buffer(), sizeof(Ast_File_Header) - 1));
+    CHECK_FALSE(file.load(encoded.buffer(), sizeof(Ast_File_Header) + 8));
+
+    ((Ast_File_Header*)encoded.buffer())->version += 1;
+    CHECK_FALSE(file.load(encoded.buffer(), encoded.len()));
+    ((Ast_File_Header*)encoded.buffer())->version -= 1;
+
+    encoded.buffer()[0] = 'X';
+    CHECK_FALSE(file.load(encoded.buffer(), encoded.len()));
+}
+
+template <class T>
+static T* mutable_section(cz::String* encoded, Ast_File_Section section) {
+    const Ast_File_Header* header = (const Ast_File_Header*)encoded->buffer();
+    return (T*)(encoded->buffer() + header->sections[section].offset);
+}
+
+TEST_CASE("walk_ast_file rejects corrupt indices") {
+    SETUP(round_trip_source);
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+    parse_all(&context, &parser, &initializers);
+
+    cz::String encoded = {};
+    CZ_DEFER(encoded.drop(cz::heap_allocator()));
+    serialize_ast(&context, &parser, initializers, &encoded);
+
+    Ast_File file = {};
+    REQUIRE(file.load(encoded.buffer(), encoded.len()));
+    size_t statements, expressions;
+    REQUIRE(walk_ast_file(file, &statements, &expressions));
+    CHECK(statements > 0);
+    CHECK(expressions > 0);
+
+    uint32_t* file_initializers =
+        mutable_section<uint32_t>(&encoded, Ast_File_Section::Initializers);
+    uint32_t initializer = file_initializers[0];
+    file_initializers[0] = 1000000;
+    CHECK_FALSE(walk_ast_file(file, &statements, &expressions));
+    file_initializers[0] = initializer;
+
+    Ast_File_Declaration* declarations =
+        mutable_section<Ast_File_Declaration>(&encoded, Ast_File_Section::Declarations);
+    size_t declaration_count =
+        file.section<Ast_File_Declaration>(Ast_File_Section::Declarations).len;
+    Ast_File_Declaration* sum = nullptr;
+    for (size_t i = 0; i < declaration_count; ++i) {
+        if (declarations[i].body_len > 0) {
+            sum = &declarations[i];
+        }
+    }
+    REQUIRE(sum);
+    Ast_File_Declaration original = *sum;
+    sum->body_start = 0xFFFFFFFF;
+    CHECK_FALSE(walk_ast_file(file, &statements, &expressions));
+    sum->body_start = 0;
+    sum->body_len = 0xFFFFFFFF;
+    CHECK_FALSE(walk_ast_file(file, &statements, &expressions));
+    *sum = original;
+    REQUIRE(walk_ast_file(file, &statements, &expressions));
+
+    // A binary expression that is its own operand would loop forever.
+    Compact_Expression* file_expressions =
+        mutable_section<Compact_Expression>(&encoded, Ast_File_Section::Expressions);
+    size_t expression_count = file.section<Compact_Expression>(Ast_File_Section::Expressions).len;
+    bool found = false;
+    for (uint32_t i = 0; i < expression_count; ++i) {
+        if (file_expressions[i].tag == Expression::Binary) {
+            file_expressions[i].operands[0] = i;
+            found = true;
+            break;
+        }
+    }
+    REQUIRE(found);
+    CHECK_FALSE(walk_ast_file(file, &statements, &expressions));
+}
+
+TEST_CASE("Ast_File maps a written file") {
+    SETUP(round_trip_source);
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+    parse_all(&context, &parser, &initializers);
+
+    char path[] = "/tmp/red_ast_file_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+    CZ_DEFER(unlink(path));
+
+    REQUIRE(write_ast_file(&context, &parser, initializers, path).is_ok());
+
+    Ast_File file = {};
+    REQUIRE(file.open(path).is_ok());
+    CZ_DEFER(file.close());
+    CHECK(file.mapped);
+    check_declarations(file, &parser);
+}
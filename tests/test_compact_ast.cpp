@@ -0,0 +1,263 @@
+#include "test_base.hpp"
+
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "compact_ast.hpp"
+#include "context.hpp"
+#include "file_contents.hpp"
+#include "load.hpp"
+#include "parse.hpp"
+
+using namespace red;
+using namespace red::parse;
+
+static void setup(Context* context, Parser* parser, cz::Str contents) {
+    context->init();
+
+    parser->init();
+    include_file_reserve(&context->files, &parser->preprocessor);
+    File_Contents file_contents;
+    file_contents.load_str(contents, context->files.file_array_buffer_array.allocator());
+    Hashed_Str file_path = Hashed_Str::from_str("*test_file*");
+    force_include_file(&context->files, &parser->preprocessor, file_path, file_contents);
+}
+
+#define SETUP(CONTENTS)                 \
+    Context context = {};               \
+    Parser parser = {};                 \
+    setup(&context, &parser, CONTENTS); \
+                                        \
+    CZ_DEFER({                          \
+        parser.drop();                  \
+        context.destroy();              \
+    })
+
+static void check_span(const Span& left, const Span& right) {
+    CHECK(left.start.file == right.start.file);
+    CHECK(left.start.index == right.start.index);
+    CHECK(left.start.line == right.start.line);
+    CHECK(left.start.column == right.start.column);
+    CHECK(left.end.file == right.end.file);
+    CHECK(left.end.index == right.end.index);
+    CHECK(left.end.line == right.end.line);
+    CHECK(left.end.column == right.end.column);
+}
+
+static void check_expression(const Expression* left, const Expression* right);
+
+static void check_optional_expression(const Expression* left, const Expression* right) {
+    REQUIRE((left == nullptr) == (right == nullptr));
+    if (left) {
+        check_expression(left, right);
+    }
+}
+
+static void check_expression(const Expression* left, const Expression* right) {
+    REQUIRE(left->tag == right->tag);
+    check_span(left->span, right->span);
+
+    switch (left->tag) {
+        case Expression::Integer:
+            CHECK(((Expression_Integer*)left)->value == ((Expression_Integer*)right)->value);
+            break;
+
+        case Expression::Variable:
+            CHECK(((Expression_Variable*)left)->variable.str ==
+                  ((Expression_Variable*)right)->variable.str);
+            break;
+
+        case Expression::Binary: {
+            Expression_Binary* l = (Expression_Binary*)left;
+            Expression_Binary* r = (Expression_Binary*)right;
+            CHECK(l->op == r->op);
+            check_expression(l->left, r->left);
+            check_expression(l->right, r->right);
+        } break;
+
+        case Expression::Function_Call: {
+            Expression_Function_Call* l = (Expression_Function_Call*)left;
+            Expression_Function_Call* r = (Expression_Function_Call*)right;
+            check_expression(l->function, r->function);
+            REQUIRE(l->arguments.len == r->arguments.len);
+            for (size_t i = 0; i < l->arguments.len; ++i) {
+                check_expression(l->arguments[i], r->arguments[i]);
+            }
+        } break;
+
+        case Expression::Index: {
+            Expression_Index* l = (Expression_Index*)left;
+            Expression_Index* r = (Expression_Index*)right;
+            check_expression(l->array, r->array);
+            check_expression(l->index, r->index);
+        } break;
+
+        case Expression::Cast: {
+            Expression_Cast* l = (Expression_Cast*)left;
+            Expression_Cast* r = (Expression_Cast*)right;
+            CHECK(l->type.value == r->type.value);
+            check_expression(l->value, r->value);
+        } break;
+
+        case Expression::Dereference_Member_Access: {
+            Expression_Dereference_Member_Access* l = (Expression_Dereference_Member_Access*)left;
+            Expression_Dereference_Member_Access* r = (Expression_Dereference_Member_Access*)right;
+            CHECK(l->field.str == r->field.str);
+            check_expression(l->pointer, r->pointer);
+        } break;
+
+        case Expression::Address_Of:
+        case Expression::Dereference:
+        case Expression::Post_Increment:
+            check_expression(((Expression_Address_Of*)left)->value,
+                             ((Expression_Address_Of*)right)->value);
+            break;
+
+        default:
+            CZ_PANIC("Unexpected expression in test");
+    }
+}
+
+static void check_statement(const Statement* left, const Statement* right);
+
+static void check_block(const Block& left, const Block& right) {
+    REQUIRE(left.statements.len == right.statements.len);
+    for (size_t i = 0; i < left.statements.len; ++i) {
+        check_statement(left.statements[i], right.statements[i]);
+    }
+}
+
+static void check_statement(const Statement* left, const Statement* right) {
+    REQUIRE(left->tag == right->tag);
+    check_span(left->span, right->span);
+
+    switch (left->tag) {
+        case Statement::Expression:
+            check_expression(((Statement_Expression*)left)->expression,
+                             ((Statement_Expression*)right)->expression);
+            break;
+
+        case Statement::Block:
+            check_block(((Statement_Block*)left)->block, ((Statement_Block*)right)->block);
+            break;
+
+        case Statement::For: {
+            Statement_For* l = (Statement_For*)left;
+            Statement_For* r = (Statement_For*)right;
+            check_optional_expression(l->initializer, r->initializer);
+            check_optional_expression(l->condition, r->condition);
+            check_optional_expression(l->increment, r->increment);
+            check_statement(l->body, r->body);
+        } break;
+
+        case Statement::While: {
+            Statement_While* l = (Statement_While*)left;
+            Statement_While* r = (Statement_While*)right;
+            check_expression(l->condition, r->condition);
+            check_statement(l->body, r->body);
+        } break;
+
+        case Statement::Return:
+            check_optional_expression(((Statement_Return*)left)->o_value,
+                                      ((Statement_Return*)right)->o_value);
+            break;
+
+        case Statement::If: {
+            Statement_If* l = (Statement_If*)left;
+            Statement_If* r = (Statement_If*)right;
+            check_expression(l->condition, r->condition);
+            check_statement(l->then, r->then);
+            REQUIRE((l->otherwise == nullptr) == (r->otherwise == nullptr));
+            if (l->otherwise) {
+                check_statement(l->otherwise, r->otherwise);
+            }
+        } break;
+
+        case Statement::Initializer_Default:
+            CHECK(((Statement_Initializer*)left)->identifier.str ==
+                  ((Statement_Initializer*)right)->identifier.str);
+            break;
+
+        case Statement::Initializer_Copy: {
+            Statement_Initializer_Copy* l = (Statement_Initializer_Copy*)left;
+            Statement_Initializer_Copy* r = (Statement_Initializer_Copy*)right;
+            CHECK(l->identifier.str == r->identifier.str);
+            check_expression(l->value, r->value);
+        } break;
+
+        case Statement::Empty:
+        case Statement::Continue:
+        case Statement::Break:
+            break;
+    }
+}
+
+TEST_CASE("Compact_Ast round trips a function body") {
+    SETUP(
+        "struct S { int x; };\n"
+        "int g(int a, int b);\n"
+        "int f(struct S* s, char* p) {\n"
+        "    int total = 0;\n"
+        "    int i;\n"
+        "    for (i = 0; i < 10; i++) {\n"
+        "        if (p[i]) continue; else break;\n"
+        "    }\n"
+        "    while (*p) { total = total + g(s->x, (int)*p); }\n"
+        "    return &total != 0;\n"
+        "}\n");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    }
+    REQUIRE(context.errors.len() == 0);
+
+    Declaration* f = parser.declarations.get_hash("f");
+    REQUIRE(f);
+    REQUIRE(f->v.function_definition);
+    const Block& block = f->v.function_definition->block;
+
+    Compact_Ast compact = {};
+    CZ_DEFER(compact.drop());
+    Compact_Block compact_block = compact.add_block(block);
+    CHECK(compact_block.len == block.statements.len);
+    CHECK(compact.list_stack.len() == 0);
+
+    Ast_Arena arena = {};
+    arena.init();
+    CZ_DEFER(arena.drop());
+    Block expanded = compact.expand_block(&arena, compact_block);
+    check_block(block, expanded);
+
+    // The compact form is considerably smaller.
+    size_t pointer_bytes = parser.ast_arena.stats.list_bytes;
+    for (size_t i = 0; i < Ast_Stats::expression_tags; ++i) {
+        pointer_bytes += parser.ast_arena.stats.expression_bytes[i];
+    }
+    for (size_t i = 0; i < Ast_Stats::statement_tags; ++i) {
+        pointer_bytes += parser.ast_arena.stats.statement_bytes[i];
+    }
+    CHECK(compact.bytes() < pointer_bytes);
+}
+
+TEST_CASE("Compact_Ast stores each name once") {
+    SETUP("int x; x + x * x;");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+
+    Statement* statement;
+    REQUIRE(parse_statement(&context, &parser, &statement).type == Result::Success);
+
+    Compact_Ast compact = {};
+    CZ_DEFER(compact.drop());
+    uint32_t index = compact.add_statement(statement);
+    CHECK(index == 0);
+    CHECK(compact.expressions.len() == 5);
+    CHECK(compact.names.len() == 1);
+
+    // Children are stored before their parents.
+    CHECK(compact.expressions[4].tag == Expression::Binary);
+    CHECK(compact.expressions[4].operands[0] < 4);
+    CHECK(compact.expressions[4].operands[1] < 4);
+}
@@ -0,0 +1,111 @@
+#include "test_base.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include "file_contents.hpp"
+#include "hashed_str.hpp"
+#include "header_bundle.hpp"
+#include "load.hpp"
+
+using namespace red;
+
+static void write_file(cz::Str path, cz::Str contents) {
+    cz::String terminated = {};
+    CZ_DEFER(terminated.drop(cz::heap_allocator()));
+    terminated.reserve(cz::heap_allocator(), path.len + 1);
+    terminated.append(path);
+    terminated.null_terminate();
+
+    FILE* file = fopen(terminated.buffer(), "w");
+    REQUIRE(file);
+    fwrite(contents.buffer, 1, contents.len, file);
+    fclose(file);
+}
+
+static const Header_Bundle_Slot* find(const Header_Bundle& bundle, cz::Str path) {
+    return bundle.find(path, Hashed_Str::hash_str(path));
+}
+
+TEST_CASE("Header_Bundle contains the files under the include paths") {
+    char directory[] = "/tmp/red_bundle_XXXXXX";
+    REQUIRE(mkdtemp(directory));
+    cz::String a_path = {};
+    cz::String sys_path = {};
+    cz::String b_path = {};
+    CZ_DEFER({
+        unlink(a_path.buffer());
+        unlink(b_path.buffer());
+        rmdir(sys_path.buffer());
+        rmdir(directory);
+        a_path.drop(cz::heap_allocator());
+        sys_path.drop(cz::heap_allocator());
+        b_path.drop(cz::heap_allocator());
+    });
+
+    make_include_path(directory, "a.h", cz::heap_allocator(), &a_path);
+    make_include_path(directory, "sys", cz::heap_allocator(), &sys_path);
+    make_include_path(directory, "sys/b.h", cz::heap_allocator(), &b_path);
+    REQUIRE(mkdir(sys_path.buffer(), 0700) == 0);
+    write_file(a_path, "int a;\n");
+    write_file(b_path, "int \\\nb;\n");
+
+    // Listing a directory twice doesn't bundle its files twice.
+    cz::Str include_paths[] = {directory, directory};
+    cz::String encoded = {};
+    CZ_DEFER(encoded.drop(cz::heap_allocator()));
+    REQUIRE(serialize_header_bundle({include_paths, 2}, &encoded).is_ok());
+
+    Header_Bundle bundle = {};
+    REQUIRE(bundle.load(encoded.buffer(), encoded.len()));
+    CHECK(bundle.section<Header_Bundle_Slot>(Header_Bundle_Section::Slots).len == 4);
+
+    const Header_Bundle_Slot* a = find(bundle, a_path);
+    REQUIRE(a);
+    CHECK(bundle.string(a->contents) == "int a;\n");
+    CHECK(a->first_splice == 7);
+
+    const Header_Bundle_Slot* b = find(bundle, b_path);
+    REQUIRE(b);
+    CHECK(b->first_splice == 4);
+
+    File_Contents contents = {};
+    bundle.load_file(*b, &contents, cz::heap_allocator());
+    CZ_DEFER(contents.drop_array(cz::heap_allocator()));
+    CHECK(contents.storage == File_Contents_Storage::Borrowed);
+    CHECK(contents.len == 9);
+    CHECK(contents.get(8) == '\n');
+    CHECK(contents.get(9) == File_Contents::eof);
+
+    CHECK_FALSE(find(bundle, sys_path));
+    CHECK(bundle.covers(sys_path));
+    CHECK_FALSE(bundle.covers("/not/bundled.h"));
+
+    // A sibling directory that starts with the same characters isn't covered.
+    cz::String sibling_path = {};
+    CZ_DEFER(sibling_path.drop(cz::heap_allocator()));
+    sibling_path.reserve(cz::heap_allocator(), cz::Str(directory).len + 5);
+    sibling_path.append(directory);
+    sibling_path.append("2/a.h");
+    CHECK_FALSE(bundle.covers(sibling_path));
+    CHECK(bundle.covers(directory));
+}
+
+TEST_CASE("Header_Bundle rejects invalid bundles") {
+    cz::String encoded = {};
+    CZ_DEFER(encoded.drop(cz::heap_allocator()));
+    REQUIRE(serialize_header_bundle({}, &encoded).is_ok());
+
+    Header_Bundle bundle = {};
+    CHECK(bundle.load(encoded.buffer(), encoded.len()));
+    CHECK_FALSE(bundle.find("/usr/include/stdio.h", Hashed_Str::hash_str("/usr/include/stdio.h")));
+
+    CHECK_FALSE(bundle.load(encoded.buffer(), sizeof(Header_Bundle_Header) - 1));
+
+    encoded[0] = 'X';
+    CHECK_FALSE(bundle.load(encoded.buffer(), encoded.len()));
+}
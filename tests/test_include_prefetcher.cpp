@@ -0,0 +1,119 @@
+#include "test_base.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include "file_contents.hpp"
+#include "hashed_str.hpp"
+#include "include_prefetcher.hpp"
+#include "load.hpp"
+
+using namespace red;
+
+TEST_CASE("scan_includes finds include lines") {
+    File_Contents contents = {};
+    contents.load_str(
+        "#include <stdio.h>\n"
+        "  #  include \"local.h\"\n"
+        "int x; #include <not_at_start.h>\n"
+        "#include_next <next.h>\n"
+        "#include MACRO\n"
+        "#include <unterminated.h\n"
+        "#define include <define.h>\n"
+        "#\tinclude\t<sys/types.h>",
+        cz::heap_allocator());
+    CZ_DEFER(contents.drop_array(cz::heap_allocator()));
+
+    cz::Vector<Include_Spelling> spellings = {};
+    CZ_DEFER(spellings.drop(cz::heap_allocator()));
+    scan_includes(contents, &spellings);
+
+    REQUIRE(spellings.len() == 3);
+    CHECK(spellings[0].relative_path == "stdio.h");
+    CHECK(spellings[0].angled);
+    CHECK(spellings[1].relative_path == "local.h");
+    CHECK_FALSE(spellings[1].angled);
+    CHECK(spellings[2].relative_path == "sys/types.h");
+    CHECK(spellings[2].angled);
+}
+
+static void write_file(cz::Str path, cz::Str contents) {
+    cz::String terminated = {};
+    CZ_DEFER(terminated.drop(cz::heap_allocator()));
+    terminated.reserve(cz::heap_allocator(), path.len + 1);
+    terminated.append(path);
+    terminated.null_terminate();
+
+    FILE* file = fopen(terminated.buffer(), "w");
+    REQUIRE(file);
+    fwrite(contents.buffer, 1, contents.len, file);
+    fclose(file);
+}
+
+/// Wait until the prefetcher has either loaded `path` or found it to be missing.
+static bool wait_for_entry(Include_Prefetcher* prefetcher, cz::Str path) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline) {
+        {
+            std::lock_guard<std::mutex> lock(prefetcher->mutex);
+            if (prefetcher->entries.get(path, Hashed_Str::hash_str(path))) {
+                return true;
+            }
+        }
+        std::this_thread::yield();
+    }
+    return false;
+}
+
+TEST_CASE("Include_Prefetcher loads includes ahead of time") {
+    char directory[] = "/tmp/red_prefetch_XXXXXX";
+    REQUIRE(mkdtemp(directory));
+    cz::String a_path = {};
+    cz::String b_path = {};
+    cz::String missing_path = {};
+    CZ_DEFER({
+        unlink(a_path.buffer());
+        unlink(b_path.buffer());
+        rmdir(directory);
+        a_path.drop(cz::heap_allocator());
+        b_path.drop(cz::heap_allocator());
+        missing_path.drop(cz::heap_allocator());
+    });
+
+    make_include_path(directory, "a.h", cz::heap_allocator(), &a_path);
+    make_include_path(directory, "b.h", cz::heap_allocator(), &b_path);
+    make_include_path(directory, "missing.h", cz::heap_allocator(), &missing_path);
+    write_file(a_path, "#include \"b.h\"\n");
+    write_file(b_path, "int b;\n");
+
+    cz::Str include_paths[] = {directory};
+    Include_Prefetcher prefetcher;
+    prefetcher.start({include_paths, 1});
+
+    File_Contents main = {};
+    main.load_str("#include <a.h>\n#include <missing.h>\n", cz::heap_allocator());
+    CZ_DEFER(main.drop_array(cz::heap_allocator()));
+    prefetcher.scan("/main.c", main);
+
+    REQUIRE(wait_for_entry(&prefetcher, a_path));
+    REQUIRE(wait_for_entry(&prefetcher, b_path));
+    REQUIRE(wait_for_entry(&prefetcher, missing_path));
+
+    File_Contents contents = {};
+    REQUIRE(prefetcher.take(a_path, Hashed_Str::hash_str(a_path), &contents) ==
+            Prefetch_Result::Loaded);
+    CHECK(contents.len == 15);
+    contents.drop_buffers();
+
+    // Files can only be taken once.
+    CHECK(prefetcher.take(a_path, Hashed_Str::hash_str(a_path), &contents) ==
+          Prefetch_Result::Unknown);
+    CHECK(prefetcher.take(missing_path, Hashed_Str::hash_str(missing_path), &contents) ==
+          Prefetch_Result::Missing);
+
+    prefetcher.stop();
+}
@@ -0,0 +1,207 @@
+#include "test_base.hpp"
+
+#include <stdio.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "context.hpp"
+#include "file.hpp"
+#include "file_contents.hpp"
+#include "incremental.hpp"
+#include "result.hpp"
+
+using namespace red;
+using namespace red::parse;
+
+#define SETUP(CONTENTS)                                                                        \
+    Context context = {};                                                                      \
+    context.init();                                                                            \
+    Incremental_Parse incremental = {};                                                        \
+    CZ_DEFER({                                                                                 \
+        incremental.drop();                                                                    \
+        context.destroy();                                                                     \
+    });                                                                                        \
+    REQUIRE(incremental.init(&context, "*test_file*", CONTENTS).type == Result::Success); \
+    REQUIRE(incremental.full_reparses == 1)
+
+static size_t find(const Incremental_Parse& incremental, cz::Str str) {
+    cz::Str contents = incremental.contents;
+    for (size_t i = 0; i + str.len <= contents.len; ++i) {
+        if (contents.slice(i, i + str.len) == str) {
+            return i;
+        }
+    }
+    CZ_PANIC("Not found");
+}
+
+TEST_CASE("Incremental_Parse edit inside function body only reparses the body") {
+    SETUP("int g;\nint f() { return g; }\nint h() { return 1; }\n");
+    REQUIRE(incremental.bodies.len() == 2);
+    CHECK(context.errors.len() == 0);
+
+    size_t index = find(incremental, "return g");
+    REQUIRE(incremental.edit(&context, index, index, "g; ").type == Result::Success);
+    CHECK(incremental.incremental_reparses == 1);
+    CHECK(incremental.full_reparses == 1);
+    CHECK(context.errors.len() == 0);
+
+    Function_Definition* f = incremental.bodies[0].function_definition;
+    REQUIRE(f->block.statements.len == 2);
+    CHECK(f->block.statements[0]->tag == Statement::Expression);
+    CHECK(f->block.statements[1]->tag == Statement::Return);
+}
+
+TEST_CASE("Incremental_Parse reparsed body can't see later declarations") {
+    SETUP("int f() { return 0; }\nint later;\n");
+    REQUIRE(incremental.bodies.len() == 1);
+
+    // The body fails to parse so the entire file is reparsed.
+    size_t index = find(incremental, "0;");
+    CHECK(incremental.edit(&context, index, index + 1, "later").is_err());
+    CHECK(incremental.incremental_reparses == 0);
+    CHECK(incremental.full_reparses == 2);
+    CHECK(context.errors.len() == 1);
+
+    REQUIRE(incremental.edit(&context, index, index + 5, "1").type == Result::Success);
+    CHECK(context.errors.len() == 0);
+}
+
+TEST_CASE("Incremental_Parse edit outside of a body reparses everything") {
+    SETUP("int f() { return 0; }\n");
+
+    size_t index = find(incremental, "f()");
+    REQUIRE(incremental.edit(&context, index, index + 1, "g").type == Result::Success);
+    CHECK(incremental.incremental_reparses == 0);
+    CHECK(incremental.full_reparses == 2);
+    REQUIRE(incremental.parser.declarations.get_hash("g"));
+    CHECK_FALSE(incremental.parser.declarations.get_hash("f"));
+}
+
+TEST_CASE("Incremental_Parse edit unbalancing braces reparses everything") {
+    SETUP("int f() { return 0; }\nint g() { return 1; }\n");
+
+    size_t index = find(incremental, "return 0");
+    CHECK(incremental.edit(&context, index, index, "{").is_err());
+    CHECK(incremental.incremental_reparses == 0);
+    CHECK(incremental.full_reparses == 2);
+    CHECK(context.errors.len() > 0);
+}
+
+TEST_CASE("Incremental_Parse moves later bodies after an edit") {
+    SETUP("int f() { return 0; } int g() { return 1; }\nint h() { return 2; }\n");
+    REQUIRE(incremental.bodies.len() == 3);
+
+    size_t index = find(incremental, "return 0");
+    REQUIRE(incremental.edit(&context, index, index, "0;\n  ").type == Result::Success);
+    index = find(incremental, "return 1");
+    REQUIRE(incremental.edit(&context, index, index, "\n").type == Result::Success);
+    index = find(incremental, "return 2");
+    REQUIRE(incremental.edit(&context, index, index, "2; ").type == Result::Success);
+    CHECK(incremental.incremental_reparses == 3);
+    CHECK(context.errors.len() == 0);
+
+    // Compare against parsing the final text from scratch.
+    Context expected_context = {};
+    expected_context.init();
+    Incremental_Parse expected = {};
+    CZ_DEFER({
+        expected.drop();
+        expected_context.destroy();
+    });
+    REQUIRE(expected.init(&expected_context, "*test_file*", incremental.contents).type ==
+            Result::Success);
+
+    REQUIRE(expected.bodies.len() == 3);
+    for (size_t i = 0; i < 3; ++i) {
+        Span actual_span = incremental.bodies[i].function_definition->block_span;
+        Span expected_span = expected.bodies[i].function_definition->block_span;
+        CHECK(actual_span.start.index == expected_span.start.index);
+        CHECK(actual_span.start.line == expected_span.start.line);
+        CHECK(actual_span.start.column == expected_span.start.column);
+        CHECK(actual_span.end.index == expected_span.end.index);
+        CHECK(incremental.bodies[i].end == expected.bodies[i].end);
+        CHECK(incremental.bodies[i].function_definition->block.statements.len ==
+              expected.bodies[i].function_definition->block.statements.len);
+    }
+}
+
+/// Check that no name in `table` points into the contents of `file`.
+template <class T>
+static void check_names_outside(const Scope_Table<T>& table, const File_Contents& file) {
+    const char* start = file.buffers[0];
+    const char* end = start + file.len;
+    for (size_t i = 0; i < table.heads.cap; ++i) {
+        if (table.heads.is_present(i)) {
+            const char* name = table.heads.keys[i].buffer;
+            CHECK_FALSE(name >= start && name < end);
+        }
+    }
+}
+
+TEST_CASE("Incremental_Parse reuses memory when a body is edited repeatedly") {
+    SETUP("int f() { int x = 1; return x + 2; }\nint g() { return 3 * 4; }\n");
+    REQUIRE(incremental.bodies.len() == 2);
+
+    size_t f = find(incremental, "int x") - 1;
+    size_t g = find(incremental, "return 3") - 1;
+    size_t files = 0;
+    size_t file_bytes = 0;
+    size_t f_bytes = 0;
+    size_t g_bytes = 0;
+    for (size_t i = 0; i < 100; ++i) {
+        // Declare a new name each time so the scope tables see names from every reload.
+        char declaration[16];
+        snprintf(declaration, sizeof(declaration), "int n%03zu; ", i);
+        cz::Str str = declaration;
+        REQUIRE(incremental.edit(&context, f, f, str).type == Result::Success);
+        REQUIRE(incremental.edit(&context, f, f + str.len, "").type == Result::Success);
+        g = find(incremental, "return 3") - 1;
+        REQUIRE(incremental.edit(&context, g, g, "\n").type == Result::Success);
+        REQUIRE(incremental.edit(&context, g, g + 1, "").type == Result::Success);
+
+        if (i == 0) {
+            files = context.files.files.len();
+            file_bytes = incremental.parser.ast_arena.stats.bytes();
+            f_bytes = incremental.bodies[0].arena->stats.bytes();
+            g_bytes = incremental.bodies[1].arena->stats.bytes();
+            CHECK(f_bytes > 0);
+            CHECK(g_bytes > 0);
+        }
+        CHECK(context.files.files.len() == files);
+        CHECK(incremental.parser.ast_arena.stats.bytes() == file_bytes);
+        CHECK(incremental.bodies[0].arena->stats.bytes() == f_bytes);
+        CHECK(incremental.bodies[1].arena->stats.bytes() == g_bytes);
+    }
+
+    CHECK(incremental.incremental_reparses == 400);
+    CHECK(incremental.full_reparses == 1);
+    CHECK(context.errors.len() == 0);
+    // The file parsed last and one version for each body.
+    CHECK(context.files.files.len() == incremental.file + 3);
+
+    Function_Definition* g_definition = incremental.bodies[1].function_definition;
+    REQUIRE(g_definition->block.statements.len == 1);
+    CHECK(g_definition->block.statements[0]->tag == Statement::Return);
+    CHECK(g_definition->block_span.start.file == incremental.bodies[1].file);
+    CHECK(g_definition->block_span.start.line == 1);
+
+    const File_Contents& version = context.files.files[incremental.bodies[0].file].contents;
+    check_names_outside(incremental.parser.declarations, version);
+    CHECK(incremental.parser.declarations.heads.count >= 100);
+}
+
+TEST_CASE("Incremental_Parse reparses a body after it declares a new name") {
+    SETUP("int f() { int a; return a; }\n");
+
+    size_t index = find(incremental, "return");
+    REQUIRE(incremental.edit(&context, index, index, "int zzzzzz_new_local; ").type ==
+            Result::Success);
+    index = find(incremental, "return");
+    REQUIRE(incremental.edit(&context, index, index, "int q; ").type == Result::Success);
+    CHECK(incremental.incremental_reparses == 2);
+    CHECK(context.errors.len() == 0);
+
+    // The body's version is replaced by the next reparse so the names must have been copied.
+    const File_Contents& version = context.files.files[incremental.bodies[0].file].contents;
+    check_names_outside(incremental.parser.declarations, version);
+    check_names_outside(incremental.parser.types, version);
+}
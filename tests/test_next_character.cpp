@@ -2,18 +2,22 @@
 
 #include <cz/defer.hpp>
 #include <cz/heap.hpp>
+#include <cz/string.hpp>
 #include "file_contents.hpp"
 #include "lex.hpp"
 #include "location.hpp"
 
 using red::lex::next_character;
 
-#define SETUP(CONTENTS)                                       \
-    red::File_Contents file_contents = {};                    \
-    file_contents.load_str(CONTENTS, cz::heap_allocator());   \
-    CZ_DEFER(file_contents.drop_array(cz::heap_allocator())); \
-                                                              \
-    red::Location location = {};                              \
+#define SETUP_CONTENTS(CONTENTS)                            \
+    red::File_Contents file_contents = {};                  \
+    file_contents.load_str(CONTENTS, cz::heap_allocator()); \
+    CZ_DEFER(file_contents.drop_array(cz::heap_allocator()))
+
+#define SETUP(CONTENTS)          \
+    SETUP_CONTENTS(CONTENTS);    \
+                                 \
+    red::Location location = {}; \
     char ch;
 
 TEST_CASE("next_character() empty file") {
@@ -164,3 +168,77 @@ TEST_CASE("next_character() backslash newline repeatedly handled") {
     CHECK(location.line == 3);
     CHECK(location.column == 1);
 }
+
+TEST_CASE("File_Contents::find_first_splice") {
+    {
+        SETUP_CONTENTS("a ? b : c; \"\\n\" /* ?! */");
+        CHECK(file_contents.is_splice_free());
+    }
+    {
+        SETUP_CONTENTS("#define X \\\n 1");
+        CHECK(file_contents.first_splice == 10);
+        CHECK_FALSE(file_contents.is_splice_free());
+    }
+    {
+        SETUP_CONTENTS("ab?"
+              "?=");
+        CHECK(file_contents.first_splice == 2);
+    }
+}
+
+TEST_CASE("File_Contents::find_first_splice splice across buffers") {
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    contents.reserve(cz::heap_allocator(), red::File_Contents::buffer_size + 2);
+    for (size_t i = 0; i + 1 < red::File_Contents::buffer_size; ++i) {
+        contents.push('a');
+    }
+    contents.append("\\\nb");
+
+    SETUP_CONTENTS(contents);
+    CHECK(file_contents.first_splice == red::File_Contents::buffer_size - 1);
+}
+
+TEST_CASE("File_Contents::validate_utf8") {
+    {
+        SETUP_CONTENTS("int main() { return 0; }");
+        CHECK(file_contents.is_ascii);
+        CHECK(file_contents.first_invalid_utf8 == file_contents.len);
+    }
+    {
+        SETUP_CONTENTS("// caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80\nint x;");
+        CHECK_FALSE(file_contents.is_ascii);
+        CHECK(file_contents.first_invalid_utf8 == file_contents.len);
+    }
+    {
+        // An overlong encoding of `/`.
+        SETUP_CONTENTS("ab\xC0\xAF");
+        CHECK_FALSE(file_contents.is_ascii);
+        CHECK(file_contents.first_invalid_utf8 == 2);
+    }
+    {
+        // A surrogate.
+        SETUP_CONTENTS("\xC3\xA9\xED\xA0\x80");
+        CHECK(file_contents.first_invalid_utf8 == 2);
+    }
+    {
+        // Truncated at the end of the file.
+        SETUP_CONTENTS("a\xE2\x82");
+        CHECK(file_contents.first_invalid_utf8 == 1);
+    }
+}
+
+TEST_CASE("File_Contents::validate_utf8 sequence across buffers") {
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    contents.reserve(cz::heap_allocator(), red::File_Contents::buffer_size + 8);
+    for (size_t i = 0; i + 1 < red::File_Contents::buffer_size; ++i) {
+        contents.push('a');
+    }
+    // U+20AC EURO SIGN starts in the first buffer and ends in the second.
+    contents.append("\xE2\x82\xAC\xFF");
+
+    SETUP_CONTENTS(contents);
+    CHECK_FALSE(file_contents.is_ascii);
+    CHECK(file_contents.first_invalid_utf8 == red::File_Contents::buffer_size + 2);
+}
@@ -2,23 +2,25 @@
 
 #include <cz/defer.hpp>
 #include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include <cz/vector.hpp>
 #include <czt/mock_allocate.hpp>
 #include "context.hpp"
+#include "file.hpp"
 #include "file_contents.hpp"
 #include "lex.hpp"
 #include "token.hpp"
+#include "token_buffer.hpp"
 
 using red::Integer_Suffix;
 using red::lex::Lexer;
 using red::lex::next_token;
 
-#define SETUP(CONTENTS)                                     \
+#define SETUP_LEXER(CONTENTS)                               \
     red::File_Contents file_contents = {};                  \
     file_contents.load_str(CONTENTS, cz::heap_allocator()); \
                                                             \
     red::Location location = {};                            \
-    red::Token token = {};                                  \
-    bool is_bol = false;                                    \
                                                             \
     Lexer lexer = {};                                       \
     lexer.init();                                           \
@@ -30,7 +32,12 @@ using red::lex::next_token;
         file_contents.drop_array(cz::heap_allocator());     \
         lexer.drop();                                       \
         context.destroy();                                  \
-    });
+    })
+
+#define SETUP(CONTENTS)    \
+    SETUP_LEXER(CONTENTS); \
+    red::Token token = {}; \
+    bool is_bol = false;
 
 TEST_CASE("next_token() basic symbol") {
     SETUP("<");
@@ -125,6 +132,70 @@ TEST_CASE("next_token() integer 33ul") {
     CHECK(token.v.integer.suffix == (Integer_Suffix::Unsigned | Integer_Suffix::Long));
 }
 
+TEST_CASE("next_token() long integers") {
+    SETUP("1234567890123456789ULL 0xDeadBeef01234567 18446744073709551615");
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Integer);
+    CHECK(token.span.end.index == 22);
+    CHECK(token.span.end.column == 22);
+    CHECK(token.v.integer.value == 1234567890123456789);
+    CHECK(token.v.integer.suffix == (Integer_Suffix::Unsigned | Integer_Suffix::LongLong));
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Integer);
+    CHECK(token.span.end.index == 41);
+    CHECK(token.v.integer.value == 0xDeadBeef01234567);
+    CHECK(token.v.integer.suffix == 0);
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Integer);
+    CHECK(token.v.integer.value == UINT64_MAX);
+    REQUIRE(context.errors.len() == 0);
+}
+
+TEST_CASE("next_token() integer too large") {
+    SETUP("18446744073709551616 0x10000000000000000");
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Integer);
+    CHECK(context.errors.len() == 1);
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Integer);
+    CHECK(context.errors.len() == 2);
+}
+
+TEST_CASE("next_token() integer starting at the end of a chunk") {
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    contents.reserve(cz::heap_allocator(), red::File_Contents::buffer_size + 4);
+    for (size_t i = 0; i + 1 < red::File_Contents::buffer_size; ++i) {
+        contents.push(' ');
+    }
+    contents.append("1234");
+
+    SETUP(contents);
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Integer);
+    CHECK(token.v.integer.value == 1234);
+    CHECK(token.span.end.index == red::File_Contents::buffer_size + 3);
+    REQUIRE(context.errors.len() == 0);
+}
+
+TEST_CASE("next_token() integer backslash and then newline") {
+    SETUP("12\\\n34u\\\nl");
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Integer);
+    CHECK(token.span.end.index == 10);
+    CHECK(token.span.end.line == 2);
+    CHECK(token.v.integer.value == 1234);
+    CHECK(token.v.integer.suffix == (Integer_Suffix::Unsigned | Integer_Suffix::Long));
+    REQUIRE(context.errors.len() == 0);
+}
+
 TEST_CASE("next_token() basic identifier") {
     SETUP("abc");
 
@@ -346,6 +417,46 @@ TEST_CASE("next_token() string") {
     CHECK(token.v.identifier.str == "abc");
 }
 
+TEST_CASE("next_token() string without escapes points into the file") {
+    SETUP("\"abc\" \"a?b\"");
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::String);
+    CHECK(token.v.string == "abc");
+    CHECK(token.v.string.buffer == file_contents.buffers[0] + 1);
+    CHECK(token.span.end.index == 5);
+    CHECK(token.span.end.column == 5);
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::String);
+    CHECK(token.v.string == "a?b");
+    CHECK(token.v.string.buffer == file_contents.buffers[0] + 7);
+    CHECK(token.span.end.index == 11);
+}
+
+TEST_CASE("next_token() long string with an escape at the end") {
+    SETUP("\"0123456789abcdefghij\\n\" x");
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::String);
+    CHECK(token.v.string == "0123456789abcdefghij\n");
+    CHECK(token.span.end.index == 24);
+    CHECK(token.span.end.column == 24);
+    REQUIRE(context.errors.len() == 0);
+}
+
+TEST_CASE("next_token() string with trigraph escape") {
+    SETUP(
+        "\"a?"
+        "?/\"b\"");
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::String);
+    CHECK(token.v.string == "a\"b");
+    CHECK(token.span.end.index == 8);
+    REQUIRE(context.errors.len() == 0);
+}
+
 TEST_CASE("next_token() Block comment") {
     SETUP("/*abc*/x");
 
@@ -473,6 +584,58 @@ TEST_CASE("next_token() tilde") {
     check_keyword("~", red::Token::Tilde);
 }
 
+TEST_CASE("next_token() %") {
+    check_keyword("%", red::Token::Modulus);
+}
+TEST_CASE("next_token() %:") {
+    check_keyword("%:", red::Token::Hash);
+}
+TEST_CASE("next_token() %:%:") {
+    check_keyword("%:%:", red::Token::HashHash);
+}
+
+static void lex_all(cz::Str contents, cz::Vector<red::Token>* tokens) {
+    SETUP(contents);
+    while (next_token(&context, &lexer, file_contents, &location, &token, &is_bol)) {
+        tokens->reserve(cz::heap_allocator(), 1);
+        tokens->push(token);
+    }
+}
+
+TEST_CASE("next_token() punctuators are the same with and without line splices") {
+    const char* punctuators = "a<<=b->c...d%:%:e%:%f..g%h>>i<:j:>k<%l%>m::n!=o&&p|=q^r~s?t;";
+
+    cz::Vector<red::Token> plain = {};
+    cz::Vector<red::Token> spliced = {};
+    CZ_DEFER(plain.drop(cz::heap_allocator()));
+    CZ_DEFER(spliced.drop(cz::heap_allocator()));
+
+    cz::String with_splice = {};
+    CZ_DEFER(with_splice.drop(cz::heap_allocator()));
+    with_splice.reserve(cz::heap_allocator(), strlen(punctuators) + 2);
+    with_splice.append(punctuators);
+    with_splice.append("\\\n");
+
+    lex_all(punctuators, &plain);
+    lex_all(with_splice, &spliced);
+
+    REQUIRE(plain.len() == 42);
+    REQUIRE(plain.len() == spliced.len());
+    for (size_t i = 0; i < plain.len(); ++i) {
+        CHECK(plain[i].type == spliced[i].type);
+        CHECK(plain[i].span.start.index == spliced[i].span.start.index);
+        CHECK(plain[i].span.end.index == spliced[i].span.end.index);
+        CHECK(plain[i].span.end.column == spliced[i].span.end.column);
+    }
+
+    CHECK(plain[1].type == red::Token::LeftShiftSet);
+    CHECK(plain[7].type == red::Token::HashHash);
+    CHECK(plain[9].type == red::Token::Hash);
+    CHECK(plain[10].type == red::Token::Modulus);
+    CHECK(plain[12].type == red::Token::Dot);
+    CHECK(plain[13].type == red::Token::Dot);
+}
+
 TEST_CASE("next_token() ...") {
     check_keyword("...", red::Token::Preprocessor_Varargs_Parameter_Indicator);
 }
@@ -551,3 +714,171 @@ TEST_CASE("next_token() identifier backslash and then newline") {
 
     REQUIRE(!next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
 }
+
+TEST_CASE("next_token() UTF-8 identifiers") {
+    SETUP(
+        "gr\xC3\xB6\xC3\x9F"
+        "e = \xE5\x90\x8D\xE5\x89\x8D");
+    CHECK_FALSE(file_contents.is_ascii);
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Identifier);
+    CHECK(token.v.identifier.str ==
+          "gr\xC3\xB6\xC3\x9F"
+          "e");
+    CHECK(token.span.start.index == 0);
+    CHECK(token.span.end.index == 7);
+    CHECK(token.span.end.column == 7);
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Set);
+
+    REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(token.type == red::Token::Identifier);
+    CHECK(token.v.identifier.str == "\xE5\x90\x8D\xE5\x89\x8D");
+    CHECK(token.span.start.index == 10);
+    CHECK(token.span.end.index == 16);
+
+    REQUIRE(!next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+    CHECK(context.errors.len() == 0);
+}
+
+TEST_CASE("next_token() UTF-8 characters that can't start identifiers") {
+    {
+        // U+00D7 MULTIPLICATION SIGN
+        SETUP("a \xC3\x97 b");
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(token.type == red::Token::Identifier);
+        REQUIRE(!next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(context.errors.len() == 1);
+    }
+    {
+        // U+0301 COMBINING ACUTE ACCENT can only continue an identifier.
+        SETUP("e\xCC\x81 \xCC\x81");
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(token.type == red::Token::Identifier);
+        CHECK(token.v.identifier.str == "e\xCC\x81");
+        REQUIRE(!next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(context.errors.len() == 1);
+    }
+    {
+        SETUP("a\xC3( b");
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(token.type == red::Token::Identifier);
+        CHECK(token.v.identifier.str == "a");
+        REQUIRE(!next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(context.errors.len() == 1);
+    }
+}
+
+TEST_CASE("next_token() invalid UTF-8 in comments and literals") {
+    {
+        // Valid UTF-8 in comments and strings is fine.
+        SETUP("/* caf\xC3\xA9 */ \"\xE2\x82\xAC\" // \xF0\x9F\x98\x80\n");
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(token.type == red::Token::String);
+        REQUIRE(!next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(context.errors.len() == 0);
+    }
+    {
+        // Lexing continues after the error.
+        SETUP("/* caf\xC3 */ a");
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(token.type == red::Token::Identifier);
+        REQUIRE(context.errors.len() == 1);
+        CHECK(context.errors[0].error_span.start.index == 0);
+        CHECK(context.errors[0].error_span.end.index == 10);
+    }
+    {
+        SETUP("// \xFE\na");
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(token.type == red::Token::Identifier);
+        CHECK(context.errors.len() == 1);
+    }
+    {
+        SETUP("\"\xED\xA0\x80\" \"\\n\xFE\" '\xFE'");
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(token.type == red::Token::String);
+        CHECK(context.errors.len() == 1);
+        // Only the first invalid sequence in the file is reported.
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        REQUIRE(next_token(&context, &lexer, file_contents, &location, &token, &is_bol));
+        CHECK(token.type == red::Token::Character);
+        CHECK(context.errors.len() == 1);
+    }
+}
+
+TEST_CASE("tokenize_range() stops at the end of the line") {
+    SETUP_LEXER("a + 1 /* \n */ - 2\nb c");
+    red::Token token = {};
+
+    red::Token_Buffer tokens = {};
+    CZ_DEFER(tokens.drop(cz::heap_allocator()));
+
+    red::lex::Tokenize_Options options = {};
+    options.allocator = cz::heap_allocator();
+    options.max_tokens = SIZE_MAX;
+    options.stop_at_eol = true;
+    REQUIRE(red::lex::tokenize_range(&context, &lexer, file_contents, &location, options, &tokens,
+                                     &token) == red::lex::Tokenize_Stop::End_Of_Line);
+
+    REQUIRE(tokens.len() == 5);
+    CHECK(tokens.type(0) == red::Token::Identifier);
+    CHECK(tokens.type(1) == red::Token::Plus);
+    CHECK(tokens.type(2) == red::Token::Integer);
+    CHECK(tokens.type(3) == red::Token::Minus);
+    CHECK(tokens.type(4) == red::Token::Integer);
+
+    CHECK(token.type == red::Token::Identifier);
+    CHECK(token.v.identifier.str == "b");
+    CHECK(location.index == 19);
+}
+
+TEST_CASE("tokenize_range() records line starts and stops when full") {
+    SETUP_LEXER("a\nb c\n d e");
+
+    red::Token_Buffer tokens = {};
+    cz::Vector<uint32_t> line_starts = {};
+    CZ_DEFER(tokens.drop(cz::heap_allocator()));
+    CZ_DEFER(line_starts.drop(cz::heap_allocator()));
+
+    red::lex::Tokenize_Options options = {};
+    options.allocator = cz::heap_allocator();
+    options.max_tokens = 4;
+    options.at_bol = true;
+    options.line_starts = &line_starts;
+    REQUIRE(red::lex::tokenize_range(&context, &lexer, file_contents, &location, options, &tokens,
+                                     nullptr) == red::lex::Tokenize_Stop::Full);
+    CHECK(tokens.len() == 4);
+    REQUIRE(line_starts.len() == 3);
+    CHECK(line_starts[0] == 0);
+    CHECK(line_starts[1] == 1);
+    CHECK(line_starts[2] == 3);
+
+    options.at_bol = false;
+    REQUIRE(red::lex::tokenize_range(&context, &lexer, file_contents, &location, options, &tokens,
+                                     nullptr) == red::lex::Tokenize_Stop::End_Of_File);
+    REQUIRE(tokens.len() == 5);
+    CHECK(line_starts.len() == 3);
+
+    // Spans are looked up in the file's line table.
+    red::File file = {};
+    file.contents = file_contents;
+    context.files.files.reserve(cz::heap_allocator(), 1);
+    context.files.files.push(file);
+    CZ_DEFER({
+        // `file_contents` is dropped by `SETUP`.
+        context.files.files[0].line_starts.drop(cz::heap_allocator());
+        context.files.files.set_len(0);
+    });
+
+    red::Token last;
+    tokens.get(&context.files, 4, &last);
+    CHECK(last.v.identifier.str == "e");
+    CHECK(last.span.start.index == 9);
+    CHECK(last.span.start.line == 2);
+    CHECK(last.span.start.column == 3);
+    CHECK(last.span.end.index == 10);
+    CHECK(last.span.end.line == 2);
+    CHECK(last.span.end.column == 4);
+}
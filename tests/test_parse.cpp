@@ -1,10 +1,14 @@
 #include "test_base.hpp"
 
+#include <stdio.h>
 #include <cz/defer.hpp>
 #include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include "compiler.hpp"
 #include "context.hpp"
 #include "file_contents.hpp"
 #include "load.hpp"
+#include "parallel_parse.hpp"
 #include "parse.hpp"
 
 using namespace red;
@@ -37,8 +41,8 @@ TEST_CASE("parse_declaration just semicolon") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
     CHECK(initializers.len() == 0);
 
     CHECK(context.errors.len() == 0);
@@ -50,8 +54,8 @@ TEST_CASE("parse_declaration type but no identifier") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
     CHECK(initializers.len() == 0);
 
     CHECK(context.errors.len() == 0);
@@ -64,14 +68,14 @@ TEST_CASE("parse_declaration type with identifier") {
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
     REQUIRE(initializers.len() == 1);
     REQUIRE(initializers[0]);
     REQUIRE(initializers[0]->tag == Statement::Initializer_Default);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK_FALSE(abc->type.is_const());
@@ -88,10 +92,10 @@ TEST_CASE("parse_declaration two variables same type") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 2);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 2);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->span.start.index == 4);
     CHECK(abc->span.end.index == 7);
@@ -99,7 +103,7 @@ TEST_CASE("parse_declaration two variables same type") {
     CHECK_FALSE(abc->type.is_const());
     CHECK_FALSE(abc->type.is_volatile());
 
-    Declaration* def = parser.declaration_stack[0].get_hash("def");
+    Declaration* def = parser.declarations.get_hash("def");
     REQUIRE(def);
     CHECK(def->span.start.index == 9);
     CHECK(def->span.end.index == 12);
@@ -116,16 +120,16 @@ TEST_CASE("parse_declaration const applies to both variables") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 2);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 2);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK(abc->type.is_const());
     CHECK_FALSE(abc->type.is_volatile());
 
-    Declaration* def = parser.declaration_stack[0].get_hash("def");
+    Declaration* def = parser.declarations.get_hash("def");
     REQUIRE(def);
     CHECK(def->type.get_type() == parser.type_signed_int);
     CHECK(def->type.is_const());
@@ -140,16 +144,16 @@ TEST_CASE("parse_declaration second variable is pointer") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 2);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 2);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK_FALSE(abc->type.is_const());
     CHECK_FALSE(abc->type.is_volatile());
 
-    Declaration* def = parser.declaration_stack[0].get_hash("def");
+    Declaration* def = parser.declarations.get_hash("def");
     REQUIRE(def);
     CHECK_FALSE(def->type.is_const());
     CHECK_FALSE(def->type.is_volatile());
@@ -170,16 +174,16 @@ TEST_CASE("parse_declaration const cannot be used after an identifier") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 2);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 2);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK_FALSE(abc->type.is_const());
     CHECK_FALSE(abc->type.is_volatile());
 
-    Declaration* def = parser.declaration_stack[0].get_hash("def");
+    Declaration* def = parser.declarations.get_hash("def");
     REQUIRE(def);
     CHECK_FALSE(def->type.is_const());
     CHECK_FALSE(def->type.is_volatile());
@@ -200,14 +204,14 @@ TEST_CASE("parse_declaration static") {
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
     REQUIRE(initializers.len() == 1);
     REQUIRE(initializers[0]);
     REQUIRE(initializers[0]->tag == Statement::Initializer_Default);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK_FALSE(abc->type.is_const());
@@ -226,10 +230,10 @@ TEST_CASE("parse_declaration basic function declaration no parameters") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* f = parser.declaration_stack[0].get_hash("f");
+    Declaration* f = parser.declarations.get_hash("f");
     REQUIRE(f);
     CHECK_FALSE(f->type.is_const());
     CHECK_FALSE(f->type.is_volatile());
@@ -249,10 +253,10 @@ TEST_CASE("parse_declaration extern function declaration one parameter") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* f = parser.declaration_stack[0].get_hash("f");
+    Declaration* f = parser.declarations.get_hash("f");
     REQUIRE(f);
     CHECK_FALSE(f->type.is_const());
     CHECK_FALSE(f->type.is_volatile());
@@ -276,10 +280,10 @@ TEST_CASE("parse_declaration parenthesized variable name") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK_FALSE(abc->type.is_const());
@@ -293,10 +297,10 @@ TEST_CASE("parse_declaration parenthesized variable name pointer") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK_FALSE(abc->type.is_const());
     CHECK_FALSE(abc->type.is_volatile());
@@ -313,10 +317,10 @@ TEST_CASE("parse_declaration function pointer one parameter") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* f = parser.declaration_stack[0].get_hash("f");
+    Declaration* f = parser.declarations.get_hash("f");
     REQUIRE(f);
     CHECK(f->span.start.index == 5);
     CHECK(f->span.end.index == 16);
@@ -348,10 +352,10 @@ TEST_CASE("parse_declaration function definition one parameter") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* f = parser.declaration_stack[0].get_hash("f");
+    Declaration* f = parser.declarations.get_hash("f");
     REQUIRE(f);
     CHECK_FALSE(f->type.is_const());
     CHECK_FALSE(f->type.is_volatile());
@@ -379,10 +383,10 @@ TEST_CASE("parse_declaration function definition one parameter and its used") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* f = parser.declaration_stack[0].get_hash("f");
+    Declaration* f = parser.declarations.get_hash("f");
     REQUIRE(f);
     CHECK(f->span.start.index == 5);
     CHECK(f->span.end.index == 13);
@@ -407,6 +411,309 @@ TEST_CASE("parse_declaration function definition one parameter and its used") {
     CHECK(statement->tag == Statement::Expression);
 }
 
+TEST_CASE("parse_declaration skip_bodies records the body's tokens") {
+    SETUP("int g; int f(int x) { { x; } return g; } int h;");
+    parser.skip_bodies = true;
+    parser.record_body_tokens = true;
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    }
+    CHECK(context.errors.len() == 0);
+    CHECK(parser.declarations.get_hash("h"));
+
+    Declaration* f = parser.declarations.get_hash("f");
+    REQUIRE(f);
+    REQUIRE(f->v.function_definition);
+    CHECK(f->v.function_definition->block.statements.len == 0);
+    CHECK(f->v.function_definition->block_span.start.index == 20);
+    CHECK(f->v.function_definition->block_span.end.index == 40);
+
+    REQUIRE(parser.skipped_bodies.len() == 1);
+    const Skipped_Body& body = parser.skipped_bodies[0];
+    CHECK(body.function_definition == f->v.function_definition);
+    CHECK(body.tokens_end - body.tokens_start == 9);
+    CHECK(parser.ast_arena.stats.statement_counts[Statement::Return] == 0);
+
+    REQUIRE(parse_skipped_body(&context, &parser, parser.body_tokens, body).type ==
+            Result::Success);
+    CHECK(context.errors.len() == 0);
+    REQUIRE(f->v.function_definition->block.statements.len == 2);
+    CHECK(f->v.function_definition->block.statements[0]->tag == Statement::Block);
+    CHECK(f->v.function_definition->block.statements[1]->tag == Statement::Return);
+    CHECK(f->v.function_definition->block_span.end.index == 40);
+    CHECK(parser.declarations.depth() == 1);
+}
+
+TEST_CASE("parse_skipped_bodies_in_parallel shares array types without writing to them") {
+    // Every body reaches the canonical `int[4]` through a struct member and `sizeof`.  Run the
+    // tests with ThreadSanitizer to check that the workers only read it.
+    cz::String source = {};
+    CZ_DEFER(source.drop(cz::heap_allocator()));
+    cz::Str global = "int (*gp)[4];\n";
+    cz::Str body = "() { struct { int m[4]; } s; return sizeof(int[4]); }\n";
+    source.reserve(cz::heap_allocator(), global.len + (body.len + 8) * 16);
+    source.append(global);
+    for (size_t i = 0; i < 16; ++i) {
+        source.append("int f");
+        source.push('a' + i);
+        source.append(body);
+    }
+
+    SETUP(source);
+    parser.skip_bodies = true;
+    parser.record_body_tokens = true;
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    Result result;
+    while ((result = parse_declaration(&context, &parser, &initializers)).type ==
+           Result::Success) {
+    }
+    REQUIRE(result.type == Result::Done);
+    REQUIRE(parser.skipped_bodies.len() == 16);
+
+    REQUIRE(parse_skipped_bodies_in_parallel(&context, &parser, 4).is_ok());
+    CHECK(context.errors.len() == 0);
+
+    Declaration* gp = parser.declarations.get_hash("gp");
+    REQUIRE(gp);
+    REQUIRE(gp->type.get_type()->tag == Type::Pointer);
+    Type_Array* array = (Type_Array*)((Type_Pointer*)gp->type.get_type())->inner.get_type();
+    REQUIRE(array->tag == Type::Array);
+    CHECK(array->flags & Type_Array::Layout_Known);
+    CHECK(array->size == 16);
+}
+
+TEST_CASE("parse_skipped_body hides later declarations") {
+    SETUP("int f() { return later; } int later;");
+    parser.skip_bodies = true;
+    parser.record_body_tokens = true;
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    CHECK(context.errors.len() == 0);
+
+    REQUIRE(parser.skipped_bodies.len() == 1);
+    parse_skipped_body(&context, &parser, parser.body_tokens, parser.skipped_bodies[0]);
+    CHECK(context.errors.len() == 1);
+    CHECK(parser.declarations.get_hash("later"));
+}
+
+TEST_CASE("parse_declaration skip_bodies unterminated body") {
+    SETUP("int f() { {");
+    parser.skip_bodies = true;
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    CHECK(parse_declaration(&context, &parser, &initializers).is_err());
+    CHECK(context.errors.len() == 1);
+}
+
+TEST_CASE("parse_skipped_bodies_in_parallel reports errors in order") {
+    SETUP(
+        "int g[4];\n"
+        "int a() { return g[0]; }\n"
+        "int b() { return x; }\n"
+        "int c() { int g; return g; }\n"
+        "int d() { return y; }\n");
+    parser.skip_bodies = true;
+    parser.record_body_tokens = true;
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    for (int i = 0; i < 5; ++i) {
+        REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    }
+    REQUIRE(parser.skipped_bodies.len() == 4);
+
+    CHECK(parse_skipped_bodies_in_parallel(&context, &parser, 3).is_err());
+    REQUIRE(context.errors.len() == 2);
+    CHECK(context.errors[0].error_span.start.line == 2);
+    CHECK(context.errors[1].error_span.start.line == 4);
+
+    Declaration* c = parser.declarations.get_hash("c");
+    REQUIRE(c);
+    REQUIRE(c->v.function_definition);
+    CHECK(c->v.function_definition->block.statements.len == 2);
+
+    // The worker's shadowing declaration doesn't leak into the file scope.
+    Declaration* g = parser.declarations.get_hash("g");
+    REQUIRE(g);
+    CHECK(g->type.get_type()->tag == Type::Array);
+}
+
+struct Consumed_Declarations {
+    size_t declarations;
+    size_t initializers;
+    size_t functions;
+    size_t body_statements;
+};
+
+static Result count_declaration(void* data,
+                                Context* context,
+                                Parser* parser,
+                                const Parsed_Declaration& declaration) {
+    Consumed_Declarations* consumed = (Consumed_Declarations*)data;
+    consumed->declarations += declaration.declarations.len;
+    consumed->initializers += declaration.initializers.len;
+    if (declaration.function_definition) {
+        ++consumed->functions;
+        consumed->body_statements += declaration.function_definition->block.statements.len;
+    }
+    return Result::ok();
+}
+
+TEST_CASE("parse_declarations hands over each declaration and frees bodies") {
+    SETUP("int a, b = 2; int f(); int f() { int x; return x; } int g() { return f(); }");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    Consumed_Declarations consumed = {};
+    Declaration_Consumer consumer;
+    consumer.consume = count_declaration;
+    consumer.data = &consumed;
+    CHECK(parse_declarations(&context, &parser, &initializers, consumer).type == Result::Done);
+    CHECK(context.errors.len() == 0);
+
+    CHECK(consumed.declarations == 4);
+    CHECK(consumed.initializers == 2);
+    CHECK(consumed.functions == 2);
+    CHECK(consumed.body_statements == 3);
+
+    Declaration* f = parser.declarations.get_hash("f");
+    REQUIRE(f);
+    REQUIRE(f->v.function_definition);
+    CHECK(f->v.function_definition->block.statements.len == 0);
+
+    CHECK(parser.body_arena == nullptr);
+    CHECK(parser.ast_arena.stats.statement_counts[Statement::Return] == 2);
+    CHECK(parser.ast_arena.stats.peak_body_bytes > 0);
+}
+
+struct Streamed_Bodies {
+    Declaration_Consumer inner;
+    size_t bodies;
+    size_t file_bytes;
+    bool flat;
+};
+
+/// Forward to `inner` and check that the file's arena doesn't grow.
+static Result check_streamed_body(void* data,
+                                  Context* context,
+                                  Parser* parser,
+                                  const Parsed_Declaration& declaration) {
+    Streamed_Bodies* streamed = (Streamed_Bodies*)data;
+    CZ_TRY(streamed->inner.consume(streamed->inner.data, context, parser, declaration));
+    if (streamed->bodies++ == 0) {
+        streamed->file_bytes = parser->ast_arena.stats.bytes();
+    }
+    if (parser->ast_arena.stats.bytes() != streamed->file_bytes) {
+        streamed->flat = false;
+    }
+    return Result::ok();
+}
+
+static void check_stream_consumer_keeps_nothing(bool print_stats) {
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    for (size_t i = 0; i < 500; ++i) {
+        char function[64];
+        int len = snprintf(function, sizeof(function), "int f%zu() { int x = %zu; return x; }\n",
+                           i, i);
+        contents.reserve(cz::heap_allocator(), len);
+        contents.append({function, (size_t)len});
+    }
+
+    SETUP(contents);
+    context.options.print_stats = print_stats;
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    Streamed_Bodies streamed = {};
+    streamed.inner = stream_consumer(&context);
+    streamed.flat = true;
+    Declaration_Consumer consumer;
+    consumer.consume = check_streamed_body;
+    consumer.data = &streamed;
+    CHECK(parse_declarations(&context, &parser, &initializers, consumer).type == Result::Done);
+    CHECK(context.errors.len() == 0);
+    CHECK(streamed.bodies == 500);
+    CHECK(streamed.flat);
+}
+
+TEST_CASE("stream_consumer keeps nothing") {
+    check_stream_consumer_keeps_nothing(false);
+}
+
+TEST_CASE("stream_consumer keeps nothing with statistics") {
+    check_stream_consumer_keeps_nothing(true);
+}
+
+static Result find_cast_struct(void* data,
+                               Context* context,
+                               Parser* parser,
+                               const Parsed_Declaration& declaration) {
+    Type_Struct** struct_type = (Type_Struct**)data;
+    if (!declaration.function_definition || *struct_type) {
+        return Result::ok();
+    }
+    cz::Slice<Statement*> statements = declaration.function_definition->block.statements;
+    REQUIRE(statements.len > 0);
+    REQUIRE(statements[statements.len - 1]->tag == Statement::Return);
+    Expression* value = ((Statement_Return*)statements[statements.len - 1])->o_value;
+    REQUIRE(value->tag == Expression::Cast);
+    Type* pointer = ((Expression_Cast*)value)->type.get_type();
+    REQUIRE(pointer->tag == Type::Pointer);
+    Type* type = ((Type_Pointer*)pointer)->inner.get_type();
+    REQUIRE(type->tag == Type::Struct);
+    *struct_type = (Type_Struct*)type;
+    return Result::ok();
+}
+
+TEST_CASE("parse_declarations keeps structs declared in bodies after freeing them") {
+    SETUP("int f() { struct S { int a; int b; } s; return (struct S*)0; }\n"
+          "int g() { int x = 1; int y = 2; return x + y; }");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    Type_Struct* struct_type = nullptr;
+    Declaration_Consumer consumer;
+    consumer.consume = find_cast_struct;
+    consumer.data = &struct_type;
+    CHECK(parse_declarations(&context, &parser, &initializers, consumer).type == Result::Done);
+    CHECK(context.errors.len() == 0);
+
+    // The struct's members outlive the body they were declared in.
+    REQUIRE(struct_type);
+    REQUIRE(struct_type->initializers.len == 2);
+    REQUIRE(struct_type->initializers[0]->tag == Statement::Initializer_Default);
+    CHECK(((Statement_Initializer*)struct_type->initializers[0])->identifier.str == "a");
+    CHECK(((Statement_Initializer*)struct_type->initializers[1])->identifier.str == "b");
+}
+
+TEST_CASE("parse_declaration nested scopes shadow and are popped") {
+    SETUP("int x; void f(char x) { { short x; int y; } x; }");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    CHECK(context.errors.len() == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 2);
+
+    Declaration* x = parser.declarations.get_hash("x");
+    REQUIRE(x);
+    CHECK(x->type.get_type() == parser.type_signed_int);
+    CHECK(parser.declarations.get_hash("y") == nullptr);
+    CHECK(parser.declarations.bindings.len() == 2);
+}
+
 TEST_CASE("parse_declaration function returning function pointer one parameter") {
     SETUP("void (*f())(int x);");
     cz::Vector<Statement*> initializers = {};
@@ -414,10 +721,10 @@ TEST_CASE("parse_declaration function returning function pointer one parameter")
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* decl = parser.declaration_stack[0].get_hash("f");
+    Declaration* decl = parser.declarations.get_hash("f");
     REQUIRE(decl);
     CHECK_FALSE(decl->type.is_const());
     CHECK_FALSE(decl->type.is_volatile());
@@ -451,10 +758,10 @@ TEST_CASE("parse_declaration array of function pointer one parameter") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* decl = parser.declaration_stack[0].get_hash("f");
+    Declaration* decl = parser.declarations.get_hash("f");
     REQUIRE(decl);
     CHECK_FALSE(decl->type.is_const());
     CHECK_FALSE(decl->type.is_volatile());
@@ -490,10 +797,10 @@ TEST_CASE("parse_declaration array no length") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* decl = parser.declaration_stack[0].get_hash("f");
+    Declaration* decl = parser.declarations.get_hash("f");
     REQUIRE(decl);
     CHECK_FALSE(decl->type.is_const());
     CHECK_FALSE(decl->type.is_volatile());
@@ -512,6 +819,37 @@ TEST_CASE("parse_declaration array no length") {
     CHECK(ret->inner.get_type() == parser.type_void);
 }
 
+TEST_CASE("parse_declaration array length is folded") {
+    SETUP("int a[2 + 3]; int n; int b[n];");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    for (int i = 0; i < 3; ++i) {
+        CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    }
+    CHECK(context.errors.len() == 0);
+
+    Declaration* a = parser.declarations.get_hash("a");
+    REQUIRE(a);
+    REQUIRE(a->type.get_type()->tag == Type::Array);
+    Type_Array* a_type = (Type_Array*)a->type.get_type();
+    REQUIRE(a_type->flags & Type_Array::Length_Known);
+    CHECK(a_type->length == 5);
+
+    size_t size, alignment;
+    REQUIRE(get_type_size_alignment(a_type, &size, &alignment));
+    CHECK(size == 20);
+    CHECK(alignment == 4);
+    CHECK(a_type->flags & Type_Array::Layout_Known);
+
+    Declaration* b = parser.declarations.get_hash("b");
+    REQUIRE(b);
+    REQUIRE(b->type.get_type()->tag == Type::Array);
+    Type_Array* b_type = (Type_Array*)b->type.get_type();
+    CHECK_FALSE(b_type->flags & Type_Array::Length_Known);
+    CHECK_FALSE(get_type_size_alignment(b_type, &size, &alignment));
+}
+
 TEST_CASE("parse_declaration long int = signed long") {
     SETUP("long int abc;");
     cz::Vector<Statement*> initializers = {};
@@ -519,10 +857,10 @@ TEST_CASE("parse_declaration long int = signed long") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_long);
     CHECK_FALSE(abc->type.is_const());
@@ -536,10 +874,10 @@ TEST_CASE("parse_declaration long unsigned int = unsigned long") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_unsigned_long);
     CHECK_FALSE(abc->type.is_const());
@@ -553,10 +891,10 @@ TEST_CASE("parse_declaration volatile signed const = CV (signed)") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK(abc->type.is_const());
@@ -570,10 +908,10 @@ TEST_CASE("parse_declaration long double = long double") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_long_double);
     CHECK_FALSE(abc->type.is_const());
@@ -587,10 +925,10 @@ TEST_CASE("parse_declaration signed = signed int") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK_FALSE(abc->type.is_const());
@@ -604,10 +942,10 @@ TEST_CASE("parse_declaration signed = unsigned int") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_unsigned_int);
     CHECK_FALSE(abc->type.is_const());
@@ -621,10 +959,10 @@ TEST_CASE("parse_declaration char = char") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_char);
     CHECK_FALSE(abc->type.is_const());
@@ -638,10 +976,10 @@ TEST_CASE("parse_declaration char signed = char") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_char);
     CHECK_FALSE(abc->type.is_const());
@@ -655,10 +993,10 @@ TEST_CASE("parse_declaration unsigned char = char") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_unsigned_char);
     CHECK_FALSE(abc->type.is_const());
@@ -671,12 +1009,10 @@ TEST_CASE("parse_declaration struct unnamed empty body") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.type_stack.len() == 1);
-    CHECK(parser.type_stack[0].count == 0);
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.types.depth() == 1);
+    CHECK(parser.types.scope_count(0) == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
 
     CHECK(context.errors.len() == 0);
 }
@@ -687,9 +1023,9 @@ TEST_CASE("parse_declaration struct named empty body") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 1);
-    Type** type = parser.type_stack[0].get_hash("S");
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 1);
+    Type** type = parser.types.get_hash("S");
     REQUIRE(type);
     REQUIRE(*type);
     REQUIRE((*type)->tag == Type::Struct);
@@ -697,17 +1033,14 @@ TEST_CASE("parse_declaration struct named empty body") {
     CHECK(ts->span.start.index == 0);
     CHECK(ts->span.end.index == 11);
     CHECK(ts->types.count == 0);
-    CHECK(ts->typedefs.count == 0);
     CHECK(ts->declarations.count == 0);
     CHECK(ts->initializers.len == 0);
     CHECK(ts->flags == Type_Struct::Defined);
     CHECK(ts->size == 0);
     CHECK(ts->alignment == 1);
 
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
 
     CHECK(context.errors.len() == 0);
 }
@@ -718,15 +1051,14 @@ TEST_CASE("parse_declaration struct named two fields") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 1);
-    Type** type = parser.type_stack[0].get_hash("S");
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 1);
+    Type** type = parser.types.get_hash("S");
     REQUIRE(type);
     REQUIRE(*type);
     REQUIRE((*type)->tag == Type::Struct);
     Type_Struct* ts = (Type_Struct*)*type;
     CHECK(ts->types.count == 0);
-    CHECK(ts->typedefs.count == 0);
     CHECK(ts->size == 8);
     CHECK(ts->alignment == 4);
     REQUIRE(ts->declarations.count == 2);
@@ -749,37 +1081,74 @@ TEST_CASE("parse_declaration struct named two fields") {
     CHECK(x->v.initializer == ts->initializers[0]);
     CHECK(y->v.initializer == ts->initializers[1]);
 
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
 
     CHECK(context.errors.len() == 0);
 }
 
+TEST_CASE("parse_declaration struct with many members") {
+    SETUP("struct S { char a, b, c, d, e, f, g, h, i, j; int k; };");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    CHECK(context.errors.len() == 0);
+
+    Type** type = parser.types.get_hash("S");
+    REQUIRE(type);
+    REQUIRE((*type)->tag == Type::Struct);
+    Type_Struct* ts = (Type_Struct*)*type;
+    CHECK_FALSE(ts->declarations.is_small());
+    CHECK(ts->declarations.count == 11);
+    CHECK(ts->declarations.get_hash("a"));
+    CHECK(ts->declarations.get_hash("k"));
+    CHECK(ts->size == 16);
+    CHECK(ts->alignment == 4);
+}
+
+TEST_CASE("parse_declaration struct with array fields") {
+    SETUP("struct S { char c; int a[sizeof(int) * 2]; }; struct T { struct S s[2]; char d; };");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    CHECK(context.errors.len() == 0);
+
+    Type** s = parser.types.get_hash("S");
+    REQUIRE(s);
+    REQUIRE((*s)->tag == Type::Struct);
+    CHECK(((Type_Struct*)*s)->size == 36);
+    CHECK(((Type_Struct*)*s)->alignment == 4);
+
+    Type** t = parser.types.get_hash("T");
+    REQUIRE(t);
+    REQUIRE((*t)->tag == Type::Struct);
+    CHECK(((Type_Struct*)*t)->size == 73);
+    CHECK(((Type_Struct*)*t)->alignment == 4);
+}
+
 TEST_CASE("parse_declaration struct named with variable") {
     SETUP("struct S {} s;");
     cz::Vector<Statement*> initializers = {};
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 1);
-    Type** type = parser.type_stack[0].get_hash("S");
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 1);
+    Type** type = parser.types.get_hash("S");
     REQUIRE(type);
     REQUIRE(*type);
     REQUIRE((*type)->tag == Type::Struct);
     Type_Struct* ts = (Type_Struct*)*type;
     REQUIRE(ts->types.count == 0);
-    REQUIRE(ts->typedefs.count == 0);
     REQUIRE(ts->declarations.count == 0);
     REQUIRE(ts->initializers.len == 0);
     REQUIRE(ts->flags == Type_Struct::Defined);
 
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
     REQUIRE(initializers.len() == 1);
     REQUIRE(initializers[0]);
@@ -794,12 +1163,10 @@ TEST_CASE("parse_declaration union unnamed empty body") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.type_stack.len() == 1);
-    CHECK(parser.type_stack[0].count == 0);
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.types.depth() == 1);
+    CHECK(parser.types.scope_count(0) == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
 
     CHECK(context.errors.len() == 0);
 }
@@ -810,22 +1177,19 @@ TEST_CASE("parse_declaration union named empty body") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 1);
-    Type** type = parser.type_stack[0].get_hash("S");
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 1);
+    Type** type = parser.types.get_hash("S");
     REQUIRE(type);
     REQUIRE(*type);
     REQUIRE((*type)->tag == Type::Union);
     Type_Union* ts = (Type_Union*)*type;
     CHECK(ts->types.count == 0);
-    CHECK(ts->typedefs.count == 0);
     CHECK(ts->declarations.count == 0);
     CHECK(ts->flags == Type_Union::Defined);
 
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
 
     CHECK(context.errors.len() == 0);
 }
@@ -836,15 +1200,14 @@ TEST_CASE("parse_declaration union named two fields") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 1);
-    Type** type = parser.type_stack[0].get_hash("S");
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 1);
+    Type** type = parser.types.get_hash("S");
     REQUIRE(type);
     REQUIRE(*type);
     REQUIRE((*type)->tag == Type::Union);
     Type_Union* ts = (Type_Union*)*type;
     CHECK(ts->types.count == 0);
-    CHECK(ts->typedefs.count == 0);
     CHECK(ts->size == 4);
     CHECK(ts->alignment == 4);
     CHECK(ts->flags == Type_Union::Defined);
@@ -861,10 +1224,8 @@ TEST_CASE("parse_declaration union named two fields") {
     CHECK_FALSE(y->type.is_const());
     CHECK_FALSE(y->type.is_volatile());
 
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
 
     CHECK(context.errors.len() == 1);
 }
@@ -875,22 +1236,19 @@ TEST_CASE("parse_declaration union named with variable") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 1);
-    Type** type = parser.type_stack[0].get_hash("S");
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 1);
+    Type** type = parser.types.get_hash("S");
     REQUIRE(type);
     REQUIRE(*type);
     REQUIRE((*type)->tag == Type::Union);
     Type_Union* ts = (Type_Union*)*type;
     CHECK(ts->types.count == 0);
-    CHECK(ts->typedefs.count == 0);
     CHECK(ts->declarations.count == 0);
     CHECK(ts->flags == Type_Union::Defined);
 
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
     REQUIRE(initializers.len() == 1);
     REQUIRE(initializers[0]);
@@ -907,11 +1265,11 @@ TEST_CASE("parse_declaration struct declaration and then usage without tag is er
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(initializers.len() == 1);
-    REQUIRE(parser.declaration_stack[0].count == 1);
-    Declaration* s = parser.declaration_stack[0].get_hash("s");
+    REQUIRE(parser.declarations.scope_count(0) == 1);
+    Declaration* s = parser.declarations.get_hash("s");
     REQUIRE(s);
-    REQUIRE(parser.type_stack[0].count == 1);
-    Type** ts = parser.type_stack[0].get_hash("S");
+    REQUIRE(parser.types.scope_count(0) == 1);
+    Type** ts = parser.types.get_hash("S");
     REQUIRE(ts);
     CHECK(s->type.get_type() == *ts);
 
@@ -926,11 +1284,11 @@ TEST_CASE("parse_declaration struct declaration and then usage with tag is ok")
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(initializers.len() == 1);
-    REQUIRE(parser.declaration_stack[0].count == 1);
-    Declaration* s = parser.declaration_stack[0].get_hash("s");
+    REQUIRE(parser.declarations.scope_count(0) == 1);
+    Declaration* s = parser.declarations.get_hash("s");
     REQUIRE(s);
-    REQUIRE(parser.type_stack[0].count == 1);
-    Type** ts = parser.type_stack[0].get_hash("S");
+    REQUIRE(parser.types.scope_count(0) == 1);
+    Type** ts = parser.types.get_hash("S");
     REQUIRE(ts);
     CHECK(s->type.get_type() == *ts);
 
@@ -946,12 +1304,10 @@ TEST_CASE("parse_declaration typedef unnamed struct declaration and then usage w
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
 
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 0);
-    REQUIRE(parser.typedef_stack.len() == 1);
-    REQUIRE(parser.typedef_stack[0].count == 1);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    REQUIRE(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    REQUIRE(parser.declarations.scope_count(0) == 2);
 }
 
 TEST_CASE("parse_declaration typedef named struct declaration and then usage without tag is ok") {
@@ -963,12 +1319,10 @@ TEST_CASE("parse_declaration typedef named struct declaration and then usage wit
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
 
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 1);
-    REQUIRE(parser.typedef_stack.len() == 1);
-    REQUIRE(parser.typedef_stack[0].count == 1);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    REQUIRE(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    REQUIRE(parser.declarations.scope_count(0) == 2);
 }
 
 TEST_CASE(
@@ -982,22 +1336,52 @@ TEST_CASE(
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
 
-    REQUIRE(parser.type_stack.len() == 1);
-    REQUIRE(parser.type_stack[0].count == 1);
-    REQUIRE(parser.typedef_stack.len() == 1);
-    REQUIRE(parser.typedef_stack[0].count == 1);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    REQUIRE(parser.declaration_stack[0].count == 1);
-    Declaration* s = parser.declaration_stack[0].get_hash("s");
-    Type** type_s = parser.type_stack[0].get_hash("S");
-    Type_Definition* typedef_s = parser.typedef_stack[0].get_hash("S");
+    REQUIRE(parser.types.depth() == 1);
+    REQUIRE(parser.types.scope_count(0) == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    REQUIRE(parser.declarations.scope_count(0) == 2);
+    Declaration* s = parser.declarations.get_hash("s");
+    Type** type_s = parser.types.get_hash("S");
+    Declaration* typedef_s = parser.declarations.get_hash("S");
     REQUIRE(s);
     REQUIRE(type_s);
     REQUIRE(typedef_s);
+    CHECK(typedef_s->flags & Declaration::Typedef);
     CHECK(s->type.get_type() == *type_s);
     CHECK(typedef_s->type.get_type() != *type_s);
 }
 
+TEST_CASE("parse_declaration variable in inner scope shadows typedef") {
+    SETUP("typedef int T; void f() { char T; T; } T t;");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    CHECK(context.errors.len() == 0);
+
+    Declaration* f = parser.declarations.get_hash("f");
+    REQUIRE(f);
+    REQUIRE(f->v.function_definition);
+    REQUIRE(f->v.function_definition->block.statements.len == 2);
+    CHECK(f->v.function_definition->block.statements[1]->tag == Statement::Expression);
+
+    Declaration* t = parser.declarations.get_hash("t");
+    REQUIRE(t);
+    CHECK(t->type.get_type() == parser.type_signed_int);
+}
+
+TEST_CASE("parse_declaration typedef and variable with same name in scope") {
+    SETUP("typedef int T; int T;");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    CHECK(context.errors.len() == 1);
+}
+
 TEST_CASE("parse_declaration enum with no values does nothing") {
     SETUP("enum {};");
     cz::Vector<Statement*> initializers = {};
@@ -1005,12 +1389,10 @@ TEST_CASE("parse_declaration enum with no values does nothing") {
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.type_stack.len() == 1);
-    CHECK(parser.type_stack[0].count == 0);
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.types.depth() == 1);
+    CHECK(parser.types.scope_count(0) == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
     CHECK(initializers.len() == 0);
 }
 
@@ -1021,12 +1403,10 @@ TEST_CASE("parse_declaration enum with two values") {
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
-    REQUIRE(parser.type_stack.len() == 1);
-    CHECK(parser.type_stack[0].count == 0);
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 2);
+    REQUIRE(parser.types.depth() == 1);
+    CHECK(parser.types.scope_count(0) == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 2);
     CHECK(initializers.len() == 0);
 }
 
@@ -1037,14 +1417,12 @@ TEST_CASE("parse_declaration unnamed struct no body") {
 
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 1);
-    REQUIRE(parser.type_stack.len() == 1);
-    CHECK(parser.type_stack[0].count == 0);
-    REQUIRE(parser.typedef_stack.len() == 1);
-    CHECK(parser.typedef_stack[0].count == 0);
-    REQUIRE(parser.declaration_stack.len() == 1);
-
-    REQUIRE(parser.declaration_stack[0].count == 1);
-    Declaration* a = parser.declaration_stack[0].get_hash("a");
+    REQUIRE(parser.types.depth() == 1);
+    CHECK(parser.types.scope_count(0) == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+
+    REQUIRE(parser.declarations.scope_count(0) == 1);
+    Declaration* a = parser.declarations.get_hash("a");
     REQUIRE(a);
     REQUIRE(a->type.get_type());
     CHECK(a->type.get_type()->tag == Type::Pointer);
@@ -1064,9 +1442,9 @@ TEST_CASE("parse_declaration ignore second forward declaration of function") {
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
 
-    REQUIRE(parser.declaration_stack.len() == 1);
-    REQUIRE(parser.declaration_stack[0].count == 1);
-    Declaration* f = parser.declaration_stack[0].get_hash("f");
+    REQUIRE(parser.declarations.depth() == 1);
+    REQUIRE(parser.declarations.scope_count(0) == 1);
+    Declaration* f = parser.declarations.get_hash("f");
     REQUIRE(f);
     REQUIRE(f->type.get_type());
     CHECK(f->type.get_type()->tag == Type::Function);
@@ -1082,9 +1460,9 @@ TEST_CASE("parse_declaration error on second declaration of variable") {
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 1);
 
-    REQUIRE(parser.declaration_stack.len() == 1);
-    REQUIRE(parser.declaration_stack[0].count == 1);
-    Declaration* x = parser.declaration_stack[0].get_hash("x");
+    REQUIRE(parser.declarations.depth() == 1);
+    REQUIRE(parser.declarations.scope_count(0) == 1);
+    Declaration* x = parser.declarations.get_hash("x");
     REQUIRE(x);
     CHECK(x->type.get_type() == parser.type_signed_int);
 }
@@ -1098,9 +1476,9 @@ TEST_CASE("parse_declaration ignore forward declaration of function after defini
     CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
     CHECK(context.errors.len() == 0);
 
-    REQUIRE(parser.declaration_stack.len() == 1);
-    REQUIRE(parser.declaration_stack[0].count == 1);
-    Declaration* f = parser.declaration_stack[0].get_hash("f");
+    REQUIRE(parser.declarations.depth() == 1);
+    REQUIRE(parser.declarations.scope_count(0) == 1);
+    Declaration* f = parser.declarations.get_hash("f");
     REQUIRE(f);
     REQUIRE(f->type.get_type());
     CHECK(f->type.get_type()->tag == Type::Function);
@@ -1108,6 +1486,62 @@ TEST_CASE("parse_declaration ignore forward declaration of function after defini
     CHECK(f->v.function_definition->block.statements.len == 0);
 }
 
+TEST_CASE("parse_declaration identical derived types share one node") {
+    SETUP("const char* a; const char* b; const char** c; int f(const char*); int g(const char*);");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    for (int i = 0; i < 5; ++i) {
+        CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    }
+    CHECK(context.errors.len() == 0);
+
+    Declaration* a = parser.declarations.get_hash("a");
+    Declaration* b = parser.declarations.get_hash("b");
+    Declaration* c = parser.declarations.get_hash("c");
+    Declaration* f = parser.declarations.get_hash("f");
+    Declaration* g = parser.declarations.get_hash("g");
+    REQUIRE(a);
+    REQUIRE(b);
+    REQUIRE(c);
+    REQUIRE(f);
+    REQUIRE(g);
+
+    CHECK(a->type.get_type() == b->type.get_type());
+    REQUIRE(c->type.get_type()->tag == Type::Pointer);
+    CHECK(((Type_Pointer*)c->type.get_type())->inner.get_type() == a->type.get_type());
+
+    CHECK(f->type.get_type() == g->type.get_type());
+    REQUIRE(f->type.get_type()->tag == Type::Function);
+    Type_Function* function = (Type_Function*)f->type.get_type();
+    REQUIRE(function->parameter_types.len == 1);
+    CHECK(function->parameter_types[0].get_type() == a->type.get_type());
+}
+
+TEST_CASE("parse_declaration qualifiers distinguish interned types") {
+    SETUP("char* a; const char* b; char* const c;");
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+
+    for (int i = 0; i < 3; ++i) {
+        CHECK(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+    }
+    CHECK(context.errors.len() == 0);
+
+    Declaration* a = parser.declarations.get_hash("a");
+    Declaration* b = parser.declarations.get_hash("b");
+    Declaration* c = parser.declarations.get_hash("c");
+    REQUIRE(a);
+    REQUIRE(b);
+    REQUIRE(c);
+
+    // The qualifiers of the pointee are part of the pointer type.
+    CHECK(a->type.get_type() != b->type.get_type());
+    // The qualifiers of the pointer itself are stored beside it.
+    CHECK(a->type.get_type() == c->type.get_type());
+    CHECK(c->type.is_const());
+}
+
 TEST_CASE("parse_expression defined variable") {
     SETUP("int abc; abc;");
     cz::Vector<Statement*> initializers = {};
@@ -1210,6 +1644,39 @@ TEST_CASE("parse_expression binary expression right to left") {
     CHECK(context.errors.len() == 0);
 }
 
+TEST_CASE("parse_expression modulus and xor") {
+    SETUP("1 + 2 % 3 ^ 4;");
+
+    Expression* expression;
+    REQUIRE(parse_expression(&context, &parser, &expression).type == Result::Success);
+    REQUIRE(expression->tag == Expression::Binary);
+    Expression_Binary* e = (Expression_Binary*)expression;
+    CHECK(e->op == Token::Xor);
+    CHECK(e->right->tag == Expression::Integer);
+
+    REQUIRE(e->left->tag == Expression::Binary);
+    Expression_Binary* plus = (Expression_Binary*)e->left;
+    CHECK(plus->op == Token::Plus);
+    REQUIRE(plus->right->tag == Expression::Binary);
+    CHECK(((Expression_Binary*)plus->right)->op == Token::Modulus);
+
+    CHECK(context.errors.len() == 0);
+}
+
+TEST_CASE("parse_expression modulus assignment") {
+    SETUP("1 %= 2 %= 3;");
+
+    Expression* expression;
+    REQUIRE(parse_expression(&context, &parser, &expression).type == Result::Success);
+    REQUIRE(expression->tag == Expression::Binary);
+    Expression_Binary* e = (Expression_Binary*)expression;
+    CHECK(e->op == Token::ModulusSet);
+    CHECK(e->left->tag == Expression::Integer);
+    CHECK(e->right->tag == Expression::Binary);
+
+    CHECK(context.errors.len() == 0);
+}
+
 TEST_CASE("parse_expression binary expression left to right parenthesis") {
     SETUP("1 + (2 + 3);");
 
@@ -1359,6 +1826,118 @@ TEST_CASE("parse_expression ternary operator comma breaks otherwise") {
     CHECK(ternary->otherwise->tag == Expression::Integer);
 }
 
+TEST_CASE("parse_expression constant folding collapses integer operators") {
+    SETUP("1 + 2 * (3 - ~0) ? !0 : 5;");
+    parser.fold_constants = true;
+
+    Expression* expression;
+    REQUIRE(parse_expression(&context, &parser, &expression).type == Result::Success);
+    REQUIRE(expression);
+    REQUIRE(expression->tag == Expression::Integer);
+    CHECK(((Expression_Integer*)expression)->value == 1);
+    CHECK(expression->span.start.index == 0);
+    CHECK(expression->span.end.index == 25);
+    CHECK(parser.ast_arena.stats.folded_expressions == 6);
+    CHECK(parser.ast_arena.stats.expression_counts[Expression::Binary] == 0);
+
+    CHECK(context.errors.len() == 0);
+}
+
+TEST_CASE("parse_expression constant folding modulus and xor") {
+    SETUP("7 % 3 ^ 6;");
+    parser.fold_constants = true;
+
+    Expression* expression;
+    REQUIRE(parse_expression(&context, &parser, &expression).type == Result::Success);
+    REQUIRE(expression->tag == Expression::Integer);
+    CHECK(((Expression_Integer*)expression)->value == 7);
+    CHECK(parser.ast_arena.stats.folded_expressions == 2);
+
+    CHECK(context.errors.len() == 0);
+}
+
+TEST_CASE("parse_expression constant folding keeps variables and division by zero") {
+    SETUP("int x; x + 2 * 3; 1 / 0; 1 % 0;");
+    parser.fold_constants = true;
+    cz::Vector<Statement*> initializers = {};
+    CZ_DEFER(initializers.drop(cz::heap_allocator()));
+    REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
+
+    Statement* statement;
+    REQUIRE(parse_statement(&context, &parser, &statement).type == Result::Success);
+    REQUIRE(statement->tag == Statement::Expression);
+    Expression* expression = ((Statement_Expression*)statement)->expression;
+    REQUIRE(expression->tag == Expression::Binary);
+    Expression_Binary* binary = (Expression_Binary*)expression;
+    CHECK(binary->left->tag == Expression::Variable);
+    REQUIRE(binary->right->tag == Expression::Integer);
+    CHECK(((Expression_Integer*)binary->right)->value == 6);
+
+    REQUIRE(parse_statement(&context, &parser, &statement).type == Result::Success);
+    REQUIRE(statement->tag == Statement::Expression);
+    CHECK(((Statement_Expression*)statement)->expression->tag == Expression::Binary);
+
+    REQUIRE(parse_statement(&context, &parser, &statement).type == Result::Success);
+    REQUIRE(statement->tag == Statement::Expression);
+    CHECK(((Statement_Expression*)statement)->expression->tag == Expression::Binary);
+    CHECK(parser.ast_arena.stats.folded_expressions == 1);
+
+    CHECK(context.errors.len() == 0);
+}
+
+/// Parse the next expression statement and return its expression.
+static Expression* next_expression_statement(Context* context, Parser* parser) {
+    Statement* statement;
+    REQUIRE(parse_statement(context, parser, &statement).type == Result::Success);
+    REQUIRE(statement->tag == Statement::Expression);
+    return ((Statement_Expression*)statement)->expression;
+}
+
+TEST_CASE("parse_expression constant folding only folds int operands") {
+    SETUP(
+        "0xFFFFFFFFFFFFFFFF / 2; 0 - 1 < 0u; 1l + 2; 3u * 4; 4294967295 - 1; 0x80000000 >> 1;");
+    parser.fold_constants = true;
+
+    for (size_t i = 0; i < 6; ++i) {
+        CHECK(next_expression_statement(&context, &parser)->tag == Expression::Binary);
+    }
+
+    // `0 - 1` is an int so it is folded even though the comparison isn't.
+    CHECK(parser.ast_arena.stats.folded_expressions == 1);
+    CHECK(context.errors.len() == 0);
+}
+
+TEST_CASE("parse_expression constant folding leaves overflowing int operations") {
+    SETUP(
+        "2147483647 + 1; 0 - 2147483647 - 2; 65536 * 65536; 1 << 31; 1 << 40; 1 >> 32; "
+        "(0 - 1) << 1; (0 - 2147483647 - 1) / (0 - 1); (0 - 2147483647 - 1) % (0 - 1);");
+    parser.fold_constants = true;
+
+    for (size_t i = 0; i < 9; ++i) {
+        CHECK(next_expression_statement(&context, &parser)->tag == Expression::Binary);
+    }
+    CHECK(context.errors.len() == 0);
+}
+
+TEST_CASE("parse_expression constant folding reuses its operands") {
+    SETUP("1 + 2 * 3 + 4; 5 + 6;");
+    parser.fold_constants = true;
+
+    Expression* expression = next_expression_statement(&context, &parser);
+    REQUIRE(expression->tag == Expression::Integer);
+    CHECK(((Expression_Integer*)expression)->value == 11);
+    CHECK(((Expression_Integer*)expression)->is_int);
+    CHECK(parser.ast_arena.stats.expression_counts[Expression::Integer] == 3);
+
+    expression = next_expression_statement(&context, &parser);
+    REQUIRE(expression->tag == Expression::Integer);
+    CHECK(((Expression_Integer*)expression)->value == 11);
+    CHECK(parser.ast_arena.stats.folded_expressions == 4);
+    CHECK(parser.ast_arena.stats.expression_counts[Expression::Integer] == 3);
+
+    CHECK(context.errors.len() == 0);
+}
+
 TEST_CASE("parse_expression type cast") {
     SETUP("(int)2 + 3;");
 
@@ -1942,10 +2521,10 @@ TEST_CASE("parse_declaration_or_statement type with identifier") {
     REQUIRE(parse_declaration_or_statement(&context, &parser, &statements, &which).type ==
             Result::Success);
     REQUIRE(which == Declaration_Or_Statement::Declaration);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 1);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 1);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->type.get_type() == parser.type_signed_int);
     CHECK_FALSE(abc->type.is_const());
@@ -1960,10 +2539,10 @@ TEST_CASE("parse_declaration two variables first has initializer") {
     CZ_DEFER(initializers.drop(cz::heap_allocator()));
 
     REQUIRE(parse_declaration(&context, &parser, &initializers).type == Result::Success);
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 2);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 2);
 
-    Declaration* abc = parser.declaration_stack[0].get_hash("abc");
+    Declaration* abc = parser.declarations.get_hash("abc");
     REQUIRE(abc);
     CHECK(abc->span.start.index == 4);
     CHECK(abc->span.end.index == 7);
@@ -1976,7 +2555,7 @@ TEST_CASE("parse_declaration two variables first has initializer") {
     CHECK(initializers[0]->span.start.index == 4);
     CHECK(initializers[0]->span.end.index == 12);
 
-    Declaration* def = parser.declaration_stack[0].get_hash("def");
+    Declaration* def = parser.declarations.get_hash("def");
     REQUIRE(def);
     CHECK(def->span.start.index == 14);
     CHECK(def->span.end.index == 17);
@@ -2018,8 +2597,8 @@ TEST_CASE("parse_statement block with defined variable and expression usage") {
     Expression_Variable* e = (Expression_Variable*)expression;
     CHECK(e->variable.str == "abc");
 
-    REQUIRE(parser.declaration_stack.len() == 1);
-    CHECK(parser.declaration_stack[0].count == 0);
+    REQUIRE(parser.declarations.depth() == 1);
+    CHECK(parser.declarations.scope_count(0) == 0);
 
     CHECK(context.errors.len() == 0);
 }
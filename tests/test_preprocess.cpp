@@ -402,6 +402,17 @@ TEST_CASE("cpp::next_token #if parenthesis and order of operations") {
     REQUIRE(EAT_NEXT().type == Result::Done);
 }
 
+TEST_CASE("cpp::next_token #if modulus binds like division") {
+    SETUP("#if 1 + 7 % 4 == 4\na\n#else\nb\n#endif");
+
+    REQUIRE(EAT_NEXT().type == Result::Success);
+    CHECK(token.type == Token::Identifier);
+    CHECK(token.v.identifier.str == "a");
+    CHECK(context.errors.len() == 0);
+
+    REQUIRE(EAT_NEXT().type == Result::Done);
+}
+
 TEST_CASE("cpp::next_token #if inside #if parsed correctly") {
     SETUP("#if 1\n#if 1\na\n#else\nb\n#endif\n#else\nc\n#endif");
 
@@ -791,6 +802,38 @@ TEST_CASE("cpp::next_token #define no body") {
     CHECK(definition->tokens.len() == 0);
 }
 
+TEST_CASE("cpp::next_token #define body is stored compactly") {
+    SETUP("#define abc(x) x + 13 * y\na");
+
+    REQUIRE(EAT_NEXT().type == Result::Success);
+    CHECK(context.errors.len() == 0);
+
+    pre::Definition* definition = preprocessor.definitions.get_hash("abc");
+    REQUIRE(definition);
+    REQUIRE(definition->tokens.len() == 5);
+    CHECK(definition->tokens.type(0) == Token::Preprocessor_Parameter);
+    CHECK(definition->tokens.parameter(0) == 0);
+    CHECK(definition->tokens.type(1) == Token::Plus);
+    CHECK(definition->tokens.type(3) == Token::Star);
+    CHECK(definition->tokens.identifiers.len() == 1);
+    CHECK(definition->tokens.integers.len() == 1);
+
+    Token integer;
+    definition->tokens.get(&context.files, 2, &integer);
+    REQUIRE(integer.type == Token::Integer);
+    CHECK(integer.v.integer.value == 13);
+    CHECK(integer.span.start.index == 19);
+    CHECK(integer.span.start.line == 0);
+    CHECK(integer.span.start.column == 19);
+    CHECK(integer.span.end.index == 21);
+    CHECK(integer.span.end.column == 21);
+
+    Token identifier;
+    definition->tokens.get(&context.files, 4, &identifier);
+    REQUIRE(identifier.type == Token::Identifier);
+    CHECK(identifier.v.identifier.str == "y");
+}
+
 TEST_CASE("cpp::next_token #define usage with comma inside parenthesis is still one argument") {
     SETUP("#define abc(x) x\nabc((a, b))");
 
@@ -0,0 +1,88 @@
+#include "test_base.hpp"
+
+#include <stdio.h>
+#include <cz/heap.hpp>
+#include "small_map.hpp"
+
+using namespace red;
+
+static void insert(Small_Map<int, 4>* map, cz::Str key, int value) {
+    map->reserve(cz::heap_allocator(), 1);
+    map->insert(key, Hashed_Str::hash_str(key), value);
+}
+
+TEST_CASE("Small_Map stays small up to its capacity") {
+    Small_Map<int, 4> map = {};
+    insert(&map, "a", 1);
+    insert(&map, "b", 2);
+    insert(&map, "a", 3);
+
+    CHECK(map.is_small());
+    CHECK(map.count == 2);
+    REQUIRE(map.get_hash("a"));
+    CHECK(*map.get_hash("a") == 3);
+    REQUIRE(map.get_hash("b"));
+    CHECK(*map.get_hash("b") == 2);
+    CHECK_FALSE(map.get_hash("c"));
+
+    // Small maps are iterated in insertion order.
+    REQUIRE(map.slots() == 2);
+    CHECK(map.key(0) == "a");
+    CHECK(map.key(1) == "b");
+
+    map.drop(cz::heap_allocator());
+}
+
+TEST_CASE("Small_Map moves to a hash table past its capacity") {
+    Small_Map<int, 4> map = {};
+    char keys[10][4];
+    for (int i = 0; i < 10; ++i) {
+        snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+        insert(&map, keys[i], i);
+    }
+
+    CHECK_FALSE(map.is_small());
+    CHECK(map.count == 10);
+    for (int i = 0; i < 10; ++i) {
+        int* value = map.get_hash(keys[i]);
+        REQUIRE(value);
+        CHECK(*value == i);
+    }
+
+    int total = 0;
+    for (size_t i = 0; i < map.slots(); ++i) {
+        if (map.is_present(i)) {
+            total += map.value(i);
+        }
+    }
+    CHECK(total == 45);
+
+    map.drop(cz::heap_allocator());
+}
+
+TEST_CASE("Small_Map only allocates room for the entries reserved") {
+    Small_Map<int, 4> map = {};
+    CHECK(map.small_cap == 0);
+
+    map.reserve(cz::heap_allocator(), 3);
+    CHECK(map.small_cap == 3);
+    insert(&map, "a", 1);
+    insert(&map, "b", 2);
+    insert(&map, "c", 3);
+    CHECK(map.small_cap == 3);
+
+    // Growing one at a time is capped at the small capacity.
+    insert(&map, "d", 4);
+    CHECK(map.is_small());
+    CHECK(map.small_cap == 4);
+    REQUIRE(map.get_hash("d"));
+    CHECK(*map.get_hash("d") == 4);
+    map.drop(cz::heap_allocator());
+
+    // Reserving past the capacity at once goes straight to the hash table.
+    Small_Map<int, 4> big = {};
+    big.reserve(cz::heap_allocator(), 5);
+    CHECK_FALSE(big.is_small());
+    CHECK(big.small_cap == 0);
+    big.drop(cz::heap_allocator());
+}
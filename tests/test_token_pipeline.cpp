@@ -0,0 +1,111 @@
+#include "test_base.hpp"
+
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include "context.hpp"
+#include "file_contents.hpp"
+#include "lex.hpp"
+#include "load.hpp"
+#include "preprocess.hpp"
+#include "token_pipeline.hpp"
+
+using namespace red;
+using namespace red::parse;
+
+static void setup(Context* context, pre::Preprocessor* preprocessor, cz::Str contents) {
+    context->init();
+
+    include_file_reserve(&context->files, preprocessor);
+    File_Contents file_contents;
+    file_contents.load_str(contents, context->files.file_array_buffer_array.allocator());
+    Hashed_Str file_path = Hashed_Str::from_str("*test_file*");
+    force_include_file(&context->files, preprocessor, file_path, file_contents);
+}
+
+#define SETUP(CONTENTS)                       \
+    Context context = {};                     \
+    pre::Preprocessor preprocessor = {};      \
+    lex::Lexer lexer = {};                    \
+    setup(&context, &preprocessor, CONTENTS); \
+    lexer.init();                             \
+                                              \
+    CZ_DEFER({                                \
+        lexer.drop();                         \
+        preprocessor.destroy();               \
+        context.destroy();                    \
+    })
+
+TEST_CASE("Token_Pipeline produces every token across many batches") {
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    contents.reserve(cz::heap_allocator(), 32);
+    contents.append("#define X(a) a + 1\n");
+    size_t lines = Token_Pipeline::batch_count * Token_Batch::capacity;
+    for (size_t i = 0; i < lines; ++i) {
+        contents.reserve(cz::heap_allocator(), 8);
+        contents.append("X(y);\n");
+    }
+
+    SETUP(contents);
+
+    Token_Pipeline pipeline;
+    pipeline.start(&context, &preprocessor, &lexer);
+
+    size_t count = 0;
+    Token_Source_Span_Pair pair;
+    Result result;
+    while ((result = pipeline.next(&context, &pair)).type == Result::Success) {
+        ++count;
+    }
+    CHECK(result.type == Result::Done);
+    CHECK(pipeline.next(&context, &pair).type == Result::Done);
+
+    pipeline.stop(&context);
+
+    // `y + 1 ;` on each line.
+    CHECK(count == lines * 4);
+    CHECK(context.errors.len() == 0);
+    CHECK(context.files.files.len() == 1);
+}
+
+TEST_CASE("Token_Pipeline reports preprocessor errors before the next token") {
+    SETUP("a\n#pragma bogus\nb\n#pragma bogus\n");
+
+    Token_Pipeline pipeline;
+    pipeline.start(&context, &preprocessor, &lexer);
+
+    Token_Source_Span_Pair pair;
+    REQUIRE(pipeline.next(&context, &pair).type == Result::Success);
+    CHECK(pair.token.type == Token::Identifier);
+    CHECK(context.errors.len() == 0);
+
+    REQUIRE(pipeline.next(&context, &pair).type == Result::Success);
+    CHECK(pair.token.type == Token::Identifier);
+    CHECK(context.errors.len() == 1);
+
+    CHECK(pipeline.next(&context, &pair).type == Result::Done);
+    CHECK(context.errors.len() == 2);
+
+    pipeline.stop(&context);
+}
+
+TEST_CASE("Token_Pipeline can be stopped early") {
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    for (size_t i = 0; i < Token_Pipeline::batch_count * Token_Batch::capacity * 2; ++i) {
+        contents.reserve(cz::heap_allocator(), 2);
+        contents.append("x ");
+    }
+
+    SETUP(contents);
+
+    Token_Pipeline pipeline;
+    pipeline.start(&context, &preprocessor, &lexer);
+
+    Token_Source_Span_Pair pair;
+    REQUIRE(pipeline.next(&context, &pair).type == Result::Success);
+    pipeline.stop(&context);
+
+    CHECK(context.files.files.len() == 1);
+}
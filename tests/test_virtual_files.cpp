@@ -0,0 +1,83 @@
+#include "test_base.hpp"
+
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include "context.hpp"
+#include "file.hpp"
+#include "hashed_str.hpp"
+#include "load.hpp"
+#include "preprocess.hpp"
+#include "virtual_files.hpp"
+
+using namespace red;
+
+static const cz::Str* find(Virtual_Files* virtual_files, cz::Str path) {
+    return virtual_files->find(path, Hashed_Str::hash_str(path));
+}
+
+TEST_CASE("parse_virtual_files") {
+    Virtual_Files virtual_files;
+    virtual_files.init();
+    CZ_DEFER(virtual_files.drop());
+
+    REQUIRE(parse_virtual_files(
+        " {\"/a/b.h\": \"int b;\\n\\t\\\"\\\\\\/\",\n"
+        "  \"/a/../c.h\" : \"\\u00e9\\ud83d\\ude00\","
+        "  \"/a/b.h\": \"int replaced;\"} \n",
+        &virtual_files));
+    CHECK(virtual_files.files.count == 2);
+
+    const cz::Str* b = find(&virtual_files, "/a/b.h");
+    REQUIRE(b);
+    CHECK(*b == "int replaced;");
+
+    // Paths are flattened like `make_include_path` does.
+    const cz::Str* c = find(&virtual_files, "/c.h");
+    REQUIRE(c);
+    CHECK(*c == "\xc3\xa9\xf0\x9f\x98\x80");
+
+    CHECK(parse_virtual_files("{}", &virtual_files));
+    CHECK_FALSE(parse_virtual_files("", &virtual_files));
+    CHECK_FALSE(parse_virtual_files("{\"/d.h\": \"d\"", &virtual_files));
+    CHECK_FALSE(parse_virtual_files("{\"/d.h\" \"d\"}", &virtual_files));
+    CHECK_FALSE(parse_virtual_files("{\"/d.h\": \"\\q\"}", &virtual_files));
+    CHECK_FALSE(parse_virtual_files("{\"/d.h\": \"\\ud83d\"}", &virtual_files));
+    CHECK_FALSE(parse_virtual_files("{} x", &virtual_files));
+}
+
+TEST_CASE("include_file loads virtual files before the disk") {
+    Context context = {};
+    context.init();
+    pre::Preprocessor preprocessor = {};
+    CZ_DEFER({
+        preprocessor.destroy();
+        context.destroy();
+    });
+
+    REQUIRE(context.files.get_virtual_files()->add("/red_virtual/a.h", "int a;\n").is_ok());
+
+    cz::Allocator allocator = context.files.file_path_buffer_array.allocator();
+    cz::String a_path = {};
+    make_include_path("/red_virtual", "a.h", allocator, &a_path);
+    REQUIRE(include_file(&context.files, &preprocessor, a_path).is_ok());
+    REQUIRE(context.files.files.len() == 1);
+    CHECK(context.files.files[0].path == "/red_virtual/a.h");
+    CHECK(context.files.files[0].contents.len == 7);
+    CHECK(context.files.files[0].contents.get(4) == 'a');
+
+    cz::String missing_path = {};
+    make_include_path("/red_virtual", "missing.h", allocator, &missing_path);
+    CHECK(include_file(&context.files, &preprocessor, missing_path).is_err());
+    CHECK(context.files.files.len() == 1);
+
+    // Real files are hidden when only virtual files are allowed.
+    context.files.virtual_files->exclusive = true;
+    cz::String real_path = {};
+    make_include_path("/", "dev/null", allocator, &real_path);
+    CHECK(include_file(&context.files, &preprocessor, real_path).is_err());
+    context.files.virtual_files->exclusive = false;
+    make_include_path("/", "dev/null", allocator, &real_path);
+    CHECK(include_file(&context.files, &preprocessor, real_path).is_ok());
+    CHECK(context.files.files.len() == 2);
+}